@@ -33,7 +33,8 @@ public class LuaMachine : ModuleRules
                 "Core",
                 "HTTP",
                 "Json",
-                "PakFile"
+                "PakFile",
+                "DeveloperSettings"
 				// ... add other public dependencies that you statically link with here ...
 			}
             );
@@ -50,6 +51,8 @@ public class LuaMachine : ModuleRules
                 "InputCore",
                 "CommonUI",
                 "ModelViewViewModel",
+                "Sockets",
+                "Networking",
 				// ... add private dependencies that you statically link with here ...	
 			}
             );
@@ -66,7 +69,8 @@ public class LuaMachine : ModuleRules
         {
             PrivateDependencyModuleNames.AddRange(new string[]{
                 "UnrealEd",
-                "Projects"
+                "Projects",
+                "DirectoryWatcher"
             });
         }
 
@@ -251,6 +251,16 @@ FLuaValue ULuaBlueprintFunctionLibrary::Conv_NameToLuaValue(const FName Value)
 	return FLuaValue(Value.ToString());
 }
 
+void ULuaBlueprintFunctionLibrary::LuaPreloadStates(UObject* WorldContextObject, TArray<TSubclassOf<ULuaState>> States)
+{
+	FLuaMachineModule::Get().PreloadLuaStates(States, WorldContextObject->GetWorld());
+}
+
+float ULuaBlueprintFunctionLibrary::LuaGetPreloadProgress()
+{
+	return FLuaMachineModule::Get().GetPreloadProgress();
+}
+
 FLuaValue ULuaBlueprintFunctionLibrary::LuaGetGlobal(UObject* WorldContextObject, TSubclassOf<ULuaState> State, const FString& Name)
 {
 	ULuaState* L = FLuaMachineModule::Get().GetLuaState(State, WorldContextObject->GetWorld());
@@ -1035,6 +1045,22 @@ void ULuaBlueprintFunctionLibrary::LuaSetGlobal(UObject* WorldContextObject, TSu
 	L->SetFieldFromTree(Name, Value, true);
 }
 
+bool ULuaBlueprintFunctionLibrary::LuaSetGlobalDataTable(UObject* WorldContextObject, TSubclassOf<ULuaState> State, const FString& Name, UDataTable* DataTable)
+{
+	ULuaState* L = FLuaMachineModule::Get().GetLuaState(State, WorldContextObject->GetWorld());
+	if (!L)
+		return false;
+	return L->SetGlobalDataTable(Name, DataTable);
+}
+
+FLuaValue ULuaBlueprintFunctionLibrary::LuaValueCopyToState(UObject* WorldContextObject, TSubclassOf<ULuaState> State, FLuaValue Value)
+{
+	ULuaState* L = FLuaMachineModule::Get().GetLuaState(State, WorldContextObject->GetWorld());
+	if (!L)
+		return FLuaValue();
+	return L->CopyLuaValue(Value);
+}
+
 FLuaValue ULuaBlueprintFunctionLibrary::LuaGlobalCall(UObject* WorldContextObject, TSubclassOf<ULuaState> State, const FString& Name, TArray<FLuaValue> Args)
 {
 	FLuaValue ReturnValue;
@@ -1651,23 +1677,10 @@ ULuaState* ULuaBlueprintFunctionLibrary::LuaGetState(UObject* WorldContextObject
 
 bool ULuaBlueprintFunctionLibrary::LuaTableImplements(FLuaValue Table, ULuaTableAsset* TableAsset)
 {
-	if (Table.Type != ELuaValueType::Table)
-		return false;
-
-	ULuaState* L = Table.LuaState.Get();
-	if (!L)
+	if (!TableAsset)
 		return false;
 
-	for (TPair<FString, FLuaValue>& Pair : TableAsset->Table)
-	{
-		FLuaValue Item = Table.GetField(Pair.Key);
-		if (Item.Type == ELuaValueType::Nil)
-			return false;
-		if (Item.Type != Pair.Value.Type)
-			return false;
-	}
-
-	return true;
+	return TableAsset->IsImplementedBy(Table);
 }
 
 bool ULuaBlueprintFunctionLibrary::LuaTableImplementsAll(FLuaValue Table, TArray<ULuaTableAsset*> TableAssets)
@@ -3,6 +3,7 @@
 
 #include "LuaCode.h"
 #include "LuaMachine.h"
+#include "LuaCodeCompiler.h"
 #include "Serialization/CustomVersion.h"
 #include "EditorFramework/AssetImportData.h"
 
@@ -24,9 +25,13 @@ void ULuaCode::Serialize(FArchive& Ar)
 		{
 			bCooked = true;
 			FString ErrorString;
-			ByteCode = ULuaState::ToByteCode(Code.ToString(), GetPathName(), ErrorString);
-			if (!ErrorString.IsEmpty())
+			// already compiled by the pre-cook pass unless the code changed
+			if (!FLuaCodeCompiler::Get().Compile(Code.ToString(), GetPathName(), ByteCode, ErrorString))
 			{
+				if (FLuaCodeCompiler::ShouldFailOnError())
+				{
+					UE_LOG(LogLuaMachine, Fatal, TEXT("Unable to generate bytecode: %s"), *ErrorString);
+				}
 				UE_LOG(LogLuaMachine, Error, TEXT("Unable to generate bytecode: %s"), *ErrorString);
 			}
 			bSkipOriginalCode = true;
@@ -81,6 +86,11 @@ void ULuaCode::PreSave(const ITargetPlatform * TargetPlatform)
 		{
 			FLuaMachineModule::Get().UnregisterLuaState(LuaState);
 		}
+		// modules required from this asset are patched in place
+		else if (LuaState->bHotReload)
+		{
+			LuaState->ReloadLuaCodeModules(this);
+		}
 	}
 }
 
@@ -0,0 +1,161 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaCodeCompiler.h"
+#include "LuaCode.h"
+#include "LuaState.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "Misc/CommandLine.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/SecureHash.h"
+
+FLuaCodeCompiler& FLuaCodeCompiler::Get()
+{
+	static FLuaCodeCompiler Compiler;
+	return Compiler;
+}
+
+FLuaCodeCompiler::FLuaCodeCompiler()
+	: PreprocessorOptions(FLuaPreprocessorOptions::FromCookSettings())
+{
+	if (!PreprocessorOptions.IsEmpty())
+	{
+		PreprocessorOptionsKey = PreprocessorOptions.ToString();
+		UE_LOG(LogLuaMachine, Display, TEXT("LuaCode preprocessor: %s"), *PreprocessorOptionsKey);
+	}
+}
+
+bool FLuaCodeCompiler::ShouldFailOnError()
+{
+	bool bFailOnError = false;
+	if (GConfig)
+	{
+		GConfig->GetBool(TEXT("LuaMachine"), TEXT("bFailCookOnCompileError"), bFailOnError, GEngineIni);
+	}
+	return bFailOnError || FParse::Param(FCommandLine::Get(), TEXT("LuaMachineFailOnCompileError"));
+}
+
+FString FLuaCodeCompiler::GetCacheKey(const FString& Code, const FString& CodePath) const
+{
+	// the path is part of the error messages, the version of the bytecode format
+	FTCHARToUTF8 CodeUTF8(*Code);
+	FTCHARToUTF8 CodePathUTF8(*CodePath);
+	FTCHARToUTF8 PreprocessorUTF8(*PreprocessorOptionsKey);
+	FSHA1 Sha1;
+	Sha1.Update((const uint8*)LUA_RELEASE, FCStringAnsi::Strlen(LUA_RELEASE));
+	Sha1.Update((const uint8*)PreprocessorUTF8.Get(), PreprocessorUTF8.Length() + 1);
+	Sha1.Update((const uint8*)CodePathUTF8.Get(), CodePathUTF8.Length() + 1);
+	Sha1.Update((const uint8*)CodeUTF8.Get(), CodeUTF8.Length());
+	Sha1.Final();
+
+	FSHAHash Hash;
+	Sha1.GetHash(Hash.Hash);
+	return Hash.ToString();
+}
+
+bool FLuaCodeCompiler::Compile(const FString& Code, const FString& CodePath, TArray<uint8>& ByteCode, FString& ErrorString)
+{
+	const FString Key = GetCacheKey(Code, CodePath);
+
+	{
+		FScopeLock Lock(&CacheLock);
+		if (const FEntry* Entry = Cache.Find(Key))
+		{
+			NumCacheHits.Increment();
+			ByteCode = Entry->ByteCode;
+			ErrorString = Entry->Error;
+			return ErrorString.IsEmpty();
+		}
+	}
+
+	FEntry Entry;
+	const FString CacheFilename = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("LuaMachine"), TEXT("ByteCodeCache"), Key + TEXT(".luac"));
+	if (FFileHelper::LoadFileToArray(Entry.ByteCode, *CacheFilename, FILEREAD_Silent) && Entry.ByteCode.Num() > 0)
+	{
+		NumCacheHits.Increment();
+	}
+	else
+	{
+		NumCompiled.Increment();
+		FString ProcessedCode;
+		if (PreprocessorOptions.IsEmpty())
+		{
+			Entry.ByteCode = ULuaState::ToByteCode(Code, CodePath, Entry.Error);
+		}
+		else if (FLuaPreprocessor::Process(Code, PreprocessorOptions, ProcessedCode, Entry.Error))
+		{
+			Entry.ByteCode = ULuaState::ToByteCode(ProcessedCode, CodePath, Entry.Error);
+		}
+		else
+		{
+			Entry.Error = CodePath + TEXT(": ") + Entry.Error;
+		}
+		// errors are cached only in memory, they are reported again by the next cook
+		if (Entry.Error.IsEmpty())
+		{
+			// multiple cook processes can share the cache directory
+			const FString TempFilename = CacheFilename + FString::Printf(TEXT(".%u.%u.tmp"), FPlatformProcess::GetCurrentProcessId(), FPlatformTLS::GetCurrentThreadId());
+			if (FFileHelper::SaveArrayToFile(Entry.ByteCode, *TempFilename))
+			{
+				IFileManager::Get().Move(*CacheFilename, *TempFilename, true, true, false, true);
+			}
+		}
+	}
+
+	ByteCode = Entry.ByteCode;
+	ErrorString = Entry.Error;
+
+	FScopeLock Lock(&CacheLock);
+	Cache.Add(Key, MoveTemp(Entry));
+	return ErrorString.IsEmpty();
+}
+
+int32 FLuaCodeCompiler::CompileAll(const TArray<ULuaCode*>& LuaCodes)
+{
+	struct FJob
+	{
+		FString Code;
+		FString CodePath;
+		FString Error;
+	};
+
+	// UObjects are accessed only from the game thread
+	TArray<FJob> Jobs;
+	for (ULuaCode* LuaCode : LuaCodes)
+	{
+		if (LuaCode && LuaCode->bCookAsBytecode && !LuaCode->Code.IsEmpty())
+		{
+			Jobs.Add({ LuaCode->Code.ToString(), LuaCode->GetPathName(), FString() });
+		}
+	}
+
+	const double StartSeconds = FPlatformTime::Seconds();
+	const int32 CompiledBefore = NumCompiled.GetValue();
+
+	ParallelFor(Jobs.Num(), [this, &Jobs](const int32 Index)
+		{
+			TArray<uint8> ByteCode;
+			Compile(Jobs[Index].Code, Jobs[Index].CodePath, ByteCode, Jobs[Index].Error);
+		});
+
+	int32 NumErrors = 0;
+	for (const FJob& Job : Jobs)
+	{
+		if (!Job.Error.IsEmpty())
+		{
+			UE_LOG(LogLuaMachine, Error, TEXT("Unable to generate bytecode for %s: %s"), *Job.CodePath, *Job.Error);
+			NumErrors++;
+		}
+	}
+
+	UE_LOG(LogLuaMachine, Display, TEXT("Compiled %d LuaCode assets in %.2fs (%d compiled, %d errors)"), Jobs.Num(), FPlatformTime::Seconds() - StartSeconds, NumCompiled.GetValue() - CompiledBefore, NumErrors);
+
+	if (NumErrors > 0 && ShouldFailOnError())
+	{
+		UE_LOG(LogLuaMachine, Fatal, TEXT("%d LuaCode assets failed to compile"), NumErrors);
+	}
+
+	return NumErrors;
+}
@@ -2,6 +2,7 @@
 
 #include "LuaCommonUIWidget.h"
 #include "LuaBlueprintFunctionLibrary.h"
+#include "LuaListDataSource.h"
 
 /**
  * @brief Initializes a ULuaCommonUIWidget instance and sets default behavior.
@@ -253,4 +254,48 @@ ULuaState* ULuaCommonUIWidget::LuaWidgetGetState()
 	}
 
 	return ULuaBlueprintFunctionLibrary::LuaGetState(this, LuaState);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Binds a list view to a Lua array stored in the widget's Lua table.
+ *
+ * The data source is owned by this widget. When SourceName is not empty its Lua api is stored in that field,
+ * so the script can notify changes with `self.Inventory:Dirty(i)` or `self.Inventory:Refresh()`.
+ *
+ * @param ListView The list view to fill.
+ * @param ArrayName Field of the widget's Lua table holding the array.
+ * @param SourceName Field of the widget's Lua table receiving the data source api (optional).
+ * @return ULuaListDataSource* The data source, or nullptr if the widget table is uninitialized or the field is not a table.
+ */
+ULuaListDataSource* ULuaCommonUIWidget::LuaBindListView(UListView* ListView, const FString& ArrayName, const FString& SourceName)
+{
+	if (WidgetLuaTable.Type != ELuaValueType::Table)
+	{
+		if (bLogError)
+		{
+			UE_LOG(LogLuaMachine, Error, TEXT("LuaCommonUIWidget: Widget Lua table is not initialized"));
+		}
+		return nullptr;
+	}
+
+	FLuaValue Array = ULuaBlueprintFunctionLibrary::LuaTableGetField(WidgetLuaTable, ArrayName);
+	if (Array.Type != ELuaValueType::Table)
+	{
+		if (bLogError)
+		{
+			UE_LOG(LogLuaMachine, Error, TEXT("LuaCommonUIWidget: Field '%s' is not a table"), *ArrayName);
+		}
+		return nullptr;
+	}
+
+	ULuaListDataSource* DataSource = ULuaListDataSource::CreateLuaListDataSource(this, ListView, Array);
+	DataSource->bLogError = bLogError;
+	ListDataSources.Add(DataSource);
+
+	if (!SourceName.IsEmpty())
+	{
+		ULuaBlueprintFunctionLibrary::LuaTableSetField(WidgetLuaTable, SourceName, DataSource->GetLuaTable());
+	}
+
+	return DataSource;
+}
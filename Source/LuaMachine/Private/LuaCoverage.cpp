@@ -0,0 +1,288 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaCoverage.h"
+#include "LuaState.h"
+#include "Misc/FileHelper.h"
+
+FLuaCoverage::FLuaCoverage()
+	: bRunning(false)
+	, LastSource(nullptr)
+	, LastChunkId(INDEX_NONE)
+{
+}
+
+void FLuaCoverage::Start(const TArray<FString>& InFilters)
+{
+	// already known chunks keep their measured state, call Reset() for changing filters
+	Filters = InFilters;
+	bRunning = true;
+}
+
+void FLuaCoverage::Stop()
+{
+	bRunning = false;
+}
+
+void FLuaCoverage::Reset()
+{
+	Chunks.Empty();
+	ChunkIds.Empty();
+	ChunkPointers.Empty();
+	LastSource = nullptr;
+	LastChunkId = INDEX_NONE;
+}
+
+void FLuaCoverage::SetLine(TBitArray<>& Lines, const int32 Line)
+{
+	if (Line < 0)
+	{
+		return;
+	}
+
+	if (Line >= Lines.Num())
+	{
+		Lines.Add(false, Line + 1 - Lines.Num());
+	}
+	Lines[Line] = true;
+}
+
+int32 FLuaCoverage::FindChunk(const char* Source)
+{
+	if (!Source)
+	{
+		return INDEX_NONE;
+	}
+
+	// the string could have been collected and its memory reused
+	if (Source == LastSource && FCStringAnsi::Strcmp(Chunks[LastChunkId].Key.GetData(), Source) == 0)
+	{
+		return LastChunkId;
+	}
+
+	int32 ChunkId = INDEX_NONE;
+	if (int32* CachedId = ChunkPointers.Find(Source))
+	{
+		if (FCStringAnsi::Strcmp(Chunks[*CachedId].Key.GetData(), Source) == 0)
+		{
+			ChunkId = *CachedId;
+		}
+	}
+
+	if (ChunkId == INDEX_NONE)
+	{
+		FString ChunkName = UTF8_TO_TCHAR(Source);
+		if (ChunkName.StartsWith(TEXT("@")) || ChunkName.StartsWith(TEXT("=")))
+		{
+			ChunkName.RightChopInline(1);
+		}
+
+		if (int32* ExistingId = ChunkIds.Find(ChunkName))
+		{
+			ChunkId = *ExistingId;
+		}
+		else
+		{
+			FChunk Chunk;
+			Chunk.Name = ChunkName;
+			Chunk.Key.Append(Source, FCStringAnsi::Strlen(Source) + 1);
+			Chunk.bMeasured = Filters.Num() == 0;
+			for (const FString& Filter : Filters)
+			{
+				if (ChunkName.MatchesWildcard(Filter))
+				{
+					Chunk.bMeasured = true;
+					break;
+				}
+			}
+			ChunkId = Chunks.Add(MoveTemp(Chunk));
+			ChunkIds.Add(ChunkName, ChunkId);
+		}
+
+		ChunkPointers.Add(Source, ChunkId);
+	}
+
+	LastSource = Source;
+	LastChunkId = ChunkId;
+	return ChunkId;
+}
+
+void FLuaCoverage::OnFunctionCall(FLuaHookEvent& Event, FChunk& Chunk)
+{
+	const int32 LineDefined = Event.GetLineDefined();
+	if (FFunction* Function = Chunk.Functions.Find(LineDefined))
+	{
+		Function->Hits++;
+		return;
+	}
+
+	FFunction Function;
+	Function.Hits = 1;
+	if (LineDefined == 0)
+	{
+		Function.Name = TEXT("main");
+	}
+	else
+	{
+		const char* Name = Event.GetName();
+		Function.Name = FString::Printf(TEXT("%s@%d"), Name ? UTF8_TO_TCHAR(Name) : TEXT("anonymous"), LineDefined);
+	}
+	Chunk.Functions.Add(LineDefined, Function);
+
+	// first call of the function, record its executable lines
+	lua_State* L = Event.L;
+	lua_getinfo(L, "L", Event.Debug);
+	lua_pushnil(L);
+	while (lua_next(L, -2) != 0)
+	{
+		SetLine(Chunk.ExecutableLines, (int32)lua_tointeger(L, -2));
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 1);
+}
+
+void FLuaCoverage::OnLuaHook(ULuaState* LuaState, FLuaHookEvent& Event)
+{
+	const int32 EventType = Event.GetEvent();
+
+	if (EventType == LUA_HOOKLINE)
+	{
+		// lines could still be enabled in an unmeasured chunk after an error
+		const int32 ChunkId = FindChunk(Event.GetSource());
+		if (ChunkId != INDEX_NONE && Chunks[ChunkId].bMeasured)
+		{
+			SetLine(Chunks[ChunkId].ExecutedLines, Event.GetCurrentLine());
+		}
+		return;
+	}
+
+	if (EventType == LUA_HOOKCALL || EventType == LUA_HOOKTAILCALL)
+	{
+		// C functions do not generate line events, keep the current state (changing it would restart the count hook)
+		if (Event.GetWhat()[0] == 'C')
+		{
+			return;
+		}
+
+		const int32 ChunkId = FindChunk(Event.GetSource());
+		const bool bMeasured = ChunkId != INDEX_NONE && Chunks[ChunkId].bMeasured;
+		if (bMeasured)
+		{
+			OnFunctionCall(Event, Chunks[ChunkId]);
+		}
+		LuaState->SetThreadOnDemandHook(Event.L, bMeasured ? LUA_MASKLINE : 0);
+		return;
+	}
+
+	if (EventType == LUA_HOOKRET)
+	{
+		// the state depends on the function we are returning to
+		lua_Debug Caller;
+		if (lua_getstack(Event.L, 1, &Caller) != 1)
+		{
+			LuaState->SetThreadOnDemandHook(Event.L, 0);
+			return;
+		}
+
+		lua_getinfo(Event.L, "S", &Caller);
+		if (Caller.what[0] == 'C')
+		{
+			return;
+		}
+
+		const int32 ChunkId = FindChunk(Caller.source);
+		LuaState->SetThreadOnDemandHook(Event.L, ChunkId != INDEX_NONE && Chunks[ChunkId].bMeasured ? LUA_MASKLINE : 0);
+	}
+}
+
+FString FLuaCoverage::ExportLcov(const FString& TestName) const
+{
+	FString Lcov;
+	for (const FChunk& Chunk : Chunks)
+	{
+		if (!Chunk.bMeasured)
+		{
+			continue;
+		}
+
+		Lcov += FString::Printf(TEXT("TN:%s\nSF:%s\n"), *TestName, *Chunk.Name);
+
+		TArray<int32> FunctionLines;
+		Chunk.Functions.GetKeys(FunctionLines);
+		FunctionLines.Sort();
+
+		int32 FunctionsHit = 0;
+		for (const int32 FunctionLine : FunctionLines)
+		{
+			Lcov += FString::Printf(TEXT("FN:%d,%s\n"), FMath::Max(FunctionLine, 1), *Chunk.Functions[FunctionLine].Name);
+		}
+		for (const int32 FunctionLine : FunctionLines)
+		{
+			const FFunction& Function = Chunk.Functions[FunctionLine];
+			Lcov += FString::Printf(TEXT("FNDA:%d,%s\n"), Function.Hits, *Function.Name);
+			if (Function.Hits > 0)
+			{
+				FunctionsHit++;
+			}
+		}
+		Lcov += FString::Printf(TEXT("FNF:%d\nFNH:%d\n"), FunctionLines.Num(), FunctionsHit);
+
+		int32 LinesFound = 0;
+		int32 LinesHit = 0;
+		const int32 NumLines = FMath::Max(Chunk.ExecutableLines.Num(), Chunk.ExecutedLines.Num());
+		for (int32 Line = 1; Line < NumLines; Line++)
+		{
+			const bool bExecuted = Line < Chunk.ExecutedLines.Num() && Chunk.ExecutedLines[Line];
+			if (!bExecuted && !(Line < Chunk.ExecutableLines.Num() && Chunk.ExecutableLines[Line]))
+			{
+				continue;
+			}
+			LinesFound++;
+			if (bExecuted)
+			{
+				LinesHit++;
+			}
+			Lcov += FString::Printf(TEXT("DA:%d,%d\n"), Line, bExecuted ? 1 : 0);
+		}
+		Lcov += FString::Printf(TEXT("LF:%d\nLH:%d\nend_of_record\n"), LinesFound, LinesHit);
+	}
+	return Lcov;
+}
+
+bool FLuaCoverage::SaveLcov(const FString& Filename, const FString& TestName) const
+{
+	return FFileHelper::SaveStringToFile(ExportLcov(TestName), *Filename);
+}
+
+FString FLuaCoverage::GetSummary() const
+{
+	FString Summary;
+	int32 TotalFound = 0;
+	int32 TotalHit = 0;
+	for (const FChunk& Chunk : Chunks)
+	{
+		if (!Chunk.bMeasured)
+		{
+			continue;
+		}
+
+		int32 LinesFound = 0;
+		int32 LinesHit = 0;
+		const int32 NumLines = FMath::Max(Chunk.ExecutableLines.Num(), Chunk.ExecutedLines.Num());
+		for (int32 Line = 1; Line < NumLines; Line++)
+		{
+			const bool bExecuted = Line < Chunk.ExecutedLines.Num() && Chunk.ExecutedLines[Line];
+			if (bExecuted || (Line < Chunk.ExecutableLines.Num() && Chunk.ExecutableLines[Line]))
+			{
+				LinesFound++;
+				LinesHit += bExecuted ? 1 : 0;
+			}
+		}
+
+		TotalFound += LinesFound;
+		TotalHit += LinesHit;
+		Summary += FString::Printf(TEXT("%6.1f%% %5d/%-5d %s\n"), LinesFound > 0 ? LinesHit * 100.0 / LinesFound : 0.0, LinesHit, LinesFound, *Chunk.Name);
+	}
+
+	Summary += FString::Printf(TEXT("%6.1f%% %5d/%-5d total\n"), TotalFound > 0 ? TotalHit * 100.0 / TotalFound : 0.0, TotalHit, TotalFound);
+	return Summary;
+}
@@ -0,0 +1,784 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaDataTable.h"
+#include "LuaState.h"
+#include "Engine/DataTable.h"
+#include "Misc/Crc.h"
+
+static const char* LuaDataTableMetaTableName = "LuaMachine.DataTable";
+static const char* LuaDataTableColumnMetaTableName = "LuaMachine.DataTableColumn";
+
+struct FLuaDataTable::FProxy
+{
+	// read as FLuaUserData::Type by ULuaState::ToLuaValue(), Nil means not convertible
+	ELuaValueType Type;
+	// INDEX_NONE for the table itself
+	int32 Column;
+	FLuaDataTablePtr Data;
+};
+
+struct FLuaDataTable::FCondition
+{
+	enum class EOperator : uint8
+	{
+		Less,
+		LessEqual,
+		Greater,
+		GreaterEqual,
+		Equal,
+		NotEqual,
+	};
+
+	int32 Column;
+	EOperator Operator;
+	// integer columns compared with an integer value do not go through doubles
+	bool bInteger;
+	bool Bool;
+	int64 Integer;
+	double Number;
+	// INDEX_NONE if the string is not in the table
+	int32 String;
+};
+
+// Operator follows the order of FLuaDataTable::FCondition::EOperator
+template<typename T>
+static bool LuaDataTableCompare(const uint8 Operator, const T A, const T B)
+{
+	switch (Operator)
+	{
+	case 0:
+		return A < B;
+	case 1:
+		return A <= B;
+	case 2:
+		return A > B;
+	case 3:
+		return A >= B;
+	case 4:
+		return A == B;
+	default:
+		return A != B;
+	}
+}
+
+FLuaDataTablePtr FLuaDataTable::Import(UDataTable* DataTable)
+{
+	if (!DataTable || !DataTable->GetRowStruct())
+	{
+		return nullptr;
+	}
+
+	TSharedPtr<FLuaDataTable, ESPMode::ThreadSafe> Data = MakeShared<FLuaDataTable, ESPMode::ThreadSafe>();
+	Data->Name = DataTable->GetName();
+	Data->DataTable = DataTable;
+
+	TArray<uint8*> Rows;
+	const TMap<FName, uint8*>& RowMap = DataTable->GetRowMap();
+	Data->RowNames.Reserve(RowMap.Num());
+	Data->RowIndices.Reserve(RowMap.Num());
+	Rows.Reserve(RowMap.Num());
+	for (const TPair<FName, uint8*>& Pair : RowMap)
+	{
+		Data->RowIndices.Add(Pair.Key, Data->RowNames.Num());
+		Data->RowNames.Add(Pair.Key);
+		Rows.Add(Pair.Value);
+	}
+
+#if ENGINE_MAJOR_VERSION > 4 || ENGINE_MINOR_VERSION >= 25
+	for (TFieldIterator<FProperty> It(DataTable->GetRowStruct()); It; ++It)
+#else
+	for (TFieldIterator<UProperty> It(DataTable->GetRowStruct()); It; ++It)
+#endif
+	{
+		FColumn& Column = Data->Columns.AddDefaulted_GetRef();
+		Column.Property = *It;
+		Column.Name = Column.Property->GetName();
+		FTCHARToUTF8 Utf8Name(*Column.Name);
+		Column.Utf8Name.Append(Utf8Name.Get(), Utf8Name.Length());
+		Column.Utf8Name.Add(0);
+		Column.Type = EColumnType::Value;
+
+#if ENGINE_MAJOR_VERSION > 4 || ENGINE_MINOR_VERSION >= 25
+		if (FBoolProperty* BoolProperty = CastField<FBoolProperty>(Column.Property))
+#else
+		if (UBoolProperty* BoolProperty = Cast<UBoolProperty>(Column.Property))
+#endif
+		{
+			Column.Type = EColumnType::Bool;
+			Column.Bools.Reserve(Rows.Num());
+			for (uint8* Row : Rows)
+			{
+				Column.Bools.Add(BoolProperty->GetPropertyValue_InContainer(Row));
+			}
+		}
+#if ENGINE_MAJOR_VERSION > 4 || ENGINE_MINOR_VERSION >= 25
+		else if (FEnumProperty* EnumProperty = CastField<FEnumProperty>(Column.Property))
+		{
+			Column.Type = EColumnType::Integer;
+			Column.Integers.Reserve(Rows.Num());
+			for (uint8* Row : Rows)
+			{
+				Column.Integers.Add(EnumProperty->GetUnderlyingProperty()->GetSignedIntPropertyValue(EnumProperty->ContainerPtrToValuePtr<void>(Row)));
+			}
+		}
+		else if (FNumericProperty* NumericProperty = CastField<FNumericProperty>(Column.Property))
+#else
+		else if (UNumericProperty* NumericProperty = Cast<UNumericProperty>(Column.Property))
+#endif
+		{
+			if (NumericProperty->IsFloatingPoint())
+			{
+				Column.Type = EColumnType::Number;
+				Column.Numbers.Reserve(Rows.Num());
+				for (uint8* Row : Rows)
+				{
+					Column.Numbers.Add(NumericProperty->GetFloatingPointPropertyValue(NumericProperty->ContainerPtrToValuePtr<void>(Row)));
+				}
+			}
+			else
+			{
+				Column.Type = EColumnType::Integer;
+				Column.Integers.Reserve(Rows.Num());
+				for (uint8* Row : Rows)
+				{
+					Column.Integers.Add(NumericProperty->GetSignedIntPropertyValue(NumericProperty->ContainerPtrToValuePtr<void>(Row)));
+				}
+			}
+		}
+#if ENGINE_MAJOR_VERSION > 4 || ENGINE_MINOR_VERSION >= 25
+		else if (FStrProperty* StrProperty = CastField<FStrProperty>(Column.Property))
+#else
+		else if (UStrProperty* StrProperty = Cast<UStrProperty>(Column.Property))
+#endif
+		{
+			Column.Type = EColumnType::String;
+			Column.Strings.Reserve(Rows.Num());
+			for (uint8* Row : Rows)
+			{
+				Column.Strings.Add(Data->InternString(StrProperty->GetPropertyValue_InContainer(Row)));
+			}
+		}
+#if ENGINE_MAJOR_VERSION > 4 || ENGINE_MINOR_VERSION >= 25
+		else if (FNameProperty* NameProperty = CastField<FNameProperty>(Column.Property))
+#else
+		else if (UNameProperty* NameProperty = Cast<UNameProperty>(Column.Property))
+#endif
+		{
+			Column.Type = EColumnType::String;
+			Column.Strings.Reserve(Rows.Num());
+			for (uint8* Row : Rows)
+			{
+				Column.Strings.Add(Data->InternString(NameProperty->GetPropertyValue_InContainer(Row).ToString()));
+			}
+		}
+#if ENGINE_MAJOR_VERSION > 4 || ENGINE_MINOR_VERSION >= 25
+		else if (FTextProperty* TextProperty = CastField<FTextProperty>(Column.Property))
+#else
+		else if (UTextProperty* TextProperty = Cast<UTextProperty>(Column.Property))
+#endif
+		{
+			Column.Type = EColumnType::String;
+			Column.Strings.Reserve(Rows.Num());
+			for (uint8* Row : Rows)
+			{
+				Column.Strings.Add(Data->InternString(TextProperty->GetPropertyValue_InContainer(Row).ToString()));
+			}
+		}
+	}
+
+	return Data;
+}
+
+int32 FLuaDataTable::InternString(const FString& Value)
+{
+	FTCHARToUTF8 Utf8Value(*Value);
+	const int32 Found = FindString(Utf8Value.Get(), Utf8Value.Length());
+	if (Found != INDEX_NONE)
+	{
+		return Found;
+	}
+
+	const int32 String = StringOffsets.Add(StringData.Num());
+	StringData.Append(Utf8Value.Get(), Utf8Value.Length());
+	StringData.Add(0);
+	StringsByHash.Add(FCrc::MemCrc32(Utf8Value.Get(), Utf8Value.Length()), String);
+	return String;
+}
+
+int32 FLuaDataTable::FindString(const char* Value, const int32 Length) const
+{
+	for (TMultiMap<uint32, int32>::TConstKeyIterator It = StringsByHash.CreateConstKeyIterator(FCrc::MemCrc32(Value, Length)); It; ++It)
+	{
+		const int32 Offset = StringOffsets[It.Value()];
+		const int32 NextOffset = It.Value() + 1 < StringOffsets.Num() ? StringOffsets[It.Value() + 1] : StringData.Num();
+		if (NextOffset - Offset - 1 == Length && FMemory::Memcmp(&StringData[Offset], Value, Length) == 0)
+		{
+			return It.Value();
+		}
+	}
+	return INDEX_NONE;
+}
+
+int32 FLuaDataTable::FindRow(const FName& RowName) const
+{
+	const int32* Row = RowIndices.Find(RowName);
+	return Row ? *Row : INDEX_NONE;
+}
+
+int32 FLuaDataTable::FindColumn(const char* ColumnName) const
+{
+	for (int32 Column = 0; Column < Columns.Num(); Column++)
+	{
+		if (FCStringAnsi::Strcmp(Columns[Column].Utf8Name.GetData(), ColumnName) == 0)
+		{
+			return Column;
+		}
+	}
+	return INDEX_NONE;
+}
+
+SIZE_T FLuaDataTable::GetAllocatedSize() const
+{
+	SIZE_T Size = RowNames.GetAllocatedSize() + RowIndices.GetAllocatedSize() + Columns.GetAllocatedSize();
+	for (const FColumn& Column : Columns)
+	{
+		Size += Column.Name.GetAllocatedSize() + Column.Utf8Name.GetAllocatedSize();
+		Size += Column.Bools.GetAllocatedSize() + Column.Integers.GetAllocatedSize() + Column.Numbers.GetAllocatedSize() + Column.Strings.GetAllocatedSize();
+	}
+	return Size + StringData.GetAllocatedSize() + StringOffsets.GetAllocatedSize() + StringsByHash.GetAllocatedSize();
+}
+
+void FLuaDataTable::PushCell(lua_State* L, const int32 Column, const int32 Row) const
+{
+	const FColumn& ColumnData = Columns[Column];
+	switch (ColumnData.Type)
+	{
+	case EColumnType::Bool:
+		lua_pushboolean(L, ColumnData.Bools[Row] ? 1 : 0);
+		break;
+	case EColumnType::Integer:
+		lua_pushinteger(L, ColumnData.Integers[Row]);
+		break;
+	case EColumnType::Number:
+		lua_pushnumber(L, ColumnData.Numbers[Row]);
+		break;
+	case EColumnType::String:
+		lua_pushstring(L, &StringData[StringOffsets[ColumnData.Strings[Row]]]);
+		break;
+	default:
+	{
+		UDataTable* Table = DataTable.Get();
+		uint8* RowData = Table ? Table->FindRowUnchecked(RowNames[Row]) : nullptr;
+		if (!RowData)
+		{
+			lua_pushnil(L);
+			break;
+		}
+		ULuaState* LuaState = ULuaState::GetFromExtraSpace(L);
+		bool bSuccess = false;
+		FLuaValue Value = LuaState->FromProperty(RowData, ColumnData.Property, bSuccess);
+		LuaState->FromLuaValue(Value, nullptr, L);
+		break;
+	}
+	}
+}
+
+void FLuaDataTable::PushProxy(lua_State* L, FLuaDataTablePtr Data)
+{
+	if (!Data.IsValid())
+	{
+		lua_pushnil(L);
+		return;
+	}
+
+	FProxy* Proxy = (FProxy*)lua_newuserdata(L, sizeof(FProxy));
+	new(Proxy) FProxy();
+	Proxy->Type = ELuaValueType::Nil;
+	Proxy->Column = INDEX_NONE;
+	Proxy->Data = Data;
+
+	if (luaL_newmetatable(L, LuaDataTableMetaTableName))
+	{
+		// methods are looked up before the columns
+		lua_newtable(L);
+		const luaL_Reg Methods[] =
+		{
+			{"row", FLuaDataTable::TableFunction_row},
+			{"name", FLuaDataTable::TableFunction_name},
+			{"column", FLuaDataTable::TableFunction_column},
+			{"get", FLuaDataTable::TableFunction_get},
+			{"totable", FLuaDataTable::TableFunction_totable},
+			{"select", FLuaDataTable::TableFunction_select},
+			{"count", FLuaDataTable::TableFunction_count},
+			{"sum", FLuaDataTable::TableFunction_sum},
+			{"min", FLuaDataTable::TableFunction_min},
+			{"max", FLuaDataTable::TableFunction_max},
+			{nullptr, nullptr}
+		};
+		luaL_setfuncs(L, Methods, 0);
+		lua_pushcclosure(L, FLuaDataTable::MetaTableFunction__index, 1);
+		lua_setfield(L, -2, "__index");
+		lua_pushcfunction(L, FLuaDataTable::MetaTableFunction__newindex);
+		lua_setfield(L, -2, "__newindex");
+		lua_pushcfunction(L, FLuaDataTable::MetaTableFunction__len);
+		lua_setfield(L, -2, "__len");
+		lua_pushcfunction(L, FLuaDataTable::MetaTableFunction__tostring);
+		lua_setfield(L, -2, "__tostring");
+		lua_pushcfunction(L, FLuaDataTable::MetaTableFunction__gc);
+		lua_setfield(L, -2, "__gc");
+		lua_pushboolean(L, 0);
+		lua_setfield(L, -2, "__metatable");
+	}
+	lua_setmetatable(L, -2);
+}
+
+void FLuaDataTable::PushColumnProxy(lua_State* L, const int32 Column) const
+{
+	FProxy* Proxy = (FProxy*)lua_newuserdata(L, sizeof(FProxy));
+	new(Proxy) FProxy();
+	Proxy->Type = ELuaValueType::Nil;
+	Proxy->Column = Column;
+	Proxy->Data = AsShared();
+
+	if (luaL_newmetatable(L, LuaDataTableColumnMetaTableName))
+	{
+		lua_pushcfunction(L, FLuaDataTable::MetaTableFunctionColumn__index);
+		lua_setfield(L, -2, "__index");
+		lua_pushcfunction(L, FLuaDataTable::MetaTableFunction__newindex);
+		lua_setfield(L, -2, "__newindex");
+		lua_pushcfunction(L, FLuaDataTable::MetaTableFunctionColumn__len);
+		lua_setfield(L, -2, "__len");
+		lua_pushcfunction(L, FLuaDataTable::MetaTableFunctionColumn__tostring);
+		lua_setfield(L, -2, "__tostring");
+		lua_pushcfunction(L, FLuaDataTable::MetaTableFunction__gc);
+		lua_setfield(L, -2, "__gc");
+		lua_pushboolean(L, 0);
+		lua_setfield(L, -2, "__metatable");
+	}
+	lua_setmetatable(L, -2);
+}
+
+FLuaDataTable::FProxy* FLuaDataTable::CheckProxy(lua_State* L, const int Index)
+{
+	return (FProxy*)luaL_checkudata(L, Index, LuaDataTableMetaTableName);
+}
+
+int32 FLuaDataTable::ToRow(lua_State* L, const FLuaDataTable& Data, const int Index)
+{
+	if (lua_type(L, Index) == LUA_TNUMBER)
+	{
+		int IsInteger = 0;
+		const lua_Integer Row = lua_tointegerx(L, Index, &IsInteger);
+		return IsInteger && Row >= 1 && Row <= Data.RowNames.Num() ? (int32)Row - 1 : INDEX_NONE;
+	}
+
+	if (lua_type(L, Index) == LUA_TSTRING)
+	{
+		// FNAME_Find avoids adding unknown names to the name table
+		const FName RowName(UTF8_TO_TCHAR(lua_tostring(L, Index)), FNAME_Find);
+		return RowName.IsNone() ? INDEX_NONE : Data.FindRow(RowName);
+	}
+
+	luaL_argerror(L, Index, "row index or row name expected");
+	return INDEX_NONE;
+}
+
+int32 FLuaDataTable::CheckColumn(lua_State* L, const FLuaDataTable& Data, const int Index)
+{
+	const char* ColumnName = luaL_checkstring(L, Index);
+	const int32 Column = Data.FindColumn(ColumnName);
+	if (Column == INDEX_NONE)
+	{
+		luaL_error(L, "unknown column %s in %s", ColumnName, TCHAR_TO_UTF8(*Data.Name));
+	}
+	return Column;
+}
+
+int32 FLuaDataTable::CheckNumericColumn(lua_State* L, const FLuaDataTable& Data, const int Index)
+{
+	const int32 Column = CheckColumn(L, Data, Index);
+	if (Data.Columns[Column].Type != EColumnType::Integer && Data.Columns[Column].Type != EColumnType::Number)
+	{
+		luaL_error(L, "column %s is not numeric", lua_tostring(L, Index));
+	}
+	return Column;
+}
+
+TArrayView<FCondition> FLuaDataTable::CheckConditions(lua_State* L, const FLuaDataTable& Data, const int FirstIndex)
+{
+	const int Top = lua_gettop(L);
+	if ((Top - FirstIndex + 1) % 3 != 0)
+	{
+		luaL_error(L, "conditions must be column, operator, value triples");
+	}
+
+	// luaL_error() and luaL_argerror() longjmp, a TArray would leak
+	const int32 NumConditions = (Top - FirstIndex + 1) / 3;
+	FCondition* Conditions = (FCondition*)lua_newuserdata(L, sizeof(FCondition) * NumConditions);
+	FMemory::Memzero(Conditions, sizeof(FCondition) * NumConditions);
+
+	for (int Index = FirstIndex; Index <= Top; Index += 3)
+	{
+		FCondition& Condition = Conditions[(Index - FirstIndex) / 3];
+		Condition.Column = CheckColumn(L, Data, Index);
+
+		const char* Operator = luaL_checkstring(L, Index + 1);
+		if (!FCStringAnsi::Strcmp(Operator, "<"))
+		{
+			Condition.Operator = FCondition::EOperator::Less;
+		}
+		else if (!FCStringAnsi::Strcmp(Operator, "<="))
+		{
+			Condition.Operator = FCondition::EOperator::LessEqual;
+		}
+		else if (!FCStringAnsi::Strcmp(Operator, ">"))
+		{
+			Condition.Operator = FCondition::EOperator::Greater;
+		}
+		else if (!FCStringAnsi::Strcmp(Operator, ">="))
+		{
+			Condition.Operator = FCondition::EOperator::GreaterEqual;
+		}
+		else if (!FCStringAnsi::Strcmp(Operator, "=="))
+		{
+			Condition.Operator = FCondition::EOperator::Equal;
+		}
+		else if (!FCStringAnsi::Strcmp(Operator, "~="))
+		{
+			Condition.Operator = FCondition::EOperator::NotEqual;
+		}
+		else
+		{
+			luaL_argerror(L, Index + 1, "unknown operator");
+		}
+
+		const bool bOrdering = Condition.Operator != FCondition::EOperator::Equal && Condition.Operator != FCondition::EOperator::NotEqual;
+		switch (Data.Columns[Condition.Column].Type)
+		{
+		case EColumnType::Bool:
+			luaL_checktype(L, Index + 2, LUA_TBOOLEAN);
+			if (bOrdering)
+			{
+				luaL_argerror(L, Index + 1, "only == and ~= are supported on boolean columns");
+			}
+			Condition.Bool = lua_toboolean(L, Index + 2) != 0;
+			break;
+		case EColumnType::Integer:
+			Condition.bInteger = lua_isinteger(L, Index + 2) != 0;
+			Condition.Integer = lua_tointeger(L, Index + 2);
+			Condition.Number = luaL_checknumber(L, Index + 2);
+			break;
+		case EColumnType::Number:
+			Condition.Number = luaL_checknumber(L, Index + 2);
+			break;
+		case EColumnType::String:
+		{
+			if (bOrdering)
+			{
+				luaL_argerror(L, Index + 1, "only == and ~= are supported on string columns");
+			}
+			size_t Length = 0;
+			const char* Value = luaL_checklstring(L, Index + 2, &Length);
+			Condition.String = Data.FindString(Value, (int32)Length);
+			break;
+		}
+		default:
+			luaL_error(L, "column %s can not be scanned", lua_tostring(L, Index));
+			break;
+		}
+	}
+
+	return TArrayView<FCondition>(Conditions, NumConditions);
+}
+
+bool FLuaDataTable::MatchesConditions(const TArrayView<FCondition> Conditions, const int32 Row) const
+{
+	for (const FCondition& Condition : Conditions)
+	{
+		const FColumn& Column = Columns[Condition.Column];
+		const uint8 Operator = (uint8)Condition.Operator;
+		bool bMatches = false;
+		switch (Column.Type)
+		{
+		case EColumnType::Bool:
+			bMatches = LuaDataTableCompare<bool>(Operator, Column.Bools[Row], Condition.Bool);
+			break;
+		case EColumnType::Integer:
+			bMatches = Condition.bInteger ? LuaDataTableCompare<int64>(Operator, Column.Integers[Row], Condition.Integer) : LuaDataTableCompare<double>(Operator, (double)Column.Integers[Row], Condition.Number);
+			break;
+		case EColumnType::Number:
+			bMatches = LuaDataTableCompare<double>(Operator, Column.Numbers[Row], Condition.Number);
+			break;
+		case EColumnType::String:
+			bMatches = LuaDataTableCompare<int32>(Operator, Column.Strings[Row], Condition.String);
+			break;
+		default:
+			break;
+		}
+
+		if (!bMatches)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int FLuaDataTable::MetaTableFunction__index(lua_State* L)
+{
+	FProxy* Proxy = CheckProxy(L, 1);
+
+	lua_pushvalue(L, 2);
+	if (lua_rawget(L, lua_upvalueindex(1)) != LUA_TNIL)
+	{
+		return 1;
+	}
+
+	if (lua_type(L, 2) != LUA_TSTRING)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	const int32 Column = Proxy->Data->FindColumn(lua_tostring(L, 2));
+	if (Column == INDEX_NONE)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	Proxy->Data->PushColumnProxy(L, Column);
+	return 1;
+}
+
+int FLuaDataTable::MetaTableFunction__newindex(lua_State* L)
+{
+	return luaL_error(L, "attempt to modify a read-only data table");
+}
+
+int FLuaDataTable::MetaTableFunction__len(lua_State* L)
+{
+	FProxy* Proxy = CheckProxy(L, 1);
+	lua_pushinteger(L, Proxy->Data->RowNames.Num());
+	return 1;
+}
+
+int FLuaDataTable::MetaTableFunction__tostring(lua_State* L)
+{
+	FProxy* Proxy = CheckProxy(L, 1);
+	lua_pushfstring(L, "data table: %s (%d rows)", TCHAR_TO_UTF8(*Proxy->Data->Name), Proxy->Data->RowNames.Num());
+	return 1;
+}
+
+int FLuaDataTable::MetaTableFunction__gc(lua_State* L)
+{
+	// shared by the table and the columns
+	FProxy* Proxy = (FProxy*)lua_touserdata(L, 1);
+	if (Proxy)
+	{
+		Proxy->~FProxy();
+	}
+	return 0;
+}
+
+int FLuaDataTable::MetaTableFunctionColumn__index(lua_State* L)
+{
+	FProxy* Proxy = (FProxy*)luaL_checkudata(L, 1, LuaDataTableColumnMetaTableName);
+	const int32 Row = ToRow(L, *Proxy->Data, 2);
+	if (Row == INDEX_NONE)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+	Proxy->Data->PushCell(L, Proxy->Column, Row);
+	return 1;
+}
+
+int FLuaDataTable::MetaTableFunctionColumn__len(lua_State* L)
+{
+	FProxy* Proxy = (FProxy*)luaL_checkudata(L, 1, LuaDataTableColumnMetaTableName);
+	lua_pushinteger(L, Proxy->Data->RowNames.Num());
+	return 1;
+}
+
+int FLuaDataTable::MetaTableFunctionColumn__tostring(lua_State* L)
+{
+	FProxy* Proxy = (FProxy*)luaL_checkudata(L, 1, LuaDataTableColumnMetaTableName);
+	lua_pushfstring(L, "data table column: %s.%s", TCHAR_TO_UTF8(*Proxy->Data->Name), Proxy->Data->Columns[Proxy->Column].Utf8Name.GetData());
+	return 1;
+}
+
+int FLuaDataTable::TableFunction_row(lua_State* L)
+{
+	FProxy* Proxy = CheckProxy(L, 1);
+	luaL_checktype(L, 2, LUA_TSTRING);
+	const int32 Row = ToRow(L, *Proxy->Data, 2);
+	if (Row == INDEX_NONE)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_pushinteger(L, Row + 1);
+	return 1;
+}
+
+int FLuaDataTable::TableFunction_name(lua_State* L)
+{
+	FProxy* Proxy = CheckProxy(L, 1);
+	const lua_Integer Row = luaL_checkinteger(L, 2);
+	if (Row < 1 || Row > Proxy->Data->RowNames.Num())
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_pushstring(L, TCHAR_TO_UTF8(*Proxy->Data->RowNames[Row - 1].ToString()));
+	return 1;
+}
+
+int FLuaDataTable::TableFunction_column(lua_State* L)
+{
+	FProxy* Proxy = CheckProxy(L, 1);
+	Proxy->Data->PushColumnProxy(L, CheckColumn(L, *Proxy->Data, 2));
+	return 1;
+}
+
+int FLuaDataTable::TableFunction_get(lua_State* L)
+{
+	FProxy* Proxy = CheckProxy(L, 1);
+	const int32 Column = CheckColumn(L, *Proxy->Data, 3);
+	const int32 Row = ToRow(L, *Proxy->Data, 2);
+	if (Row == INDEX_NONE)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+	Proxy->Data->PushCell(L, Column, Row);
+	return 1;
+}
+
+int FLuaDataTable::TableFunction_totable(lua_State* L)
+{
+	FProxy* Proxy = CheckProxy(L, 1);
+	const int32 Row = ToRow(L, *Proxy->Data, 2);
+	if (Row == INDEX_NONE)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	// same layout of ULuaState::StructToLuaTable()
+	lua_createtable(L, 0, Proxy->Data->Columns.Num());
+	for (int32 Column = 0; Column < Proxy->Data->Columns.Num(); Column++)
+	{
+		Proxy->Data->PushCell(L, Column, Row);
+		lua_setfield(L, -2, Proxy->Data->Columns[Column].Utf8Name.GetData());
+	}
+	return 1;
+}
+
+int FLuaDataTable::TableFunction_select(lua_State* L)
+{
+	FProxy* Proxy = CheckProxy(L, 1);
+	const TArrayView<FCondition> Conditions = CheckConditions(L, *Proxy->Data, 2);
+
+	lua_newtable(L);
+	lua_Integer Index = 1;
+	for (int32 Row = 0; Row < Proxy->Data->RowNames.Num(); Row++)
+	{
+		if (Proxy->Data->MatchesConditions(Conditions, Row))
+		{
+			lua_pushinteger(L, Row + 1);
+			lua_rawseti(L, -2, Index++);
+		}
+	}
+	return 1;
+}
+
+int FLuaDataTable::TableFunction_count(lua_State* L)
+{
+	FProxy* Proxy = CheckProxy(L, 1);
+	const TArrayView<FCondition> Conditions = CheckConditions(L, *Proxy->Data, 2);
+
+	lua_Integer Count = 0;
+	for (int32 Row = 0; Row < Proxy->Data->RowNames.Num(); Row++)
+	{
+		if (Proxy->Data->MatchesConditions(Conditions, Row))
+		{
+			Count++;
+		}
+	}
+	lua_pushinteger(L, Count);
+	return 1;
+}
+
+int FLuaDataTable::TableFunction_sum(lua_State* L)
+{
+	FProxy* Proxy = CheckProxy(L, 1);
+	const FColumn& Column = Proxy->Data->Columns[CheckNumericColumn(L, *Proxy->Data, 2)];
+	if (Column.Type == EColumnType::Integer)
+	{
+		lua_Integer Sum = 0;
+		for (const int64 Value : Column.Integers)
+		{
+			Sum += Value;
+		}
+		lua_pushinteger(L, Sum);
+		return 1;
+	}
+
+	lua_Number Sum = 0;
+	for (const double Value : Column.Numbers)
+	{
+		Sum += Value;
+	}
+	lua_pushnumber(L, Sum);
+	return 1;
+}
+
+template<typename T>
+static int32 LuaDataTableFindExtreme(const TArray<T>& Values, const bool bMax)
+{
+	int32 Found = INDEX_NONE;
+	for (int32 Row = 0; Row < Values.Num(); Row++)
+	{
+		if (Found == INDEX_NONE || (bMax ? Values[Row] > Values[Found] : Values[Row] < Values[Found]))
+		{
+			Found = Row;
+		}
+	}
+	return Found;
+}
+
+int FLuaDataTable::TableFunction_min(lua_State* L)
+{
+	FProxy* Proxy = CheckProxy(L, 1);
+	const int32 Column = CheckNumericColumn(L, *Proxy->Data, 2);
+	const FColumn& ColumnData = Proxy->Data->Columns[Column];
+	const int32 Row = ColumnData.Type == EColumnType::Integer ? LuaDataTableFindExtreme(ColumnData.Integers, false) : LuaDataTableFindExtreme(ColumnData.Numbers, false);
+	if (Row == INDEX_NONE)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+	// value and row index
+	Proxy->Data->PushCell(L, Column, Row);
+	lua_pushinteger(L, Row + 1);
+	return 2;
+}
+
+int FLuaDataTable::TableFunction_max(lua_State* L)
+{
+	FProxy* Proxy = CheckProxy(L, 1);
+	const int32 Column = CheckNumericColumn(L, *Proxy->Data, 2);
+	const FColumn& ColumnData = Proxy->Data->Columns[Column];
+	const int32 Row = ColumnData.Type == EColumnType::Integer ? LuaDataTableFindExtreme(ColumnData.Integers, true) : LuaDataTableFindExtreme(ColumnData.Numbers, true);
+	if (Row == INDEX_NONE)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+	// value and row index
+	Proxy->Data->PushCell(L, Column, Row);
+	lua_pushinteger(L, Row + 1);
+	return 2;
+}
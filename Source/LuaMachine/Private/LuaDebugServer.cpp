@@ -0,0 +1,903 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaDebugServer.h"
+
+#if LUAMACHINE_WITH_DEBUG_SERVER
+
+#include "LuaState.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#include "Common/TcpSocketBuilder.h"
+#include "Interfaces/IPv4/IPv4Endpoint.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/Paths.h"
+#include "HAL/ThreadHeartBeat.h"
+
+// the only thread exposed to the client, coroutines are shown as part of the stack of the paused one
+static const int32 LuaDebugServerThreadId = 1;
+static const int32 LuaDebugServerMaxTableEntries = 1000;
+
+FLuaDebugServer::FLuaDebugServer(ULuaState* InLuaState)
+	: LuaState(InLuaState)
+	, ListenSocket(nullptr)
+	, Connection(nullptr)
+	, Seq(1)
+	, LastSource(nullptr)
+	, LastChunkId(INDEX_NONE)
+	, StepMode(EStepMode::None)
+	, StepThread(nullptr)
+	, StepDepth(0)
+	, bPaused(false)
+	, PausedL(nullptr)
+	, bImmediateLineHook(false)
+	, ImmediateLineHookFrame(0)
+{
+}
+
+FLuaDebugServer::~FLuaDebugServer()
+{
+	FCoreDelegates::OnEndFrame.Remove(EndFrameHandle);
+
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (Connection)
+	{
+		Connection->Close();
+		SocketSubsystem->DestroySocket(Connection);
+	}
+	if (ListenSocket)
+	{
+		ListenSocket->Close();
+		SocketSubsystem->DestroySocket(ListenSocket);
+	}
+}
+
+bool FLuaDebugServer::Listen(const int32 Port)
+{
+	Close();
+
+	ListenSocket = FTcpSocketBuilder(TEXT("LuaMachineDebugServer"))
+		.AsReusable()
+		.AsNonBlocking()
+		.BoundToEndpoint(FIPv4Endpoint(FIPv4Address(127, 0, 0, 1), Port))
+		.Listening(1);
+
+	if (!ListenSocket)
+	{
+		return false;
+	}
+
+	EndFrameHandle = FCoreDelegates::OnEndFrame.AddRaw(this, &FLuaDebugServer::OnEndFrame);
+	return true;
+}
+
+void FLuaDebugServer::Close()
+{
+	Detach();
+
+	FCoreDelegates::OnEndFrame.Remove(EndFrameHandle);
+	EndFrameHandle.Reset();
+
+	if (ListenSocket)
+	{
+		ListenSocket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(ListenSocket);
+		ListenSocket = nullptr;
+	}
+}
+
+void FLuaDebugServer::Detach()
+{
+	if (Connection)
+	{
+		Connection->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Connection);
+		Connection = nullptr;
+	}
+
+	ReceiveBuffer.Empty();
+	Breakpoints.Empty();
+	for (FChunk& Chunk : Chunks)
+	{
+		Chunk.ClientPath.Empty();
+		Chunk.Breakpoints.Empty();
+		Chunk.bHasBreakpoints = false;
+	}
+
+	StepMode = EStepMode::None;
+	StepThread = nullptr;
+	bPaused = false;
+	bImmediateLineHook = false;
+
+	// back to no hook at all (if nothing else needs it)
+	LuaState->RefreshDebugHook();
+}
+
+void FLuaDebugServer::OnEndFrame()
+{
+	if (bImmediateLineHook && GFrameCounter > ImmediateLineHookFrame)
+	{
+		// from now on the call/return events enable the line hook only where needed
+		bImmediateLineHook = false;
+		LuaState->RefreshDebugHook();
+	}
+
+	if (!bPaused)
+	{
+		Poll();
+	}
+}
+
+int32 FLuaDebugServer::GetLuaHookMask() const
+{
+	if (!Connection)
+	{
+		return 0;
+	}
+
+	if (StepMode != EStepMode::None)
+	{
+		return LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE;
+	}
+
+	if (Breakpoints.Num() == 0)
+	{
+		return 0;
+	}
+
+	return bImmediateLineHook ? (LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE) : (LUA_MASKCALL | LUA_MASKRET);
+}
+
+bool FLuaDebugServer::Poll()
+{
+	if (!Connection)
+	{
+		bool bPendingConnection = false;
+		if (ListenSocket && ListenSocket->HasPendingConnection(bPendingConnection) && bPendingConnection)
+		{
+			Connection = ListenSocket->Accept(TEXT("LuaMachineDebugClient"));
+			if (Connection)
+			{
+				Connection->SetNonBlocking(true);
+				Seq = 1;
+			}
+		}
+		return Connection != nullptr;
+	}
+
+	uint32 PendingDataSize = 0;
+	while (Connection->HasPendingData(PendingDataSize) && PendingDataSize > 0)
+	{
+		const int32 Offset = ReceiveBuffer.Num();
+		ReceiveBuffer.AddUninitialized(PendingDataSize);
+		int32 BytesRead = 0;
+		if (!Connection->Recv(ReceiveBuffer.GetData() + Offset, (int32)PendingDataSize, BytesRead) || BytesRead <= 0)
+		{
+			Detach();
+			return false;
+		}
+		ReceiveBuffer.SetNum(Offset + BytesRead, false);
+	}
+
+	// readable without pending data means the client closed the connection
+	if (Connection->Wait(ESocketWaitConditions::WaitForRead, FTimespan::Zero()) && !(Connection->HasPendingData(PendingDataSize) && PendingDataSize > 0))
+	{
+		Detach();
+		return false;
+	}
+
+	// "Content-Length: N\r\n\r\n" followed by N bytes of utf8 json
+	while (Connection)
+	{
+		int32 HeaderEnd = INDEX_NONE;
+		for (int32 Index = 0; Index + 3 < ReceiveBuffer.Num(); Index++)
+		{
+			if (ReceiveBuffer[Index] == '\r' && ReceiveBuffer[Index + 1] == '\n' && ReceiveBuffer[Index + 2] == '\r' && ReceiveBuffer[Index + 3] == '\n')
+			{
+				HeaderEnd = Index;
+				break;
+			}
+		}
+
+		if (HeaderEnd == INDEX_NONE)
+		{
+			break;
+		}
+
+		const FString Header = FString(HeaderEnd, (const ANSICHAR*)ReceiveBuffer.GetData());
+		int32 ContentLength = INDEX_NONE;
+		TArray<FString> HeaderLines;
+		Header.ParseIntoArrayLines(HeaderLines);
+		for (const FString& HeaderLine : HeaderLines)
+		{
+			FString Key;
+			FString Value;
+			if (HeaderLine.Split(TEXT(":"), &Key, &Value) && Key.TrimStartAndEnd().Equals(TEXT("Content-Length"), ESearchCase::IgnoreCase))
+			{
+				ContentLength = FCString::Atoi(*Value.TrimStartAndEnd());
+			}
+		}
+
+		if (ContentLength < 0)
+		{
+			// garbage, nothing to recover
+			Detach();
+			return false;
+		}
+
+		const int32 ContentStart = HeaderEnd + 4;
+		if (ReceiveBuffer.Num() < ContentStart + ContentLength)
+		{
+			break;
+		}
+
+		FUTF8ToTCHAR Content((const ANSICHAR*)ReceiveBuffer.GetData() + ContentStart, ContentLength);
+		const FString Json(Content.Length(), Content.Get());
+		ReceiveBuffer.RemoveAt(0, ContentStart + ContentLength, false);
+
+		TSharedPtr<FJsonObject> Message;
+		TSharedRef<TJsonReader<TCHAR>> Reader = TJsonReaderFactory<TCHAR>::Create(Json);
+		if (FJsonSerializer::Deserialize(Reader, Message) && Message.IsValid())
+		{
+			HandleMessage(Message);
+		}
+	}
+
+	return Connection != nullptr;
+}
+
+void FLuaDebugServer::SendMessage(const TSharedRef<FJsonObject>& Message)
+{
+	if (!Connection)
+	{
+		return;
+	}
+
+	Message->SetNumberField(TEXT("seq"), Seq++);
+
+	FString Json;
+	TSharedRef<TJsonWriter<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>> Writer = TJsonWriterFactory<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>::Create(&Json);
+	FJsonSerializer::Serialize(Message, Writer);
+
+	FTCHARToUTF8 Content(*Json);
+	const FString Header = FString::Printf(TEXT("Content-Length: %d\r\n\r\n"), Content.Length());
+
+	TArray<uint8> Data;
+	Data.Append((const uint8*)TCHAR_TO_ANSI(*Header), Header.Len());
+	Data.Append((const uint8*)Content.Get(), Content.Length());
+
+	// the socket is non blocking, retry for a bit before giving up on the client
+	int32 Sent = 0;
+	int32 Retries = 1000;
+	while (Sent < Data.Num())
+	{
+		int32 BytesSent = 0;
+		if (!Connection->Send(Data.GetData() + Sent, Data.Num() - Sent, BytesSent))
+		{
+			Detach();
+			return;
+		}
+		Sent += BytesSent;
+		if (BytesSent <= 0)
+		{
+			if (--Retries <= 0)
+			{
+				Detach();
+				return;
+			}
+			FPlatformProcess::Sleep(0.001f);
+		}
+	}
+}
+
+void FLuaDebugServer::SendResponse(const TSharedPtr<FJsonObject>& Request, const bool bSuccess, const TSharedPtr<FJsonObject>& Body, const FString& ErrorMessage)
+{
+	TSharedRef<FJsonObject> Response = MakeShared<FJsonObject>();
+	Response->SetStringField(TEXT("type"), TEXT("response"));
+	Response->SetNumberField(TEXT("request_seq"), Request->GetNumberField(TEXT("seq")));
+	Response->SetStringField(TEXT("command"), Request->GetStringField(TEXT("command")));
+	Response->SetBoolField(TEXT("success"), bSuccess);
+	if (!bSuccess)
+	{
+		Response->SetStringField(TEXT("message"), ErrorMessage);
+	}
+	if (Body.IsValid())
+	{
+		Response->SetObjectField(TEXT("body"), Body);
+	}
+	SendMessage(Response);
+}
+
+void FLuaDebugServer::SendEvent(const FString& EventName, const TSharedPtr<FJsonObject>& Body)
+{
+	TSharedRef<FJsonObject> Event = MakeShared<FJsonObject>();
+	Event->SetStringField(TEXT("type"), TEXT("event"));
+	Event->SetStringField(TEXT("event"), EventName);
+	if (Body.IsValid())
+	{
+		Event->SetObjectField(TEXT("body"), Body);
+	}
+	SendMessage(Event);
+}
+
+void FLuaDebugServer::HandleMessage(const TSharedPtr<FJsonObject>& Message)
+{
+	FString Type;
+	FString Command;
+	if (!Message->TryGetStringField(TEXT("type"), Type) || Type != TEXT("request") || !Message->TryGetStringField(TEXT("command"), Command))
+	{
+		return;
+	}
+
+	TSharedPtr<FJsonObject> Arguments = MakeShared<FJsonObject>();
+	const TSharedPtr<FJsonObject>* ArgumentsField = nullptr;
+	if (Message->TryGetObjectField(TEXT("arguments"), ArgumentsField))
+	{
+		Arguments = *ArgumentsField;
+	}
+
+	if (Command == TEXT("initialize"))
+	{
+		TSharedPtr<FJsonObject> Body = MakeShared<FJsonObject>();
+		Body->SetBoolField(TEXT("supportsConfigurationDoneRequest"), true);
+		SendResponse(Message, true, Body);
+		SendEvent(TEXT("initialized"));
+	}
+	else if (Command == TEXT("attach") || Command == TEXT("launch") || Command == TEXT("configurationDone") || Command == TEXT("setExceptionBreakpoints"))
+	{
+		SendResponse(Message, true);
+	}
+	else if (Command == TEXT("setBreakpoints"))
+	{
+		SetBreakpoints(Message, Arguments);
+	}
+	else if (Command == TEXT("threads"))
+	{
+		TSharedPtr<FJsonObject> Thread = MakeShared<FJsonObject>();
+		Thread->SetNumberField(TEXT("id"), LuaDebugServerThreadId);
+		Thread->SetStringField(TEXT("name"), LuaState->GetClass()->GetName());
+		TArray<TSharedPtr<FJsonValue>> Threads;
+		Threads.Add(MakeShared<FJsonValueObject>(Thread));
+
+		TSharedPtr<FJsonObject> Body = MakeShared<FJsonObject>();
+		Body->SetArrayField(TEXT("threads"), Threads);
+		SendResponse(Message, true, Body);
+	}
+	else if (Command == TEXT("stackTrace"))
+	{
+		SendResponse(Message, true, GetStackTrace());
+	}
+	else if (Command == TEXT("scopes"))
+	{
+		SendResponse(Message, true, GetScopes((int32)Arguments->GetNumberField(TEXT("frameId"))));
+	}
+	else if (Command == TEXT("variables"))
+	{
+		SendResponse(Message, true, GetVariables((int32)Arguments->GetNumberField(TEXT("variablesReference"))));
+	}
+	else if (Command == TEXT("continue"))
+	{
+		TSharedPtr<FJsonObject> Body = MakeShared<FJsonObject>();
+		Body->SetBoolField(TEXT("allThreadsContinued"), true);
+		SendResponse(Message, true, Body);
+		Resume(EStepMode::None);
+	}
+	else if (Command == TEXT("next"))
+	{
+		SendResponse(Message, true);
+		Resume(EStepMode::Over);
+	}
+	else if (Command == TEXT("stepIn"))
+	{
+		SendResponse(Message, true);
+		Resume(EStepMode::In);
+	}
+	else if (Command == TEXT("stepOut"))
+	{
+		SendResponse(Message, true);
+		Resume(EStepMode::Out);
+	}
+	else if (Command == TEXT("pause"))
+	{
+		SendResponse(Message, true);
+		// stop at the next executed line
+		if (!bPaused)
+		{
+			StepMode = EStepMode::Pause;
+			LuaState->RefreshDebugHook();
+		}
+	}
+	else if (Command == TEXT("disconnect"))
+	{
+		SendResponse(Message, true);
+		Detach();
+	}
+	else
+	{
+		SendResponse(Message, false, nullptr, FString::Printf(TEXT("unsupported command %s"), *Command));
+	}
+}
+
+FString FLuaDebugServer::NormalizePath(const FString& Path)
+{
+	FString NormalizedPath = Path;
+	if (NormalizedPath.StartsWith(TEXT("@")) || NormalizedPath.StartsWith(TEXT("=")))
+	{
+		NormalizedPath.RightChopInline(1);
+	}
+	FPaths::NormalizeFilename(NormalizedPath);
+	return NormalizedPath.ToLower();
+}
+
+void FLuaDebugServer::SetBreakpoints(const TSharedPtr<FJsonObject>& Request, const TSharedPtr<FJsonObject>& Arguments)
+{
+	const TSharedPtr<FJsonObject>* Source = nullptr;
+	FString Path;
+	if (!Arguments->TryGetObjectField(TEXT("source"), Source) || (!(*Source)->TryGetStringField(TEXT("path"), Path) && !(*Source)->TryGetStringField(TEXT("name"), Path)))
+	{
+		SendResponse(Request, false, nullptr, TEXT("missing source"));
+		return;
+	}
+
+	TArray<int32> Lines;
+	TArray<TSharedPtr<FJsonValue>> VerifiedBreakpoints;
+	const TArray<TSharedPtr<FJsonValue>>* RequestedBreakpoints = nullptr;
+	if (Arguments->TryGetArrayField(TEXT("breakpoints"), RequestedBreakpoints))
+	{
+		for (const TSharedPtr<FJsonValue>& RequestedBreakpoint : *RequestedBreakpoints)
+		{
+			const int32 Line = (int32)RequestedBreakpoint->AsObject()->GetNumberField(TEXT("line"));
+			Lines.Add(Line);
+
+			TSharedPtr<FJsonObject> Breakpoint = MakeShared<FJsonObject>();
+			Breakpoint->SetBoolField(TEXT("verified"), true);
+			Breakpoint->SetNumberField(TEXT("line"), Line);
+			VerifiedBreakpoints.Add(MakeShared<FJsonValueObject>(Breakpoint));
+		}
+	}
+
+	const FString NormalizedPath = NormalizePath(Path);
+	if (Lines.Num() > 0)
+	{
+		Breakpoints.Add(NormalizedPath, Lines);
+	}
+	else
+	{
+		Breakpoints.Remove(NormalizedPath);
+	}
+
+	for (FChunk& Chunk : Chunks)
+	{
+		ResolveBreakpoints(Chunk);
+	}
+
+	TSharedPtr<FJsonObject> Body = MakeShared<FJsonObject>();
+	Body->SetArrayField(TEXT("breakpoints"), VerifiedBreakpoints);
+	SendResponse(Request, true, Body);
+
+	// the line hook is usually enabled by the call events, but the functions already running would miss the new breakpoints
+	if (Breakpoints.Num() > 0)
+	{
+		bImmediateLineHook = true;
+		ImmediateLineHookFrame = GFrameCounter;
+		if (bPaused && PausedL)
+		{
+			// applied to the paused thread once the hook dispatch is over
+			LuaState->SetThreadOnDemandHook(PausedL, LUA_MASKLINE);
+		}
+	}
+
+	LuaState->RefreshDebugHook();
+}
+
+void FLuaDebugServer::ResolveBreakpoints(FChunk& Chunk)
+{
+	Chunk.Breakpoints.Empty();
+	Chunk.bHasBreakpoints = false;
+
+	// chunk names are usually relative (to the Content directory), while clients send absolute paths
+	const FString ChunkPath = NormalizePath(Chunk.Name);
+	for (const TPair<FString, TArray<int32>>& Pair : Breakpoints)
+	{
+		const FString& ClientPath = Pair.Key;
+		const bool bMatches = ClientPath == ChunkPath ||
+			(ClientPath.EndsWith(ChunkPath) && ClientPath[ClientPath.Len() - ChunkPath.Len() - 1] == '/') ||
+			(ChunkPath.EndsWith(ClientPath) && ChunkPath[ChunkPath.Len() - ClientPath.Len() - 1] == '/');
+		if (!bMatches)
+		{
+			continue;
+		}
+
+		Chunk.ClientPath = ClientPath;
+		for (const int32 Line : Pair.Value)
+		{
+			if (Line < 0)
+			{
+				continue;
+			}
+			if (Line >= Chunk.Breakpoints.Num())
+			{
+				Chunk.Breakpoints.Add(false, Line + 1 - Chunk.Breakpoints.Num());
+			}
+			Chunk.Breakpoints[Line] = true;
+			Chunk.bHasBreakpoints = true;
+		}
+		break;
+	}
+}
+
+int32 FLuaDebugServer::FindChunk(const char* Source)
+{
+	if (!Source)
+	{
+		return INDEX_NONE;
+	}
+
+	// the string could have been collected and its memory reused
+	if (Source == LastSource && FCStringAnsi::Strcmp(Chunks[LastChunkId].Key.GetData(), Source) == 0)
+	{
+		return LastChunkId;
+	}
+
+	int32 ChunkId = INDEX_NONE;
+	if (int32* CachedId = ChunkPointers.Find(Source))
+	{
+		if (FCStringAnsi::Strcmp(Chunks[*CachedId].Key.GetData(), Source) == 0)
+		{
+			ChunkId = *CachedId;
+		}
+	}
+
+	if (ChunkId == INDEX_NONE)
+	{
+		FString ChunkName = UTF8_TO_TCHAR(Source);
+		if (ChunkName.StartsWith(TEXT("@")) || ChunkName.StartsWith(TEXT("=")))
+		{
+			ChunkName.RightChopInline(1);
+		}
+
+		if (int32* ExistingId = ChunkIds.Find(ChunkName))
+		{
+			ChunkId = *ExistingId;
+		}
+		else
+		{
+			FChunk Chunk;
+			Chunk.Name = ChunkName;
+			Chunk.Key.Append(Source, FCStringAnsi::Strlen(Source) + 1);
+			ResolveBreakpoints(Chunk);
+			ChunkId = Chunks.Add(MoveTemp(Chunk));
+			ChunkIds.Add(ChunkName, ChunkId);
+		}
+
+		ChunkPointers.Add(Source, ChunkId);
+	}
+
+	LastSource = Source;
+	LastChunkId = ChunkId;
+	return ChunkId;
+}
+
+int32 FLuaDebugServer::GetStackDepth(lua_State* L)
+{
+	int32 Depth = 0;
+	lua_Debug ar;
+	while (lua_getstack(L, Depth, &ar) == 1)
+	{
+		Depth++;
+	}
+	return Depth;
+}
+
+bool FLuaDebugServer::ShouldStopStepping(lua_State* L) const
+{
+	switch (StepMode)
+	{
+	case EStepMode::Pause:
+	case EStepMode::In:
+		return true;
+	case EStepMode::Over:
+		return L == StepThread && GetStackDepth(L) <= StepDepth;
+	case EStepMode::Out:
+		return L == StepThread && GetStackDepth(L) < StepDepth;
+	default:
+		break;
+	}
+	return false;
+}
+
+void FLuaDebugServer::OnLuaHook(ULuaState* InLuaState, FLuaHookEvent& Event)
+{
+	const int32 EventType = Event.GetEvent();
+
+	if (EventType == LUA_HOOKLINE)
+	{
+		if (StepMode != EStepMode::None && ShouldStopStepping(Event.L))
+		{
+			EnterPausedLoop(Event.L, StepMode == EStepMode::Pause ? TEXT("pause") : TEXT("step"));
+			return;
+		}
+
+		const int32 ChunkId = FindChunk(Event.GetSource());
+		if (ChunkId != INDEX_NONE && Chunks[ChunkId].bHasBreakpoints)
+		{
+			const TBitArray<>& ChunkBreakpoints = Chunks[ChunkId].Breakpoints;
+			const int32 Line = Event.GetCurrentLine();
+			if (Line >= 0 && Line < ChunkBreakpoints.Num() && ChunkBreakpoints[Line])
+			{
+				EnterPausedLoop(Event.L, TEXT("breakpoint"));
+			}
+		}
+		return;
+	}
+
+	// while stepping the line hook is always installed, just make sure older coroutines get it too
+	if (StepMode != EStepMode::None)
+	{
+		InLuaState->SetThreadOnDemandHook(Event.L, LUA_MASKLINE);
+		return;
+	}
+
+	if (EventType == LUA_HOOKCALL || EventType == LUA_HOOKTAILCALL)
+	{
+		// C functions do not generate line events, keep the current state (changing it would restart the count hook)
+		if (Event.GetWhat()[0] == 'C')
+		{
+			return;
+		}
+
+		const int32 ChunkId = FindChunk(Event.GetSource());
+		InLuaState->SetThreadOnDemandHook(Event.L, ChunkId != INDEX_NONE && Chunks[ChunkId].bHasBreakpoints ? LUA_MASKLINE : 0);
+	}
+	else if (EventType == LUA_HOOKRET)
+	{
+		// the state depends on the function we are returning to
+		lua_Debug Caller;
+		if (lua_getstack(Event.L, 1, &Caller) != 1)
+		{
+			InLuaState->SetThreadOnDemandHook(Event.L, 0);
+			return;
+		}
+
+		lua_getinfo(Event.L, "S", &Caller);
+		if (Caller.what[0] == 'C')
+		{
+			return;
+		}
+
+		const int32 ChunkId = FindChunk(Caller.source);
+		InLuaState->SetThreadOnDemandHook(Event.L, ChunkId != INDEX_NONE && Chunks[ChunkId].bHasBreakpoints ? LUA_MASKLINE : 0);
+	}
+}
+
+void FLuaDebugServer::Resume(const EStepMode InStepMode)
+{
+	if (!bPaused)
+	{
+		return;
+	}
+
+	StepMode = InStepMode;
+	StepThread = PausedL;
+	StepDepth = GetStackDepth(PausedL);
+	bPaused = false;
+}
+
+void FLuaDebugServer::EnterPausedLoop(lua_State* L, const FString& Reason)
+{
+	StepMode = EStepMode::None;
+	bPaused = true;
+	PausedL = L;
+
+	TSharedPtr<FJsonObject> Body = MakeShared<FJsonObject>();
+	Body->SetStringField(TEXT("reason"), Reason);
+	Body->SetNumberField(TEXT("threadId"), LuaDebugServerThreadId);
+	Body->SetBoolField(TEXT("allThreadsStopped"), true);
+	SendEvent(TEXT("stopped"), Body);
+
+	const uint64 PauseStartCycles = FPlatformTime::Cycles64();
+	{
+		// the game thread is blocked on purpose
+		FSlowHeartBeatScope SuspendHeartBeat;
+		while (bPaused && Poll())
+		{
+			FPlatformProcess::Sleep(0.005f);
+		}
+	}
+
+	bPaused = false;
+	PausedL = nullptr;
+	Variables.Empty();
+
+	// the time spent paused is not charged to the watchdog and the stats
+	LuaState->ExecutionStartCycles += FPlatformTime::Cycles64() - PauseStartCycles;
+
+	// applied once the hook dispatch is over
+	LuaState->RefreshDebugHook();
+}
+
+TSharedPtr<FJsonObject> FLuaDebugServer::GetStackTrace()
+{
+	TArray<TSharedPtr<FJsonValue>> StackFrames;
+
+	if (bPaused)
+	{
+		lua_Debug ar;
+		for (int32 Level = 0; lua_getstack(PausedL, Level, &ar) == 1; Level++)
+		{
+			lua_getinfo(PausedL, "Sln", &ar);
+
+			TSharedPtr<FJsonObject> StackFrame = MakeShared<FJsonObject>();
+			StackFrame->SetNumberField(TEXT("id"), Level);
+			StackFrame->SetStringField(TEXT("name"), ar.name ? UTF8_TO_TCHAR(ar.name) : (ar.what && ar.what[0] == 'm' ? TEXT("main chunk") : TEXT("?")));
+			StackFrame->SetNumberField(TEXT("line"), FMath::Max(ar.currentline, 0));
+			StackFrame->SetNumberField(TEXT("column"), 0);
+
+			if (ar.what && ar.what[0] != 'C')
+			{
+				const int32 ChunkId = FindChunk(ar.source);
+				if (ChunkId == INDEX_NONE)
+				{
+					continue;
+				}
+				TSharedPtr<FJsonObject> Source = MakeShared<FJsonObject>();
+				Source->SetStringField(TEXT("name"), FPaths::GetCleanFilename(Chunks[ChunkId].Name));
+				FString Path = Chunks[ChunkId].ClientPath;
+				if (Path.IsEmpty())
+				{
+					const FString ContentPath = FPaths::Combine(FPaths::ProjectContentDir(), Chunks[ChunkId].Name);
+					Path = FPaths::FileExists(ContentPath) ? FPaths::ConvertRelativePathToFull(ContentPath) : Chunks[ChunkId].Name;
+				}
+				Source->SetStringField(TEXT("path"), Path);
+				StackFrame->SetObjectField(TEXT("source"), Source);
+			}
+			else
+			{
+				StackFrame->SetStringField(TEXT("presentationHint"), TEXT("subtle"));
+			}
+
+			StackFrames.Add(MakeShared<FJsonValueObject>(StackFrame));
+		}
+	}
+
+	TSharedPtr<FJsonObject> Body = MakeShared<FJsonObject>();
+	Body->SetArrayField(TEXT("stackFrames"), StackFrames);
+	Body->SetNumberField(TEXT("totalFrames"), StackFrames.Num());
+	return Body;
+}
+
+TSharedPtr<FJsonObject> FLuaDebugServer::GetScopes(const int32 FrameId)
+{
+	TArray<TSharedPtr<FJsonValue>> Scopes;
+
+	if (bPaused)
+	{
+		FVariables Locals;
+		Locals.Kind = EVariablesKind::Locals;
+		Locals.Level = FrameId;
+		TSharedPtr<FJsonObject> LocalsScope = MakeShared<FJsonObject>();
+		LocalsScope->SetStringField(TEXT("name"), TEXT("Locals"));
+		LocalsScope->SetNumberField(TEXT("variablesReference"), Variables.Add(Locals) + 1);
+		LocalsScope->SetBoolField(TEXT("expensive"), false);
+		Scopes.Add(MakeShared<FJsonValueObject>(LocalsScope));
+
+		FVariables Upvalues;
+		Upvalues.Kind = EVariablesKind::Upvalues;
+		Upvalues.Level = FrameId;
+		TSharedPtr<FJsonObject> UpvaluesScope = MakeShared<FJsonObject>();
+		UpvaluesScope->SetStringField(TEXT("name"), TEXT("Upvalues"));
+		UpvaluesScope->SetNumberField(TEXT("variablesReference"), Variables.Add(Upvalues) + 1);
+		UpvaluesScope->SetBoolField(TEXT("expensive"), false);
+		Scopes.Add(MakeShared<FJsonValueObject>(UpvaluesScope));
+	}
+
+	TSharedPtr<FJsonObject> Body = MakeShared<FJsonObject>();
+	Body->SetArrayField(TEXT("scopes"), Scopes);
+	return Body;
+}
+
+TSharedPtr<FJsonObject> FLuaDebugServer::MakeVariable(const FString& Name, const FLuaValue& Value)
+{
+	TSharedPtr<FJsonObject> Variable = MakeShared<FJsonObject>();
+	Variable->SetStringField(TEXT("name"), Name);
+
+	int32 VariablesReference = 0;
+	FString DisplayValue;
+	switch (Value.Type)
+	{
+	case ELuaValueType::String:
+		DisplayValue = FString::Printf(TEXT("\"%s\""), *Value.String);
+		break;
+	case ELuaValueType::Table:
+	{
+		FVariables Table;
+		Table.Kind = EVariablesKind::Table;
+		Table.Level = 0;
+		Table.Table = Value;
+		VariablesReference = Variables.Add(Table) + 1;
+		DisplayValue = TEXT("table");
+		break;
+	}
+	case ELuaValueType::UObject:
+		DisplayValue = Value.Object ? Value.ToString() : TEXT("nil");
+		break;
+	default:
+		DisplayValue = Value.ToString();
+		break;
+	}
+
+	Variable->SetStringField(TEXT("value"), DisplayValue);
+	Variable->SetNumberField(TEXT("variablesReference"), VariablesReference);
+	return Variable;
+}
+
+TSharedPtr<FJsonObject> FLuaDebugServer::GetVariables(const int32 VariablesReference)
+{
+	TArray<TSharedPtr<FJsonValue>> Result;
+
+	if (bPaused && Variables.IsValidIndex(VariablesReference - 1))
+	{
+		// copy it, MakeVariable() can grow the array
+		const FVariables Container = Variables[VariablesReference - 1];
+		switch (Container.Kind)
+		{
+		case EVariablesKind::Locals:
+			for (const TPair<FString, FLuaValue>& Pair : LuaState->GetLocals(PausedL, Container.Level))
+			{
+				// skip the internal ones (for loops state, temporaries...)
+				if (!Pair.Key.StartsWith(TEXT("(")))
+				{
+					Result.Add(MakeShared<FJsonValueObject>(MakeVariable(Pair.Key, Pair.Value)));
+				}
+			}
+			break;
+		case EVariablesKind::Upvalues:
+		{
+			lua_Debug ar;
+			if (lua_getstack(PausedL, Container.Level, &ar) == 1)
+			{
+				lua_getinfo(PausedL, "f", &ar);
+				int32 Index = 1;
+				const char* Name = lua_getupvalue(PausedL, -1, Index);
+				while (Name)
+				{
+					Result.Add(MakeShared<FJsonValueObject>(MakeVariable(UTF8_TO_TCHAR(Name), LuaState->ToLuaValue(-1, PausedL))));
+					lua_pop(PausedL, 1);
+					Name = lua_getupvalue(PausedL, -1, ++Index);
+				}
+				lua_pop(PausedL, 1);
+			}
+			break;
+		}
+		case EVariablesKind::Table:
+		{
+			FLuaValue Table = Container.Table;
+			LuaState->FromLuaValue(Table, nullptr, PausedL);
+			lua_pushnil(PausedL);
+			int32 NumEntries = 0;
+			while (lua_next(PausedL, -2) != 0)
+			{
+				if (NumEntries++ < LuaDebugServerMaxTableEntries)
+				{
+					const FLuaValue Key = LuaState->ToLuaValue(-2, PausedL);
+					const FString KeyName = Key.Type == ELuaValueType::String ? Key.String : FString::Printf(TEXT("[%s]"), *Key.ToString());
+					Result.Add(MakeShared<FJsonValueObject>(MakeVariable(KeyName, LuaState->ToLuaValue(-1, PausedL))));
+				}
+				lua_pop(PausedL, 1);
+			}
+			lua_pop(PausedL, 1);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	TSharedPtr<FJsonObject> Body = MakeShared<FJsonObject>();
+	Body->SetArrayField(TEXT("variables"), Result);
+	return Body;
+}
+
+#endif
@@ -0,0 +1,137 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ThirdParty/lua/lua.hpp"
+#include "LuaHookListener.h"
+#include "LuaValue.h"
+
+#if !UE_BUILD_SHIPPING
+#define LUAMACHINE_WITH_DEBUG_SERVER 1
+#else
+#define LUAMACHINE_WITH_DEBUG_SERVER 0
+#endif
+
+class ULuaState;
+
+#if LUAMACHINE_WITH_DEBUG_SERVER
+
+class FSocket;
+class FJsonObject;
+
+/*
+ * Debug Adapter Protocol server (localhost only) for a single ULuaState.
+ * Without breakpoints no hook is installed at all; with breakpoints only call/return events are installed
+ * and the line hook is enabled (per lua thread) while running a chunk with breakpoints.
+ * Everything runs on the game thread: a breakpoint blocks the hook and serves the client until resumed.
+ */
+class FLuaDebugServer : public ILuaHookListener
+{
+public:
+	FLuaDebugServer(ULuaState* InLuaState);
+	~FLuaDebugServer();
+
+	bool Listen(const int32 Port);
+	void Close();
+
+	FORCEINLINE bool IsClientConnected() const { return Connection != nullptr; }
+
+	/* ILuaHookListener */
+	virtual int32 GetLuaHookMask() const override;
+	virtual int32 GetLuaHookOnDemandMask() const override { return LUA_MASKLINE; }
+	virtual void OnLuaHook(ULuaState* InLuaState, FLuaHookEvent& Event) override;
+
+private:
+	enum class EStepMode : uint8
+	{
+		None,
+		Pause,
+		In,
+		Over,
+		Out
+	};
+
+	enum class EVariablesKind : uint8
+	{
+		Locals,
+		Upvalues,
+		Table
+	};
+
+	struct FChunk
+	{
+		FString Name;
+		TArray<ANSICHAR> Key;
+		// client side path, when a breakpoint source matched the chunk
+		FString ClientPath;
+		TBitArray<> Breakpoints;
+		bool bHasBreakpoints;
+	};
+
+	struct FVariables
+	{
+		EVariablesKind Kind;
+		int32 Level;
+		FLuaValue Table;
+	};
+
+	void OnEndFrame();
+
+	/* accept/read/dispatch, returns false when the client is gone */
+	bool Poll();
+	void Detach();
+
+	void HandleMessage(const TSharedPtr<FJsonObject>& Message);
+	void SendMessage(const TSharedRef<FJsonObject>& Message);
+	void SendResponse(const TSharedPtr<FJsonObject>& Request, const bool bSuccess, const TSharedPtr<FJsonObject>& Body = nullptr, const FString& ErrorMessage = TEXT(""));
+	void SendEvent(const FString& EventName, const TSharedPtr<FJsonObject>& Body = nullptr);
+
+	void SetBreakpoints(const TSharedPtr<FJsonObject>& Request, const TSharedPtr<FJsonObject>& Arguments);
+	void ResolveBreakpoints(FChunk& Chunk);
+	TSharedPtr<FJsonObject> GetStackTrace();
+	TSharedPtr<FJsonObject> GetScopes(const int32 FrameId);
+	TSharedPtr<FJsonObject> GetVariables(const int32 VariablesReference);
+	TSharedPtr<FJsonObject> MakeVariable(const FString& Name, const FLuaValue& Value);
+
+	void Resume(const EStepMode InStepMode);
+	void EnterPausedLoop(lua_State* L, const FString& Reason);
+	bool ShouldStopStepping(lua_State* L) const;
+	static int32 GetStackDepth(lua_State* L);
+
+	int32 FindChunk(const char* Source);
+	static FString NormalizePath(const FString& Path);
+
+	ULuaState* LuaState;
+
+	FSocket* ListenSocket;
+	FSocket* Connection;
+	TArray<uint8> ReceiveBuffer;
+	int32 Seq;
+
+	FDelegateHandle EndFrameHandle;
+
+	// normalized client path -> lines
+	TMap<FString, TArray<int32>> Breakpoints;
+
+	TArray<FChunk> Chunks;
+	TMap<FString, int32> ChunkIds;
+	TMap<const char*, int32> ChunkPointers;
+	const char* LastSource;
+	int32 LastChunkId;
+
+	EStepMode StepMode;
+	lua_State* StepThread;
+	int32 StepDepth;
+
+	bool bPaused;
+	lua_State* PausedL;
+
+	// after a setBreakpoints the line hook is global until the end of the next frame (the frames already running get no call event)
+	bool bImmediateLineHook;
+	uint64 ImmediateLineHookFrame;
+	// variablesReference - 1
+	TArray<FVariables> Variables;
+};
+
+#endif
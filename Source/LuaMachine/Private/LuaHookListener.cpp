@@ -0,0 +1,47 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaHookListener.h"
+
+const lua_Debug& FLuaHookEvent::Require(const char* What)
+{
+	char Missing[8];
+	int32 NumMissing = 0;
+	for (const char* Option = What; *Option && NumMissing < 7; Option++)
+	{
+		uint8 Field = 0;
+		switch (*Option)
+		{
+		case 'S':
+			Field = 1;
+			break;
+		case 'l':
+			Field = 2;
+			break;
+		case 'n':
+			Field = 4;
+			break;
+		case 'u':
+			Field = 8;
+			break;
+		case 't':
+			Field = 16;
+			break;
+		default:
+			continue;
+		}
+
+		if (!(FilledFields & Field))
+		{
+			Missing[NumMissing++] = *Option;
+			FilledFields |= Field;
+		}
+	}
+
+	if (NumMissing > 0)
+	{
+		Missing[NumMissing] = 0;
+		lua_getinfo(L, Missing, Debug);
+	}
+
+	return *Debug;
+}
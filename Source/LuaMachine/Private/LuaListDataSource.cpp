@@ -0,0 +1,377 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaListDataSource.h"
+#include "LuaState.h"
+#include "LuaBlueprintFunctionLibrary.h"
+#include "Components/ListView.h"
+#include "Misc/CoreDelegates.h"
+
+ULuaListItem::ULuaListItem()
+{
+	Index = 0;
+	bMaterialized = false;
+}
+
+/**
+ * @brief Returns the value of this row, reading it from the Lua array on the first access after a change.
+ */
+FLuaValue ULuaListItem::GetLuaValue()
+{
+	if (!bMaterialized)
+	{
+		ULuaListDataSource* Source = DataSource.Get();
+		if (!Source)
+		{
+			return FLuaValue();
+		}
+		CachedValue = Source->GetLuaValue(Index);
+		bMaterialized = true;
+	}
+	return CachedValue;
+}
+
+/**
+ * @brief Returns a field of this row, nil when the row is not a table.
+ *
+ * @param Name The field name.
+ */
+FLuaValue ULuaListItem::GetLuaField(const FString& Name)
+{
+	FLuaValue Value = GetLuaValue();
+	if (Value.Type != ELuaValueType::Table)
+	{
+		return FLuaValue();
+	}
+	return Value.GetField(Name);
+}
+
+/**
+ * @brief Drops the materialized value (and its Lua reference), the next access reads the row again.
+ */
+void ULuaListItem::Invalidate()
+{
+	CachedValue = FLuaValue();
+	bMaterialized = false;
+}
+
+ULuaListDataSource::ULuaListDataSource()
+{
+	NumItems = 0;
+	bAllDirty = false;
+	bLogError = true;
+}
+
+/**
+ * @brief Creates a data source for a Lua array and binds it to a list view.
+ *
+ * @param Outer Owner of the data source, keep a reference to it for as long as the list is used.
+ * @param ListView The list view to fill (can be null and bound later).
+ * @param Array The Lua array (a table with 1-based integer keys).
+ * @return ULuaListDataSource* The new data source.
+ */
+ULuaListDataSource* ULuaListDataSource::CreateLuaListDataSource(UObject* Outer, UListView* ListView, FLuaValue Array)
+{
+	ULuaListDataSource* DataSource = NewObject<ULuaListDataSource>(Outer ? Outer : GetTransientPackage());
+	DataSource->Array = Array;
+	DataSource->BindListView(ListView);
+	return DataSource;
+}
+
+/**
+ * @brief Replaces the Lua array and refreshes the list.
+ */
+void ULuaListDataSource::SetArray(FLuaValue InArray)
+{
+	if (InArray.Type != ELuaValueType::Table && !InArray.IsNil() && bLogError)
+	{
+		UE_LOG(LogLuaMachine, Error, TEXT("LuaListDataSource: the array is not a table"));
+	}
+	Array = InArray;
+	if (LuaTable.Type == ELuaValueType::Table)
+	{
+		LuaTable.SetField(TEXT("Array"), Array);
+	}
+	Refresh();
+}
+
+/**
+ * @brief Makes ListView show the rows of the Lua array.
+ */
+void ULuaListDataSource::BindListView(UListView* InListView)
+{
+	ListView = InListView;
+	Refresh();
+}
+
+/**
+ * @brief Returns the pooled item of a row, null when the row does not exist.
+ *
+ * @param Index 1-based row index.
+ */
+ULuaListItem* ULuaListDataSource::GetItem(const int32 Index) const
+{
+	if (Index < 1 || Index > NumItems)
+	{
+		return nullptr;
+	}
+	return Items[Index - 1];
+}
+
+/**
+ * @brief Reads a row from the Lua array.
+ *
+ * @param Index 1-based row index.
+ * @return FLuaValue The value of the row, nil when the array or the row do not exist.
+ */
+FLuaValue ULuaListDataSource::GetLuaValue(const int32 Index) const
+{
+	if (Array.Type != ELuaValueType::Table || Index < 1 || Index > NumItems)
+	{
+		return FLuaValue();
+	}
+
+	return ULuaBlueprintFunctionLibrary::LuaTableGetByIndex(Array, Index);
+}
+
+/**
+ * @brief Returns the raw length of the Lua array (0 when it is not a table or its LuaState is gone).
+ */
+int32 ULuaListDataSource::GetArrayLength() const
+{
+	if (Array.Type != ELuaValueType::Table)
+	{
+		return 0;
+	}
+
+	ULuaState* State = Array.LuaState.Get();
+	if (!State)
+	{
+		return 0;
+	}
+
+	FLuaValue ArrayValue = Array;
+	State->FromLuaValue(ArrayValue);
+	const int32 Length = static_cast<int32>(lua_rawlen(State->GetInternalLuaState(), -1));
+	State->Pop();
+
+	return Length;
+}
+
+/**
+ * @brief Rereads the length of the array and resizes the list.
+ *
+ * Items are allocated only for the rows never seen before, the pool is never shrunk.
+ * The materialized rows are dropped and the visible entries regenerated, pending dirty rows are discarded.
+ */
+void ULuaListDataSource::Refresh()
+{
+	NumItems = GetArrayLength();
+
+	const int32 PoolSize = Items.Num();
+	if (NumItems > PoolSize)
+	{
+		Items.Reserve(NumItems);
+		for (int32 Index = PoolSize; Index < NumItems; Index++)
+		{
+			ULuaListItem* Item = NewObject<ULuaListItem>(this);
+			Item->Index = Index + 1;
+			Item->DataSource = this;
+			Items.Add(Item);
+		}
+	}
+
+	for (int32 Index = 0; Index < PoolSize; Index++)
+	{
+		Items[Index]->Invalidate();
+	}
+
+	DirtyIndices.Empty();
+	bAllDirty = false;
+
+	if (UListView* ListViewPtr = ListView.Get())
+	{
+		TArray<UObject*> ListItems;
+		ListItems.Reserve(NumItems);
+		for (int32 Index = 0; Index < NumItems; Index++)
+		{
+			ListItems.Add(Items[Index]);
+		}
+		ListViewPtr->SetListItems(ListItems);
+		ListViewPtr->RegenerateAllEntries();
+	}
+}
+
+/**
+ * @brief Marks a row as changed, notified once at the end of the frame.
+ *
+ * @param Index 1-based row index, rows out of the list are ignored.
+ */
+void ULuaListDataSource::MarkIndexDirty(const int32 Index)
+{
+	if (Index < 1 || Index > NumItems || bAllDirty)
+	{
+		return;
+	}
+
+	DirtyIndices.Add(Index);
+	ScheduleFlush();
+}
+
+/**
+ * @brief Marks the rows First..Last (inclusive) as changed, notified once at the end of the frame.
+ */
+void ULuaListDataSource::MarkRangeDirty(const int32 First, const int32 Last)
+{
+	const int32 RangeFirst = FMath::Max(First, 1);
+	const int32 RangeLast = FMath::Min(Last, NumItems);
+	if (RangeFirst > RangeLast || bAllDirty)
+	{
+		return;
+	}
+
+	// the whole list, regenerate the visible entries instead of tracking every row
+	if (RangeFirst == 1 && RangeLast == NumItems)
+	{
+		DirtyIndices.Empty();
+		bAllDirty = true;
+	}
+	else
+	{
+		for (int32 Index = RangeFirst; Index <= RangeLast; Index++)
+		{
+			DirtyIndices.Add(Index);
+		}
+	}
+
+	ScheduleFlush();
+}
+
+void ULuaListDataSource::ScheduleFlush()
+{
+	if (!FlushHandle.IsValid())
+	{
+		FlushHandle = FCoreDelegates::OnEndFrame.AddUObject(this, &ULuaListDataSource::FlushDirtyIndices);
+	}
+}
+
+/**
+ * @brief Drops the materialized value of every dirty row and notifies it.
+ *
+ * Only the items with a bound entry widget have listeners, the others just reread the row when they become visible.
+ */
+void ULuaListDataSource::FlushDirtyIndices()
+{
+	if (FlushHandle.IsValid())
+	{
+		FCoreDelegates::OnEndFrame.Remove(FlushHandle);
+		FlushHandle.Reset();
+	}
+
+	if (bAllDirty)
+	{
+		bAllDirty = false;
+		for (int32 Index = 0; Index < NumItems; Index++)
+		{
+			Items[Index]->Invalidate();
+		}
+		if (UListView* ListViewPtr = ListView.Get())
+		{
+			ListViewPtr->RegenerateAllEntries();
+		}
+		return;
+	}
+
+	TSet<int32> IndicesToNotify = MoveTemp(DirtyIndices);
+	DirtyIndices.Reset();
+	for (const int32 Index : IndicesToNotify)
+	{
+		// the list could have been shrunk by a listener
+		if (Index > NumItems)
+		{
+			continue;
+		}
+		ULuaListItem* Item = Items[Index - 1];
+		Item->Invalidate();
+		Item->OnLuaItemChanged.Broadcast(Item);
+	}
+}
+
+/**
+ * @brief Returns the Lua table exposing Dirty/Refresh/Flush (and the Array field), created on first use.
+ */
+FLuaValue ULuaListDataSource::GetLuaTable()
+{
+	if (LuaTable.Type == ELuaValueType::Table)
+	{
+		return LuaTable;
+	}
+
+	ULuaState* State = Array.LuaState.Get();
+	if (!State)
+	{
+		if (bLogError)
+		{
+			UE_LOG(LogLuaMachine, Error, TEXT("LuaListDataSource: the array has no LuaState"));
+		}
+		return FLuaValue();
+	}
+
+	LuaTable = State->CreateLuaTable();
+	LuaTable.SetField(TEXT("Array"), Array);
+	LuaTable.SetField(TEXT("Dirty"), FLuaValue::FunctionOfObject(this, GET_FUNCTION_NAME_CHECKED(ULuaListDataSource, LuaTableDirty)));
+	LuaTable.SetField(TEXT("Refresh"), FLuaValue::FunctionOfObject(this, GET_FUNCTION_NAME_CHECKED(ULuaListDataSource, LuaTableRefresh)));
+	LuaTable.SetField(TEXT("Flush"), FLuaValue::FunctionOfObject(this, GET_FUNCTION_NAME_CHECKED(ULuaListDataSource, LuaTableFlush)));
+
+	return LuaTable;
+}
+
+/**
+ * @brief Lua entry point of list:Dirty(i) and list:Dirty(first, last).
+ */
+void ULuaListDataSource::LuaTableDirty(FLuaValue Self, FLuaValue First, FLuaValue Last)
+{
+	if (Last.IsNil())
+	{
+		MarkIndexDirty(static_cast<int32>(First.ToInteger()));
+	}
+	else
+	{
+		MarkRangeDirty(static_cast<int32>(First.ToInteger()), static_cast<int32>(Last.ToInteger()));
+	}
+}
+
+/**
+ * @brief Lua entry point of list:Refresh(), the array can be replaced with list.Array = t before calling it.
+ */
+void ULuaListDataSource::LuaTableRefresh(FLuaValue Self)
+{
+	FLuaValue NewArray = LuaTable.GetField(TEXT("Array"));
+	if (NewArray.Type == ELuaValueType::Table)
+	{
+		Array = NewArray;
+	}
+	Refresh();
+}
+
+/**
+ * @brief Lua entry point of list:Flush().
+ */
+void ULuaListDataSource::LuaTableFlush(FLuaValue Self)
+{
+	FlushDirtyIndices();
+}
+
+/**
+ * @brief Stops waiting for the end of the frame.
+ */
+void ULuaListDataSource::BeginDestroy()
+{
+	if (FlushHandle.IsValid())
+	{
+		FCoreDelegates::OnEndFrame.Remove(FlushHandle);
+		FlushHandle.Reset();
+	}
+	DirtyIndices.Empty();
+
+	Super::BeginDestroy();
+}
@@ -1,7 +1,10 @@
 // Copyright 2018-2023 - Roberto De Ioris
 
 #include "LuaMachine.h"
+#include "LuaMachineSettings.h"
 #include "LuaBlueprintFunctionLibrary.h"
+#include "LuaSharedData.h"
+#include "Misc/CoreDelegates.h"
 #if WITH_EDITOR
 #include "Editor/UnrealEd/Public/Editor.h"
 #include "Editor/PropertyEditor/Public/PropertyEditorModule.h"
@@ -27,6 +30,22 @@ void FLuaMachineModule::StartupModule()
 	FWorldDelegates::LevelAddedToWorld.AddRaw(this, &FLuaMachineModule::LuaLevelAddedToWorld);
 	FWorldDelegates::LevelRemovedFromWorld.AddRaw(this, &FLuaMachineModule::LuaLevelRemovedFromWorld);
 
+	EndFrameHandle = FCoreDelegates::OnEndFrame.AddRaw(this, &FLuaMachineModule::PublishLuaStats);
+
+	PreloadEndFrameHandle = FCoreDelegates::OnEndFrame.AddLambda([this]()
+		{
+			if (IsPreloading())
+			{
+				FinishPreloadedLuaStates();
+			}
+		});
+
+	PostEngineInitHandle = FCoreDelegates::OnPostEngineInit.AddRaw(this, &FLuaMachineModule::PreloadConfiguredLuaStates);
+}
+
+void FLuaMachineModule::PublishLuaStats()
+{
+	FLuaStateFrameStats::PublishFrameStats(GetRegisteredLuaStates());
 }
 
 void FLuaMachineModule::LuaLevelAddedToWorld(ULevel* Level, UWorld* World)
@@ -63,15 +82,21 @@ void FLuaMachineModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+	FCoreDelegates::OnEndFrame.Remove(EndFrameHandle);
+	FCoreDelegates::OnEndFrame.Remove(PreloadEndFrameHandle);
+	FCoreDelegates::OnPostEngineInit.Remove(PostEngineInitHandle);
 }
 
 void FLuaMachineModule::AddReferencedObjects(FReferenceCollector& Collector)
 {
 	Collector.AddReferencedObjects(LuaStates);
+	Collector.AddReferencedObjects(PreloadingLuaStates);
 }
 
 void FLuaMachineModule::CleanupLuaStates(bool bIsSimulating)
 {
+	FinishPreloadedLuaStates(true);
+
 	TArray<TSubclassOf<ULuaState>> LuaStatesKeys;
 	LuaStates.GetKeys(LuaStatesKeys);
 
@@ -98,6 +123,9 @@ void FLuaMachineModule::CleanupLuaStates(bool bIsSimulating)
 
 	LuaStates = PersistentLuaStates;
 	OnRegisteredLuaStatesChanged.Broadcast();
+
+	// the next session reloads the (possibly edited) json files and LuaTableAssets, persistent states keep their proxies
+	FLuaSharedData::ReleaseCache();
 }
 
 ULuaState* FLuaMachineModule::GetLuaState(TSubclassOf<ULuaState> LuaStateClass, UWorld* InWorld, bool bCheckOnly)
@@ -113,6 +141,16 @@ ULuaState* FLuaMachineModule::GetLuaState(TSubclassOf<ULuaState> LuaStateClass,
 		return nullptr;
 	}
 
+	if (PreloadingLuaStates.Contains(LuaStateClass))
+	{
+		if (bCheckOnly)
+		{
+			return nullptr;
+		}
+		// needed right now, wait for its worker
+		FinishPreloadedLuaState(LuaStateClass);
+	}
+
 	if (!LuaStates.Contains(LuaStateClass))
 	{
 		if (bCheckOnly)
@@ -143,6 +181,147 @@ TArray<ULuaState*> FLuaMachineModule::GetRegisteredLuaStates()
 	return RegisteredStates;
 }
 
+void FLuaMachineModule::PreloadLuaStates(const TArray<TSubclassOf<ULuaState>>& LuaStateClasses, UWorld* InWorld)
+{
+	if (!IsPreloading())
+	{
+		NumPreloadRequested = 0;
+		NumPreloaded = 0;
+	}
+
+	PreloadWorld = InWorld;
+
+	for (TSubclassOf<ULuaState> LuaStateClass : LuaStateClasses)
+	{
+		if (!LuaStateClass || LuaStateClass == ULuaState::StaticClass() || LuaStates.Contains(LuaStateClass) || PreloadingLuaStates.Contains(LuaStateClass))
+		{
+			continue;
+		}
+
+		ULuaState* NewLuaState = NewObject<ULuaState>((UObject*)GetTransientPackage(), LuaStateClass);
+		// disabled states are left to GetLuaState()
+		if (NewLuaState->StartAsyncInitialization())
+		{
+			PreloadingLuaStates.Add(LuaStateClass, NewLuaState);
+			NumPreloadRequested++;
+		}
+	}
+}
+
+void FLuaMachineModule::FinishPreloadedLuaStates(const bool bWait)
+{
+	TArray<TSubclassOf<ULuaState>> LuaStateClasses;
+	PreloadingLuaStates.GetKeys(LuaStateClasses);
+
+	for (TSubclassOf<ULuaState> LuaStateClass : LuaStateClasses)
+	{
+		// a previous state could have already finished this one (calling GetLuaState() from its init code)
+#if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION >= 4
+		if (TObjectPtr<ULuaState>* Preloading = PreloadingLuaStates.Find(LuaStateClass))
+#else
+		if (ULuaState** Preloading = PreloadingLuaStates.Find(LuaStateClass))
+#endif
+		{
+			if (bWait || (*Preloading)->IsAsyncInitializationReady())
+			{
+				FinishPreloadedLuaState(LuaStateClass);
+			}
+		}
+	}
+}
+
+ULuaState* FLuaMachineModule::FinishPreloadedLuaState(TSubclassOf<ULuaState> LuaStateClass)
+{
+#if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION >= 4
+	TObjectPtr<ULuaState>* Preloading = PreloadingLuaStates.Find(LuaStateClass);
+#else
+	ULuaState** Preloading = PreloadingLuaStates.Find(LuaStateClass);
+#endif
+	if (!Preloading)
+	{
+		// already finished (re-entrantly)
+		if (LuaStates.Contains(LuaStateClass))
+		{
+			return LuaStates[LuaStateClass]->GetLuaState(PreloadWorld.Get());
+		}
+		return nullptr;
+	}
+
+	ULuaState* PreloadedLuaState = *Preloading;
+	PreloadingLuaStates.Remove(LuaStateClass);
+	LuaStates.Add(LuaStateClass, PreloadedLuaState);
+	OnNewLuaState.Broadcast(PreloadedLuaState);
+	OnRegisteredLuaStatesChanged.Broadcast();
+
+	ULuaState* LuaState = PreloadedLuaState->GetLuaState(PreloadWorld.Get());
+	NumPreloaded++;
+	OnLuaStatePreloaded.Broadcast(LuaState, NumPreloaded, NumPreloadRequested);
+	return LuaState;
+}
+
+float FLuaMachineModule::GetPreloadProgress() const
+{
+	if (NumPreloadRequested == 0)
+	{
+		return 1;
+	}
+	return (float)NumPreloaded / NumPreloadRequested;
+}
+
+void FLuaMachineModule::PreloadConfiguredLuaStates()
+{
+	// states created in the editor are destroyed when PIE starts
+	if (GIsEditor || IsRunningCommandlet())
+	{
+		return;
+	}
+
+	const ULuaMachineSettings* Settings = GetDefault<ULuaMachineSettings>();
+
+	TArray<TSubclassOf<ULuaState>> LuaStateClasses;
+	for (const TSoftClassPtr<ULuaState>& LuaStateClassPtr : Settings->PreloadLuaStates)
+	{
+		if (LuaStateClassPtr.IsNull())
+		{
+			UE_LOG(LogLuaMachine, Warning, TEXT("unable to preload LuaState: empty entry in the LuaMachine settings"));
+			continue;
+		}
+
+		UClass* LuaStateClass = LuaStateClassPtr.LoadSynchronous();
+		if (!LuaStateClass)
+		{
+			UE_LOG(LogLuaMachine, Warning, TEXT("unable to preload LuaState %s: class not found"), *LuaStateClassPtr.ToString());
+			continue;
+		}
+
+		if (LuaStateClass->HasAnyClassFlags(CLASS_Abstract) || LuaStateClasses.Contains(LuaStateClass))
+		{
+			UE_LOG(LogLuaMachine, Warning, TEXT("unable to preload LuaState %s: abstract or duplicated class"), *LuaStateClassPtr.ToString());
+			continue;
+		}
+
+		LuaStateClasses.Add(LuaStateClass);
+	}
+
+	if (LuaStateClasses.Num() > 0)
+	{
+		PreloadLuaStates(LuaStateClasses, nullptr);
+	}
+}
+
+ULuaState* FLuaMachineModule::FindLuaStateByName(const FString& Name)
+{
+	for (ULuaState* LuaState : GetRegisteredLuaStates())
+	{
+		const FString ClassName = LuaState->GetClass()->GetName();
+		if (ClassName.Equals(Name, ESearchCase::IgnoreCase) || ClassName.Equals(Name + TEXT("_C"), ESearchCase::IgnoreCase))
+		{
+			return LuaState;
+		}
+	}
+	return nullptr;
+}
+
 void FLuaMachineModule::UnregisterLuaState(ULuaState* LuaState)
 {
 	TSubclassOf<ULuaState> FoundLuaStateClass = nullptr;
@@ -260,6 +439,339 @@ bool FLuaMachineModule::Exec(UWorld* InWorld, const TCHAR* Cmd, FOutputDevice& A
 		}
 	}
 
+	if (FParse::Command(&Cmd, TEXT("luaprofiler")))
+	{
+		FString Action;
+		FString StateName;
+		if (!FParse::Token(Cmd, Action, false) || !FParse::Token(Cmd, StateName, false))
+		{
+			Ar.Logf(TEXT("usage: luaprofiler <start|stop|report|save> <LuaState> [args]"));
+			return true;
+		}
+
+		ULuaState* LuaState = FindLuaStateByName(StateName);
+		if (!LuaState)
+		{
+			Ar.Logf(TEXT("LuaState %s is not registered."), *StateName);
+			return true;
+		}
+
+		FString Arg;
+		if (Action == TEXT("start"))
+		{
+			// luaprofiler start <LuaState> [InstructionCount] [IntervalSeconds]
+			int32 InstructionCount = LuaState->SamplingProfilerInstructionCount;
+			float Interval = LuaState->SamplingProfilerInterval;
+			if (FParse::Token(Cmd, Arg, false))
+			{
+				InstructionCount = FCString::Atoi(*Arg);
+				if (FParse::Token(Cmd, Arg, false))
+				{
+					Interval = FCString::Atof(*Arg);
+				}
+			}
+			LuaState->StartSamplingProfiler(InstructionCount, Interval);
+			Ar.Logf(TEXT("%s: sampling profiler started (every %d instructions)."), *StateName, InstructionCount);
+		}
+		else if (Action == TEXT("stop"))
+		{
+			LuaState->StopSamplingProfiler();
+			Ar.Logf(TEXT("%s: sampling profiler stopped."), *StateName);
+		}
+		else if (Action == TEXT("report"))
+		{
+			// luaprofiler report <LuaState> [NumEntries]
+			const int32 NumEntries = FParse::Token(Cmd, Arg, false) ? FCString::Atoi(*Arg) : 20;
+			TArray<FString> Lines;
+			LuaState->GetSamplingProfilerReport(NumEntries).ParseIntoArrayLines(Lines);
+			for (const FString& Line : Lines)
+			{
+				Ar.Log(Line);
+			}
+		}
+		else if (Action == TEXT("save"))
+		{
+			// luaprofiler save <LuaState> [Filename], defaults to Saved/Profiling/LuaMachine
+			FString Filename;
+			if (!FParse::Token(Cmd, Filename, false))
+			{
+				Filename = FPaths::Combine(FPaths::ProfilingDir(), TEXT("LuaMachine"), FString::Printf(TEXT("%s-%s.folded"), *StateName, *FDateTime::Now().ToString()));
+			}
+			if (LuaState->SaveSamplingProfilerCollapsedStacks(Filename))
+			{
+				Ar.Logf(TEXT("%s: collapsed stacks saved to %s"), *StateName, *Filename);
+			}
+			else
+			{
+				Ar.Logf(TEXT("%s: unable to save collapsed stacks to %s"), *StateName, *Filename);
+			}
+		}
+		else
+		{
+			Ar.Logf(TEXT("unknown luaprofiler action %s"), *Action);
+		}
+		return true;
+	}
+
+	if (FParse::Command(&Cmd, TEXT("luadebug")))
+	{
+		FString Action;
+		FString StateName;
+		if (!FParse::Token(Cmd, Action, false) || !FParse::Token(Cmd, StateName, false))
+		{
+			Ar.Logf(TEXT("usage: luadebug <start|stop> <LuaState> [Port]"));
+			return true;
+		}
+
+		ULuaState* LuaState = FindLuaStateByName(StateName);
+		if (!LuaState)
+		{
+			Ar.Logf(TEXT("LuaState %s is not registered."), *StateName);
+			return true;
+		}
+
+		if (Action == TEXT("start"))
+		{
+			// luadebug start <LuaState> [Port]
+			FString Arg;
+			const int32 Port = FParse::Token(Cmd, Arg, false) ? FCString::Atoi(*Arg) : LuaState->DebugServerPort;
+			if (LuaState->StartDebugServer(Port))
+			{
+				Ar.Logf(TEXT("%s: debug server listening on 127.0.0.1:%d"), *StateName, Port);
+			}
+			else
+			{
+				Ar.Logf(TEXT("%s: unable to start the debug server on port %d"), *StateName, Port);
+			}
+		}
+		else if (Action == TEXT("stop"))
+		{
+			LuaState->StopDebugServer();
+			Ar.Logf(TEXT("%s: debug server stopped."), *StateName);
+		}
+		else
+		{
+			Ar.Logf(TEXT("unknown luadebug action %s"), *Action);
+		}
+		return true;
+	}
+
+	if (FParse::Command(&Cmd, TEXT("luareload")))
+	{
+		FString StateName;
+		if (!FParse::Token(Cmd, StateName, false))
+		{
+			Ar.Logf(TEXT("usage: luareload <LuaState> [Module...]"));
+			return true;
+		}
+
+		ULuaState* LuaState = FindLuaStateByName(StateName);
+		if (!LuaState)
+		{
+			Ar.Logf(TEXT("LuaState %s is not registered."), *StateName);
+			return true;
+		}
+
+		// without modules, reload the modified ones
+		FString ModuleName;
+		bool bHasModules = false;
+		while (FParse::Token(Cmd, ModuleName, false))
+		{
+			bHasModules = true;
+			if (LuaState->ReloadModule(ModuleName))
+			{
+				Ar.Logf(TEXT("%s: module %s reloaded."), *StateName, *ModuleName);
+			}
+			else
+			{
+				Ar.Logf(TEXT("%s: unable to reload module %s."), *StateName, *ModuleName);
+			}
+		}
+
+		if (!bHasModules)
+		{
+			Ar.Logf(TEXT("%s: %d modules reloaded."), *StateName, LuaState->ReloadModifiedModules());
+		}
+		return true;
+	}
+
+	if (FParse::Command(&Cmd, TEXT("luacoverage")))
+	{
+		FString Action;
+		FString StateName;
+		if (!FParse::Token(Cmd, Action, false) || !FParse::Token(Cmd, StateName, false))
+		{
+			Ar.Logf(TEXT("usage: luacoverage <start|stop|report|save> <LuaState> [args]"));
+			return true;
+		}
+
+		ULuaState* LuaState = FindLuaStateByName(StateName);
+		if (!LuaState)
+		{
+			Ar.Logf(TEXT("LuaState %s is not registered."), *StateName);
+			return true;
+		}
+
+		FString Arg;
+		if (Action == TEXT("start"))
+		{
+			// luacoverage start <LuaState> [Filter...]
+			TArray<FString> Filters;
+			while (FParse::Token(Cmd, Arg, false))
+			{
+				Filters.Add(Arg);
+			}
+			LuaState->StartCoverage(Filters.Num() > 0 ? Filters : LuaState->CoverageFilters);
+			Ar.Logf(TEXT("%s: coverage started."), *StateName);
+		}
+		else if (Action == TEXT("stop"))
+		{
+			LuaState->StopCoverage();
+			Ar.Logf(TEXT("%s: coverage stopped."), *StateName);
+		}
+		else if (Action == TEXT("report"))
+		{
+			TArray<FString> Lines;
+			LuaState->GetCoverageSummary().ParseIntoArrayLines(Lines);
+			for (const FString& Line : Lines)
+			{
+				Ar.Log(Line);
+			}
+		}
+		else if (Action == TEXT("save"))
+		{
+			// luacoverage save <LuaState> [Filename], defaults to Saved/Profiling/LuaMachine
+			FString Filename;
+			if (!FParse::Token(Cmd, Filename, false))
+			{
+				Filename = FPaths::Combine(FPaths::ProfilingDir(), TEXT("LuaMachine"), FString::Printf(TEXT("%s-%s.lcov"), *StateName, *FDateTime::Now().ToString()));
+			}
+			if (LuaState->SaveCoverageLcov(Filename, StateName))
+			{
+				Ar.Logf(TEXT("%s: coverage saved to %s"), *StateName, *Filename);
+			}
+			else
+			{
+				Ar.Logf(TEXT("%s: unable to save coverage to %s"), *StateName, *Filename);
+			}
+		}
+		else
+		{
+			Ar.Logf(TEXT("unknown luacoverage action %s"), *Action);
+		}
+		return true;
+	}
+
+	if (FParse::Command(&Cmd, TEXT("luamemory")))
+	{
+		FString Action;
+		FString StateName;
+		if (!FParse::Token(Cmd, Action, false) || !FParse::Token(Cmd, StateName, false))
+		{
+			Ar.Logf(TEXT("usage: luamemory <start|stop|snapshot|report|diff> <LuaState> [NumEntries]"));
+			return true;
+		}
+
+		ULuaState* LuaState = FindLuaStateByName(StateName);
+		if (!LuaState)
+		{
+			Ar.Logf(TEXT("LuaState %s is not registered."), *StateName);
+			return true;
+		}
+
+		FString Arg;
+		const int32 NumEntries = FParse::Token(Cmd, Arg, false) ? FCString::Atoi(*Arg) : 20;
+
+		FString Report;
+		if (Action == TEXT("start"))
+		{
+			LuaState->StartAllocationTracking();
+			Report = FString::Printf(TEXT("%s: allocation tracking started."), *StateName);
+		}
+		else if (Action == TEXT("stop"))
+		{
+			LuaState->StopAllocationTracking();
+			Report = FString::Printf(TEXT("%s: allocation tracking stopped."), *StateName);
+		}
+		else if (Action == TEXT("snapshot"))
+		{
+			LuaState->TakeAllocationSnapshot();
+			Report = FString::Printf(TEXT("%s: allocation snapshot taken."), *StateName);
+		}
+		else if (Action == TEXT("report"))
+		{
+			Report = LuaState->GetAllocationReport(NumEntries);
+		}
+		else if (Action == TEXT("diff"))
+		{
+			Report = LuaState->GetAllocationSnapshotDiff(NumEntries);
+		}
+		else
+		{
+			Report = FString::Printf(TEXT("unknown luamemory action %s"), *Action);
+		}
+
+		TArray<FString> Lines;
+		Report.ParseIntoArrayLines(Lines);
+		for (const FString& Line : Lines)
+		{
+			Ar.Log(Line);
+		}
+		return true;
+	}
+
+	if (FParse::Command(&Cmd, TEXT("luarefs")))
+	{
+		FString Action;
+		FString StateName;
+		if (!FParse::Token(Cmd, Action, false) || !FParse::Token(Cmd, StateName, false))
+		{
+			Ar.Logf(TEXT("usage: luarefs <start|stop|snapshot|census> <LuaState> [NumEntries]"));
+			return true;
+		}
+
+		ULuaState* LuaState = FindLuaStateByName(StateName);
+		if (!LuaState)
+		{
+			Ar.Logf(TEXT("LuaState %s is not registered."), *StateName);
+			return true;
+		}
+
+		FString Report;
+		if (Action == TEXT("start"))
+		{
+			LuaState->StartRegistryTracking();
+			Report = FString::Printf(TEXT("%s: registry tracking started."), *StateName);
+		}
+		else if (Action == TEXT("stop"))
+		{
+			LuaState->StopRegistryTracking();
+			Report = FString::Printf(TEXT("%s: registry tracking stopped."), *StateName);
+		}
+		else if (Action == TEXT("snapshot"))
+		{
+			LuaState->TakeRegistrySnapshot();
+			Report = FString::Printf(TEXT("%s: registry snapshot taken."), *StateName);
+		}
+		else if (Action == TEXT("census"))
+		{
+			FString Arg;
+			Report = LuaState->GetRegistryCensus(FParse::Token(Cmd, Arg, false) ? FCString::Atoi(*Arg) : 20);
+		}
+		else
+		{
+			Report = FString::Printf(TEXT("unknown luarefs action %s"), *Action);
+		}
+
+		TArray<FString> Lines;
+		Report.ParseIntoArrayLines(Lines);
+		for (const FString& Line : Lines)
+		{
+			Ar.Log(Line);
+		}
+		return true;
+	}
+
 	return false;
 }
 
@@ -0,0 +1,210 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaMachineMemory.h"
+#include "Runtime/Launch/Resources/Version.h"
+
+FLuaStateAllocator::FLuaStateAllocator(const FString& StateName)
+	: L(nullptr)
+	, bTracking(false)
+	, bHasSnapshot(false)
+{
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	LLMTagName = FName(*FString::Printf(TEXT("LuaMachine/%s"), *StateName));
+#endif
+
+	FSite UnknownSite;
+	UnknownSite.Name = TEXT("[unknown]");
+	UnknownSite.LiveBytes = 0;
+	UnknownSite.LiveAllocations = 0;
+	UnknownSite.SnapshotBytes = 0;
+	UnknownSite.SnapshotAllocations = 0;
+	Sites.Add(UnknownSite);
+}
+
+void* FLuaStateAllocator::Alloc(void* UserData, void* Ptr, size_t OldSize, size_t NewSize)
+{
+	FLuaStateAllocator* Allocator = (FLuaStateAllocator*)UserData;
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER && ENGINE_MAJOR_VERSION > 4
+	FLLMScope LLMScope(Allocator->LLMTagName, false, ELLMTagSet::None, ELLMTracker::Default);
+#endif
+
+	if (!Allocator->bTracking)
+	{
+		if (NewSize == 0)
+		{
+			FMemory::Free(Ptr);
+			return nullptr;
+		}
+		return FMemory::Realloc(Ptr, NewSize);
+	}
+
+	return Allocator->Realloc(Ptr, NewSize);
+}
+
+void* FLuaStateAllocator::Realloc(void* Ptr, size_t NewSize)
+{
+	int32 SiteId = INDEX_NONE;
+	if (Ptr)
+	{
+		// blocks allocated before tracking was enabled are simply ignored
+		FAllocation Allocation;
+		if (Allocations.RemoveAndCopyValue(Ptr, Allocation))
+		{
+			Sites[Allocation.SiteId].LiveBytes -= Allocation.Size;
+			Sites[Allocation.SiteId].LiveAllocations--;
+			// a grown block keeps its original site
+			SiteId = Allocation.SiteId;
+		}
+	}
+
+	if (NewSize == 0)
+	{
+		FMemory::Free(Ptr);
+		return nullptr;
+	}
+
+	if (SiteId == INDEX_NONE)
+	{
+		// must be resolved before reallocating, the block could be the Lua stack itself
+		SiteId = GetCurrentSite();
+	}
+
+	void* NewPtr = FMemory::Realloc(Ptr, NewSize);
+	if (NewPtr)
+	{
+		FAllocation Allocation;
+		Allocation.SiteId = SiteId;
+		Allocation.Size = (int64)NewSize;
+		Allocations.Add(NewPtr, Allocation);
+		Sites[SiteId].LiveBytes += Allocation.Size;
+		Sites[SiteId].LiveAllocations++;
+	}
+	return NewPtr;
+}
+
+int32 FLuaStateAllocator::GetCurrentSite()
+{
+	if (!L)
+	{
+		return 0;
+	}
+
+	// attribute allocations done by C functions (string library, table constructors...) to the first Lua frame.
+	// Note: only the main thread is inspected, allocations in coroutines are reported at the resume site.
+	lua_Debug ar;
+	for (int32 Level = 0; Level < 8 && lua_getstack(L, Level, &ar) == 1; Level++)
+	{
+		lua_getinfo(L, "Sl", &ar);
+		if (ar.currentline < 0)
+		{
+			continue;
+		}
+
+		const uint64 Key = ((uint64)FCrc::StrCrc32(ar.source) << 32) | (uint32)ar.currentline;
+		if (int32* SiteId = SiteIds.Find(Key))
+		{
+			return *SiteId;
+		}
+
+		FSite Site;
+		Site.Name = FString::Printf(TEXT("%s:%d"), UTF8_TO_TCHAR(ar.short_src), ar.currentline);
+		Site.LiveBytes = 0;
+		Site.LiveAllocations = 0;
+		Site.SnapshotBytes = 0;
+		Site.SnapshotAllocations = 0;
+		const int32 NewSiteId = Sites.Add(Site);
+		SiteIds.Add(Key, NewSiteId);
+		return NewSiteId;
+	}
+
+	return 0;
+}
+
+void FLuaStateAllocator::StartTracking()
+{
+	bTracking = true;
+}
+
+void FLuaStateAllocator::StopTracking()
+{
+	bTracking = false;
+	Allocations.Empty();
+	SiteIds.Empty();
+	Sites.SetNum(1);
+	Sites[0].LiveBytes = 0;
+	Sites[0].LiveAllocations = 0;
+	Sites[0].SnapshotBytes = 0;
+	Sites[0].SnapshotAllocations = 0;
+	bHasSnapshot = false;
+}
+
+void FLuaStateAllocator::TakeSnapshot()
+{
+	for (FSite& Site : Sites)
+	{
+		Site.SnapshotBytes = Site.LiveBytes;
+		Site.SnapshotAllocations = Site.LiveAllocations;
+	}
+	bHasSnapshot = true;
+}
+
+FString FLuaStateAllocator::GetReport(const int32 Num) const
+{
+	if (!bTracking)
+	{
+		return TEXT("allocation tracking is not enabled");
+	}
+
+	TArray<const FSite*> SortedSites;
+	int64 TotalBytes = 0;
+	for (const FSite& Site : Sites)
+	{
+		TotalBytes += Site.LiveBytes;
+		if (Site.LiveAllocations > 0)
+		{
+			SortedSites.Add(&Site);
+		}
+	}
+
+	SortedSites.Sort([](const FSite& A, const FSite& B) { return A.LiveBytes > B.LiveBytes; });
+
+	FString Report = FString::Printf(TEXT("%lld bytes in %d tracked allocations\n"), TotalBytes, Allocations.Num());
+	Report += FString::Printf(TEXT("%12s %8s  %s\n"), TEXT("Bytes"), TEXT("Count"), TEXT("Site"));
+	for (int32 Index = 0; Index < SortedSites.Num() && (Num <= 0 || Index < Num); Index++)
+	{
+		Report += FString::Printf(TEXT("%12lld %8d  %s\n"), SortedSites[Index]->LiveBytes, SortedSites[Index]->LiveAllocations, *SortedSites[Index]->Name);
+	}
+	return Report;
+}
+
+FString FLuaStateAllocator::GetSnapshotDiff(const int32 Num) const
+{
+	if (!bHasSnapshot)
+	{
+		return TEXT("no snapshot available");
+	}
+
+	TArray<const FSite*> SortedSites;
+	int64 TotalDelta = 0;
+	for (const FSite& Site : Sites)
+	{
+		const int64 Delta = Site.LiveBytes - Site.SnapshotBytes;
+		TotalDelta += Delta;
+		if (Delta != 0 || Site.LiveAllocations != Site.SnapshotAllocations)
+		{
+			SortedSites.Add(&Site);
+		}
+	}
+
+	SortedSites.Sort([](const FSite& A, const FSite& B) { return (A.LiveBytes - A.SnapshotBytes) > (B.LiveBytes - B.SnapshotBytes); });
+
+	FString Report = FString::Printf(TEXT("%+lld bytes since last snapshot\n"), TotalDelta);
+	Report += FString::Printf(TEXT("%12s %8s %12s  %s\n"), TEXT("Delta"), TEXT("Count"), TEXT("Bytes"), TEXT("Site"));
+	for (int32 Index = 0; Index < SortedSites.Num() && (Num <= 0 || Index < Num); Index++)
+	{
+		const FSite& Site = *SortedSites[Index];
+		Report += FString::Printf(TEXT("%+12lld %+8d %12lld  %s\n"), Site.LiveBytes - Site.SnapshotBytes, Site.LiveAllocations - Site.SnapshotAllocations, Site.LiveBytes, *Site.Name);
+	}
+	return Report;
+}
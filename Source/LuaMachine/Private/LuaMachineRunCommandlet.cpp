@@ -0,0 +1,380 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaMachineRunCommandlet.h"
+#include "Async/Async.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonSerializer.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+struct FLuaMachineRunOptions
+{
+	FString Script;
+	bool bNonContentDirectory = false;
+	FString Function;
+	TArray<FString> Args;
+	int32 Iterations = 1;
+	int32 WarmUpIterations = 0;
+	bool bFullGC = false;
+};
+
+static int64 GetLuaMachineRunUsedMemory(ULuaState* LuaState)
+{
+	return (int64)LuaState->GC(LUA_GCCOUNT) * 1024 + LuaState->GC(LUA_GCCOUNTB);
+}
+
+static int32 GetLuaMachineRunExitCode(const FLuaValue& Value)
+{
+	switch (Value.Type)
+	{
+	case ELuaValueType::Integer:
+	case ELuaValueType::Number:
+		return (int32)Value.ToInteger();
+	case ELuaValueType::Bool:
+		return Value.ToBool() ? 0 : 1;
+	default:
+		return 0;
+	}
+}
+
+/* a LuaState and the results of its iterations, only Run() is called from the worker threads */
+struct FLuaMachineRunner
+{
+	ULuaState* LuaState = nullptr;
+	int32 ExitCode = 0;
+	FString Error;
+
+	TArray<double> IterationSeconds;
+	double WallSeconds = 0;
+	int64 StartMemory = 0;
+	int64 MaxMemory = 0;
+	int64 EndMemory = 0;
+	// after a full collection at the end of the run
+	int64 RetainedMemory = 0;
+	double FinalGCSeconds = 0;
+	FLuaStateFrameStats Stats;
+
+	bool Setup(UClass* StateClass, const FLuaMachineRunOptions& Options, const int32 Index, const int32 NumThreads)
+	{
+		LuaState = NewObject<ULuaState>(GetTransientPackage(), StateClass);
+		LuaState->AddToRoot();
+		if (!LuaState->GetLuaState(nullptr))
+		{
+			Error = FString::Printf(TEXT("unable to initialize %s: %s"), *StateClass->GetName(), *LuaState->LastError);
+			return false;
+		}
+
+		// same layout of the standalone interpreter, plus the thread index
+		FLuaValue Arg = LuaState->CreateLuaTable();
+		Arg.SetFieldByIndex(0, FLuaValue(Options.Script));
+		for (int32 ArgIndex = 0; ArgIndex < Options.Args.Num(); ArgIndex++)
+		{
+			Arg.SetFieldByIndex(ArgIndex + 1, FLuaValue(Options.Args[ArgIndex]));
+		}
+		Arg.SetField(TEXT("thread"), FLuaValue(Index + 1));
+		Arg.SetField(TEXT("threads"), FLuaValue(NumThreads));
+		LuaState->SetFieldFromTree(TEXT("arg"), Arg, true);
+
+		if (Options.Function.IsEmpty())
+		{
+			return true;
+		}
+
+		if (!LuaState->RunFile(Options.Script, false, 0, Options.bNonContentDirectory))
+		{
+			Error = LuaState->LastError;
+			LuaState->Pop();
+			return false;
+		}
+
+		const int32 ItemsToPop = LuaState->GetFieldFromTree(Options.Function);
+		const bool bIsFunction = LuaState->ToLuaValue(-1).Type == ELuaValueType::Function;
+		LuaState->Pop(ItemsToPop);
+		if (!bIsFunction)
+		{
+			Error = FString::Printf(TEXT("%s is not a function"), *Options.Function);
+			return false;
+		}
+		return true;
+	}
+
+	bool RunIteration(const FLuaMachineRunOptions& Options, FLuaValue& ReturnValue)
+	{
+		if (Options.Function.IsEmpty())
+		{
+			const bool bSuccess = LuaState->RunFile(Options.Script, false, 1, Options.bNonContentDirectory);
+			if (bSuccess)
+			{
+				ReturnValue = LuaState->ToLuaValue(-1);
+			}
+			// the return value or the error
+			LuaState->Pop();
+			return bSuccess;
+		}
+
+		const int32 ItemsToPop = LuaState->GetFieldFromTree(Options.Function);
+		for (const FString& Arg : Options.Args)
+		{
+			FLuaValue LuaArg(Arg);
+			LuaState->FromLuaValue(LuaArg);
+		}
+		const bool bSuccess = LuaState->Call(Options.Args.Num(), ReturnValue);
+		// the function has been replaced by the return value (or the error)
+		LuaState->Pop(ItemsToPop);
+		return bSuccess;
+	}
+
+	bool Run(const FLuaMachineRunOptions& Options)
+	{
+		const double StartSeconds = FPlatformTime::Seconds();
+		IterationSeconds.Reserve(Options.Iterations);
+
+		for (int32 Iteration = 0; Iteration < Options.WarmUpIterations + Options.Iterations; Iteration++)
+		{
+			if (Iteration == Options.WarmUpIterations)
+			{
+				LuaState->GetFrameStats().Reset();
+				StartMemory = GetLuaMachineRunUsedMemory(LuaState);
+				MaxMemory = StartMemory;
+			}
+
+			const double IterationStartSeconds = FPlatformTime::Seconds();
+			FLuaValue ReturnValue;
+			if (!RunIteration(Options, ReturnValue))
+			{
+				Error = LuaState->LastError;
+				ExitCode = 1;
+				break;
+			}
+
+			if (Options.bFullGC)
+			{
+				LuaState->GC(LUA_GCCOLLECT);
+			}
+
+			if (Iteration >= Options.WarmUpIterations)
+			{
+				IterationSeconds.Add(FPlatformTime::Seconds() - IterationStartSeconds);
+				MaxMemory = FMath::Max(MaxMemory, GetLuaMachineRunUsedMemory(LuaState));
+			}
+			ExitCode = GetLuaMachineRunExitCode(ReturnValue);
+		}
+
+		WallSeconds = FPlatformTime::Seconds() - StartSeconds;
+		Stats = LuaState->GetFrameStats();
+
+		EndMemory = GetLuaMachineRunUsedMemory(LuaState);
+		const double GCStartSeconds = FPlatformTime::Seconds();
+		LuaState->GC(LUA_GCCOLLECT);
+		FinalGCSeconds = FPlatformTime::Seconds() - GCStartSeconds;
+		RetainedMemory = GetLuaMachineRunUsedMemory(LuaState);
+
+		return Error.IsEmpty();
+	}
+
+	double GetPercentileSeconds(const float Percentile) const
+	{
+		if (IterationSeconds.Num() == 0)
+		{
+			return 0;
+		}
+		TArray<double> Sorted = IterationSeconds;
+		Sorted.Sort();
+		return Sorted[FMath::Clamp((int32)(Sorted.Num() * Percentile), 0, Sorted.Num() - 1)];
+	}
+
+	TSharedRef<FJsonObject> ToJson(const int32 Index) const
+	{
+		double TotalSeconds = 0;
+		for (const double Seconds : IterationSeconds)
+		{
+			TotalSeconds += Seconds;
+		}
+
+		TSharedRef<FJsonObject> JsonObject = MakeShared<FJsonObject>();
+		JsonObject->SetNumberField(TEXT("thread"), Index + 1);
+		JsonObject->SetNumberField(TEXT("exit_code"), ExitCode);
+		JsonObject->SetStringField(TEXT("error"), Error);
+		JsonObject->SetNumberField(TEXT("iterations"), IterationSeconds.Num());
+		JsonObject->SetNumberField(TEXT("wall_ms"), WallSeconds * 1000);
+		JsonObject->SetNumberField(TEXT("avg_ms"), IterationSeconds.Num() > 0 ? TotalSeconds * 1000 / IterationSeconds.Num() : 0);
+		JsonObject->SetNumberField(TEXT("min_ms"), GetPercentileSeconds(0) * 1000);
+		JsonObject->SetNumberField(TEXT("p50_ms"), GetPercentileSeconds(0.5f) * 1000);
+		JsonObject->SetNumberField(TEXT("p95_ms"), GetPercentileSeconds(0.95f) * 1000);
+		JsonObject->SetNumberField(TEXT("max_ms"), GetPercentileSeconds(1) * 1000);
+		JsonObject->SetNumberField(TEXT("lua_ms"), FPlatformTime::ToMilliseconds64(Stats.LuaCycles));
+		JsonObject->SetNumberField(TEXT("bridge_ms"), FPlatformTime::ToMilliseconds64(Stats.BridgeCycles));
+		JsonObject->SetNumberField(TEXT("bridge_calls"), Stats.BridgeCalls);
+		JsonObject->SetNumberField(TEXT("gc_ms"), FPlatformTime::ToMilliseconds64(Stats.GCCycles));
+		JsonObject->SetNumberField(TEXT("final_gc_ms"), FinalGCSeconds * 1000);
+		JsonObject->SetNumberField(TEXT("start_memory"), (double)StartMemory);
+		JsonObject->SetNumberField(TEXT("max_memory"), (double)MaxMemory);
+		JsonObject->SetNumberField(TEXT("end_memory"), (double)EndMemory);
+		JsonObject->SetNumberField(TEXT("retained_memory"), (double)RetainedMemory);
+		return JsonObject;
+	}
+};
+
+ULuaMachineRunCommandlet::ULuaMachineRunCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+
+	HelpDescription = TEXT("Run a Lua script in one or more LuaStates and report timing, memory and GC statistics");
+	HelpUsage = TEXT("-run=LuaMachineRun -Script=<file> [-State=<class path>] [-Function=<global>] [-Args=\"<args>\"] [-Iterations=<n>] [-WarmUp=<n>] [-Threads=<n>] [-FullGC] [-Report=<file.json>]");
+}
+
+int32 ULuaMachineRunCommandlet::Main(const FString& Params)
+{
+	FLuaMachineRunOptions Options;
+	if (!FParse::Value(*Params, TEXT("Script="), Options.Script))
+	{
+		UE_LOG(LogLuaMachine, Error, TEXT("Usage: %s"), *HelpUsage);
+		return 1;
+	}
+	// relative paths are in the Content directory, like ULuaState::RunFile()
+	Options.bNonContentDirectory = !FPaths::IsRelative(Options.Script);
+
+	UClass* StateClass = ULuaMachineRunCommandletState::StaticClass();
+	FString StatePath;
+	if (FParse::Value(*Params, TEXT("State="), StatePath))
+	{
+		StateClass = LoadClass<ULuaState>(nullptr, *StatePath);
+		if (!StateClass)
+		{
+			UE_LOG(LogLuaMachine, Error, TEXT("unable to load LuaState class %s"), *StatePath);
+			return 1;
+		}
+	}
+
+	FParse::Value(*Params, TEXT("Function="), Options.Function);
+	FString Args;
+	if (FParse::Value(*Params, TEXT("Args="), Args))
+	{
+		Args.ParseIntoArrayWS(Options.Args);
+	}
+	FParse::Value(*Params, TEXT("Iterations="), Options.Iterations);
+	FParse::Value(*Params, TEXT("WarmUp="), Options.WarmUpIterations);
+	Options.Iterations = FMath::Max(Options.Iterations, 1);
+	Options.WarmUpIterations = FMath::Max(Options.WarmUpIterations, 0);
+	Options.bFullGC = FParse::Param(*Params, TEXT("FullGC"));
+
+	int32 NumThreads = 1;
+	FParse::Value(*Params, TEXT("Threads="), NumThreads);
+	NumThreads = FMath::Max(NumThreads, 1);
+
+	// states are always initialized in the game thread
+	TArray<FLuaMachineRunner> Runners;
+	Runners.SetNum(NumThreads);
+	bool bSetupFailed = false;
+	for (int32 Index = 0; Index < NumThreads; Index++)
+	{
+		if (!Runners[Index].Setup(StateClass, Options, Index, NumThreads))
+		{
+			UE_LOG(LogLuaMachine, Error, TEXT("%s"), *Runners[Index].Error);
+			bSetupFailed = true;
+			break;
+		}
+	}
+
+	const double StartSeconds = FPlatformTime::Seconds();
+	if (!bSetupFailed)
+	{
+		if (NumThreads == 1)
+		{
+			Runners[0].Run(Options);
+		}
+		else
+		{
+			// scripts running in parallel must not access UObjects (states are fully isolated otherwise)
+			TArray<TFuture<bool>> Futures;
+			for (FLuaMachineRunner& Runner : Runners)
+			{
+				FLuaMachineRunner* RunnerPtr = &Runner;
+				Futures.Add(Async(EAsyncExecution::Thread, [RunnerPtr, &Options]() { return RunnerPtr->Run(Options); }));
+			}
+			for (TFuture<bool>& Future : Futures)
+			{
+				Future.Wait();
+			}
+		}
+	}
+	const double WallSeconds = FPlatformTime::Seconds() - StartSeconds;
+
+	int32 ExitCode = bSetupFailed ? 1 : 0;
+	int32 TotalIterations = 0;
+	TArray<TSharedPtr<FJsonValue>> JsonThreads;
+	for (int32 Index = 0; Index < Runners.Num(); Index++)
+	{
+		FLuaMachineRunner& Runner = Runners[Index];
+		if (!Runner.LuaState)
+		{
+			continue;
+		}
+
+		if (!bSetupFailed)
+		{
+			TSharedRef<FJsonObject> JsonThread = Runner.ToJson(Index);
+			JsonThreads.Add(MakeShared<FJsonValueObject>(JsonThread));
+			TotalIterations += Runner.IterationSeconds.Num();
+
+			if (!Runner.Error.IsEmpty())
+			{
+				UE_LOG(LogLuaMachine, Error, TEXT("[thread %d] %s"), Index + 1, *Runner.Error);
+			}
+			UE_LOG(LogLuaMachine, Display, TEXT("[thread %d] iterations: %d avg: %.3fms min: %.3fms p50: %.3fms p95: %.3fms max: %.3fms"),
+				Index + 1, Runner.IterationSeconds.Num(), JsonThread->GetNumberField(TEXT("avg_ms")), JsonThread->GetNumberField(TEXT("min_ms")),
+				JsonThread->GetNumberField(TEXT("p50_ms")), JsonThread->GetNumberField(TEXT("p95_ms")), JsonThread->GetNumberField(TEXT("max_ms")));
+			UE_LOG(LogLuaMachine, Display, TEXT("[thread %d] lua: %.3fms bridge: %.3fms (%u calls) gc: %.3fms final gc: %.3fms"),
+				Index + 1, JsonThread->GetNumberField(TEXT("lua_ms")), JsonThread->GetNumberField(TEXT("bridge_ms")), Runner.Stats.BridgeCalls,
+				JsonThread->GetNumberField(TEXT("gc_ms")), Runner.FinalGCSeconds * 1000);
+			UE_LOG(LogLuaMachine, Display, TEXT("[thread %d] memory start: %lldKB max: %lldKB end: %lldKB retained: %lldKB"),
+				Index + 1, Runner.StartMemory / 1024, Runner.MaxMemory / 1024, Runner.EndMemory / 1024, Runner.RetainedMemory / 1024);
+
+			if (ExitCode == 0)
+			{
+				ExitCode = Runner.ExitCode;
+			}
+		}
+
+		Runner.LuaState->RemoveFromRoot();
+#if ENGINE_MAJOR_VERSION > 4
+		Runner.LuaState->MarkAsGarbage();
+#else
+		Runner.LuaState->MarkPendingKill();
+#endif
+	}
+
+	if (!bSetupFailed)
+	{
+		UE_LOG(LogLuaMachine, Display, TEXT("%d threads, %d iterations in %.3fms (%.1f iterations/s)"),
+			NumThreads, TotalIterations, WallSeconds * 1000, WallSeconds > 0 ? TotalIterations / WallSeconds : 0);
+
+		FString ReportFilename;
+		if (FParse::Value(*Params, TEXT("Report="), ReportFilename))
+		{
+			TSharedRef<FJsonObject> JsonObject = MakeShared<FJsonObject>();
+			JsonObject->SetStringField(TEXT("script"), Options.Script);
+			JsonObject->SetStringField(TEXT("state"), StateClass->GetPathName());
+			JsonObject->SetStringField(TEXT("function"), Options.Function);
+			JsonObject->SetNumberField(TEXT("threads"), NumThreads);
+			JsonObject->SetNumberField(TEXT("iterations"), TotalIterations);
+			JsonObject->SetNumberField(TEXT("wall_ms"), WallSeconds * 1000);
+			JsonObject->SetNumberField(TEXT("exit_code"), ExitCode);
+			JsonObject->SetArrayField(TEXT("results"), JsonThreads);
+
+			FString Json;
+			TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+			FJsonSerializer::Serialize(JsonObject, Writer);
+			if (!FFileHelper::SaveStringToFile(Json, *ReportFilename))
+			{
+				UE_LOG(LogLuaMachine, Error, TEXT("unable to write report %s"), *ReportFilename);
+			}
+		}
+	}
+
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	return ExitCode;
+}
@@ -0,0 +1,10 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaMachineSettings.h"
+#include "LuaState.h"
+
+ULuaMachineSettings::ULuaMachineSettings()
+{
+	CategoryName = TEXT("Plugins");
+	SectionName = TEXT("LuaMachine");
+}
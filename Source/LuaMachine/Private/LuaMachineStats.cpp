@@ -0,0 +1,121 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaMachineStats.h"
+#include "LuaState.h"
+
+DEFINE_STAT(STAT_LuaMachine_LuaTime);
+DEFINE_STAT(STAT_LuaMachine_BridgeTime);
+DEFINE_STAT(STAT_LuaMachine_GCTime);
+DEFINE_STAT(STAT_LuaMachine_Calls);
+DEFINE_STAT(STAT_LuaMachine_BridgeCalls);
+DEFINE_STAT(STAT_LuaMachine_RegistrySize);
+DEFINE_STAT(STAT_LuaMachine_TrackedUserData);
+DEFINE_STAT(STAT_LuaMachine_UsedMemory);
+
+CSV_DEFINE_CATEGORY_MODULE(LUAMACHINE_API, LuaMachine, true);
+
+namespace LuaMachineStats
+{
+	enum EStatIndex
+	{
+		LuaTime,
+		BridgeTime,
+		GCTime,
+		Calls,
+		BridgeCalls,
+		RegistrySize,
+		TrackedUserData,
+		UsedMemory,
+		Num
+	};
+
+	static const TCHAR* Names[] =
+	{
+		TEXT("LuaTimeMs"),
+		TEXT("BridgeTimeMs"),
+		TEXT("GCTimeMs"),
+		TEXT("Calls"),
+		TEXT("BridgeCalls"),
+		TEXT("RegistrySize"),
+		TEXT("TrackedUserData"),
+		TEXT("UsedMemoryKB"),
+	};
+}
+
+void FLuaStateFrameStats::PublishFrameStats(const TArray<ULuaState*>& LuaStates)
+{
+	int64 TotalUsedMemory = 0;
+	for (ULuaState* LuaState : LuaStates)
+	{
+		if (LuaState && LuaState->GetInternalLuaState())
+		{
+			TotalUsedMemory += LuaState->GetFrameStats().Publish(LuaState);
+		}
+	}
+	SET_MEMORY_STAT(STAT_LuaMachine_UsedMemory, TotalUsedMemory);
+}
+
+int64 FLuaStateFrameStats::Publish(ULuaState* LuaState)
+{
+	lua_State* L = LuaState->GetInternalLuaState();
+
+	double Values[LuaMachineStats::Num];
+	Values[LuaMachineStats::LuaTime] = FPlatformTime::ToMilliseconds64(LuaCycles);
+	Values[LuaMachineStats::BridgeTime] = FPlatformTime::ToMilliseconds64(BridgeCycles);
+	Values[LuaMachineStats::GCTime] = FPlatformTime::ToMilliseconds64(GCCycles);
+	Values[LuaMachineStats::Calls] = Calls;
+	Values[LuaMachineStats::BridgeCalls] = BridgeCalls;
+	Values[LuaMachineStats::RegistrySize] = lua_rawlen(L, LUA_REGISTRYINDEX);
+	Values[LuaMachineStats::TrackedUserData] = LuaState->TrackedLuaUserDataObjects.Num();
+	const int64 UsedMemory = ((int64)lua_gc(L, LUA_GCCOUNT, 0) * 1024) + lua_gc(L, LUA_GCCOUNTB, 0);
+	Values[LuaMachineStats::UsedMemory] = UsedMemory / 1024.0;
+
+	if (StateName.IsEmpty())
+	{
+		StateName = LuaState->GetClass()->GetName();
+	}
+
+#if STATS
+	// group totals
+	INC_FLOAT_STAT_BY(STAT_LuaMachine_LuaTime, (float)Values[LuaMachineStats::LuaTime]);
+	INC_FLOAT_STAT_BY(STAT_LuaMachine_BridgeTime, (float)Values[LuaMachineStats::BridgeTime]);
+	INC_FLOAT_STAT_BY(STAT_LuaMachine_GCTime, (float)Values[LuaMachineStats::GCTime]);
+	INC_DWORD_STAT_BY(STAT_LuaMachine_Calls, Calls);
+	INC_DWORD_STAT_BY(STAT_LuaMachine_BridgeCalls, BridgeCalls);
+	INC_DWORD_STAT_BY(STAT_LuaMachine_RegistrySize, (uint32)Values[LuaMachineStats::RegistrySize]);
+	INC_DWORD_STAT_BY(STAT_LuaMachine_TrackedUserData, (uint32)Values[LuaMachineStats::TrackedUserData]);
+
+	// per-state counters
+	if (StatNames.Num() == 0)
+	{
+		for (int32 Index = 0; Index < LuaMachineStats::Num; Index++)
+		{
+			StatNames.Add(FDynamicStats::CreateStatIdDouble<FStatGroup_STATGROUP_LuaMachine>(FString::Printf(TEXT("%s %s"), *StateName, LuaMachineStats::Names[Index])).GetName());
+		}
+	}
+
+	for (int32 Index = 0; Index < LuaMachineStats::Num; Index++)
+	{
+		FThreadStats::AddMessage(StatNames[Index], EStatOperation::Set, Values[Index]);
+	}
+#endif
+
+#if CSV_PROFILER
+	if (CsvNames.Num() == 0)
+	{
+		for (int32 Index = 0; Index < LuaMachineStats::Num; Index++)
+		{
+			CsvNames.Add(FName(*FString::Printf(TEXT("%s/%s"), *StateName, LuaMachineStats::Names[Index])));
+		}
+	}
+
+	for (int32 Index = 0; Index < LuaMachineStats::Num; Index++)
+	{
+		FCsvProfiler::RecordCustomStat(CsvNames[Index], CSV_CATEGORY_INDEX(LuaMachine), (float)Values[Index], ECsvCustomStatOp::Set);
+	}
+#endif
+
+	Reset();
+
+	return UsedMemory;
+}
@@ -0,0 +1,146 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaMachineTrace.h"
+#include "LuaState.h"
+#if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
+#include "ProfilingDebugging/MiscTrace.h"
+#endif
+
+#if LUAMACHINE_TRACE_ENABLED
+
+UE_TRACE_CHANNEL_DEFINE(LuaMachineChannel)
+
+FLuaStateTracer::FLuaStateTracer(ULuaState* InLuaState)
+	: Depth(0)
+	, OpenEvents(0)
+	, bRegionOpen(false)
+{
+	StatePrefix = InLuaState->GetClass()->GetName() + TEXT(" ");
+	RegionName = FString::Printf(TEXT("LuaMachine %s"), *InLuaState->GetClass()->GetName());
+}
+
+uint32 FLuaStateTracer::GetFunctionSpecId(lua_State* L, lua_Debug* ar)
+{
+	// ar must be already filled with "S"
+	const TPair<uint32, int32> Key(FCrc::StrCrc32(ar->source), ar->linedefined);
+	if (uint32* SpecId = FunctionSpecIds.Find(Key))
+	{
+		return *SpecId;
+	}
+
+	FString Name;
+	if (ar->what && FCStringAnsi::Strcmp(ar->what, "main") == 0)
+	{
+		Name = StatePrefix + FString::Printf(TEXT("%s (main chunk)"), UTF8_TO_TCHAR(ar->short_src));
+	}
+	else
+	{
+		Name = StatePrefix + FString::Printf(TEXT("%s:%d"), UTF8_TO_TCHAR(ar->short_src), ar->linedefined);
+	}
+
+	const uint32 NewSpecId = FCpuProfilerTrace::OutputEventType(*Name);
+	FunctionSpecIds.Add(Key, NewSpecId);
+	return NewSpecId;
+}
+
+uint32 FLuaStateTracer::GetBridgeSpecId(UFunction* Function)
+{
+	if (uint32* SpecId = BridgeSpecIds.Find(Function))
+	{
+		return *SpecId;
+	}
+
+	const uint32 NewSpecId = FCpuProfilerTrace::OutputEventType(*(StatePrefix + TEXT("Bridge ") + Function->GetName()));
+	BridgeSpecIds.Add(Function, NewSpecId);
+	return NewSpecId;
+}
+
+uint32 FLuaStateTracer::GetSpecId(const FString& Name)
+{
+	if (uint32* SpecId = NamedSpecIds.Find(Name))
+	{
+		return *SpecId;
+	}
+
+	const uint32 NewSpecId = FCpuProfilerTrace::OutputEventType(*(StatePrefix + Name));
+	NamedSpecIds.Add(Name, NewSpecId);
+	return NewSpecId;
+}
+
+void FLuaStateTracer::OnLuaHook(ULuaState* LuaState, FLuaHookEvent& Event)
+{
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	lua_State* L = Event.L;
+	lua_Debug* ar = Event.Debug;
+	Event.Require("S");
+	// C functions are covered by the bridge events
+	if (ar->what && ar->what[0] == 'C')
+	{
+		return;
+	}
+
+	switch (Event.GetEvent())
+	{
+	case LUA_HOOKCALL:
+		FCpuProfilerTrace::OutputBeginEvent(GetFunctionSpecId(L, ar));
+		OpenEvents++;
+		break;
+	case LUA_HOOKTAILCALL:
+		// the caller frame has been replaced, no return event will be generated for it
+		if (OpenEvents > 0)
+		{
+			FCpuProfilerTrace::OutputEndEvent();
+			OpenEvents--;
+		}
+		FCpuProfilerTrace::OutputBeginEvent(GetFunctionSpecId(L, ar));
+		OpenEvents++;
+		break;
+	case LUA_HOOKRET:
+		// returns of frames entered before the channel was enabled are ignored
+		if (OpenEvents > 0)
+		{
+			FCpuProfilerTrace::OutputEndEvent();
+			OpenEvents--;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+int32 FLuaStateTracer::Enter()
+{
+	if (Depth++ == 0 && IsEnabled())
+	{
+#if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
+		TRACE_BEGIN_REGION(*RegionName);
+		bRegionOpen = true;
+#endif
+	}
+	return OpenEvents;
+}
+
+void FLuaStateTracer::Leave(const int32 OpenEventsOnEnter)
+{
+	// errors unwind the Lua stack without generating return events, and yielded coroutines
+	// leave their frames open: close them here so the timeline stays balanced
+	while (OpenEvents > OpenEventsOnEnter)
+	{
+		FCpuProfilerTrace::OutputEndEvent();
+		OpenEvents--;
+	}
+
+	if (--Depth == 0 && bRegionOpen)
+	{
+#if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
+		TRACE_END_REGION(*RegionName);
+#endif
+		bRegionOpen = false;
+	}
+}
+
+#endif
@@ -0,0 +1,96 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ThirdParty/lua/lua.hpp"
+#include "LuaHookListener.h"
+
+#if CPUPROFILERTRACE_ENABLED
+#define LUAMACHINE_TRACE_ENABLED 1
+#else
+#define LUAMACHINE_TRACE_ENABLED 0
+#endif
+
+class ULuaState;
+
+#if LUAMACHINE_TRACE_ENABLED
+
+/*
+ * LuaMachine Insights channel, disabled by default.
+ * Enable it with -trace=cpu,LuaMachine (or "trace.enable LuaMachine" at runtime).
+ */
+UE_TRACE_CHANNEL_EXTERN(LuaMachineChannel, LUAMACHINE_API)
+
+/*
+ * Per-state event type cache: every name is registered once with FCpuProfilerTrace
+ * and prefixed by the state name, so each state gets its own set of timers and its own
+ * timing region lane in Timing Insights.
+ */
+class FLuaStateTracer : public ILuaHookListener
+{
+public:
+	FLuaStateTracer(ULuaState* InLuaState);
+
+	static bool IsEnabled()
+	{
+		return UE_TRACE_CHANNELEXPR_IS_ENABLED(LuaMachineChannel | CpuChannel);
+	}
+
+	uint32 GetFunctionSpecId(lua_State* L, lua_Debug* ar);
+	uint32 GetBridgeSpecId(UFunction* Function);
+	uint32 GetSpecId(const FString& Name);
+
+	/* ILuaHookListener, call/tail call/return events only while the channel is enabled */
+	virtual int32 GetLuaHookMask() const override { return IsEnabled() ? (LUA_MASKCALL | LUA_MASKRET) : 0; }
+	virtual void OnLuaHook(ULuaState* LuaState, FLuaHookEvent& Event) override;
+
+	/* UE->Lua transitions, the outermost one opens the state timing region */
+	int32 Enter();
+	void Leave(const int32 OpenEventsOnEnter);
+
+private:
+	FString StatePrefix;
+	FString RegionName;
+
+	// keyed by source crc and line defined
+	TMap<TPair<uint32, int32>, uint32> FunctionSpecIds;
+	TMap<TWeakObjectPtr<UFunction>, uint32> BridgeSpecIds;
+	TMap<FString, uint32> NamedSpecIds;
+
+	int32 Depth;
+	int32 OpenEvents;
+	bool bRegionOpen;
+};
+
+/* begin/end pair, a zero spec id means the channel was disabled when the scope was created */
+struct FLuaMachineTraceScope
+{
+	FLuaMachineTraceScope(const uint32 InSpecId)
+		: SpecId(InSpecId)
+	{
+		if (SpecId)
+		{
+			FCpuProfilerTrace::OutputBeginEvent(SpecId);
+		}
+	}
+
+	~FLuaMachineTraceScope()
+	{
+		if (SpecId)
+		{
+			FCpuProfilerTrace::OutputEndEvent();
+		}
+	}
+
+	uint32 SpecId;
+};
+
+#define LUAMACHINE_TRACE_SCOPE(LuaState, SpecIdExpr) FLuaMachineTraceScope LuaMachineTraceScope((LuaState)->GetTracer() && FLuaStateTracer::IsEnabled() ? (LuaState)->GetTracer()->SpecIdExpr : 0)
+
+#else
+
+#define LUAMACHINE_TRACE_SCOPE(LuaState, SpecIdExpr)
+
+#endif
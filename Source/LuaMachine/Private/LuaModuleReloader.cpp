@@ -0,0 +1,490 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaModuleReloader.h"
+#include "LuaState.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+#if WITH_EDITOR
+#include "DirectoryWatcherModule.h"
+#include "IDirectoryWatcher.h"
+#endif
+
+FLuaModuleReloader::FLuaModuleReloader(ULuaState* InLuaState)
+	: LuaState(InLuaState)
+	, StartTime(FDateTime::UtcNow())
+{
+}
+
+FLuaModuleReloader::~FLuaModuleReloader()
+{
+	StopWatching();
+}
+
+void FLuaModuleReloader::RecordModuleSource(const FString& ModuleName, const FString& Filename, ULuaCode* LuaCode)
+{
+	FLuaModuleSource& Source = ModuleSources.FindOrAdd(ModuleName);
+	Source.Filename = Filename;
+	Source.LuaCode = LuaCode;
+	Source.Timestamp = Filename.IsEmpty() ? FDateTime::UtcNow() : IFileManager::Get().GetTimeStamp(*Filename);
+}
+
+void FLuaModuleReloader::ResolveModuleSources()
+{
+	lua_State* L = LuaState->L;
+	const int Top = lua_gettop(L);
+
+	lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+	const int LoadedIndex = lua_gettop(L);
+	lua_getfield(L, LoadedIndex, "package");
+	const int PackageIndex = lua_gettop(L);
+	if (!lua_istable(L, PackageIndex))
+	{
+		lua_settop(L, Top);
+		return;
+	}
+
+	lua_pushnil(L);
+	while (lua_next(L, LoadedIndex))
+	{
+		if (lua_type(L, -2) == LUA_TSTRING)
+		{
+			const FString ModuleName = UTF8_TO_TCHAR(lua_tostring(L, -2));
+			if (!ModuleSources.Contains(ModuleName))
+			{
+				lua_getfield(L, PackageIndex, "searchpath");
+				lua_pushvalue(L, -3);
+				lua_getfield(L, PackageIndex, "path");
+				if (lua_pcall(L, 2, 1, 0) == LUA_OK && lua_type(L, -1) == LUA_TSTRING)
+				{
+					// the file could have been modified after being loaded, but before being resolved
+					FLuaModuleSource& Source = ModuleSources.Add(ModuleName);
+					Source.Filename = UTF8_TO_TCHAR(lua_tostring(L, -1));
+					Source.Timestamp = StartTime;
+				}
+				lua_pop(L, 1);
+			}
+		}
+		lua_pop(L, 1);
+	}
+
+	lua_settop(L, Top);
+}
+
+bool FLuaModuleReloader::ReloadModule(const FString& ModuleName)
+{
+	lua_State* L = LuaState->L;
+	if (!L)
+	{
+		return false;
+	}
+
+	if (!ModuleSources.Contains(ModuleName))
+	{
+		ResolveModuleSources();
+		if (!ModuleSources.Contains(ModuleName))
+		{
+			LuaState->LogError(FString::Printf(TEXT("unable to reload module %s: unknown source"), *ModuleName));
+			return false;
+		}
+	}
+	// the module could require new modules, changing ModuleSources
+	const FLuaModuleSource Source = ModuleSources[ModuleName];
+
+	const int Top = lua_gettop(L);
+
+	lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+	const int LoadedIndex = lua_gettop(L);
+	lua_getfield(L, LoadedIndex, TCHAR_TO_UTF8(*ModuleName));
+	const int OldIndex = lua_gettop(L);
+	if (lua_isnil(L, OldIndex))
+	{
+		// will be loaded from scratch by the next require()
+		lua_settop(L, Top);
+		return false;
+	}
+
+	const double StartSeconds = FPlatformTime::Seconds();
+
+	bool bSuccess = false;
+	if (Source.LuaCode.IsValid())
+	{
+		bSuccess = LuaState->RunCodeAsset(Source.LuaCode.Get(), 1);
+	}
+	else if (!Source.Filename.IsEmpty())
+	{
+		bSuccess = LuaState->RunFile(Source.Filename, false, 1, true);
+	}
+	else
+	{
+		LuaState->LastError = FString::Printf(TEXT("the LuaCode asset of module %s is not available"), *ModuleName);
+		lua_pushnil(L);
+	}
+
+	if (!bSuccess)
+	{
+		// the old module is left untouched
+		LuaState->LogError(FString::Printf(TEXT("unable to reload module %s: %s"), *ModuleName, *LuaState->LastError));
+		lua_settop(L, Top);
+		return false;
+	}
+
+	const int NewIndex = lua_gettop(L);
+	// same as require()
+	if (lua_isnil(L, NewIndex))
+	{
+		lua_pushboolean(L, 1);
+		lua_replace(L, NewIndex);
+	}
+
+	// old function -> new function
+	lua_newtable(L);
+	const int FunctionsIndex = lua_gettop(L);
+	lua_newtable(L);
+	const int VisitedIndex = lua_gettop(L);
+
+	int ModuleIndex = NewIndex;
+	if (lua_istable(L, OldIndex) && lua_istable(L, NewIndex))
+	{
+		// the old table is kept, so the references to it (and its fields) survive
+		PatchTable(OldIndex, NewIndex, FunctionsIndex, VisitedIndex);
+		ModuleIndex = OldIndex;
+	}
+	else
+	{
+		if (lua_isfunction(L, OldIndex) && lua_isfunction(L, NewIndex))
+		{
+			JoinUpvalues(OldIndex, NewIndex);
+			lua_pushvalue(L, OldIndex);
+			lua_pushvalue(L, NewIndex);
+			lua_rawset(L, FunctionsIndex);
+		}
+		lua_pushvalue(L, NewIndex);
+		lua_setfield(L, LoadedIndex, TCHAR_TO_UTF8(*ModuleName));
+	}
+
+	ReplaceFunctions(FunctionsIndex);
+
+	if (!Source.Filename.IsEmpty())
+	{
+		ModuleSources[ModuleName].Timestamp = IFileManager::Get().GetTimeStamp(*Source.Filename);
+	}
+
+	LuaState->Log(FString::Printf(TEXT("module %s reloaded in %.2fms"), *ModuleName, (FPlatformTime::Seconds() - StartSeconds) * 1000));
+
+	if (lua_istable(L, ModuleIndex))
+	{
+		lua_getfield(L, ModuleIndex, "__reload");
+		if (lua_isfunction(L, -1))
+		{
+			lua_pushvalue(L, ModuleIndex);
+			FLuaValue ReturnValue;
+			if (!LuaState->Call(1, ReturnValue, 0))
+			{
+				LuaState->LogError(FString::Printf(TEXT("error in __reload of module %s: %s"), *ModuleName, *LuaState->LastError));
+			}
+		}
+	}
+
+	lua_settop(L, Top);
+
+	LuaState->ModulesReloadCount++;
+	LuaState->ReceiveLuaModuleReloaded(ModuleName);
+	return true;
+}
+
+void FLuaModuleReloader::PatchTable(const int OldIndex, const int NewIndex, const int FunctionsIndex, const int VisitedIndex)
+{
+	lua_State* L = LuaState->L;
+
+	lua_pushvalue(L, OldIndex);
+	if (lua_rawget(L, VisitedIndex) != LUA_TNIL)
+	{
+		lua_pop(L, 1);
+		return;
+	}
+	lua_pop(L, 1);
+	lua_pushvalue(L, OldIndex);
+	lua_pushboolean(L, 1);
+	lua_rawset(L, VisitedIndex);
+
+	luaL_checkstack(L, 6, "module reload");
+
+	lua_pushnil(L);
+	while (lua_next(L, NewIndex))
+	{
+		const int NewValueIndex = lua_gettop(L);
+		const int KeyIndex = NewValueIndex - 1;
+		lua_pushvalue(L, KeyIndex);
+		lua_rawget(L, OldIndex);
+		const int OldValueIndex = lua_gettop(L);
+
+		const int NewType = lua_type(L, NewValueIndex);
+		const int OldType = lua_type(L, OldValueIndex);
+
+		if (NewType == LUA_TFUNCTION && OldType == LUA_TFUNCTION)
+		{
+			JoinUpvalues(OldValueIndex, NewValueIndex);
+			lua_pushvalue(L, OldValueIndex);
+			lua_pushvalue(L, NewValueIndex);
+			lua_rawset(L, FunctionsIndex);
+		}
+
+		if (NewType == LUA_TTABLE && OldType == LUA_TTABLE)
+		{
+			PatchTable(OldValueIndex, NewValueIndex, FunctionsIndex, VisitedIndex);
+		}
+		// functions are always replaced, runtime values only added
+		else if (NewType == LUA_TFUNCTION || OldType == LUA_TNIL)
+		{
+			lua_pushvalue(L, KeyIndex);
+			lua_pushvalue(L, NewValueIndex);
+			lua_rawset(L, OldIndex);
+		}
+
+		lua_pop(L, 2);
+	}
+}
+
+void FLuaModuleReloader::JoinUpvalues(const int OldIndex, const int NewIndex)
+{
+	lua_State* L = LuaState->L;
+
+	if (lua_iscfunction(L, OldIndex) || lua_iscfunction(L, NewIndex))
+	{
+		return;
+	}
+
+	for (int NewUpvalue = 1; const char* NewName = lua_getupvalue(L, NewIndex, NewUpvalue); NewUpvalue++)
+	{
+		lua_pop(L, 1);
+		// names are not available in stripped bytecode
+		if (NewName[0] == 0 || NewName[0] == '(')
+		{
+			continue;
+		}
+
+		for (int OldUpvalue = 1; const char* OldName = lua_getupvalue(L, OldIndex, OldUpvalue); OldUpvalue++)
+		{
+			lua_pop(L, 1);
+			if (!FCStringAnsi::Strcmp(NewName, OldName))
+			{
+				lua_upvaluejoin(L, NewIndex, NewUpvalue, OldIndex, OldUpvalue);
+				break;
+			}
+		}
+	}
+}
+
+void FLuaModuleReloader::ReplaceFunctions(const int FunctionsIndex)
+{
+	lua_State* L = LuaState->L;
+
+	lua_pushnil(L);
+	if (!lua_next(L, FunctionsIndex))
+	{
+		return;
+	}
+	lua_pop(L, 2);
+
+	// breadth first visit of everything reachable from the registry
+	lua_newtable(L);
+	const int VisitedIndex = lua_gettop(L);
+	lua_newtable(L);
+	const int QueueIndex = lua_gettop(L);
+	lua_Integer Head = 1;
+	lua_Integer Tail = 0;
+
+	auto Enqueue = [L, VisitedIndex, QueueIndex, &Tail](const int Index)
+	{
+		const int Type = lua_type(L, Index);
+		if (Type != LUA_TTABLE && Type != LUA_TFUNCTION && Type != LUA_TUSERDATA)
+		{
+			return;
+		}
+		lua_pushvalue(L, Index);
+		if (lua_rawget(L, VisitedIndex) != LUA_TNIL)
+		{
+			lua_pop(L, 1);
+			return;
+		}
+		lua_pop(L, 1);
+		lua_pushvalue(L, Index);
+		lua_pushboolean(L, 1);
+		lua_rawset(L, VisitedIndex);
+		lua_pushvalue(L, Index);
+		lua_rawseti(L, QueueIndex, ++Tail);
+	};
+
+	lua_pushvalue(L, LUA_REGISTRYINDEX);
+	Enqueue(lua_gettop(L));
+	lua_pop(L, 1);
+
+	while (Head <= Tail)
+	{
+		lua_rawgeti(L, QueueIndex, Head);
+		lua_pushnil(L);
+		lua_rawseti(L, QueueIndex, Head++);
+		const int ObjectIndex = lua_gettop(L);
+
+		switch (lua_type(L, ObjectIndex))
+		{
+		case LUA_TTABLE:
+			lua_pushnil(L);
+			while (lua_next(L, ObjectIndex))
+			{
+				const int ValueIndex = lua_gettop(L);
+				lua_pushvalue(L, ValueIndex);
+				if (lua_rawget(L, FunctionsIndex) == LUA_TFUNCTION)
+				{
+					// assigning an existing field is allowed while traversing
+					lua_pushvalue(L, ValueIndex - 1);
+					lua_insert(L, -2);
+					lua_rawset(L, ObjectIndex);
+				}
+				else
+				{
+					lua_pop(L, 1);
+				}
+				Enqueue(ValueIndex - 1);
+				Enqueue(ValueIndex);
+				lua_pop(L, 1);
+			}
+			if (lua_getmetatable(L, ObjectIndex))
+			{
+				Enqueue(lua_gettop(L));
+				lua_pop(L, 1);
+			}
+			break;
+		case LUA_TFUNCTION:
+			for (int Upvalue = 1; lua_getupvalue(L, ObjectIndex, Upvalue); Upvalue++)
+			{
+				const int ValueIndex = lua_gettop(L);
+				lua_pushvalue(L, ValueIndex);
+				if (lua_rawget(L, FunctionsIndex) == LUA_TFUNCTION)
+				{
+					lua_setupvalue(L, ObjectIndex, Upvalue);
+				}
+				else
+				{
+					lua_pop(L, 1);
+				}
+				Enqueue(ValueIndex);
+				lua_pop(L, 1);
+			}
+			break;
+		case LUA_TUSERDATA:
+			if (lua_getmetatable(L, ObjectIndex))
+			{
+				Enqueue(lua_gettop(L));
+				lua_pop(L, 1);
+			}
+			lua_getuservalue(L, ObjectIndex);
+			Enqueue(lua_gettop(L));
+			lua_pop(L, 1);
+			break;
+		default:
+			break;
+		}
+
+		lua_pop(L, 1);
+	}
+
+	lua_pop(L, 2);
+}
+
+int32 FLuaModuleReloader::ReloadModifiedModules()
+{
+	if (!LuaState->L)
+	{
+		return 0;
+	}
+
+	ResolveModuleSources();
+
+	TArray<FString> ModifiedModules;
+	for (const TPair<FString, FLuaModuleSource>& Pair : ModuleSources)
+	{
+		if (!Pair.Value.Filename.IsEmpty() && IFileManager::Get().GetTimeStamp(*Pair.Value.Filename) > Pair.Value.Timestamp)
+		{
+			ModifiedModules.Add(Pair.Key);
+		}
+	}
+
+	int32 NumReloaded = 0;
+	for (const FString& ModuleName : ModifiedModules)
+	{
+		if (ReloadModule(ModuleName))
+		{
+			NumReloaded++;
+		}
+	}
+	return NumReloaded;
+}
+
+int32 FLuaModuleReloader::ReloadLuaCodeModules(ULuaCode* LuaCode)
+{
+	TArray<FString> ModuleNames;
+	for (const TPair<FString, FLuaModuleSource>& Pair : ModuleSources)
+	{
+		if (Pair.Value.LuaCode.Get() == LuaCode)
+		{
+			ModuleNames.Add(Pair.Key);
+		}
+	}
+
+	int32 NumReloaded = 0;
+	for (const FString& ModuleName : ModuleNames)
+	{
+		if (ReloadModule(ModuleName))
+		{
+			NumReloaded++;
+		}
+	}
+	return NumReloaded;
+}
+
+void FLuaModuleReloader::StartWatching()
+{
+#if WITH_EDITOR
+	if (DirectoryWatcherHandle.IsValid())
+	{
+		return;
+	}
+
+	FDirectoryWatcherModule& DirectoryWatcherModule = FModuleManager::LoadModuleChecked<FDirectoryWatcherModule>(TEXT("DirectoryWatcher"));
+	WatchedDirectory = FPaths::ConvertRelativePathToFull(FPaths::ProjectContentDir());
+	DirectoryWatcherModule.Get()->RegisterDirectoryChangedCallback_Handle(WatchedDirectory, IDirectoryWatcher::FDirectoryChanged::CreateRaw(this, &FLuaModuleReloader::OnDirectoryChanged), DirectoryWatcherHandle);
+#endif
+}
+
+void FLuaModuleReloader::StopWatching()
+{
+#if WITH_EDITOR
+	if (!DirectoryWatcherHandle.IsValid())
+	{
+		return;
+	}
+
+	// can be already unloaded on shutdown
+	if (FDirectoryWatcherModule* DirectoryWatcherModule = FModuleManager::GetModulePtr<FDirectoryWatcherModule>(TEXT("DirectoryWatcher")))
+	{
+		DirectoryWatcherModule->Get()->UnregisterDirectoryChangedCallback_Handle(WatchedDirectory, DirectoryWatcherHandle);
+	}
+	DirectoryWatcherHandle.Reset();
+#endif
+}
+
+#if WITH_EDITOR
+void FLuaModuleReloader::OnDirectoryChanged(const TArray<FFileChangeData>& FileChanges)
+{
+	// the watcher is ticked by the game thread, never while Lua is running
+	for (const FFileChangeData& FileChange : FileChanges)
+	{
+		if (FileChange.Action != FFileChangeData::FCA_Removed && FileChange.Filename.EndsWith(TEXT(".lua")))
+		{
+			ReloadModifiedModules();
+			return;
+		}
+	}
+}
+#endif
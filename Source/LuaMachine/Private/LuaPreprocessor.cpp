@@ -0,0 +1,674 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaPreprocessor.h"
+#include "Misc/CommandLine.h"
+#include "Misc/ConfigCacheIni.h"
+
+namespace LuaPreprocessor
+{
+	static bool IsIdentifierStart(const TCHAR C)
+	{
+		return FChar::IsAlpha(C) || C == '_';
+	}
+
+	static bool IsIdentifierChar(const TCHAR C)
+	{
+		return FChar::IsAlnum(C) || C == '_';
+	}
+
+	// level of the long bracket ([[, [=[, ...) starting at Index, -1 if there is none
+	static int32 GetLongBracketLevel(const FString& Code, const int32 Index)
+	{
+		if (Index >= Code.Len() || Code[Index] != '[')
+		{
+			return -1;
+		}
+
+		int32 Cursor = Index + 1;
+		while (Cursor < Code.Len() && Code[Cursor] == '=')
+		{
+			Cursor++;
+		}
+		return (Cursor < Code.Len() && Code[Cursor] == '[') ? Cursor - Index - 1 : -1;
+	}
+
+	static int32 SkipLongBracket(const FString& Code, const int32 Index, const int32 Level)
+	{
+		const FString Close = TEXT("]") + FString::ChrN(Level, '=') + TEXT("]");
+		const int32 Found = Code.Find(Close, ESearchCase::CaseSensitive, ESearchDir::FromStart, Index + Level + 2);
+		return Found == INDEX_NONE ? Code.Len() : Found + Close.Len();
+	}
+
+	static int32 SkipShortString(const FString& Code, const int32 Index)
+	{
+		const TCHAR Quote = Code[Index];
+		int32 Cursor = Index + 1;
+		while (Cursor < Code.Len())
+		{
+			const TCHAR C = Code[Cursor++];
+			if (C == '\\')
+			{
+				Cursor++;
+			}
+			else if (C == Quote || C == '\n')
+			{
+				break;
+			}
+		}
+		return FMath::Min(Cursor, Code.Len());
+	}
+
+	// the newline of a line comment is not skipped
+	static int32 SkipComment(const FString& Code, const int32 Index)
+	{
+		const int32 Level = GetLongBracketLevel(Code, Index + 2);
+		if (Level >= 0)
+		{
+			return SkipLongBracket(Code, Index + 2, Level);
+		}
+		const int32 LineEnd = Code.Find(TEXT("\n"), ESearchCase::CaseSensitive, ESearchDir::FromStart, Index);
+		return LineEnd == INDEX_NONE ? Code.Len() : LineEnd;
+	}
+
+	// index after the parenthesis closing the one at Index, INDEX_NONE if unbalanced
+	static int32 SkipParenthesis(const FString& Code, int32 Index)
+	{
+		int32 Depth = 0;
+		while (Index < Code.Len())
+		{
+			const TCHAR C = Code[Index];
+			if (C == '-' && Index + 1 < Code.Len() && Code[Index + 1] == '-')
+			{
+				Index = SkipComment(Code, Index);
+				continue;
+			}
+			if (C == '"' || C == '\'')
+			{
+				Index = SkipShortString(Code, Index);
+				continue;
+			}
+			const int32 Level = GetLongBracketLevel(Code, Index);
+			if (Level >= 0)
+			{
+				Index = SkipLongBracket(Code, Index, Level);
+				continue;
+			}
+			if (C == '(')
+			{
+				Depth++;
+			}
+			else if (C == ')' && --Depth == 0)
+			{
+				return Index + 1;
+			}
+			Index++;
+		}
+		return INDEX_NONE;
+	}
+
+	static int32 CountLines(const FString& Code, const int32 Start, const int32 End)
+	{
+		int32 Lines = 0;
+		for (int32 Index = Start; Index < End; Index++)
+		{
+			if (Code[Index] == '\n')
+			{
+				Lines++;
+			}
+		}
+		return Lines;
+	}
+
+	// a call after these tokens is part of an expression (or a definition) and cannot be removed
+	static bool IsStatementStart(const FString& LastToken)
+	{
+		static const TSet<FString> ExpressionTokens = {
+			TEXT("="), TEXT(","), TEXT("("), TEXT("["), TEXT("{"), TEXT("+"), TEXT("-"), TEXT("*"), TEXT("/"), TEXT("%"), TEXT("^"), TEXT("#"),
+			TEXT("&"), TEXT("|"), TEXT("~"), TEXT("<"), TEXT(">"), TEXT("."), TEXT(".."), TEXT(":"),
+			TEXT("return"), TEXT("local"), TEXT("function"), TEXT("and"), TEXT("or"), TEXT("not"), TEXT("if"), TEXT("elseif"),
+			TEXT("while"), TEXT("until"), TEXT("in"), TEXT("for"), TEXT("goto") };
+		return !ExpressionTokens.Contains(LastToken);
+	}
+
+	enum class EConstantUse : uint8
+	{
+		// replaced by the constant
+		Value,
+		// table constructor key or label, left untouched
+		Name,
+		// declared or assigned: shadowing a constant would change the meaning of the following uses
+		Binding,
+	};
+
+	/* how the constant name ending at End is used */
+	static EConstantUse GetConstantUse(const FString& Code, const int32 End, const FString& LastToken, const bool bDeclaration, const bool bInTableConstructor)
+	{
+		// goto DEBUG (labels are skipped as fields)
+		if (LastToken == TEXT("goto"))
+		{
+			return EConstantUse::Name;
+		}
+
+		// local DEBUG, local a, DEBUG, function DEBUG(), function f(DEBUG), for DEBUG in
+		if (bDeclaration || LastToken == TEXT("local") || LastToken == TEXT("function") || LastToken == TEXT("for"))
+		{
+			return EConstantUse::Binding;
+		}
+
+		int32 Next = End;
+		while (Next < Code.Len() && FChar::IsWhitespace(Code[Next]))
+		{
+			Next++;
+		}
+
+		if (Next >= Code.Len())
+		{
+			return EConstantUse::Value;
+		}
+
+		// DEBUG = true and {DEBUG = 1} (but not DEBUG == x)
+		if (Code[Next] == '=' && (Next + 1 >= Code.Len() || Code[Next + 1] != '='))
+		{
+			const bool bKey = bInTableConstructor && (LastToken == TEXT("{") || LastToken == TEXT(",") || LastToken == TEXT(";"));
+			return bKey ? EConstantUse::Name : EConstantUse::Binding;
+		}
+
+		// DEBUG, a = 1, 2
+		if (Code[Next] == ',' && IsStatementStart(LastToken) && !bInTableConstructor)
+		{
+			return EConstantUse::Binding;
+		}
+
+		return EConstantUse::Value;
+	}
+
+	/* evaluator of the --#if expressions: names, true, false, not, and, or and parenthesis */
+	class FExpression
+	{
+	public:
+		FExpression(const FString& Expression, const TSet<FString>& InDefines)
+			: Defines(InDefines)
+			, Index(0)
+		{
+			int32 Cursor = 0;
+			while (Cursor < Expression.Len())
+			{
+				const TCHAR C = Expression[Cursor];
+				if (FChar::IsWhitespace(C))
+				{
+					Cursor++;
+				}
+				else if (IsIdentifierChar(C))
+				{
+					const int32 Start = Cursor;
+					while (Cursor < Expression.Len() && IsIdentifierChar(Expression[Cursor]))
+					{
+						Cursor++;
+					}
+					Tokens.Add(Expression.Mid(Start, Cursor - Start));
+				}
+				else
+				{
+					Tokens.Add(FString::Chr(C));
+					Cursor++;
+				}
+			}
+		}
+
+		bool Evaluate(bool& bResult)
+		{
+			return ParseOr(bResult) && Index == Tokens.Num();
+		}
+
+	private:
+		bool ParseOr(bool& bResult)
+		{
+			if (!ParseAnd(bResult))
+			{
+				return false;
+			}
+			while (Index < Tokens.Num() && Tokens[Index] == TEXT("or"))
+			{
+				Index++;
+				bool bRight = false;
+				if (!ParseAnd(bRight))
+				{
+					return false;
+				}
+				bResult = bResult || bRight;
+			}
+			return true;
+		}
+
+		bool ParseAnd(bool& bResult)
+		{
+			if (!ParseUnary(bResult))
+			{
+				return false;
+			}
+			while (Index < Tokens.Num() && Tokens[Index] == TEXT("and"))
+			{
+				Index++;
+				bool bRight = false;
+				if (!ParseUnary(bRight))
+				{
+					return false;
+				}
+				bResult = bResult && bRight;
+			}
+			return true;
+		}
+
+		bool ParseUnary(bool& bResult)
+		{
+			if (Index >= Tokens.Num())
+			{
+				return false;
+			}
+
+			const FString& Token = Tokens[Index++];
+			if (Token == TEXT("not"))
+			{
+				if (!ParseUnary(bResult))
+				{
+					return false;
+				}
+				bResult = !bResult;
+				return true;
+			}
+
+			if (Token == TEXT("("))
+			{
+				if (!ParseOr(bResult) || Index >= Tokens.Num() || Tokens[Index] != TEXT(")"))
+				{
+					return false;
+				}
+				Index++;
+				return true;
+			}
+
+			if (Token == TEXT("true") || Token == TEXT("false"))
+			{
+				bResult = Token == TEXT("true");
+				return true;
+			}
+
+			if (IsIdentifierStart(Token[0]))
+			{
+				bResult = Defines.Contains(Token);
+				return true;
+			}
+
+			return false;
+		}
+
+		const TSet<FString>& Defines;
+		TArray<FString> Tokens;
+		int32 Index;
+	};
+
+	struct FConditional
+	{
+		int32 Line;
+		bool bParentActive;
+		bool bTaken;
+		bool bElse;
+	};
+
+	static void ParseList(const FString& Value, TArray<FString>& Items)
+	{
+		TArray<FString> Parts;
+		Value.ParseIntoArray(Parts, TEXT(","));
+		for (FString& Part : Parts)
+		{
+			Part.TrimStartAndEndInline();
+			if (!Part.IsEmpty())
+			{
+				Items.Add(Part);
+			}
+		}
+	}
+}
+
+FString FLuaPreprocessorOptions::ToString() const
+{
+	TArray<FString> SortedDefines = Defines.Array();
+	SortedDefines.Sort();
+
+	TArray<FString> SortedConstants;
+	for (const TPair<FString, FString>& Pair : Constants)
+	{
+		SortedConstants.Add(Pair.Key + TEXT("=") + Pair.Value);
+	}
+	SortedConstants.Sort();
+
+	TArray<FString> SortedFunctions = StrippedFunctions.Array();
+	SortedFunctions.Sort();
+
+	return FString::Printf(TEXT("defines:%s;constants:%s;strip:%s"), *FString::Join(SortedDefines, TEXT(",")), *FString::Join(SortedConstants, TEXT(",")), *FString::Join(SortedFunctions, TEXT(",")));
+}
+
+FLuaPreprocessorOptions FLuaPreprocessorOptions::FromCookSettings()
+{
+	TArray<FString> Defines;
+	TArray<FString> Constants;
+	TArray<FString> StrippedFunctions;
+
+	if (GConfig)
+	{
+		GConfig->GetArray(TEXT("LuaMachine"), TEXT("CookDefines"), Defines, GEngineIni);
+		GConfig->GetArray(TEXT("LuaMachine"), TEXT("CookConstants"), Constants, GEngineIni);
+		GConfig->GetArray(TEXT("LuaMachine"), TEXT("CookStrippedFunctions"), StrippedFunctions, GEngineIni);
+	}
+
+	FString Value;
+	if (FParse::Value(FCommandLine::Get(), TEXT("LuaMachineDefines="), Value, false))
+	{
+		LuaPreprocessor::ParseList(Value, Defines);
+	}
+	if (FParse::Value(FCommandLine::Get(), TEXT("LuaMachineConstants="), Value, false))
+	{
+		LuaPreprocessor::ParseList(Value, Constants);
+	}
+	if (FParse::Value(FCommandLine::Get(), TEXT("LuaMachineStripFunctions="), Value, false))
+	{
+		LuaPreprocessor::ParseList(Value, StrippedFunctions);
+	}
+
+	FLuaPreprocessorOptions Options;
+	Options.Defines.Append(Defines);
+	Options.StrippedFunctions.Append(StrippedFunctions);
+	for (const FString& Constant : Constants)
+	{
+		FString Name;
+		FString Literal;
+		if (Constant.Split(TEXT("="), &Name, &Literal))
+		{
+			Options.Constants.Add(Name.TrimStartAndEnd(), Literal.TrimStartAndEnd());
+		}
+	}
+	return Options;
+}
+
+bool FLuaPreprocessor::Process(const FString& Code, const FLuaPreprocessorOptions& Options, FString& OutCode, FString& ErrorString)
+{
+	using namespace LuaPreprocessor;
+
+	OutCode.Empty(Code.Len());
+
+	TArray<FConditional> Conditionals;
+	bool bActive = true;
+	bool bLineStart = true;
+	int32 Line = 1;
+	int32 Index = 0;
+	// previous token (excluding whitespaces and comments), used for detecting statements
+	FString LastToken;
+	// in the name list of a local or for statement
+	bool bNameList = false;
+	// after function, before the parameters
+	bool bFunctionHeader = false;
+	bool bParameters = false;
+	// open (, [ and {, for detecting the keys of table constructors
+	TArray<TCHAR> Brackets;
+
+	while (Index < Code.Len())
+	{
+		if (bLineStart)
+		{
+			bLineStart = false;
+
+			int32 LineEnd = Code.Find(TEXT("\n"), ESearchCase::CaseSensitive, ESearchDir::FromStart, Index);
+			if (LineEnd == INDEX_NONE)
+			{
+				LineEnd = Code.Len();
+			}
+
+			// other --# comments are left untouched
+			const FString LineCode = Code.Mid(Index, LineEnd - Index).TrimStartAndEnd();
+			if (LineCode.StartsWith(TEXT("--#")))
+			{
+				FString Directive = LineCode.Mid(3);
+				FString Expression;
+				int32 KeywordEnd = 0;
+				while (KeywordEnd < Directive.Len() && IsIdentifierChar(Directive[KeywordEnd]))
+				{
+					KeywordEnd++;
+				}
+				Expression = Directive.Mid(KeywordEnd);
+				Directive.LeftInline(KeywordEnd);
+
+				bool bResult = false;
+				bool bDirective = true;
+				if (Directive == TEXT("if"))
+				{
+					if (!FExpression(Expression, Options.Defines).Evaluate(bResult))
+					{
+						ErrorString = FString::Printf(TEXT("line %d: invalid --#if expression \"%s\""), Line, *Expression.TrimStartAndEnd());
+						return false;
+					}
+					Conditionals.Add({ Line, bActive, bResult, false });
+					bActive = bActive && bResult;
+				}
+				else if (Directive == TEXT("elseif") || Directive == TEXT("elif"))
+				{
+					if (Conditionals.Num() == 0 || Conditionals.Last().bElse)
+					{
+						ErrorString = FString::Printf(TEXT("line %d: unexpected --#%s"), Line, *Directive);
+						return false;
+					}
+					if (!FExpression(Expression, Options.Defines).Evaluate(bResult))
+					{
+						ErrorString = FString::Printf(TEXT("line %d: invalid --#%s expression \"%s\""), Line, *Directive, *Expression.TrimStartAndEnd());
+						return false;
+					}
+					FConditional& Conditional = Conditionals.Last();
+					bActive = Conditional.bParentActive && !Conditional.bTaken && bResult;
+					Conditional.bTaken = Conditional.bTaken || bResult;
+				}
+				else if (Directive == TEXT("else"))
+				{
+					if (Conditionals.Num() == 0 || Conditionals.Last().bElse)
+					{
+						ErrorString = FString::Printf(TEXT("line %d: unexpected --#else"), Line);
+						return false;
+					}
+					FConditional& Conditional = Conditionals.Last();
+					bActive = Conditional.bParentActive && !Conditional.bTaken;
+					Conditional.bTaken = true;
+					Conditional.bElse = true;
+				}
+				else if (Directive == TEXT("endif"))
+				{
+					if (Conditionals.Num() == 0)
+					{
+						ErrorString = FString::Printf(TEXT("line %d: unexpected --#endif"), Line);
+						return false;
+					}
+					bActive = Conditionals.Pop().bParentActive;
+				}
+				else
+				{
+					bDirective = false;
+				}
+
+				if (bDirective)
+				{
+					// the directive line is left empty
+					Index = LineEnd;
+					continue;
+				}
+			}
+
+			if (!bActive)
+			{
+				Index = LineEnd;
+				continue;
+			}
+		}
+
+		const TCHAR C = Code[Index];
+
+		if (C == '\n')
+		{
+			OutCode.AppendChar(C);
+			Line++;
+			Index++;
+			bLineStart = true;
+			continue;
+		}
+
+		if (FChar::IsWhitespace(C))
+		{
+			OutCode.AppendChar(C);
+			Index++;
+			continue;
+		}
+
+		int32 End = Index;
+		bool bComment = false;
+		if (C == '-' && Index + 1 < Code.Len() && Code[Index + 1] == '-')
+		{
+			End = SkipComment(Code, Index);
+			bComment = true;
+		}
+		else if (C == '"' || C == '\'')
+		{
+			End = SkipShortString(Code, Index);
+			LastToken = TEXT("\"");
+		}
+		else if (GetLongBracketLevel(Code, Index) >= 0)
+		{
+			End = SkipLongBracket(Code, Index, GetLongBracketLevel(Code, Index));
+			LastToken = TEXT("\"");
+		}
+		else if (FChar::IsDigit(C) || (C == '.' && Index + 1 < Code.Len() && FChar::IsDigit(Code[Index + 1])))
+		{
+			const bool bHex = C == '0' && Index + 1 < Code.Len() && FChar::ToLower(Code[Index + 1]) == 'x';
+			const TCHAR Exponent = bHex ? 'p' : 'e';
+			End = Index + 1;
+			while (End < Code.Len() && (IsIdentifierChar(Code[End]) || Code[End] == '.' ||
+				((Code[End] == '+' || Code[End] == '-') && FChar::ToLower(Code[End - 1]) == Exponent)))
+			{
+				End++;
+			}
+			LastToken = TEXT("0");
+		}
+		else if (C == '.')
+		{
+			while (End < Code.Len() && Code[End] == '.')
+			{
+				End++;
+			}
+			LastToken = Code.Mid(Index, End - Index);
+		}
+		else if (IsIdentifierStart(C))
+		{
+			while (End < Code.Len() && IsIdentifierChar(Code[End]))
+			{
+				End++;
+			}
+			const FString Identifier = Code.Mid(Index, End - Index);
+			const bool bField = LastToken == TEXT(".") || LastToken == TEXT(":");
+
+			if (!bField)
+			{
+				if (const FString* Constant = Options.Constants.Find(Identifier))
+				{
+					const bool bDeclaration = bParameters || (bNameList && LastToken == TEXT(","));
+					const bool bInTableConstructor = Brackets.Num() > 0 && Brackets.Last() == '{';
+					const EConstantUse ConstantUse = GetConstantUse(Code, End, LastToken, bDeclaration, bInTableConstructor);
+					if (ConstantUse == EConstantUse::Binding)
+					{
+						ErrorString = FString::Printf(TEXT("line %d: \"%s\" is a preprocessor constant, it cannot be declared or assigned"), Line, *Identifier);
+						return false;
+					}
+
+					if (ConstantUse == EConstantUse::Value)
+					{
+						OutCode += *Constant;
+						Index = End;
+						LastToken = TEXT("0");
+						bNameList = false;
+						bFunctionHeader = false;
+						continue;
+					}
+				}
+
+				if (Options.StrippedFunctions.Contains(Identifier) && IsStatementStart(LastToken))
+				{
+					int32 CallStart = End;
+					while (CallStart < Code.Len() && (Code[CallStart] == ' ' || Code[CallStart] == '\t'))
+					{
+						CallStart++;
+					}
+
+					const int32 CallEnd = (CallStart < Code.Len() && Code[CallStart] == '(') ? SkipParenthesis(Code, CallStart) : INDEX_NONE;
+					if (CallEnd != INDEX_NONE)
+					{
+						int32 Next = CallEnd;
+						while (Next < Code.Len() && (Code[Next] == ' ' || Code[Next] == '\t'))
+						{
+							Next++;
+						}
+
+						// the result of the call must not be used
+						if (Next >= Code.Len() || FCString::Strchr(TEXT(".:[({\"'"), Code[Next]) == nullptr)
+						{
+							for (int32 Cursor = Index; Cursor < CallEnd; Cursor++)
+							{
+								OutCode.AppendChar(Code[Cursor] == '\n' ? '\n' : ' ');
+							}
+							Line += CountLines(Code, Index, CallEnd);
+							Index = CallEnd;
+							LastToken = TEXT(")");
+							bNameList = false;
+							bFunctionHeader = false;
+							continue;
+						}
+					}
+				}
+			}
+			LastToken = Identifier;
+		}
+		else
+		{
+			End = Index + 1;
+			LastToken = FString::Chr(C);
+			if (C == '(' || C == '[' || C == '{')
+			{
+				Brackets.Add(C);
+			}
+			else if ((C == ')' || C == ']' || C == '}') && Brackets.Num() > 0)
+			{
+				Brackets.Pop();
+			}
+		}
+
+		if (!bComment)
+		{
+			const bool bName = IsIdentifierStart(LastToken[0]) && LastToken != TEXT("in");
+			bNameList = LastToken == TEXT("local") || LastToken == TEXT("for") || (bNameList && (LastToken == TEXT(",") || bName));
+			if (LastToken == TEXT("("))
+			{
+				bParameters = bFunctionHeader;
+			}
+			else if (LastToken == TEXT(")"))
+			{
+				bParameters = false;
+			}
+			bFunctionHeader = LastToken == TEXT("function") || (bFunctionHeader && (bName || LastToken == TEXT(".") || LastToken == TEXT(":")));
+		}
+
+		OutCode += Code.Mid(Index, End - Index);
+		Line += CountLines(Code, Index, End);
+		Index = End;
+	}
+
+	if (Conditionals.Num() > 0)
+	{
+		ErrorString = FString::Printf(TEXT("line %d: unterminated --#if"), Conditionals.Last().Line);
+		return false;
+	}
+
+	return true;
+}
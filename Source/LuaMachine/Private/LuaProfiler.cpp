@@ -0,0 +1,258 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaProfiler.h"
+
+FLuaSamplingProfiler::FLuaSamplingProfiler(const int32 InMaxSamples, const int32 InMaxDepth)
+	: MaxSamples(FMath::Max(InMaxSamples, 1))
+	, MaxDepth(FMath::Clamp(InMaxDepth, 1, 255))
+	, WriteIndex(0)
+	, bRunning(false)
+	, InstructionInterval(1000)
+	, TimeIntervalCycles(0)
+	, NextSampleCycles(0)
+{
+	FrameBuffer.AddZeroed(MaxSamples * MaxDepth);
+	DepthBuffer.AddZeroed(MaxSamples);
+}
+
+void FLuaSamplingProfiler::Start(const int32 InInstructionInterval, const float InTimeInterval)
+{
+	InstructionInterval = FMath::Max(InInstructionInterval, 1);
+	TimeIntervalCycles = InTimeInterval > 0 ? (uint64)(InTimeInterval / FPlatformTime::GetSecondsPerCycle64()) : 0;
+	NextSampleCycles = 0;
+	bRunning = true;
+}
+
+void FLuaSamplingProfiler::Stop()
+{
+	bRunning = false;
+}
+
+void FLuaSamplingProfiler::Reset()
+{
+	WriteIndex.store(0);
+	Frames.Empty();
+	FrameIds.Empty();
+	SourceNames.Empty();
+	SourceKeys.Empty();
+	SourcePointers.Empty();
+	SourceIds.Empty();
+}
+
+void FLuaSamplingProfiler::OnLuaHook(ULuaState* LuaState, FLuaHookEvent& Event)
+{
+	if (TimeIntervalCycles > 0)
+	{
+		const uint64 Now = FPlatformTime::Cycles64();
+		if (Now < NextSampleCycles)
+		{
+			return;
+		}
+		NextSampleCycles = Now + TimeIntervalCycles;
+	}
+
+	Sample(Event.L);
+}
+
+void FLuaSamplingProfiler::Sample(lua_State* L)
+{
+	const uint64 Index = WriteIndex.load(std::memory_order_relaxed);
+	const int32 Slot = (int32)(Index % MaxSamples);
+	uint32* SampleFrames = FrameBuffer.GetData() + (Slot * MaxDepth);
+
+	int32 Depth = 0;
+	lua_Debug ar;
+	while (Depth < MaxDepth && lua_getstack(L, Depth, &ar) == 1)
+	{
+		lua_getinfo(L, "Sl", &ar);
+		SampleFrames[Depth] = InternFrame(InternSource(ar.source), FMath::Max(ar.currentline, 0));
+		Depth++;
+	}
+
+	if (Depth == 0)
+	{
+		return;
+	}
+
+	DepthBuffer[Slot] = (uint8)Depth;
+	// publish the sample only after its frames have been written
+	WriteIndex.store(Index + 1, std::memory_order_release);
+}
+
+int32 FLuaSamplingProfiler::InternSource(const char* Source)
+{
+	if (!Source)
+	{
+		Source = "=?";
+	}
+
+	if (int32* CachedId = SourcePointers.Find(Source))
+	{
+		// the string could have been collected and its memory reused
+		if (FCStringAnsi::Strcmp(SourceKeys[*CachedId].GetData(), Source) == 0)
+		{
+			return *CachedId;
+		}
+	}
+
+	FString SourceName = UTF8_TO_TCHAR(Source);
+	int32 SourceId = INDEX_NONE;
+	if (int32* ExistingId = SourceIds.Find(SourceName))
+	{
+		SourceId = *ExistingId;
+	}
+	else
+	{
+		SourceId = SourceKeys.AddDefaulted();
+		SourceKeys[SourceId].Append(Source, FCStringAnsi::Strlen(Source) + 1);
+		SourceIds.Add(SourceName, SourceId);
+		if (SourceName.StartsWith(TEXT("@")) || SourceName.StartsWith(TEXT("=")))
+		{
+			SourceName.RightChopInline(1);
+		}
+		SourceNames.Add(SourceName);
+	}
+
+	SourcePointers.Add(Source, SourceId);
+	return SourceId;
+}
+
+uint32 FLuaSamplingProfiler::InternFrame(const int32 SourceId, const int32 Line)
+{
+	const uint64 Key = ((uint64)SourceId << 32) | (uint32)Line;
+	if (uint32* FrameId = FrameIds.Find(Key))
+	{
+		return *FrameId;
+	}
+
+	FFrame Frame;
+	Frame.SourceId = SourceId;
+	Frame.Line = Line;
+	const uint32 NewFrameId = (uint32)Frames.Add(Frame);
+	FrameIds.Add(Key, NewFrameId);
+	return NewFrameId;
+}
+
+FString FLuaSamplingProfiler::GetFrameName(const uint32 FrameId) const
+{
+	const FFrame& Frame = Frames[FrameId];
+	if (Frame.Line <= 0)
+	{
+		return SourceNames[Frame.SourceId];
+	}
+	return FString::Printf(TEXT("%s:%d"), *SourceNames[Frame.SourceId], Frame.Line);
+}
+
+template<typename Callback>
+void FLuaSamplingProfiler::ForEachSample(Callback InCallback) const
+{
+	const uint64 Written = WriteIndex.load(std::memory_order_acquire);
+	const uint64 Available = FMath::Min<uint64>(Written, (uint64)MaxSamples);
+	for (uint64 Index = Written - Available; Index < Written; Index++)
+	{
+		const int32 Slot = (int32)(Index % MaxSamples);
+		InCallback(FrameBuffer.GetData() + (Slot * MaxDepth), (int32)DepthBuffer[Slot]);
+	}
+}
+
+int32 FLuaSamplingProfiler::GetNumSamples() const
+{
+	return (int32)FMath::Min<uint64>(WriteIndex.load(std::memory_order_acquire), (uint64)MaxSamples);
+}
+
+int64 FLuaSamplingProfiler::GetNumDroppedSamples() const
+{
+	const uint64 Written = WriteIndex.load(std::memory_order_acquire);
+	return Written > (uint64)MaxSamples ? (int64)(Written - MaxSamples) : 0;
+}
+
+FString FLuaSamplingProfiler::ExportCollapsedStacks() const
+{
+	// aggregate identical stacks first, the key is the root-first list of frame ids
+	TMap<FString, int32> Stacks;
+	ForEachSample([&](const uint32* SampleFrames, const int32 Depth)
+		{
+			FString Stack;
+			for (int32 FrameIndex = Depth - 1; FrameIndex >= 0; FrameIndex--)
+			{
+				Stack += GetFrameName(SampleFrames[FrameIndex]).Replace(TEXT(";"), TEXT(":")).Replace(TEXT(" "), TEXT("_"));
+				if (FrameIndex > 0)
+				{
+					Stack += TEXT(";");
+				}
+			}
+			Stacks.FindOrAdd(Stack)++;
+		});
+
+	FString Output;
+	for (const TPair<FString, int32>& Pair : Stacks)
+	{
+		Output += FString::Printf(TEXT("%s %d\n"), *Pair.Key, Pair.Value);
+	}
+	return Output;
+}
+
+TArray<FLuaProfilerEntry> FLuaSamplingProfiler::GetTopEntries(const int32 Num) const
+{
+	TMap<uint32, FLuaProfilerEntry> Entries;
+	TSet<uint32> SeenInSample;
+	ForEachSample([&](const uint32* SampleFrames, const int32 Depth)
+		{
+			SeenInSample.Reset();
+			for (int32 FrameIndex = 0; FrameIndex < Depth; FrameIndex++)
+			{
+				const uint32 FrameId = SampleFrames[FrameIndex];
+				FLuaProfilerEntry& Entry = Entries.FindOrAdd(FrameId);
+				if (FrameIndex == 0)
+				{
+					Entry.SelfSamples++;
+				}
+				// recursive frames must be counted only once per sample
+				bool bAlreadySeen = false;
+				SeenInSample.Add(FrameId, &bAlreadySeen);
+				if (!bAlreadySeen)
+				{
+					Entry.TotalSamples++;
+				}
+			}
+		});
+
+	TArray<FLuaProfilerEntry> SortedEntries;
+	for (TPair<uint32, FLuaProfilerEntry>& Pair : Entries)
+	{
+		Pair.Value.Location = GetFrameName(Pair.Key);
+		SortedEntries.Add(Pair.Value);
+	}
+
+	SortedEntries.Sort([](const FLuaProfilerEntry& A, const FLuaProfilerEntry& B)
+		{
+			if (A.SelfSamples == B.SelfSamples)
+			{
+				return A.TotalSamples > B.TotalSamples;
+			}
+			return A.SelfSamples > B.SelfSamples;
+		});
+
+	if (Num > 0 && SortedEntries.Num() > Num)
+	{
+		SortedEntries.SetNum(Num);
+	}
+
+	return SortedEntries;
+}
+
+FString FLuaSamplingProfiler::GetTopEntriesReport(const int32 Num) const
+{
+	const int32 NumSamples = FMath::Max(GetNumSamples(), 1);
+
+	FString Report = FString::Printf(TEXT("%d samples (%lld dropped)\n"), GetNumSamples(), GetNumDroppedSamples());
+	Report += FString::Printf(TEXT("%8s %8s %8s %8s  %s\n"), TEXT("Self"), TEXT("Self%"), TEXT("Total"), TEXT("Total%"), TEXT("Location"));
+	for (const FLuaProfilerEntry& Entry : GetTopEntries(Num))
+	{
+		Report += FString::Printf(TEXT("%8d %7.2f%% %8d %7.2f%%  %s\n"),
+			Entry.SelfSamples, (Entry.SelfSamples * 100.0f) / NumSamples,
+			Entry.TotalSamples, (Entry.TotalSamples * 100.0f) / NumSamples,
+			*Entry.Location);
+	}
+	return Report;
+}
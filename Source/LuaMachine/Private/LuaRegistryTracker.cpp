@@ -0,0 +1,145 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaRegistryTracker.h"
+#include "HAL/PlatformStackWalk.h"
+#include "UObject/Stack.h"
+#include "UObject/Script.h"
+
+// skip the tracker and ULuaState::NewRef frames
+static const int32 LuaRegistryTrackerSkipFrames = 2;
+static const int32 LuaRegistryTrackerMaxFrames = 24;
+
+FLuaRegistryTracker::FLuaRegistryTracker()
+	: bHasSnapshot(false)
+{
+}
+
+void FLuaRegistryTracker::OnRef(lua_State* L, const int Ref)
+{
+	if (Ref == LUA_NOREF || Ref == LUA_REFNIL)
+	{
+		return;
+	}
+
+	const int32 LuaType = lua_type(L, -1);
+
+	uint64 BackTrace[LuaRegistryTrackerMaxFrames];
+	FMemory::Memzero(BackTrace);
+	const uint32 Depth = FPlatformStackWalk::CaptureStackBackTrace(BackTrace, LuaRegistryTrackerMaxFrames);
+
+	const UFunction* BlueprintFunction = nullptr;
+#if DO_BLUEPRINT_GUARD
+	const auto& ScriptStack = FBlueprintContextTracker::Get().GetCurrentScriptStack();
+	if (ScriptStack.Num() > 0 && ScriptStack.Last())
+	{
+		BlueprintFunction = ScriptStack.Last()->Node;
+	}
+#endif
+
+	uint32 Hash = FCrc::MemCrc32(BackTrace, Depth * sizeof(uint64), (uint32)LuaType);
+	Hash = FCrc::MemCrc32(&BlueprintFunction, sizeof(BlueprintFunction), Hash);
+
+	int32 SiteId = INDEX_NONE;
+	if (int32* ExistingSiteId = SiteIds.Find(Hash))
+	{
+		SiteId = *ExistingSiteId;
+	}
+	else
+	{
+		FSite Site;
+		Site.LuaType = LuaType;
+		for (uint32 FrameIndex = LuaRegistryTrackerSkipFrames; FrameIndex < Depth; FrameIndex++)
+		{
+			Site.BackTrace.Add(BackTrace[FrameIndex]);
+		}
+		if (BlueprintFunction)
+		{
+			Site.BlueprintFunction = BlueprintFunction->GetPathName();
+		}
+		Site.LiveReferences = 0;
+		Site.SnapshotReferences = 0;
+		Site.TotalReferences = 0;
+		SiteId = Sites.Add(Site);
+		SiteIds.Add(Hash, SiteId);
+	}
+
+	// a ref could be reused without having been tracked as released (tracking started later)
+	OnUnref(Ref);
+
+	LiveReferences.Add(Ref, SiteId);
+	Sites[SiteId].LiveReferences++;
+	Sites[SiteId].TotalReferences++;
+}
+
+void FLuaRegistryTracker::OnUnref(const int Ref)
+{
+	int32 SiteId = INDEX_NONE;
+	if (LiveReferences.RemoveAndCopyValue(Ref, SiteId))
+	{
+		Sites[SiteId].LiveReferences--;
+	}
+}
+
+void FLuaRegistryTracker::TakeSnapshot()
+{
+	for (FSite& Site : Sites)
+	{
+		Site.SnapshotReferences = Site.LiveReferences;
+	}
+	bHasSnapshot = true;
+}
+
+FString FLuaRegistryTracker::GetCensus(const int32 Num, const int32 NumStackFrames) const
+{
+	TArray<int32> SortedSites;
+	for (int32 SiteId = 0; SiteId < Sites.Num(); SiteId++)
+	{
+		if (Sites[SiteId].LiveReferences > 0 || (bHasSnapshot && Sites[SiteId].SnapshotReferences > 0))
+		{
+			SortedSites.Add(SiteId);
+		}
+	}
+
+	// biggest growth first when a snapshot is available, otherwise biggest owners first
+	SortedSites.Sort([this](const int32 A, const int32 B)
+		{
+			const FSite& SiteA = Sites[A];
+			const FSite& SiteB = Sites[B];
+			if (bHasSnapshot)
+			{
+				const int32 DeltaA = SiteA.LiveReferences - SiteA.SnapshotReferences;
+				const int32 DeltaB = SiteB.LiveReferences - SiteB.SnapshotReferences;
+				if (DeltaA != DeltaB)
+				{
+					return DeltaA > DeltaB;
+				}
+			}
+			return SiteA.LiveReferences > SiteB.LiveReferences;
+		});
+
+	FString Census = FString::Printf(TEXT("%d live tracked references from %d sites\n"), LiveReferences.Num(), SortedSites.Num());
+	for (int32 Index = 0; Index < SortedSites.Num() && (Num <= 0 || Index < Num); Index++)
+	{
+		const FSite& Site = Sites[SortedSites[Index]];
+		Census += FString::Printf(TEXT("%6d live (%+d since snapshot, %d created) %s\n"),
+			Site.LiveReferences,
+			bHasSnapshot ? Site.LiveReferences - Site.SnapshotReferences : 0,
+			Site.TotalReferences,
+			ANSI_TO_TCHAR(lua_typename(nullptr, Site.LuaType)));
+
+		if (!Site.BlueprintFunction.IsEmpty())
+		{
+			Census += FString::Printf(TEXT("    Blueprint: %s\n"), *Site.BlueprintFunction);
+		}
+
+		for (int32 FrameIndex = 0; FrameIndex < Site.BackTrace.Num() && FrameIndex < NumStackFrames; FrameIndex++)
+		{
+			ANSICHAR HumanReadableString[1024];
+			HumanReadableString[0] = 0;
+			FPlatformStackWalk::ProgramCounterToHumanReadableString(FrameIndex, Site.BackTrace[FrameIndex], HumanReadableString, sizeof(HumanReadableString));
+			Census += FString::Printf(TEXT("    %s\n"), ANSI_TO_TCHAR(HumanReadableString));
+		}
+	}
+
+	return Census;
+}
@@ -0,0 +1,551 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaSharedData.h"
+#include "LuaState.h"
+#include "LuaTableAsset.h"
+#include "Misc/Crc.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Serialization/JsonSerializer.h"
+
+static const char* LuaSharedDataMetaTableName = "LuaMachine.SharedData";
+
+struct FLuaSharedData::FProxy
+{
+	// read as FLuaUserData::Type by ULuaState::ToLuaValue(), Nil means not convertible
+	ELuaValueType Type;
+	int32 Table;
+	FLuaSharedDataPtr Data;
+};
+
+class FLuaSharedDataBuilder
+{
+public:
+	FLuaSharedDataBuilder(FLuaSharedData& InData) : Data(InData)
+	{
+	}
+
+	FLuaSharedData::FValue FromJsonValue(const TSharedPtr<FJsonValue>& JsonValue)
+	{
+		FLuaSharedData::FValue Value = {};
+		Value.Type = FLuaSharedData::EValueType::Nil;
+		if (!JsonValue.IsValid())
+		{
+			return Value;
+		}
+
+		switch (JsonValue->Type)
+		{
+		case EJson::Boolean:
+			Value.Type = FLuaSharedData::EValueType::Bool;
+			Value.Bool = JsonValue->AsBool();
+			break;
+		// same as FLuaValue::FromJsonValue()
+		case EJson::Number:
+			Value.Type = FLuaSharedData::EValueType::Number;
+			Value.Number = JsonValue->AsNumber();
+			break;
+		case EJson::String:
+			Value.Type = FLuaSharedData::EValueType::String;
+			Value.Index = AddString(JsonValue->AsString());
+			break;
+		case EJson::Array:
+		{
+			TArray<FLuaSharedData::FValue> Items;
+			for (const TSharedPtr<FJsonValue>& JsonItem : JsonValue->AsArray())
+			{
+				Items.Add(FromJsonValue(JsonItem));
+			}
+			TArray<FLuaSharedData::FEntry> Fields;
+			Value.Type = FLuaSharedData::EValueType::Table;
+			Value.Index = AddTable(Items, Fields);
+			break;
+		}
+		case EJson::Object:
+		{
+			TArray<FLuaSharedData::FValue> Items;
+			TArray<FLuaSharedData::FEntry> Fields;
+			for (const TPair<FString, TSharedPtr<FJsonValue>>& Pair : JsonValue->AsObject()->Values)
+			{
+				AddField(Fields, Pair.Key, FromJsonValue(Pair.Value));
+			}
+			Value.Type = FLuaSharedData::EValueType::Table;
+			Value.Index = AddTable(Items, Fields);
+			break;
+		}
+		default:
+			break;
+		}
+		return Value;
+	}
+
+	FLuaSharedData::FValue FromLuaValue(const FLuaValue& LuaValue)
+	{
+		FLuaSharedData::FValue Value = {};
+		Value.Type = FLuaSharedData::EValueType::Nil;
+
+		// tables, functions and objects are bound to a LuaState (or to the game thread)
+		switch (LuaValue.Type)
+		{
+		case ELuaValueType::Bool:
+			Value.Type = FLuaSharedData::EValueType::Bool;
+			Value.Bool = LuaValue.Bool;
+			break;
+		case ELuaValueType::Integer:
+			Value.Type = FLuaSharedData::EValueType::Integer;
+			Value.Integer = LuaValue.Integer;
+			break;
+		case ELuaValueType::Number:
+			Value.Type = FLuaSharedData::EValueType::Number;
+			Value.Number = LuaValue.Number;
+			break;
+		case ELuaValueType::String:
+			Value.Type = FLuaSharedData::EValueType::String;
+			Value.Index = AddString(LuaValue.String);
+			break;
+		default:
+			break;
+		}
+		return Value;
+	}
+
+	void AddField(TArray<FLuaSharedData::FEntry>& Fields, const FString& Key, const FLuaSharedData::FValue& Value)
+	{
+		// like assigning nil to a Lua table
+		if (Value.Type == FLuaSharedData::EValueType::Nil)
+		{
+			return;
+		}
+
+		FLuaSharedData::FEntry Entry;
+		Entry.Key = AddString(Key);
+		const FLuaSharedData::FStringSlice& String = Data.Strings[Entry.Key];
+		Entry.Hash = FCrc::MemCrc32(Data.StringData.GetData() + String.Offset, String.Length);
+		Entry.Value = Value;
+		Fields.Add(Entry);
+	}
+
+	int32 AddTable(const TArray<FLuaSharedData::FValue>& Items, TArray<FLuaSharedData::FEntry>& Fields)
+	{
+		Fields.Sort([this](const FLuaSharedData::FEntry& A, const FLuaSharedData::FEntry& B)
+			{
+				const FLuaSharedData::FStringSlice& String = Data.Strings[B.Key];
+				return Data.Compare(A, B.Hash, Data.StringData.GetData() + String.Offset, String.Length) < 0;
+			});
+
+		FLuaSharedData::FTable Table;
+		Table.FirstArrayValue = Data.ArrayValues.Num();
+		Table.NumArrayValues = Items.Num();
+		Table.FirstEntry = Data.Entries.Num();
+		Table.NumEntries = Fields.Num();
+		Data.ArrayValues.Append(Items);
+		Data.Entries.Append(Fields);
+		return Data.Tables.Add(Table);
+	}
+
+	int32 AddString(const FString& Value)
+	{
+		if (const int32* Index = StringsMap.Find(Value))
+		{
+			return *Index;
+		}
+
+		FTCHARToUTF8 UTF8String(*Value);
+		FLuaSharedData::FStringSlice String;
+		String.Offset = Data.StringData.Num();
+		String.Length = UTF8String.Length();
+		Data.StringData.Append(UTF8String.Get(), UTF8String.Length());
+		const int32 Index = Data.Strings.Add(String);
+		StringsMap.Add(Value, Index);
+		return Index;
+	}
+
+	void Shrink()
+	{
+		Data.StringData.Shrink();
+		Data.Strings.Shrink();
+		Data.Entries.Shrink();
+		Data.ArrayValues.Shrink();
+		Data.Tables.Shrink();
+	}
+
+private:
+	FLuaSharedData& Data;
+	TMap<FString, int32> StringsMap;
+};
+
+static FCriticalSection& GetLuaSharedDataCacheLock()
+{
+	static FCriticalSection CacheLock;
+	return CacheLock;
+}
+
+static TMap<FString, FLuaSharedDataPtr>& GetLuaSharedDataCache()
+{
+	static TMap<FString, FLuaSharedDataPtr> Cache;
+	return Cache;
+}
+
+#if WITH_EDITOR
+// modification time of the cached json files
+static TMap<FString, FDateTime>& GetLuaSharedDataTimeStamps()
+{
+	static TMap<FString, FDateTime> TimeStamps;
+	return TimeStamps;
+}
+#endif
+
+FLuaSharedDataPtr FLuaSharedData::FromJson(const FString& Json, FString& ErrorString)
+{
+	TSharedPtr<FJsonValue> JsonValue;
+	TSharedRef<TJsonReader<TCHAR>> JsonReader = TJsonReaderFactory<TCHAR>::Create(Json);
+	if (!FJsonSerializer::Deserialize(JsonReader, JsonValue) || !JsonValue.IsValid())
+	{
+		ErrorString = JsonReader->GetErrorMessage();
+		return nullptr;
+	}
+
+	TSharedPtr<FLuaSharedData, ESPMode::ThreadSafe> SharedData = MakeShared<FLuaSharedData, ESPMode::ThreadSafe>();
+	FLuaSharedDataBuilder Builder(*SharedData);
+	SharedData->Root = Builder.FromJsonValue(JsonValue);
+	Builder.Shrink();
+	return SharedData;
+}
+
+FLuaSharedDataPtr FLuaSharedData::FromLuaTableAsset(const ULuaTableAsset* TableAsset)
+{
+	TSharedPtr<FLuaSharedData, ESPMode::ThreadSafe> SharedData = MakeShared<FLuaSharedData, ESPMode::ThreadSafe>();
+	FLuaSharedDataBuilder Builder(*SharedData);
+
+	TArray<FValue> Items;
+	TArray<FEntry> Fields;
+	for (const TPair<FString, FLuaValue>& Pair : TableAsset->Table)
+	{
+		Builder.AddField(Fields, Pair.Key, Builder.FromLuaValue(Pair.Value));
+	}
+	SharedData->Root.Type = EValueType::Table;
+	SharedData->Root.Index = Builder.AddTable(Items, Fields);
+	Builder.Shrink();
+	return SharedData;
+}
+
+FLuaSharedDataPtr FLuaSharedData::LoadJsonFile(const FString& Filename, const bool bNonContentDirectory)
+{
+	const FString AbsoluteFilename = bNonContentDirectory ? Filename : FPaths::Combine(FPaths::ProjectContentDir(), Filename);
+	const FString CacheKey = TEXT("json:") + AbsoluteFilename;
+
+	// the lock is held while parsing, so concurrent requests of the same file wait for the first one
+	FScopeLock Lock(&GetLuaSharedDataCacheLock());
+#if WITH_EDITOR
+	const FDateTime TimeStamp = IFileManager::Get().GetTimeStamp(*AbsoluteFilename);
+	if (const FDateTime* CachedTimeStamp = GetLuaSharedDataTimeStamps().Find(CacheKey))
+	{
+		if (*CachedTimeStamp != TimeStamp)
+		{
+			GetLuaSharedDataCache().Remove(CacheKey);
+		}
+	}
+#endif
+	if (FLuaSharedDataPtr* CachedData = GetLuaSharedDataCache().Find(CacheKey))
+	{
+		return *CachedData;
+	}
+
+	FString Json;
+	if (!FFileHelper::LoadFileToString(Json, *AbsoluteFilename))
+	{
+		UE_LOG(LogLuaMachine, Error, TEXT("unable to open shared data file %s"), *AbsoluteFilename);
+		return nullptr;
+	}
+
+	FString ErrorString;
+	FLuaSharedDataPtr SharedData = FromJson(Json, ErrorString);
+	if (!SharedData.IsValid())
+	{
+		UE_LOG(LogLuaMachine, Error, TEXT("unable to parse shared data file %s: %s"), *AbsoluteFilename, *ErrorString);
+		return nullptr;
+	}
+
+	GetLuaSharedDataCache().Add(CacheKey, SharedData);
+#if WITH_EDITOR
+	GetLuaSharedDataTimeStamps().Add(CacheKey, TimeStamp);
+#endif
+	return SharedData;
+}
+
+FLuaSharedDataPtr FLuaSharedData::LoadLuaTableAsset(const ULuaTableAsset* TableAsset)
+{
+	if (!TableAsset)
+	{
+		return nullptr;
+	}
+
+	const FString CacheKey = TEXT("asset:") + TableAsset->GetPathName();
+
+	FScopeLock Lock(&GetLuaSharedDataCacheLock());
+	if (FLuaSharedDataPtr* CachedData = GetLuaSharedDataCache().Find(CacheKey))
+	{
+		return *CachedData;
+	}
+
+	FLuaSharedDataPtr SharedData = FromLuaTableAsset(TableAsset);
+	GetLuaSharedDataCache().Add(CacheKey, SharedData);
+	return SharedData;
+}
+
+void FLuaSharedData::ReleaseCache()
+{
+	FScopeLock Lock(&GetLuaSharedDataCacheLock());
+	GetLuaSharedDataCache().Empty();
+#if WITH_EDITOR
+	GetLuaSharedDataTimeStamps().Empty();
+#endif
+}
+
+void FLuaSharedData::ReleaseCachedLuaTableAsset(const ULuaTableAsset* TableAsset)
+{
+	if (!TableAsset)
+	{
+		return;
+	}
+
+	FScopeLock Lock(&GetLuaSharedDataCacheLock());
+	GetLuaSharedDataCache().Remove(TEXT("asset:") + TableAsset->GetPathName());
+}
+
+SIZE_T FLuaSharedData::GetAllocatedSize() const
+{
+	return StringData.GetAllocatedSize() + Strings.GetAllocatedSize() + Entries.GetAllocatedSize() + ArrayValues.GetAllocatedSize() + Tables.GetAllocatedSize();
+}
+
+int32 FLuaSharedData::Compare(const FEntry& Entry, const uint32 Hash, const char* Key, const int32 KeyLength) const
+{
+	if (Entry.Hash != Hash)
+	{
+		return Entry.Hash < Hash ? -1 : 1;
+	}
+
+	const FStringSlice& String = Strings[Entry.Key];
+	const int32 Result = FMemory::Memcmp(StringData.GetData() + String.Offset, Key, FMath::Min(String.Length, KeyLength));
+	if (Result != 0)
+	{
+		return Result;
+	}
+	return String.Length - KeyLength;
+}
+
+const FLuaSharedData::FValue* FLuaSharedData::FindField(const int32 Table, const char* Key, const int32 KeyLength) const
+{
+	const FTable& TableData = Tables[Table];
+	const uint32 Hash = FCrc::MemCrc32(Key, KeyLength);
+
+	int32 First = TableData.FirstEntry;
+	int32 Last = TableData.FirstEntry + TableData.NumEntries - 1;
+	while (First <= Last)
+	{
+		const int32 Middle = First + (Last - First) / 2;
+		const int32 Result = Compare(Entries[Middle], Hash, Key, KeyLength);
+		if (Result == 0)
+		{
+			return &Entries[Middle].Value;
+		}
+		if (Result < 0)
+		{
+			First = Middle + 1;
+		}
+		else
+		{
+			Last = Middle - 1;
+		}
+	}
+	return nullptr;
+}
+
+const FLuaSharedData::FValue* FLuaSharedData::FindIndex(const int32 Table, const lua_Integer Index) const
+{
+	const FTable& TableData = Tables[Table];
+	if (Index < 1 || Index > TableData.NumArrayValues)
+	{
+		return nullptr;
+	}
+	return &ArrayValues[TableData.FirstArrayValue + Index - 1];
+}
+
+void FLuaSharedData::PushString(lua_State* L, const int32 String) const
+{
+	const FStringSlice& StringSlice = Strings[String];
+	lua_pushlstring(L, StringData.GetData() + StringSlice.Offset, StringSlice.Length);
+}
+
+void FLuaSharedData::PushValue(lua_State* L, const FValue& Value) const
+{
+	switch (Value.Type)
+	{
+	case EValueType::Bool:
+		lua_pushboolean(L, Value.Bool ? 1 : 0);
+		break;
+	case EValueType::Integer:
+		lua_pushinteger(L, Value.Integer);
+		break;
+	case EValueType::Number:
+		lua_pushnumber(L, Value.Number);
+		break;
+	case EValueType::String:
+		PushString(L, Value.Index);
+		break;
+	case EValueType::Table:
+		PushTableProxy(L, Value.Index);
+		break;
+	default:
+		lua_pushnil(L);
+		break;
+	}
+}
+
+void FLuaSharedData::PushProxy(lua_State* L, FLuaSharedDataPtr Data)
+{
+	if (!Data.IsValid())
+	{
+		lua_pushnil(L);
+		return;
+	}
+	Data->PushValue(L, Data->Root);
+}
+
+void FLuaSharedData::PushTableProxy(lua_State* L, const int32 Table) const
+{
+	FProxy* Proxy = (FProxy*)lua_newuserdata(L, sizeof(FProxy));
+	new(Proxy) FProxy();
+	Proxy->Type = ELuaValueType::Nil;
+	Proxy->Table = Table;
+	Proxy->Data = AsShared();
+
+	if (luaL_newmetatable(L, LuaSharedDataMetaTableName))
+	{
+		lua_pushcfunction(L, FLuaSharedData::MetaTableFunction__index);
+		lua_setfield(L, -2, "__index");
+		lua_pushcfunction(L, FLuaSharedData::MetaTableFunction__newindex);
+		lua_setfield(L, -2, "__newindex");
+		lua_pushcfunction(L, FLuaSharedData::MetaTableFunction__len);
+		lua_setfield(L, -2, "__len");
+		lua_pushcfunction(L, FLuaSharedData::MetaTableFunction__pairs);
+		lua_setfield(L, -2, "__pairs");
+		lua_pushcfunction(L, FLuaSharedData::MetaTableFunction__eq);
+		lua_setfield(L, -2, "__eq");
+		lua_pushcfunction(L, FLuaSharedData::MetaTableFunction__tostring);
+		lua_setfield(L, -2, "__tostring");
+		lua_pushcfunction(L, FLuaSharedData::MetaTableFunction__gc);
+		lua_setfield(L, -2, "__gc");
+		lua_pushboolean(L, 0);
+		lua_setfield(L, -2, "__metatable");
+	}
+	lua_setmetatable(L, -2);
+}
+
+int FLuaSharedData::MetaTableFunction__index(lua_State* L)
+{
+	FProxy* Proxy = (FProxy*)luaL_checkudata(L, 1, LuaSharedDataMetaTableName);
+
+	const FValue* Value = nullptr;
+	if (lua_type(L, 2) == LUA_TSTRING)
+	{
+		size_t KeyLength = 0;
+		const char* Key = lua_tolstring(L, 2, &KeyLength);
+		Value = Proxy->Data->FindField(Proxy->Table, Key, (int32)KeyLength);
+	}
+	else if (lua_type(L, 2) == LUA_TNUMBER)
+	{
+		int IsInteger = 0;
+		const lua_Integer Index = lua_tointegerx(L, 2, &IsInteger);
+		if (IsInteger)
+		{
+			Value = Proxy->Data->FindIndex(Proxy->Table, Index);
+		}
+	}
+
+	if (!Value)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	Proxy->Data->PushValue(L, *Value);
+	return 1;
+}
+
+int FLuaSharedData::MetaTableFunction__newindex(lua_State* L)
+{
+	return luaL_error(L, "attempt to modify read-only shared data");
+}
+
+int FLuaSharedData::MetaTableFunction__len(lua_State* L)
+{
+	FProxy* Proxy = (FProxy*)luaL_checkudata(L, 1, LuaSharedDataMetaTableName);
+	lua_pushinteger(L, Proxy->Data->Tables[Proxy->Table].NumArrayValues);
+	return 1;
+}
+
+int FLuaSharedData::MetaTableFunction__pairs(lua_State* L)
+{
+	luaL_checkudata(L, 1, LuaSharedDataMetaTableName);
+	// the position is kept in the iterator upvalue
+	lua_pushinteger(L, 0);
+	lua_pushcclosure(L, FLuaSharedData::PairsIterator, 1);
+	lua_pushvalue(L, 1);
+	lua_pushnil(L);
+	return 3;
+}
+
+int FLuaSharedData::PairsIterator(lua_State* L)
+{
+	FProxy* Proxy = (FProxy*)luaL_checkudata(L, 1, LuaSharedDataMetaTableName);
+	const FTable& Table = Proxy->Data->Tables[Proxy->Table];
+
+	const int32 Position = (int32)lua_tointeger(L, lua_upvalueindex(1));
+	lua_pushinteger(L, Position + 1);
+	lua_replace(L, lua_upvalueindex(1));
+
+	// array part first
+	if (Position < Table.NumArrayValues)
+	{
+		lua_pushinteger(L, Position + 1);
+		Proxy->Data->PushValue(L, Proxy->Data->ArrayValues[Table.FirstArrayValue + Position]);
+		return 2;
+	}
+
+	const int32 Entry = Position - Table.NumArrayValues;
+	if (Entry < Table.NumEntries)
+	{
+		const FEntry& EntryData = Proxy->Data->Entries[Table.FirstEntry + Entry];
+		Proxy->Data->PushString(L, EntryData.Key);
+		Proxy->Data->PushValue(L, EntryData.Value);
+		return 2;
+	}
+
+	lua_pushnil(L);
+	return 1;
+}
+
+int FLuaSharedData::MetaTableFunction__eq(lua_State* L)
+{
+	FProxy* Proxy = (FProxy*)luaL_testudata(L, 1, LuaSharedDataMetaTableName);
+	FProxy* OtherProxy = (FProxy*)luaL_testudata(L, 2, LuaSharedDataMetaTableName);
+	lua_pushboolean(L, Proxy && OtherProxy && Proxy->Data == OtherProxy->Data && Proxy->Table == OtherProxy->Table);
+	return 1;
+}
+
+int FLuaSharedData::MetaTableFunction__tostring(lua_State* L)
+{
+	FProxy* Proxy = (FProxy*)luaL_checkudata(L, 1, LuaSharedDataMetaTableName);
+	lua_pushfstring(L, "shared data: %p", &Proxy->Data->Tables[Proxy->Table]);
+	return 1;
+}
+
+int FLuaSharedData::MetaTableFunction__gc(lua_State* L)
+{
+	FProxy* Proxy = (FProxy*)luaL_checkudata(L, 1, LuaSharedDataMetaTableName);
+	Proxy->~FProxy();
+	return 0;
+}
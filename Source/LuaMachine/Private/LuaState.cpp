@@ -6,12 +6,20 @@
 #include "LuaMachine.h"
 #include "LuaBlueprintPackage.h"
 #include "LuaBlueprintFunctionLibrary.h"
+#include "LuaMachineTrace.h"
+#include "LuaDebugServer.h"
+#include "LuaModuleReloader.h"
+#include "LuaSharedData.h"
+#include "LuaDataTable.h"
+#include "LuaValueTransfer.h"
+#include "LuaTableAsset.h"
 #if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
 #include "AssetRegistry/AssetRegistryModule.h"
 #else
 #include "AssetRegistryModule.h"
 #endif
 #include "GameFramework/Actor.h"
+#include "Async/Async.h"
 #include "Runtime/Core/Public/Misc/FileHelper.h"
 #include "Runtime/Core/Public/Misc/Paths.h"
 #include "Runtime/Core/Public/Serialization/BufferArchive.h"
@@ -19,6 +27,147 @@
 
 LUAMACHINE_API DEFINE_LOG_CATEGORY(LogLuaMachine);
 
+// wraps every UE->Lua transition (PCall, RunCode, Resume)
+struct FLuaExecutionScope
+{
+	FLuaExecutionScope(ULuaState* InLuaState)
+		: LuaState(InLuaState)
+		, TraceOpenEvents(0)
+	{
+		LuaState->FrameStats.Calls++;
+		if (LuaState->ExecutionDepth++ == 0)
+		{
+			LuaState->ExecutionStartCycles = FPlatformTime::Cycles64();
+			// the watchdog budgets are per outermost call and per frame
+			LuaState->WatchdogCallInstructions = 0;
+			if (LuaState->WatchdogFrameNumber != GFrameCounter)
+			{
+				LuaState->WatchdogFrameNumber = GFrameCounter;
+				LuaState->WatchdogFrameCycles = 0;
+			}
+		}
+
+#if LUAMACHINE_TRACE_ENABLED
+		if (LuaState->Tracer.IsValid())
+		{
+			// the channel can be toggled at any time, the call/return hooks follow it
+			if (FLuaStateTracer::IsEnabled() != LuaState->bTraceHookInstalled)
+			{
+				LuaState->RefreshDebugHook();
+			}
+			TraceOpenEvents = LuaState->Tracer->Enter();
+		}
+#endif
+	}
+
+	~FLuaExecutionScope()
+	{
+#if LUAMACHINE_TRACE_ENABLED
+		if (LuaState->Tracer.IsValid())
+		{
+			LuaState->Tracer->Leave(TraceOpenEvents);
+		}
+#endif
+
+		// only the outermost transition is accounted, nested calls are already part of it
+		if (--LuaState->ExecutionDepth == 0)
+		{
+			// a listener raised an error while dispatching a hook
+			if (LuaState->bDispatchingHook)
+			{
+				LuaState->bDispatchingHook = false;
+				LuaState->bThreadOnDemandRequested = false;
+				if (LuaState->bHookRefreshPending)
+				{
+					LuaState->RefreshDebugHook();
+				}
+			}
+
+			const uint64 ElapsedCycles = FPlatformTime::Cycles64() - LuaState->ExecutionStartCycles;
+			LuaState->FrameStats.LuaCycles += ElapsedCycles;
+			LuaState->WatchdogFrameCycles += ElapsedCycles;
+		}
+	}
+
+	ULuaState* LuaState;
+	int32 TraceOpenEvents;
+};
+
+// dispatches the hooks to the Lua*Hook Blueprint events, active only when one of the bEnable*Hook properties is set
+class FLuaBlueprintHookListener : public ILuaHookListener
+{
+public:
+	FLuaBlueprintHookListener(ULuaState* InLuaState)
+		: LuaState(InLuaState)
+	{
+	}
+
+	virtual int32 GetLuaHookMask() const override
+	{
+		int32 Mask = 0;
+		if (LuaState->bEnableLineHook)
+		{
+			Mask |= LUA_MASKLINE;
+		}
+		if (LuaState->bEnableCallHook)
+		{
+			Mask |= LUA_MASKCALL;
+		}
+		if (LuaState->bEnableReturnHook)
+		{
+			Mask |= LUA_MASKRET;
+		}
+		if (LuaState->bEnableCountHook)
+		{
+			Mask |= LUA_MASKCOUNT;
+		}
+		return Mask;
+	}
+
+	virtual int32 GetLuaHookInstructionCount() const override
+	{
+		return LuaState->HookInstructionCount;
+	}
+
+	virtual void OnLuaHook(ULuaState* InLuaState, FLuaHookEvent& Event) override
+	{
+		// tail calls have never been exposed to Blueprints
+		if (Event.GetEvent() == LUA_HOOKTAILCALL)
+		{
+			return;
+		}
+
+		const lua_Debug& Debug = Event.Require("lSn");
+		FLuaDebug LuaDebug;
+		LuaDebug.CurrentLine = Debug.currentline;
+		LuaDebug.Source = ANSI_TO_TCHAR(Debug.source);
+		LuaDebug.Name = ANSI_TO_TCHAR(Debug.name);
+		LuaDebug.NameWhat = ANSI_TO_TCHAR(Debug.namewhat);
+		LuaDebug.What = ANSI_TO_TCHAR(Debug.what);
+
+		switch (Event.GetEvent())
+		{
+		case LUA_HOOKLINE:
+			LuaState->ReceiveLuaLineHook(LuaDebug);
+			break;
+		case LUA_HOOKCALL:
+			LuaState->ReceiveLuaCallHook(LuaDebug);
+			break;
+		case LUA_HOOKRET:
+			LuaState->ReceiveLuaReturnHook(LuaDebug);
+			break;
+		case LUA_HOOKCOUNT:
+			LuaState->ReceiveLuaCountHook(LuaDebug);
+			break;
+		default:
+			break;
+		}
+	}
+
+private:
+	ULuaState* LuaState;
+};
+
 ULuaState::ULuaState()
 {
 	L = nullptr;
@@ -32,6 +181,27 @@ ULuaState::ULuaState()
 	bEnableReturnHook = false;
 	bEnableCountHook = false;
 	bRawLuaFunctionCall = false;
+	bEnableSamplingProfiler = false;
+	bEnableCoverage = false;
+	bEnableDebugServer = false;
+	bHotReload = false;
+	ModulesReloadCount = 0;
+	bLazyLuaBlueprintPackages = false;
+	bTrackRegistryReferences = false;
+	bEnableWatchdog = false;
+	WatchdogCallInstructions = 0;
+	WatchdogFrameNumber = 0;
+	WatchdogFrameCycles = 0;
+	CurrentHookMask = 0;
+	CurrentHookCount = 0;
+	CurrentOnDemandHookMask = 0;
+	bDispatchingHook = false;
+	bHookRefreshPending = false;
+	bThreadOnDemandRequested = false;
+	PendingThreadOnDemandMask = 0;
+	bTraceHookInstalled = false;
+	ExecutionDepth = 0;
+	ExecutionStartCycles = 0;
 
 	FCoreUObjectDelegates::GetPostGarbageCollect().AddUObject(this, &ULuaState::GCLuaDelegatesCheck);
 }
@@ -40,6 +210,22 @@ ULuaState* ULuaState::GetLuaState(UWorld* InWorld)
 {
 	CurrentWorld = InWorld;
 
+	if (AsyncInitialization.IsValid())
+	{
+		// wait for the worker thread, then run the engine side of the initialization
+		const bool bLuaVMInitialized = AsyncInitialization.Get();
+		AsyncInitialization.Reset();
+		if (!bLuaVMInitialized)
+		{
+			if (bLogError)
+				LogError(LastError);
+			ReceiveLuaError(LastError);
+			bDisabled = true;
+			return nullptr;
+		}
+		return FinishInitialization();
+	}
+
 	if (L != nullptr)
 	{
 		return this;
@@ -50,7 +236,101 @@ ULuaState* ULuaState::GetLuaState(UWorld* InWorld)
 		return nullptr;
 	}
 
-	L = luaL_newstate();
+	if (!InitializeLuaVM())
+	{
+		if (bLogError)
+			LogError(LastError);
+		ReceiveLuaError(LastError);
+		bDisabled = true;
+		return nullptr;
+	}
+
+	return FinishInitialization();
+}
+
+bool ULuaState::StartAsyncInitialization()
+{
+	if (L != nullptr || bDisabled || AsyncInitialization.IsValid())
+	{
+		return false;
+	}
+
+	// the worker does not touch the LuaCode assets
+	AsyncCodeAssetChunks.Empty();
+	for (ULuaCode* CodeAsset : { LuaCodeAsset, UserDataMetaTableFromCodeAsset })
+	{
+		if (CodeAsset)
+		{
+			GetCodeAssetChunk(CodeAsset, AsyncCodeAssetChunks.FindOrAdd(CodeAsset->GetPathName()));
+		}
+	}
+
+	AsyncInitialization = Async(EAsyncExecution::ThreadPool, [this]()
+		{
+			return InitializeLuaVM();
+		});
+	return true;
+}
+
+// coroutine.resume() replacement: sync the hook of the coroutine, then call the original one (upvalue 1)
+static int LuaCoroutineResume(lua_State* L)
+{
+	if (lua_State* Thread = lua_tothread(L, 1))
+	{
+		ULuaState::GetFromExtraSpace(L)->SyncThreadHook(Thread);
+	}
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_insert(L, 1);
+	lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+	return lua_gettop(L);
+}
+
+// function returned by the coroutine.wrap() replacement: upvalue 1 is the original wrapper, upvalue 2 its coroutine
+static int LuaCoroutineWrapped(lua_State* L)
+{
+	ULuaState::GetFromExtraSpace(L)->SyncThreadHook(lua_tothread(L, lua_upvalueindex(2)));
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_insert(L, 1);
+	lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+	return lua_gettop(L);
+}
+
+// coroutine.wrap() replacement: the original one (upvalue 1) stores the coroutine as the first upvalue of its wrapper
+static int LuaCoroutineWrap(lua_State* L)
+{
+	lua_settop(L, 1);
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_insert(L, 1);
+	lua_call(L, 1, 1);
+	if (lua_getupvalue(L, 1, 1) == nullptr || !lua_isthread(L, -1))
+	{
+		return luaL_error(L, "coroutine.wrap() did not return a coroutine wrapper");
+	}
+	lua_pushcclosure(L, LuaCoroutineWrapped, 2);
+	return 1;
+}
+
+bool ULuaState::InitializeLuaVM()
+{
+	Allocator = MakeShared<FLuaStateAllocator>(GetClass()->GetName());
+	L = lua_newstate(FLuaStateAllocator::Alloc, Allocator.Get());
+	lua_atpanic(L, LuaPanic);
+	Allocator->SetLuaState(L);
+
+	ModuleReloader = MakeShared<FLuaModuleReloader>(this);
+
+	if (bTrackRegistryReferences)
+	{
+		StartRegistryTracking();
+	}
+
+	BlueprintHookListener = MakeShared<FLuaBlueprintHookListener>(this);
+	HookListeners.Add(BlueprintHookListener.Get());
+
+#if LUAMACHINE_TRACE_ENABLED
+	Tracer = MakeShared<FLuaStateTracer>(this);
+	HookListeners.Add(Tracer.Get());
+#endif
 
 	if (bLuaOpenLibs)
 	{
@@ -126,6 +406,18 @@ ULuaState* ULuaState::GetLuaState(UWorld* InWorld)
 	PushCFunction(ULuaState::TableFunction_print);
 	SetField(-2, "print");
 
+	// resumed coroutines get the current debug hook (profilers, coverage and debugger can be started at any time)
+	if (lua_getfield(L, -1, "coroutine") == LUA_TTABLE)
+	{
+		lua_getfield(L, -1, "resume");
+		lua_pushcclosure(L, LuaCoroutineResume, 1);
+		lua_setfield(L, -2, "resume");
+		lua_getfield(L, -1, "wrap");
+		lua_pushcclosure(L, LuaCoroutineWrap, 1);
+		lua_setfield(L, -2, "wrap");
+	}
+	Pop();
+
 	GetField(-1, "package");
 	if (!OverridePackagePath.IsEmpty())
 	{
@@ -194,6 +486,91 @@ ULuaState* ULuaState::GetLuaState(UWorld* InWorld)
 	// pop package.searchers (and package)
 	Pop(2);
 
+	// parsed once for all of the LuaStates
+	for (TPair<FString, FString>& Pair : SharedJsonFiles)
+	{
+		FLuaSharedData::PushProxy(L, FLuaSharedData::LoadJsonFile(Pair.Value));
+		SetField(-2, TCHAR_TO_ANSI(*Pair.Key));
+	}
+
+	// pop global table
+	Pop();
+
+	DeferredPreloadModules.Empty();
+	const bool bGameThread = IsInGameThread();
+	for (const FString& ModuleName : PreloadModules)
+	{
+		// modules coming from LuaCode assets are loaded on the game thread (by FinishInitialization()), the following ones too for keeping the order
+		if (!bGameThread && (DeferredPreloadModules.Num() > 0 || RequireTable.Contains(ModuleName) || FPackageName::IsValidObjectPath(ModuleName)))
+		{
+			DeferredPreloadModules.Add(ModuleName);
+			continue;
+		}
+
+		if (!RequirePreloadModule(ModuleName))
+		{
+			return false;
+		}
+	}
+
+	// the main chunks are only compiled, they run after the engine side of the initialization
+	if (bGameThread)
+	{
+		if (LuaCodeAsset)
+		{
+			PrecompileCodeAsset(LuaCodeAsset);
+		}
+	}
+	else
+	{
+		// copied from the LuaCode assets by StartAsyncInitialization()
+		for (const TPair<FString, TArray<uint8>>& Pair : AsyncCodeAssetChunks)
+		{
+			PrecompileChunk(Pair.Value, Pair.Key);
+		}
+		AsyncCodeAssetChunks.Empty();
+	}
+
+	if (!LuaFilename.IsEmpty())
+	{
+		const FString AbsoluteFilename = FPaths::Combine(FPaths::ProjectContentDir(), LuaFilename);
+		TArray<uint8> Code;
+		if (FPaths::FileExists(AbsoluteFilename) && FFileHelper::LoadFileToArray(Code, *AbsoluteFilename))
+		{
+			PrecompileChunk(Code, AbsoluteFilename);
+		}
+	}
+
+	if (UserDataMetaTableFromCodeAsset && bGameThread)
+	{
+		PrecompileCodeAsset(UserDataMetaTableFromCodeAsset);
+	}
+
+	return true;
+}
+
+bool ULuaState::RequirePreloadModule(const FString& ModuleName)
+{
+	FLuaExecutionScope ExecutionScope(this);
+	if (lua_getglobal(L, "require") != LUA_TFUNCTION)
+	{
+		Pop();
+		LastError = FString::Printf(TEXT("unable to preload module %s: require() is not available"), *ModuleName);
+		return false;
+	}
+	lua_pushstring(L, TCHAR_TO_UTF8(*ModuleName));
+	if (lua_pcall(L, 1, 0, 0))
+	{
+		LastError = FString::Printf(TEXT("Lua execution error: %s"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
+		Pop();
+		return false;
+	}
+	return true;
+}
+
+ULuaState* ULuaState::FinishInitialization()
+{
+	lua_pushglobaltable(L);
 
 	for (TPair<FString, FLuaValue>& Pair : Table)
 	{
@@ -201,24 +578,45 @@ ULuaState* ULuaState::GetLuaState(UWorld* InWorld)
 		SetField(-2, TCHAR_TO_ANSI(*Pair.Key));
 	}
 
+	for (TPair<FString, ULuaTableAsset*>& Pair : SharedTableAssets)
+	{
+		FLuaSharedData::PushProxy(L, FLuaSharedData::LoadLuaTableAsset(Pair.Value));
+		SetField(-2, TCHAR_TO_ANSI(*Pair.Key));
+	}
+
+	for (TPair<FString, UDataTable*>& Pair : DataTables)
+	{
+		FLuaDataTable::PushProxy(L, FLuaDataTable::Import(Pair.Value));
+		SetField(-2, TCHAR_TO_ANSI(*Pair.Key));
+	}
+
 	for (TPair<FString, TSubclassOf<ULuaBlueprintPackage>>& Pair : LuaBlueprintPackagesTable)
 	{
 		if (Pair.Value)
 		{
 			NewTable();
-			ULuaBlueprintPackage* LuaBlueprintPackage = NewObject<ULuaBlueprintPackage>(this, Pair.Value);
-			if (LuaBlueprintPackage)
+			if (bLazyLuaBlueprintPackages)
 			{
-				for (auto LuaPair : LuaBlueprintPackage->Table)
-				{
-					FromLuaValue(LuaPair.Value, LuaBlueprintPackage);
-					SetField(-2, TCHAR_TO_ANSI(*LuaPair.Key));
-				}
-				// this avoid the package to be GC'd
-				LuaBlueprintPackages.Add(Pair.Key, LuaBlueprintPackage);
-				LuaBlueprintPackage->SelfTable = ToLuaValue(-1);
-				LuaBlueprintPackage->Init();
-				LuaBlueprintPackage->ReceiveInit();
+				// the package will be created by the first access to the stub table
+				lua_newtable(L);
+				lua_pushstring(L, TCHAR_TO_UTF8(*Pair.Key));
+				lua_pushcclosure(L, ULuaState::MetaTableFunctionLazyPackage__index, 1);
+				lua_setfield(L, -2, "__index");
+				lua_pushstring(L, TCHAR_TO_UTF8(*Pair.Key));
+				lua_pushcclosure(L, ULuaState::MetaTableFunctionLazyPackage__newindex, 1);
+				lua_setfield(L, -2, "__newindex");
+				lua_pushstring(L, TCHAR_TO_UTF8(*Pair.Key));
+				lua_pushcclosure(L, ULuaState::MetaTableFunctionLazyPackage__pairs, 1);
+				lua_setfield(L, -2, "__pairs");
+				lua_pushstring(L, TCHAR_TO_UTF8(*Pair.Key));
+				lua_pushcclosure(L, ULuaState::MetaTableFunctionLazyPackage__len, 1);
+				lua_setfield(L, -2, "__len");
+				lua_setmetatable(L, -2);
+				LazyLuaBlueprintPackages.Add(Pair.Key, ToLuaValue(-1));
+			}
+			else
+			{
+				SetupLuaBlueprintPackage(Pair.Key, Pair.Value, L);
 			}
 		}
 		else
@@ -235,30 +633,43 @@ ULuaState* ULuaState::GetLuaState(UWorld* InWorld)
 	// we load code
 	ReceiveLuaStatePreInitialized();
 
-	int DebugMask = 0;
-	// install hooks
-	if (bEnableLineHook)
+	if (bEnableSamplingProfiler)
 	{
-		DebugMask |= LUA_MASKLINE;
+		StartSamplingProfiler(SamplingProfilerInstructionCount, SamplingProfilerInterval);
 	}
-	if (bEnableCallHook)
+
+	if (bEnableCoverage)
 	{
-		DebugMask |= LUA_MASKCALL;
+		StartCoverage(CoverageFilters);
 	}
-	if (bEnableReturnHook)
+
+	if (bEnableDebugServer)
 	{
-		DebugMask |= LUA_MASKRET;
+		StartDebugServer(DebugServerPort);
 	}
-	if (bEnableCountHook)
+
+	// PreloadModules skipped by the worker thread
+	for (const FString& ModuleName : DeferredPreloadModules)
 	{
-		DebugMask |= LUA_MASKCOUNT;
+		if (!RequirePreloadModule(ModuleName))
+		{
+			if (bLogError)
+				LogError(LastError);
+			ReceiveLuaError(LastError);
+			bDisabled = true;
+			return nullptr;
+		}
 	}
+	DeferredPreloadModules.Empty();
 
-	if (DebugMask != 0)
+	if (bHotReload)
 	{
-		lua_sethook(L, Debug_Hook, DebugMask, HookInstructionCount);
+		ModuleReloader->StartWatching();
 	}
 
+	// install hooks
+	RefreshDebugHook();
+
 	if (LuaCodeAsset)
 	{
 		if (!RunCodeAsset(LuaCodeAsset))
@@ -297,6 +708,9 @@ ULuaState* ULuaState::GetLuaState(UWorld* InWorld)
 		Pop();
 	}
 
+	// chunks not consumed by RunCode() (like a LuaFilename modified in the meantime)
+	ReleasePrecompiledChunks();
+
 	LuaStateInit();
 	ReceiveLuaStateInitialized();
 
@@ -312,64 +726,206 @@ ULuaState* ULuaState::GetLuaState(UWorld* InWorld)
 	return this;
 }
 
-FLuaValue ULuaState::GetLuaBlueprintPackageTable(const FString& PackageName)
+void ULuaState::PrecompileChunk(const TArray<uint8>& Code, const FString& CodePath)
 {
-	if (!LuaBlueprintPackages.Contains(PackageName))
+	if (PrecompiledChunks.Contains(CodePath))
 	{
-		return FLuaValue();
+		return;
 	}
 
-	return LuaBlueprintPackages[PackageName]->SelfTable;
+	FString FullCodePath = FString("@") + CodePath;
+	if (luaL_loadbuffer(L, (const char*)Code.GetData(), Code.Num(), TCHAR_TO_ANSI(*FullCodePath)) != LUA_OK)
+	{
+		// the error will be reported by RunCode()
+		Pop();
+		return;
+	}
+	PrecompiledChunks.Add(CodePath, luaL_ref(L, LUA_REGISTRYINDEX));
 }
 
-bool ULuaState::RunCodeAsset(ULuaCode* CodeAsset, int NRet)
+void ULuaState::PrecompileCodeAsset(ULuaCode* CodeAsset)
 {
+	TArray<uint8> Chunk;
+	GetCodeAssetChunk(CodeAsset, Chunk);
+	PrecompileChunk(Chunk, CodeAsset->GetPathName());
+}
 
+void ULuaState::GetCodeAssetChunk(ULuaCode* CodeAsset, TArray<uint8>& Chunk)
+{
 	if (CodeAsset->bCooked && CodeAsset->bCookAsBytecode)
 	{
+		Chunk = CodeAsset->ByteCode;
 #if PLATFORM_ANDROID
-		// fix size_t of the bytecode
-		if (CodeAsset->ByteCode.Num() >= 14)
-			CodeAsset->ByteCode[13] = sizeof(size_t);
+		// fix size_t of the bytecode (in the copy, the asset is left untouched)
+		if (Chunk.Num() >= 14)
+			Chunk[13] = sizeof(size_t);
 #endif
-		return RunCode(CodeAsset->ByteCode, CodeAsset->GetPathName(), NRet);
+		return;
 	}
 
-	return RunCode(CodeAsset->Code.ToString(), CodeAsset->GetPathName(), NRet);
-
+	const FString Code = CodeAsset->Code.ToString();
+	FTCHARToUTF8 Utf8Code(*Code);
+	Chunk.Reset(Utf8Code.Length());
+	Chunk.Append((const uint8*)Utf8Code.Get(), Utf8Code.Length());
 }
 
-bool ULuaState::RunFile(const FString& Filename, bool bIgnoreNonExistent, int NRet, bool bNonContentDirectory)
+void ULuaState::ReleasePrecompiledChunks()
 {
-	TArray<uint8> Code;
-	FString AbsoluteFilename = FPaths::Combine(FPaths::ProjectContentDir(), Filename);
+	for (const TPair<FString, int32>& Pair : PrecompiledChunks)
+	{
+		luaL_unref(L, LUA_REGISTRYINDEX, Pair.Value);
+	}
+	PrecompiledChunks.Empty();
+}
 
-	if (bNonContentDirectory)
+void ULuaState::SetupLuaBlueprintPackage(const FString& PackageName, TSubclassOf<ULuaBlueprintPackage> PackageClass, lua_State* State)
+{
+	// the package table is on top of the stack
+	ULuaBlueprintPackage* LuaBlueprintPackage = NewObject<ULuaBlueprintPackage>(this, PackageClass);
+	if (LuaBlueprintPackage)
 	{
-		AbsoluteFilename = Filename;
+		for (auto LuaPair : LuaBlueprintPackage->Table)
+		{
+			FromLuaValue(LuaPair.Value, LuaBlueprintPackage, State);
+			lua_setfield(State, -2, TCHAR_TO_UTF8(*LuaPair.Key));
+		}
+		// this avoid the package to be GC'd
+		LuaBlueprintPackages.Add(PackageName, LuaBlueprintPackage);
+		LuaBlueprintPackage->SelfTable = ToLuaValue(-1, State);
+		LuaBlueprintPackage->Init();
+		LuaBlueprintPackage->ReceiveInit();
 	}
+}
 
-	if (!FPaths::FileExists(AbsoluteFilename))
+bool ULuaState::SetupLazyLuaBlueprintPackage(const FString& PackageName, lua_State* State)
+{
+	FLuaValue StubTable;
+	if (!LazyLuaBlueprintPackages.RemoveAndCopyValue(PackageName, StubTable))
 	{
-		if (bIgnoreNonExistent)
-			return true;
-		LastError = FString::Printf(TEXT("Unable to open file %s"), *Filename);
-		FLuaValue LuaLastError = FLuaValue(LastError);
-		FromLuaValue(LuaLastError);
 		return false;
 	}
 
-	if (FFileHelper::LoadFileToArray(Code, *AbsoluteFilename))
+	TSubclassOf<ULuaBlueprintPackage>* PackageClass = LuaBlueprintPackagesTable.Find(PackageName);
+	FromLuaValue(StubTable, nullptr, State);
+	// the stub becomes the package table, so the references to it are still valid
+	lua_pushnil(State);
+	lua_setmetatable(State, -2);
+	if (PackageClass && *PackageClass)
 	{
-		if (RunCode(Code, AbsoluteFilename, NRet))
-		{
-			return true;
-		}
-		return false;
+		SetupLuaBlueprintPackage(PackageName, *PackageClass, State);
 	}
+	lua_pop(State, 1);
+	return true;
+}
 
-	LastError = FString::Printf(TEXT("Unable to open file %s"), *Filename);
-	FLuaValue LuaLastError = FLuaValue(LastError);
+int ULuaState::MetaTableFunctionLazyPackage__index(lua_State* L)
+{
+	ULuaState* LuaState = ULuaState::GetFromExtraSpace(L);
+	LuaState->SetupLazyLuaBlueprintPackage(UTF8_TO_TCHAR(lua_tostring(L, lua_upvalueindex(1))), L);
+	lua_settop(L, 2);
+	lua_rawget(L, 1);
+	return 1;
+}
+
+int ULuaState::MetaTableFunctionLazyPackage__newindex(lua_State* L)
+{
+	ULuaState* LuaState = ULuaState::GetFromExtraSpace(L);
+	LuaState->SetupLazyLuaBlueprintPackage(UTF8_TO_TCHAR(lua_tostring(L, lua_upvalueindex(1))), L);
+	lua_settop(L, 3);
+	lua_rawset(L, 1);
+	return 0;
+}
+
+// raw next() of the package table, independent from the (overridable or sandboxed) global one
+static int LuaLazyPackageNext(lua_State* L)
+{
+	lua_settop(L, 2);
+	if (lua_next(L, 1))
+	{
+		return 2;
+	}
+	lua_pushnil(L);
+	return 1;
+}
+
+int ULuaState::MetaTableFunctionLazyPackage__pairs(lua_State* L)
+{
+	ULuaState* LuaState = ULuaState::GetFromExtraSpace(L);
+	LuaState->SetupLazyLuaBlueprintPackage(UTF8_TO_TCHAR(lua_tostring(L, lua_upvalueindex(1))), L);
+	lua_pushcfunction(L, LuaLazyPackageNext);
+	lua_pushvalue(L, 1);
+	lua_pushnil(L);
+	return 3;
+}
+
+int ULuaState::MetaTableFunctionLazyPackage__len(lua_State* L)
+{
+	ULuaState* LuaState = ULuaState::GetFromExtraSpace(L);
+	LuaState->SetupLazyLuaBlueprintPackage(UTF8_TO_TCHAR(lua_tostring(L, lua_upvalueindex(1))), L);
+	lua_pushinteger(L, luaL_len(L, 1));
+	return 1;
+}
+
+FLuaValue ULuaState::GetLuaBlueprintPackageTable(const FString& PackageName)
+{
+	SetupLazyLuaBlueprintPackage(PackageName, L);
+
+	if (!LuaBlueprintPackages.Contains(PackageName))
+	{
+		return FLuaValue();
+	}
+
+	return LuaBlueprintPackages[PackageName]->SelfTable;
+}
+
+bool ULuaState::RunCodeAsset(ULuaCode* CodeAsset, int NRet)
+{
+
+	if (CodeAsset->bCooked && CodeAsset->bCookAsBytecode)
+	{
+#if PLATFORM_ANDROID
+		// fix size_t of the bytecode
+		if (CodeAsset->ByteCode.Num() >= 14)
+			CodeAsset->ByteCode[13] = sizeof(size_t);
+#endif
+		return RunCode(CodeAsset->ByteCode, CodeAsset->GetPathName(), NRet);
+	}
+
+	return RunCode(CodeAsset->Code.ToString(), CodeAsset->GetPathName(), NRet);
+
+}
+
+bool ULuaState::RunFile(const FString& Filename, bool bIgnoreNonExistent, int NRet, bool bNonContentDirectory)
+{
+	TArray<uint8> Code;
+	FString AbsoluteFilename = FPaths::Combine(FPaths::ProjectContentDir(), Filename);
+
+	if (bNonContentDirectory)
+	{
+		AbsoluteFilename = Filename;
+	}
+
+	if (!FPaths::FileExists(AbsoluteFilename))
+	{
+		if (bIgnoreNonExistent)
+			return true;
+		LastError = FString::Printf(TEXT("Unable to open file %s"), *Filename);
+		FLuaValue LuaLastError = FLuaValue(LastError);
+		FromLuaValue(LuaLastError);
+		return false;
+	}
+
+	if (FFileHelper::LoadFileToArray(Code, *AbsoluteFilename))
+	{
+		if (RunCode(Code, AbsoluteFilename, NRet))
+		{
+			return true;
+		}
+		return false;
+	}
+
+	LastError = FString::Printf(TEXT("Unable to open file %s"), *Filename);
+	FLuaValue LuaLastError = FLuaValue(LastError);
 	FromLuaValue(LuaLastError);
 	return false;
 }
@@ -385,7 +941,23 @@ bool ULuaState::RunCode(const TArray<uint8>& Code, const FString& CodePath, int
 {
 	FString FullCodePath = FString("@") + CodePath;
 
-	if (luaL_loadbuffer(L, (const char*)Code.GetData(), Code.Num(), TCHAR_TO_ANSI(*FullCodePath)))
+	FLuaExecutionScope ExecutionScope(this);
+
+	bool bLoadFailed = false;
+	int32 PrecompiledChunk = LUA_NOREF;
+	if (PrecompiledChunks.RemoveAndCopyValue(CodePath, PrecompiledChunk))
+	{
+		// already compiled by InitializeLuaVM()
+		lua_rawgeti(L, LUA_REGISTRYINDEX, PrecompiledChunk);
+		luaL_unref(L, LUA_REGISTRYINDEX, PrecompiledChunk);
+	}
+	else
+	{
+		LUAMACHINE_TRACE_SCOPE(this, GetSpecId(TEXT("Compile ") + CodePath));
+		bLoadFailed = luaL_loadbuffer(L, (const char*)Code.GetData(), Code.Num(), TCHAR_TO_ANSI(*FullCodePath)) != LUA_OK;
+	}
+
+	if (bLoadFailed)
 	{
 		LastError = FString::Printf(TEXT("Lua loading error: %s"), ANSI_TO_TCHAR(lua_tostring(L, -1)));
 		return false;
@@ -467,7 +1039,7 @@ void ULuaState::FromLuaValue(FLuaValue& LuaValue, UObject* CallContext, lua_Stat
 			lua_newtable(State);
 			lua_pushvalue(State, -1);
 			// hold references in the main state
-			LuaValue.LuaRef = luaL_ref(this->L, LUA_REGISTRYINDEX);
+			LuaValue.LuaRef = NewRef();
 			LuaValue.LuaState = this;
 			break;
 		}
@@ -485,7 +1057,7 @@ void ULuaState::FromLuaValue(FLuaValue& LuaValue, UObject* CallContext, lua_Stat
 		{
 			lua_newthread(State);
 			lua_pushvalue(State, -1);
-			LuaValue.LuaRef = luaL_ref(this->L, LUA_REGISTRYINDEX);
+			LuaValue.LuaRef = NewRef();
 			LuaValue.LuaState = this;
 			break;
 		}
@@ -667,7 +1239,7 @@ FLuaValue ULuaState::ToLuaValue(int Index, lua_State* State)
 			lua_xmove(State, this->L, 1);
 		LuaValue.Type = ELuaValueType::Table;
 		LuaValue.LuaState = this;
-		LuaValue.LuaRef = luaL_ref(this->L, LUA_REGISTRYINDEX);
+		LuaValue.LuaRef = NewRef();
 	}
 	else if (lua_isthread(State, Index))
 	{
@@ -676,7 +1248,7 @@ FLuaValue ULuaState::ToLuaValue(int Index, lua_State* State)
 			lua_xmove(State, this->L, 1);
 		LuaValue.Type = ELuaValueType::Thread;
 		LuaValue.LuaState = this;
-		LuaValue.LuaRef = luaL_ref(this->L, LUA_REGISTRYINDEX);
+		LuaValue.LuaRef = NewRef();
 	}
 	else if (lua_isfunction(State, Index))
 	{
@@ -685,7 +1257,7 @@ FLuaValue ULuaState::ToLuaValue(int Index, lua_State* State)
 			lua_xmove(State, this->L, 1);
 		LuaValue.Type = ELuaValueType::Function;
 		LuaValue.LuaState = this;
-		LuaValue.LuaRef = luaL_ref(this->L, LUA_REGISTRYINDEX);
+		LuaValue.LuaRef = NewRef();
 	}
 	else if (lua_isuserdata(State, Index))
 	{
@@ -710,191 +1282,585 @@ FLuaValue ULuaState::ToLuaValue(int Index, lua_State* State)
 			}
 			break;
 		}
-	}
+	}
+
+	return LuaValue;
+}
+
+int32 ULuaState::GetTop()
+{
+	return lua_gettop(L);
+}
+
+int ULuaState::MetaTableFunctionUserData__index(lua_State* L)
+{
+
+	ULuaState* LuaState = ULuaState::GetFromExtraSpace(L);
+	FLuaUserData* UserData = (FLuaUserData*)lua_touserdata(L, 1);
+
+	if (!UserData->Context.IsValid())
+	{
+		return luaL_error(L, "invalid UObject for UserData %p", UserData);
+	}
+
+	TMap<FString, FLuaValue>* TablePtr = nullptr;
+	UObject* Context = UserData->Context.Get();
+
+	ULuaUserDataObject* LuaUserDataObject = nullptr;
+	ULuaComponent* LuaComponent = nullptr;
+
+	FString Key = ANSI_TO_TCHAR(lua_tostring(L, 2));
+
+	LuaComponent = Cast<ULuaComponent>(Context);
+
+	if (LuaComponent)
+	{
+		TablePtr = &LuaComponent->Table;
+	}
+	else
+	{
+		LuaUserDataObject = Cast<ULuaUserDataObject>(Context);
+		if (LuaUserDataObject)
+		{
+			TablePtr = &LuaUserDataObject->Table;
+		}
+	}
+
+	if (TablePtr)
+	{
+		FLuaValue* LuaValue = TablePtr->Find(Key);
+		if (LuaValue)
+		{
+			LuaState->FromLuaValue(*LuaValue, Context, L);
+			return 1;
+
+		}
+	}
+
+	if (LuaComponent)
+	{
+		FLuaValue MetaIndexReturnValue = LuaComponent->ReceiveLuaMetaIndex(Key);
+		LuaState->FromLuaValue(MetaIndexReturnValue, Context, L);
+		return 1;
+	}
+
+	if (LuaUserDataObject)
+	{
+		FLuaValue MetaIndexReturnValue = LuaUserDataObject->ReceiveLuaMetaIndex(Key);
+		LuaState->FromLuaValue(MetaIndexReturnValue, MetaIndexReturnValue.Object ? MetaIndexReturnValue.Object : Context, L);
+		return 1;
+	}
+
+	lua_pushnil(L);
+	return 1;
+}
+
+int ULuaState::MetaTableFunctionUserData__newindex(lua_State* L)
+{
+	ULuaState* LuaState = ULuaState::GetFromExtraSpace(L);
+	FLuaUserData* UserData = (FLuaUserData*)lua_touserdata(L, 1);
+	if (!UserData->Context.IsValid())
+	{
+		return luaL_error(L, "invalid UObject for UserData %p", UserData);
+	}
+
+	TMap<FString, FLuaValue>* TablePtr = nullptr;
+	UObject* Context = UserData->Context.Get();
+
+	ULuaComponent* LuaComponent = Cast<ULuaComponent>(Context);
+
+	if (LuaComponent)
+	{
+		TablePtr = &LuaComponent->Table;
+	}
+	else if (ULuaUserDataObject* LuaUserDataObject = Cast<ULuaUserDataObject>(Context))
+	{
+		TablePtr = &LuaUserDataObject->Table;
+	}
+
+	if (TablePtr)
+	{
+		FString Key = ANSI_TO_TCHAR(lua_tostring(L, 2));
+
+		FLuaValue* LuaValue = TablePtr->Find(Key);
+		if (LuaValue)
+		{
+			*LuaValue = LuaState->ToLuaValue(3, L);
+		}
+		else
+		{
+			if (LuaComponent)
+			{
+				if (LuaComponent->ReceiveLuaMetaNewIndex(LuaState->ToLuaValue(2, L), LuaState->ToLuaValue(3, L)))
+				{
+					return 0;
+				}
+			}
+			TablePtr->Add(Key, LuaState->ToLuaValue(3, L));
+		}
+	}
+
+	return 0;
+}
+
+FLuaDebug ULuaState::LuaGetInfo(int32 Level)
+{
+	lua_Debug ar;
+	if (lua_getstack(L, Level, &ar) != 1)
+		return FLuaDebug();
+	lua_getinfo(L, "lSn", &ar);
+	FLuaDebug LuaDebug;
+	LuaDebug.CurrentLine = ar.currentline;
+	LuaDebug.Source = ANSI_TO_TCHAR(ar.source);
+	LuaDebug.Name = ANSI_TO_TCHAR(ar.name);
+	LuaDebug.NameWhat = ANSI_TO_TCHAR(ar.namewhat);
+	LuaDebug.What = ANSI_TO_TCHAR(ar.what);
+
+	return LuaDebug;
+}
+
+TMap<FString, FLuaValue> ULuaState::LuaGetLocals(int32 Level)
+{
+	return GetLocals(L, Level);
+}
+
+TMap<FString, FLuaValue> ULuaState::GetLocals(lua_State* Thread, const int32 Level)
+{
+	TMap<FString, FLuaValue> ReturnValue;
+
+	lua_Debug ar;
+	if (lua_getstack(Thread, Level, &ar) != 1)
+		return ReturnValue;
+
+	int Index = 1;
+	const char* name = lua_getlocal(Thread, &ar, Index);
+	while (name)
+	{
+		FLuaValue LuaValue = ToLuaValue(-1, Thread);
+		ReturnValue.Add(ANSI_TO_TCHAR(name), LuaValue);
+		lua_pop(Thread, 1);
+		name = lua_getlocal(Thread, &ar, ++Index);
+	}
+	return ReturnValue;
+}
+
+void ULuaState::Debug_Hook(lua_State* L, lua_Debug* ar)
+{
+	ULuaState* LuaState = ULuaState::GetFromExtraSpace(L);
+
+	// could raise a Lua error, no object with a destructor must be alive in this frame
+	if (ar->event == LUA_HOOKCOUNT && LuaState->bEnableWatchdog && LuaState->ExecutionDepth > 0)
+	{
+		Watchdog_Check(L, LuaState);
+	}
+
+	// hooks are never nested (lua disables them while one is running), a stale flag could only come from an error raised by a listener
+	LuaState->bDispatchingHook = true;
+	LuaState->bThreadOnDemandRequested = false;
+
+	const int32 EventMask = ar->event == LUA_HOOKTAILCALL ? LUA_MASKCALL : (1 << ar->event);
+	FLuaHookEvent Event(L, ar);
+	for (int32 Index = 0; Index < LuaState->ActiveHookListeners.Num(); Index++)
+	{
+		FLuaActiveHookListener& ActiveListener = LuaState->ActiveHookListeners[Index];
+		if (!(ActiveListener.Mask & EventMask))
+		{
+			continue;
+		}
+
+		// the installed count is the lowest one, every listener accumulates up to its own
+		if (EventMask == LUA_MASKCOUNT)
+		{
+			ActiveListener.PendingInstructions += LuaState->CurrentHookCount;
+			if (ActiveListener.PendingInstructions < ActiveListener.InstructionCount)
+			{
+				continue;
+			}
+			ActiveListener.PendingInstructions = 0;
+		}
+
+		ActiveListener.Listener->OnLuaHook(LuaState, Event);
+	}
+
+	LuaState->bDispatchingHook = false;
+	if (LuaState->bHookRefreshPending)
+	{
+		LuaState->RefreshDebugHook();
+	}
+
+	if (LuaState->bThreadOnDemandRequested)
+	{
+		LuaState->bThreadOnDemandRequested = false;
+		LuaState->SetThreadOnDemandHook(L, LuaState->PendingThreadOnDemandMask);
+	}
+	// the thread could still have the on demand events of a listener no longer active
+	else if (lua_gethookmask(L) & ~(LuaState->CurrentHookMask | LuaState->CurrentOnDemandHookMask))
+	{
+		LuaState->SetThreadOnDemandHook(L, 0);
+	}
+}
+
+void ULuaState::AddHookListener(ILuaHookListener* Listener)
+{
+	HookListeners.AddUnique(Listener);
+	RefreshDebugHook();
+}
+
+void ULuaState::RemoveHookListener(ILuaHookListener* Listener)
+{
+	HookListeners.Remove(Listener);
+	RefreshDebugHook();
+}
+
+void ULuaState::StartRegistryTracking()
+{
+	if (!RegistryTracker.IsValid())
+	{
+		RegistryTracker = MakeShared<FLuaRegistryTracker>();
+	}
+}
+
+void ULuaState::StopRegistryTracking()
+{
+	RegistryTracker.Reset();
+}
+
+void ULuaState::TakeRegistrySnapshot()
+{
+	if (RegistryTracker.IsValid())
+	{
+		RegistryTracker->TakeSnapshot();
+	}
+}
+
+FString ULuaState::GetRegistryCensus(const int32 NumEntries)
+{
+	if (!RegistryTracker.IsValid())
+	{
+		return TEXT("registry tracking is not enabled");
+	}
+	return FString::Printf(TEXT("registry size: %d\n"), L ? (int32)lua_rawlen(L, LUA_REGISTRYINDEX) : 0) + RegistryTracker->GetCensus(NumEntries);
+}
+
+int ULuaState::LuaPanic(lua_State* L)
+{
+	// unprotected error, the VM is going to abort()
+	UE_LOG(LogLuaMachine, Error, TEXT("PANIC: unprotected error in call to Lua API (%s)"), ANSI_TO_TCHAR(lua_tostring(L, -1)));
+	return 0;
+}
+
+void ULuaState::StartAllocationTracking()
+{
+	if (Allocator.IsValid())
+	{
+		Allocator->StartTracking();
+	}
+}
+
+void ULuaState::StopAllocationTracking()
+{
+	if (Allocator.IsValid())
+	{
+		Allocator->StopTracking();
+	}
+}
+
+void ULuaState::TakeAllocationSnapshot()
+{
+	if (Allocator.IsValid())
+	{
+		Allocator->TakeSnapshot();
+	}
+}
+
+FString ULuaState::GetAllocationReport(const int32 NumEntries)
+{
+	if (!Allocator.IsValid())
+	{
+		return FString();
+	}
+	return Allocator->GetReport(NumEntries);
+}
+
+FString ULuaState::GetAllocationSnapshotDiff(const int32 NumEntries)
+{
+	if (!Allocator.IsValid())
+	{
+		return FString();
+	}
+	return Allocator->GetSnapshotDiff(NumEntries);
+}
+
+void ULuaState::Watchdog_Check(lua_State* L, ULuaState* LuaState)
+{
+	LuaState->WatchdogCallInstructions += LuaState->CurrentHookCount;
+	if (LuaState->WatchdogInstructionBudget > 0 && LuaState->WatchdogCallInstructions > LuaState->WatchdogInstructionBudget)
+	{
+		luaL_error(L, "watchdog: instruction budget exceeded (%d instructions)", LuaState->WatchdogInstructionBudget);
+		return;
+	}
+
+	if (LuaState->WatchdogTimeBudget <= 0 && LuaState->WatchdogFrameTimeBudget <= 0)
+	{
+		return;
+	}
+
+	const double ElapsedSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - LuaState->ExecutionStartCycles);
+	if (LuaState->WatchdogTimeBudget > 0 && ElapsedSeconds > LuaState->WatchdogTimeBudget)
+	{
+		luaL_error(L, "watchdog: time budget exceeded (%f seconds)", LuaState->WatchdogTimeBudget);
+		return;
+	}
+
+	if (LuaState->WatchdogFrameTimeBudget > 0 && LuaState->WatchdogFrameNumber == GFrameCounter &&
+		FPlatformTime::ToSeconds64(LuaState->WatchdogFrameCycles) + ElapsedSeconds > LuaState->WatchdogFrameTimeBudget)
+	{
+		luaL_error(L, "watchdog: frame time budget exceeded (%f seconds)", LuaState->WatchdogFrameTimeBudget);
+		return;
+	}
+}
+
+void ULuaState::RefreshDebugHook()
+{
+	if (!L)
+	{
+		return;
+	}
+
+	// do not touch the listeners array while it is being iterated
+	if (bDispatchingHook)
+	{
+		bHookRefreshPending = true;
+		return;
+	}
+	bHookRefreshPending = false;
+
+	int DebugMask = 0;
+	int DebugCount = 0;
+	int32 OnDemandMask = 0;
+
+	TArray<FLuaActiveHookListener> PreviousListeners = MoveTemp(ActiveHookListeners);
+	ActiveHookListeners.Reset();
+
+	for (ILuaHookListener* Listener : HookListeners)
+	{
+		const int32 ListenerMask = Listener->GetLuaHookMask();
+		if (ListenerMask == 0)
+		{
+			continue;
+		}
 
-	return LuaValue;
-}
+		const int32 ListenerOnDemandMask = Listener->GetLuaHookOnDemandMask() & ~LUA_MASKCOUNT;
+		OnDemandMask |= ListenerOnDemandMask;
 
-int32 ULuaState::GetTop()
-{
-	return lua_gettop(L);
-}
+		FLuaActiveHookListener ActiveListener;
+		ActiveListener.Listener = Listener;
+		ActiveListener.Mask = ListenerMask | ListenerOnDemandMask;
+		ActiveListener.InstructionCount = 0;
+		ActiveListener.PendingInstructions = 0;
 
-int ULuaState::MetaTableFunctionUserData__index(lua_State* L)
-{
+		if (ListenerMask & LUA_MASKCOUNT)
+		{
+			ActiveListener.InstructionCount = FMath::Max(Listener->GetLuaHookInstructionCount(), 1);
+			DebugCount = DebugCount > 0 ? FMath::Min(DebugCount, ActiveListener.InstructionCount) : ActiveListener.InstructionCount;
+			for (const FLuaActiveHookListener& PreviousListener : PreviousListeners)
+			{
+				if (PreviousListener.Listener == Listener)
+				{
+					ActiveListener.PendingInstructions = PreviousListener.PendingInstructions;
+					break;
+				}
+			}
+		}
 
-	ULuaState* LuaState = ULuaState::GetFromExtraSpace(L);
-	FLuaUserData* UserData = (FLuaUserData*)lua_touserdata(L, 1);
+		DebugMask |= ListenerMask;
+		ActiveHookListeners.Add(ActiveListener);
+	}
 
-	if (!UserData->Context.IsValid())
+	if (bEnableWatchdog)
 	{
-		return luaL_error(L, "invalid UObject for UserData %p", UserData);
+		const int32 WatchdogCount = FMath::Max(WatchdogCheckInstructionCount, 1);
+		DebugMask |= LUA_MASKCOUNT;
+		DebugCount = DebugCount > 0 ? FMath::Min(DebugCount, WatchdogCount) : WatchdogCount;
 	}
 
-	TMap<FString, FLuaValue>* TablePtr = nullptr;
-	UObject* Context = UserData->Context.Get();
-
-	ULuaUserDataObject* LuaUserDataObject = nullptr;
-	ULuaComponent* LuaComponent = nullptr;
+	bTraceHookInstalled = false;
+#if LUAMACHINE_TRACE_ENABLED
+	if (Tracer.IsValid())
+	{
+		bTraceHookInstalled = Tracer->GetLuaHookMask() != 0;
+	}
+#endif
 
-	FString Key = ANSI_TO_TCHAR(lua_tostring(L, 2));
+	CurrentHookMask = DebugMask;
+	CurrentHookCount = DebugCount;
+	CurrentOnDemandHookMask = OnDemandMask;
 
-	LuaComponent = Cast<ULuaComponent>(Context);
+	// coroutines created from now on will inherit the hook
+	lua_sethook(L, DebugMask != 0 ? Debug_Hook : nullptr, DebugMask, DebugCount);
+}
 
-	if (LuaComponent)
+void ULuaState::SyncThreadHook(lua_State* Thread)
+{
+	if (Thread == L || bDispatchingHook)
 	{
-		TablePtr = &LuaComponent->Table;
+		return;
 	}
-	else
+
+	// lua_sethook() only changes the thread it is called on, the coroutines keep the hook they were created with
+	const int32 ThreadMask = lua_gethookmask(Thread);
+	const bool bMissingEvents = (ThreadMask & CurrentHookMask) != CurrentHookMask;
+	const bool bStaleEvents = (ThreadMask & ~(CurrentHookMask | CurrentOnDemandHookMask)) != 0;
+	const bool bStaleCount = (CurrentHookMask & LUA_MASKCOUNT) && lua_gethookcount(Thread) != CurrentHookCount;
+	if (bMissingEvents || bStaleEvents || bStaleCount)
 	{
-		LuaUserDataObject = Cast<ULuaUserDataObject>(Context);
-		if (LuaUserDataObject)
-		{
-			TablePtr = &LuaUserDataObject->Table;
-		}
+		const int32 Mask = CurrentHookMask | (ThreadMask & CurrentOnDemandHookMask);
+		lua_sethook(Thread, Mask != 0 ? Debug_Hook : nullptr, Mask, CurrentHookCount);
 	}
+}
 
-	if (TablePtr)
+void ULuaState::SetThreadOnDemandHook(lua_State* Thread, const int32 OnDemandMask)
+{
+	// applied by Debug_Hook once every listener has seen the event
+	if (bDispatchingHook)
 	{
-		FLuaValue* LuaValue = TablePtr->Find(Key);
-		if (LuaValue)
-		{
-			LuaState->FromLuaValue(*LuaValue, Context, L);
-			return 1;
+		PendingThreadOnDemandMask = bThreadOnDemandRequested ? (PendingThreadOnDemandMask | OnDemandMask) : OnDemandMask;
+		bThreadOnDemandRequested = true;
+		return;
+	}
 
-		}
+	const int32 Mask = CurrentHookMask | (OnDemandMask & CurrentOnDemandHookMask);
+	// lua_sethook() restarts the instruction count, so call it only on real changes
+	if (lua_gethookmask(Thread) != Mask)
+	{
+		lua_sethook(Thread, Mask != 0 ? Debug_Hook : nullptr, Mask, CurrentHookCount);
 	}
+}
 
-	if (LuaComponent)
+void ULuaState::StartSamplingProfiler(const int32 InstructionCount, const float Interval, const bool bReset)
+{
+	if (!SamplingProfiler.IsValid())
 	{
-		FLuaValue MetaIndexReturnValue = LuaComponent->ReceiveLuaMetaIndex(Key);
-		LuaState->FromLuaValue(MetaIndexReturnValue, Context, L);
-		return 1;
+		SamplingProfiler = MakeShared<FLuaSamplingProfiler>();
+		HookListeners.Add(SamplingProfiler.Get());
+	}
+	else if (bReset)
+	{
+		SamplingProfiler->Reset();
 	}
 
-	if (LuaUserDataObject)
+	SamplingProfiler->Start(InstructionCount, Interval);
+	RefreshDebugHook();
+}
+
+void ULuaState::StopSamplingProfiler()
+{
+	if (!SamplingProfiler.IsValid())
 	{
-		FLuaValue MetaIndexReturnValue = LuaUserDataObject->ReceiveLuaMetaIndex(Key);
-		LuaState->FromLuaValue(MetaIndexReturnValue, MetaIndexReturnValue.Object ? MetaIndexReturnValue.Object : Context, L);
-		return 1;
+		return;
 	}
 
-	lua_pushnil(L);
-	return 1;
+	SamplingProfiler->Stop();
+	RefreshDebugHook();
 }
 
-int ULuaState::MetaTableFunctionUserData__newindex(lua_State* L)
+FString ULuaState::GetSamplingProfilerReport(const int32 NumEntries)
 {
-	ULuaState* LuaState = ULuaState::GetFromExtraSpace(L);
-	FLuaUserData* UserData = (FLuaUserData*)lua_touserdata(L, 1);
-	if (!UserData->Context.IsValid())
+	if (!SamplingProfiler.IsValid())
 	{
-		return luaL_error(L, "invalid UObject for UserData %p", UserData);
+		return FString();
 	}
 
-	TMap<FString, FLuaValue>* TablePtr = nullptr;
-	UObject* Context = UserData->Context.Get();
+	return SamplingProfiler->GetTopEntriesReport(NumEntries);
+}
 
-	ULuaComponent* LuaComponent = Cast<ULuaComponent>(Context);
+bool ULuaState::SaveSamplingProfilerCollapsedStacks(const FString& Filename)
+{
+	if (!SamplingProfiler.IsValid())
+	{
+		return false;
+	}
 
-	if (LuaComponent)
+	return FFileHelper::SaveStringToFile(SamplingProfiler->ExportCollapsedStacks(), *Filename);
+}
+
+void ULuaState::StartCoverage(const TArray<FString>& Filters, const bool bReset)
+{
+	if (!Coverage.IsValid())
 	{
-		TablePtr = &LuaComponent->Table;
+		Coverage = MakeShared<FLuaCoverage>();
+		HookListeners.Add(Coverage.Get());
 	}
-	else if (ULuaUserDataObject* LuaUserDataObject = Cast<ULuaUserDataObject>(Context))
+	else if (bReset)
 	{
-		TablePtr = &LuaUserDataObject->Table;
+		Coverage->Reset();
 	}
 
-	if (TablePtr)
-	{
-		FString Key = ANSI_TO_TCHAR(lua_tostring(L, 2));
+	Coverage->Start(Filters);
+	RefreshDebugHook();
+}
 
-		FLuaValue* LuaValue = TablePtr->Find(Key);
-		if (LuaValue)
-		{
-			*LuaValue = LuaState->ToLuaValue(3, L);
-		}
-		else
-		{
-			if (LuaComponent)
-			{
-				if (LuaComponent->ReceiveLuaMetaNewIndex(LuaState->ToLuaValue(2, L), LuaState->ToLuaValue(3, L)))
-				{
-					return 0;
-				}
-			}
-			TablePtr->Add(Key, LuaState->ToLuaValue(3, L));
-		}
+void ULuaState::StopCoverage()
+{
+	if (!Coverage.IsValid())
+	{
+		return;
 	}
 
-	return 0;
+	Coverage->Stop();
+	RefreshDebugHook();
 }
 
-FLuaDebug ULuaState::LuaGetInfo(int32 Level)
+FString ULuaState::GetCoverageSummary()
 {
-	lua_Debug ar;
-	if (lua_getstack(L, Level, &ar) != 1)
-		return FLuaDebug();
-	lua_getinfo(L, "lSn", &ar);
-	FLuaDebug LuaDebug;
-	LuaDebug.CurrentLine = ar.currentline;
-	LuaDebug.Source = ANSI_TO_TCHAR(ar.source);
-	LuaDebug.Name = ANSI_TO_TCHAR(ar.name);
-	LuaDebug.NameWhat = ANSI_TO_TCHAR(ar.namewhat);
-	LuaDebug.What = ANSI_TO_TCHAR(ar.what);
+	if (!Coverage.IsValid())
+	{
+		return FString();
+	}
 
-	return LuaDebug;
+	return Coverage->GetSummary();
 }
 
-TMap<FString, FLuaValue> ULuaState::LuaGetLocals(int32 Level)
+bool ULuaState::SaveCoverageLcov(const FString& Filename, const FString& TestName)
 {
-	TMap<FString, FLuaValue> ReturnValue;
+	if (!Coverage.IsValid())
+	{
+		return false;
+	}
 
-	lua_Debug ar;
-	if (lua_getstack(L, Level, &ar) != 1)
-		return ReturnValue;
+	return Coverage->SaveLcov(Filename, TestName);
+}
 
-	int Index = 1;
-	const char* name = lua_getlocal(L, &ar, Index);
-	while (name)
+bool ULuaState::StartDebugServer(const int32 Port)
+{
+#if LUAMACHINE_WITH_DEBUG_SERVER
+	if (!DebugServer.IsValid())
 	{
-		FLuaValue LuaValue = ToLuaValue(-1);
-		ReturnValue.Add(ANSI_TO_TCHAR(name), LuaValue);
-		Pop();
-		name = lua_getlocal(L, &ar, ++Index);
+		DebugServer = MakeShared<FLuaDebugServer>(this);
+		HookListeners.Add(DebugServer.Get());
 	}
-	return ReturnValue;
+
+	if (!DebugServer->Listen(Port))
+	{
+		UE_LOG(LogLuaMachine, Error, TEXT("%s: unable to start the debug server on port %d"), *GetClass()->GetName(), Port);
+		return false;
+	}
+
+	UE_LOG(LogLuaMachine, Log, TEXT("%s: debug server listening on 127.0.0.1:%d"), *GetClass()->GetName(), Port);
+	return true;
+#else
+	return false;
+#endif
 }
 
-void ULuaState::Debug_Hook(lua_State* L, lua_Debug* ar)
+void ULuaState::StopDebugServer()
 {
-	ULuaState* LuaState = ULuaState::GetFromExtraSpace(L);
-	FLuaDebug LuaDebug;
-	lua_getinfo(L, "lSn", ar);
-	LuaDebug.CurrentLine = ar->currentline;
-	LuaDebug.Source = ANSI_TO_TCHAR(ar->source);
-	LuaDebug.Name = ANSI_TO_TCHAR(ar->name);
-	LuaDebug.NameWhat = ANSI_TO_TCHAR(ar->namewhat);
-	LuaDebug.What = ANSI_TO_TCHAR(ar->what);
-
-	switch (ar->event)
+#if LUAMACHINE_WITH_DEBUG_SERVER
+	if (DebugServer.IsValid())
 	{
-	case LUA_HOOKLINE:
-		LuaState->ReceiveLuaLineHook(LuaDebug);
-		break;
-	case LUA_HOOKCALL:
-		LuaState->ReceiveLuaCallHook(LuaDebug);
-		break;
-	case LUA_HOOKRET:
-		LuaState->ReceiveLuaReturnHook(LuaDebug);
-		break;
-	case LUA_HOOKCOUNT:
-		LuaState->ReceiveLuaCountHook(LuaDebug);
-		break;
-	default:
-		break;
+		DebugServer->Close();
 	}
+#endif
 }
 
 int ULuaState::MetaTableFunctionUserData__eq(lua_State* L)
@@ -1003,8 +1969,10 @@ int ULuaState::MetaTableFunction__call(lua_State* L)
 		}
 	}
 
+	FLuaBridgeStatsScope BridgeStatsScope(LuaState->FrameStats);
 	FScopeCycleCounterUObject ObjectScope(CallScope);
 	FScopeCycleCounterUObject FunctionScope(LuaCallContext->Function.Get());
+	LUAMACHINE_TRACE_SCOPE(LuaState, GetBridgeSpecId(LuaCallContext->Function.Get()));
 
 	void* Parameters = FMemory_Alloca(LuaCallContext->Function->ParmsSize);
 	FMemory::Memzero(Parameters, LuaCallContext->Function->ParmsSize);
@@ -1089,7 +2057,9 @@ int ULuaState::MetaTableFunction__call(lua_State* L)
 	}
 
 	LuaState->InceptionLevel++;
+	BridgeStatsScope.PauseForProcessEvent();
 	CallScope->ProcessEvent(LuaCallContext->Function.Get(), Parameters);
+	BridgeStatsScope.ResumeAfterProcessEvent();
 	check(LuaState->InceptionLevel > 0);
 	LuaState->InceptionLevel--;
 
@@ -1243,8 +2213,10 @@ int ULuaState::MetaTableFunction__rawcall(lua_State * L)
 		}
 	}
 
+	FLuaBridgeStatsScope BridgeStatsScope(LuaState->FrameStats);
 	FScopeCycleCounterUObject ObjectScope(CallScope);
 	FScopeCycleCounterUObject FunctionScope(LuaCallContext->Function.Get());
+	LUAMACHINE_TRACE_SCOPE(LuaState, GetBridgeSpecId(LuaCallContext->Function.Get()));
 
 	void* Parameters = FMemory_Alloca(LuaCallContext->Function->ParmsSize);
 	FMemory::Memzero(Parameters, LuaCallContext->Function->ParmsSize);
@@ -1285,7 +2257,9 @@ int ULuaState::MetaTableFunction__rawcall(lua_State * L)
 	}
 
 	LuaState->InceptionLevel++;
+	BridgeStatsScope.PauseForProcessEvent();
 	CallScope->ProcessEvent(LuaCallContext->Function.Get(), Parameters);
+	BridgeStatsScope.ResumeAfterProcessEvent();
 	check(LuaState->InceptionLevel > 0);
 	LuaState->InceptionLevel--;
 
@@ -1374,7 +2348,9 @@ int ULuaState::MetaTableFunction__rawbroadcast(lua_State * L)
 	int NArgs = lua_gettop(L);
 	int StackPointer = 2;
 
+	FLuaBridgeStatsScope BridgeStatsScope(LuaState->FrameStats);
 	FScopeCycleCounterUObject FunctionScope(LuaCallContext->Function.Get());
+	LUAMACHINE_TRACE_SCOPE(LuaState, GetBridgeSpecId(LuaCallContext->Function.Get()));
 
 	void* Parameters = FMemory_Alloca(LuaCallContext->Function->ParmsSize);
 	FMemory::Memzero(Parameters, LuaCallContext->Function->ParmsSize);
@@ -1397,7 +2373,9 @@ int ULuaState::MetaTableFunction__rawbroadcast(lua_State * L)
 	}
 
 	LuaState->InceptionLevel++;
+	BridgeStatsScope.PauseForProcessEvent();
 	LuaCallContext->MulticastScriptDelegate->ProcessMulticastDelegate<UObject>(Parameters);
+	BridgeStatsScope.ResumeAfterProcessEvent();
 	check(LuaState->InceptionLevel > 0);
 	LuaState->InceptionLevel--;
 
@@ -1454,6 +2432,12 @@ int ULuaState::TableFunction_package_loader_codeasset(lua_State * L)
 	// use the second (sanitized by the loader) argument
 	FString Key = ANSI_TO_TCHAR(lua_tostring(L, 2));
 
+	// asset registry lookups and asset loading are game thread only (modules required by PreloadModules in a worker thread)
+	if (!IsInGameThread())
+	{
+		return luaL_error(L, "unable to load asset '%s' outside of the game thread", TCHAR_TO_UTF8(*Key));
+	}
+
 	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>(TEXT("AssetRegistry"));
 #if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
 	FAssetData AssetData = AssetRegistryModule.Get().GetAssetByObjectPath(Key);
@@ -1470,6 +2454,7 @@ int ULuaState::TableFunction_package_loader_codeasset(lua_State * L)
 			{
 				return luaL_error(L, "%s", lua_tostring(L, -1));
 			}
+			LuaState->RecordModuleSource(UTF8_TO_TCHAR(lua_tostring(L, 1)), FString(), LuaCode);
 			return 1;
 		}
 	}
@@ -1486,6 +2471,7 @@ int ULuaState::TableFunction_package_loader_asset(lua_State * L)
 
 	if (LuaState->RunFile(Key, true, 1))
 	{
+		LuaState->RecordModuleSource(UTF8_TO_TCHAR(lua_tostring(L, 1)), FPaths::Combine(FPaths::ProjectContentDir(), Key), nullptr);
 		return 1;
 	}
 	return luaL_error(L, "%s", lua_tostring(L, -1));
@@ -1566,6 +2552,7 @@ int ULuaState::TableFunction_package_preload(lua_State * L)
 	{
 		if (LuaState->bAddProjectContentDirToPackagePath && LuaState->RunFile(Key + ".lua", true, 1))
 		{
+			LuaState->RecordModuleSource(Key, FPaths::Combine(FPaths::ProjectContentDir(), Key + ".lua"), nullptr);
 			return 1;
 		}
 
@@ -1574,6 +2561,7 @@ int ULuaState::TableFunction_package_preload(lua_State * L)
 		{
 			if (LuaState->RunFile(AdditionalPath / Key + ".lua", true, 1))
 			{
+				LuaState->RecordModuleSource(Key, FPaths::Combine(FPaths::ProjectContentDir(), AdditionalPath / Key + ".lua"), nullptr);
 				return 1;
 			}
 			return luaL_error(L, "%s", lua_tostring(L, -1));
@@ -1588,11 +2576,17 @@ int ULuaState::TableFunction_package_preload(lua_State * L)
 		return luaL_error(L, "LuaCodeAsset not set for package %s", TCHAR_TO_ANSI(*Key));
 	}
 
+	if (!IsInGameThread())
+	{
+		return luaL_error(L, "unable to load LuaCodeAsset of package %s outside of the game thread", TCHAR_TO_ANSI(*Key));
+	}
+
 	if (!LuaState->RunCodeAsset(LuaCode, 1))
 	{
 		return luaL_error(L, "%s", lua_tostring(L, -1));
 	}
 
+	LuaState->RecordModuleSource(Key, FString(), LuaCode);
 	return 1;
 }
 
@@ -1641,6 +2635,47 @@ void ULuaState::ReceiveLuaStateInitialized_Implementation()
 
 }
 
+void ULuaState::ReceiveLuaModuleReloaded_Implementation(const FString& ModuleName)
+{
+
+}
+
+void ULuaState::RecordModuleSource(const FString& ModuleName, const FString& Filename, ULuaCode* InLuaCode)
+{
+	// non existent files are ignored by the loaders
+	if (ModuleReloader.IsValid() && (InLuaCode || FPaths::FileExists(Filename)))
+	{
+		ModuleReloader->RecordModuleSource(ModuleName, Filename, InLuaCode);
+	}
+}
+
+bool ULuaState::ReloadModule(const FString& ModuleName)
+{
+	if (!ModuleReloader.IsValid())
+	{
+		return false;
+	}
+	return ModuleReloader->ReloadModule(ModuleName);
+}
+
+int32 ULuaState::ReloadModifiedModules()
+{
+	if (!ModuleReloader.IsValid())
+	{
+		return 0;
+	}
+	return ModuleReloader->ReloadModifiedModules();
+}
+
+int32 ULuaState::ReloadLuaCodeModules(ULuaCode* InLuaCode)
+{
+	if (!ModuleReloader.IsValid())
+	{
+		return 0;
+	}
+	return ModuleReloader->ReloadLuaCodeModules(InLuaCode);
+}
+
 void ULuaState::NewTable()
 {
 	lua_newtable(L);
@@ -1796,6 +2831,9 @@ bool ULuaState::PCall(int NArgs, FLuaValue & Value, int NRet)
 
 bool ULuaState::Call(int NArgs, FLuaValue & Value, int NRet)
 {
+	FLuaExecutionScope ExecutionScope(this);
+	LUAMACHINE_TRACE_SCOPE(this, GetSpecId(TEXT("PCall")));
+
 	if (lua_pcall(L, NArgs, NRet, 0))
 	{
 		LastError = FString::Printf(TEXT("Lua error: %s"), ANSI_TO_TCHAR(lua_tostring(L, -1)));
@@ -1831,6 +2869,10 @@ void* ULuaState::NewUserData(size_t DataSize)
 
 void ULuaState::Unref(int Ref)
 {
+	if (RegistryTracker.IsValid())
+	{
+		RegistryTracker->OnUnref(Ref);
+	}
 	luaL_unref(L, LUA_REGISTRYINDEX, Ref);
 }
 
@@ -1845,6 +2887,15 @@ void ULuaState::UnrefChecked(int Ref)
 
 int ULuaState::NewRef()
 {
+	if (RegistryTracker.IsValid())
+	{
+		// luaL_ref pops the value, so it must be inspected before
+		const int Ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, Ref);
+		RegistryTracker->OnRef(L, Ref);
+		lua_pop(L, 1);
+		return Ref;
+	}
 	return luaL_ref(L, LUA_REGISTRYINDEX);
 }
 
@@ -1902,7 +2953,13 @@ bool ULuaState::Resume(int Index, int NArgs)
 	}
 
 	lua_xmove(L, Coroutine, NArgs);
-	int Ret = lua_resume(Coroutine, L, NArgs);
+	SyncThreadHook(Coroutine);
+	int Ret = LUA_OK;
+	{
+		FLuaExecutionScope ExecutionScope(this);
+		LUAMACHINE_TRACE_SCOPE(this, GetSpecId(TEXT("Resume")));
+		Ret = lua_resume(Coroutine, L, NArgs);
+	}
 	if (Ret != LUA_OK && Ret != LUA_YIELD)
 	{
 		lua_pushboolean(L, 0);
@@ -1918,6 +2975,14 @@ bool ULuaState::Resume(int Index, int NArgs)
 
 int ULuaState::GC(int What, int Data)
 {
+	if (What == LUA_GCCOLLECT || What == LUA_GCSTEP)
+	{
+		LUAMACHINE_TRACE_SCOPE(this, GetSpecId(What == LUA_GCCOLLECT ? TEXT("GC Collect") : TEXT("GC Step")));
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		const int Ret = lua_gc(L, What, Data);
+		FrameStats.GCCycles += FPlatformTime::Cycles64() - StartCycles;
+		return Ret;
+	}
 	return lua_gc(L, What, Data);
 }
 
@@ -2027,6 +3092,13 @@ ULuaState::~ULuaState()
 
 	FLuaMachineModule::Get().UnregisterLuaState(this);
 
+	if (AsyncInitialization.IsValid())
+	{
+		AsyncInitialization.Wait();
+	}
+
+	ModuleReloader.Reset();
+
 	if (L)
 	{
 		lua_close(L);
@@ -2271,6 +3343,78 @@ FLuaValue ULuaState::StructToLuaTable(UScriptStruct * InScriptStruct, const TArr
 	return StructToLuaTable(InScriptStruct, StructData.GetData());
 }
 
+bool ULuaState::SetGlobalDataTable(const FString& Name, UDataTable * DataTable)
+{
+	FLuaDataTablePtr Data = FLuaDataTable::Import(DataTable);
+	if (!Data.IsValid())
+	{
+		return false;
+	}
+
+	PushGlobalTable();
+	FLuaDataTable::PushProxy(L, Data);
+	SetField(-2, TCHAR_TO_ANSI(*Name));
+	Pop();
+	return true;
+}
+
+FLuaValue ULuaState::CopyLuaValue(FLuaValue Value)
+{
+	ULuaState* SourceLuaState = Value.LuaState.Get();
+	// only tables, threads and functions are bound to a LuaState
+	if (!SourceLuaState || SourceLuaState == this || !SourceLuaState->L || Value.LuaRef == LUA_NOREF)
+	{
+		return Value;
+	}
+
+	SourceLuaState->FromLuaValue(Value);
+	FString ErrorString;
+	const bool bSuccess = FLuaValueTransfer::Copy(SourceLuaState->L, -1, L, ErrorString);
+	SourceLuaState->Pop();
+	if (!bSuccess)
+	{
+		LogError(FString::Printf(TEXT("Unable to copy value from %s: %s"), *SourceLuaState->GetName(), *ErrorString));
+		return FLuaValue();
+	}
+
+	FLuaValue ReturnValue = ToLuaValue(-1);
+	Pop();
+	return ReturnValue;
+}
+
+bool ULuaState::SerializeLuaValue(FLuaValue& Value, FLuaSerializedValue& Serialized)
+{
+	ULuaState* SourceLuaState = Value.LuaState.Get();
+	if (!SourceLuaState || !SourceLuaState->L || Value.LuaRef == LUA_NOREF)
+	{
+		SourceLuaState = this;
+	}
+
+	SourceLuaState->FromLuaValue(Value);
+	FString ErrorString;
+	const bool bSuccess = FLuaValueTransfer::Serialize(SourceLuaState->L, -1, Serialized, ErrorString);
+	SourceLuaState->Pop();
+	if (!bSuccess)
+	{
+		LogError(FString::Printf(TEXT("Unable to serialize value: %s"), *ErrorString));
+	}
+	return bSuccess;
+}
+
+FLuaValue ULuaState::DeserializeLuaValue(const FLuaSerializedValue& Serialized)
+{
+	FString ErrorString;
+	if (!FLuaValueTransfer::Deserialize(L, Serialized, ErrorString))
+	{
+		LogError(FString::Printf(TEXT("Unable to deserialize value: %s"), *ErrorString));
+		return FLuaValue();
+	}
+
+	FLuaValue ReturnValue = ToLuaValue(-1);
+	Pop();
+	return ReturnValue;
+}
+
 #if ENGINE_MAJOR_VERSION > 4 || ENGINE_MINOR_VERSION >= 25
 void ULuaState::ToFProperty(void* Buffer, FProperty * Property, FLuaValue Value, bool& bSuccess, int32 Index)
 #else
@@ -1,14 +1,350 @@
 // Copyright 2018-2023 - Roberto De Ioris
 
 #include "LuaTableAsset.h"
+#include "LuaSharedData.h"
+#include "Misc/Crc.h"
+
+// registry keys (their addresses) of the LuaTableImplements cache
+static int32 LuaTableAssetImplementsCache = 0;
+static int32 LuaTableAssetImplementsCacheFrame = 0;
+
+static uint32 LuaTableAssetHash(const uint8* Key, const int32 Length, const uint32 Seed)
+{
+	return FCrc::MemCrc32(Key, Length, Seed);
+}
+
+// same as ULuaState::ToLuaValue(Index).Type, without creating references
+static ELuaValueType LuaTableAssetGetType(lua_State* L, int Index)
+{
+	switch (lua_type(L, Index))
+	{
+	case LUA_TBOOLEAN:
+		return ELuaValueType::Bool;
+	case LUA_TSTRING:
+		return ELuaValueType::String;
+	case LUA_TNUMBER:
+		return lua_isinteger(L, Index) ? ELuaValueType::Integer : ELuaValueType::Number;
+	case LUA_TTABLE:
+		return ELuaValueType::Table;
+	case LUA_TTHREAD:
+		return ELuaValueType::Thread;
+	case LUA_TFUNCTION:
+		return ELuaValueType::Function;
+	case LUA_TUSERDATA:
+	{
+		FLuaUserData* UserData = (FLuaUserData*)lua_touserdata(L, Index);
+		if (UserData->Type == ELuaValueType::UObject && UserData->Context.IsValid())
+		{
+			return ELuaValueType::UObject;
+		}
+		if (UserData->Type == ELuaValueType::UFunction && UserData->Context.IsValid() && UserData->Function.IsValid())
+		{
+			return ELuaValueType::UFunction;
+		}
+		return ELuaValueType::Nil;
+	}
+	default:
+		return ELuaValueType::Nil;
+	}
+}
+
+ULuaTableAsset::ULuaTableAsset()
+{
+	bCacheImplements = false;
+	bBakeDirty = false;
+}
 
 FLuaValue ULuaTableAsset::ToLuaTable(ULuaState* LuaState)
 {
-	FLuaValue NewTable = LuaState->CreateLuaTable();
-	for (TPair<FString, FLuaValue>& Pair : Table)
+	BakeIfRequired();
+
+	lua_State* L = LuaState->GetInternalLuaState();
+	// a single allocation for all of the fields
+	lua_createtable(L, 0, BakedValues.Num());
+	for (int32 Slot = 0; Slot < BakedValues.Num(); Slot++)
 	{
-		NewTable.SetField(Pair.Key, Pair.Value);
+		LuaState->FromLuaValue(BakedValues[Slot]);
+		lua_setfield(L, -2, (const char*)BakedKeys.GetData() + BakedKeyOffsets[Slot]);
 	}
 
+	FLuaValue NewTable = LuaState->ToLuaValue(-1);
+	LuaState->Pop();
 	return NewTable;
-}
\ No newline at end of file
+}
+
+const FLuaValue* ULuaTableAsset::FindField(const FString& Key)
+{
+	BakeIfRequired();
+
+	if (BakedSeeds.Num() == 0)
+	{
+		// empty, or unable to find a perfect hash
+		return Table.Find(Key);
+	}
+
+	FTCHARToUTF8 UTF8Key(*Key);
+	const uint8* KeyData = (const uint8*)UTF8Key.Get();
+
+	const int32 Seed = BakedSeeds[LuaTableAssetHash(KeyData, UTF8Key.Length(), 0) % BakedSeeds.Num()];
+	if (Seed == 0)
+	{
+		return nullptr;
+	}
+
+	const int32 Slot = Seed < 0 ? -Seed - 1 : LuaTableAssetHash(KeyData, UTF8Key.Length(), Seed) % BakedValues.Num();
+	if (FCStringAnsi::Strcmp((const char*)BakedKeys.GetData() + BakedKeyOffsets[Slot], UTF8Key.Get()))
+	{
+		return nullptr;
+	}
+	return &BakedValues[Slot];
+}
+
+bool ULuaTableAsset::MatchesTable(lua_State* L, int Index) const
+{
+	for (int32 Slot = 0; Slot < BakedValues.Num(); Slot++)
+	{
+		lua_getfield(L, Index, (const char*)BakedKeys.GetData() + BakedKeyOffsets[Slot]);
+		const ELuaValueType Type = LuaTableAssetGetType(L, -1);
+		lua_pop(L, 1);
+		if (Type == ELuaValueType::Nil || Type != BakedValues[Slot].Type)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ULuaTableAsset::IsImplementedBy(FLuaValue& LuaTable)
+{
+	if (LuaTable.Type != ELuaValueType::Table)
+		return false;
+
+	ULuaState* LuaState = LuaTable.LuaState.Get();
+	if (!LuaState)
+		return false;
+
+	BakeIfRequired();
+
+	lua_State* L = LuaState->GetInternalLuaState();
+	LuaState->FromLuaValue(LuaTable);
+	const int TableIndex = lua_gettop(L);
+
+	if (!bCacheImplements)
+	{
+		const bool bImplements = MatchesTable(L, TableIndex);
+		lua_settop(L, TableIndex - 1);
+		return bImplements;
+	}
+
+	// table -> {asset -> result}, with weak keys and reset at every frame
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &LuaTableAssetImplementsCacheFrame);
+	const bool bCacheValid = lua_tointeger(L, -1) == (lua_Integer)GFrameCounter;
+	lua_pop(L, 1);
+	if (!bCacheValid)
+	{
+		lua_newtable(L);
+		lua_newtable(L);
+		lua_pushstring(L, "k");
+		lua_setfield(L, -2, "__mode");
+		lua_setmetatable(L, -2);
+		lua_rawsetp(L, LUA_REGISTRYINDEX, &LuaTableAssetImplementsCache);
+		lua_pushinteger(L, (lua_Integer)GFrameCounter);
+		lua_rawsetp(L, LUA_REGISTRYINDEX, &LuaTableAssetImplementsCacheFrame);
+	}
+
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &LuaTableAssetImplementsCache);
+	const int CacheIndex = lua_gettop(L);
+	lua_pushvalue(L, TableIndex);
+	if (lua_rawget(L, CacheIndex) != LUA_TTABLE)
+	{
+		lua_pop(L, 1);
+		lua_newtable(L);
+		lua_pushvalue(L, TableIndex);
+		lua_pushvalue(L, -2);
+		lua_rawset(L, CacheIndex);
+	}
+	const int ResultsIndex = lua_gettop(L);
+
+	bool bImplements = false;
+	if (lua_rawgetp(L, ResultsIndex, this) == LUA_TBOOLEAN)
+	{
+		bImplements = lua_toboolean(L, -1) != 0;
+	}
+	else
+	{
+		bImplements = MatchesTable(L, TableIndex);
+		lua_pushboolean(L, bImplements ? 1 : 0);
+		lua_rawsetp(L, ResultsIndex, this);
+	}
+
+	lua_settop(L, TableIndex - 1);
+	return bImplements;
+}
+
+void ULuaTableAsset::MarkTableDirty()
+{
+	bBakeDirty = true;
+	// the next LuaState will share the new content
+	FLuaSharedData::ReleaseCachedLuaTableAsset(this);
+}
+
+void ULuaTableAsset::BakeIfRequired()
+{
+	// assets saved before baking was introduced have no baked form
+	if (bBakeDirty || BakedValues.Num() != Table.Num())
+	{
+		Bake();
+	}
+}
+
+void ULuaTableAsset::Bake()
+{
+	bBakeDirty = false;
+
+	BakedKeys.Empty();
+	BakedKeyOffsets.Empty();
+	BakedValues.Empty();
+	BakedSeeds.Empty();
+
+	const int32 NumKeys = Table.Num();
+	if (NumKeys == 0)
+	{
+		return;
+	}
+
+	TArray<TArray<uint8>> Keys;
+	TArray<const FLuaValue*> Values;
+	for (const TPair<FString, FLuaValue>& Pair : Table)
+	{
+		FTCHARToUTF8 UTF8Key(*Pair.Key);
+		Keys.Emplace((const uint8*)UTF8Key.Get(), UTF8Key.Length());
+		Values.Add(&Pair.Value);
+	}
+
+	// hash and displace, with as many buckets as keys
+	TArray<TArray<int32>> Buckets;
+	Buckets.SetNum(NumKeys);
+	for (int32 KeyIndex = 0; KeyIndex < NumKeys; KeyIndex++)
+	{
+		Buckets[LuaTableAssetHash(Keys[KeyIndex].GetData(), Keys[KeyIndex].Num(), 0) % NumKeys].Add(KeyIndex);
+	}
+
+	TArray<int32> BucketsOrder;
+	for (int32 BucketIndex = 0; BucketIndex < NumKeys; BucketIndex++)
+	{
+		BucketsOrder.Add(BucketIndex);
+	}
+	BucketsOrder.Sort([&Buckets](const int32 A, const int32 B) { return Buckets[A].Num() > Buckets[B].Num(); });
+
+	TArray<int32> Seeds;
+	Seeds.Init(0, NumKeys);
+	TArray<int32> Slots;
+	Slots.Init(INDEX_NONE, NumKeys);
+
+	bool bPerfectHash = true;
+	for (const int32 BucketIndex : BucketsOrder)
+	{
+		const TArray<int32>& Bucket = Buckets[BucketIndex];
+		if (Bucket.Num() < 2)
+		{
+			break;
+		}
+
+		TArray<int32> BucketSlots;
+		int32 Seed = 1;
+		for (; Seed < 1 << 20; Seed++)
+		{
+			BucketSlots.Reset();
+			for (const int32 KeyIndex : Bucket)
+			{
+				const int32 Slot = LuaTableAssetHash(Keys[KeyIndex].GetData(), Keys[KeyIndex].Num(), Seed) % NumKeys;
+				if (Slots[Slot] != INDEX_NONE || BucketSlots.Contains(Slot))
+				{
+					break;
+				}
+				BucketSlots.Add(Slot);
+			}
+			if (BucketSlots.Num() == Bucket.Num())
+			{
+				break;
+			}
+		}
+
+		if (BucketSlots.Num() != Bucket.Num())
+		{
+			bPerfectHash = false;
+			break;
+		}
+
+		Seeds[BucketIndex] = Seed;
+		for (int32 Index = 0; Index < Bucket.Num(); Index++)
+		{
+			Slots[BucketSlots[Index]] = Bucket[Index];
+		}
+	}
+
+	if (bPerfectHash)
+	{
+		// single key buckets get the free slots
+		int32 FreeSlot = 0;
+		for (const int32 BucketIndex : BucketsOrder)
+		{
+			if (Buckets[BucketIndex].Num() != 1)
+			{
+				continue;
+			}
+			while (Slots[FreeSlot] != INDEX_NONE)
+			{
+				FreeSlot++;
+			}
+			Slots[FreeSlot] = Buckets[BucketIndex][0];
+			Seeds[BucketIndex] = -FreeSlot - 1;
+		}
+		BakedSeeds = MoveTemp(Seeds);
+	}
+	else
+	{
+		// FindField() falls back to Table
+		UE_LOG(LogLuaMachine, Warning, TEXT("unable to find a perfect hash for %s"), *GetPathName());
+		for (int32 Slot = 0; Slot < NumKeys; Slot++)
+		{
+			Slots[Slot] = Slot;
+		}
+	}
+
+	for (const int32 KeyIndex : Slots)
+	{
+		BakedKeyOffsets.Add(BakedKeys.Num());
+		BakedKeys.Append(Keys[KeyIndex]);
+		BakedKeys.Add(0);
+		BakedValues.Add(*Values[KeyIndex]);
+	}
+}
+
+void ULuaTableAsset::PostLoad()
+{
+	Super::PostLoad();
+	BakeIfRequired();
+}
+
+#if ENGINE_MAJOR_VERSION > 4
+void ULuaTableAsset::PreSave(FObjectPreSaveContext ObjectSaveContext)
+{
+	Super::PreSave(ObjectSaveContext);
+#else
+void ULuaTableAsset::PreSave(const ITargetPlatform* TargetPlatform)
+{
+	Super::PreSave(TargetPlatform);
+#endif
+	Bake();
+}
+
+#if WITH_EDITOR
+void ULuaTableAsset::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+	Bake();
+	// the next LuaState will share the new content
+	FLuaSharedData::ReleaseCachedLuaTableAsset(this);
+}
+#endif
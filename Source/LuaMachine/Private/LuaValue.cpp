@@ -143,6 +143,14 @@ FLuaValue::FLuaValue(const FLuaValue& SourceValue)
 
 FLuaValue& FLuaValue::operator = (const FLuaValue& SourceValue)
 {
+	if (this == &SourceValue)
+	{
+		return *this;
+	}
+
+	// release the currently held reference, otherwise it would leak in the registry
+	Unref();
+
 	Type = SourceValue.Type;
 	Object = SourceValue.Object;
 	LuaRef = SourceValue.LuaRef;
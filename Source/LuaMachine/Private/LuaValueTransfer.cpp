@@ -0,0 +1,639 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaValueTransfer.h"
+#include "LuaState.h"
+
+enum class ELuaTransferTag : uint8
+{
+	Nil,
+	False,
+	True,
+	Integer,
+	Number,
+	String,
+	// followed by the array size hint, the fields (key and value) and End
+	Table,
+	TableRef,
+	// the next value is the metatable of the current table
+	MetaTable,
+	NamedMetaTable,
+	End,
+	Object,
+	Function,
+};
+
+/* walks a Lua value (depth first) feeding a sink, every table is visited only once */
+template<typename SinkType>
+class TLuaValueWalker
+{
+public:
+	TLuaValueWalker(lua_State* InL, SinkType& InSink) : L(InL), Sink(InSink), NextTable(0), Depth(0)
+	{
+		Top = lua_gettop(L);
+		// table -> index of the first visit
+		lua_newtable(L);
+		SeenIndex = lua_gettop(L);
+	}
+
+	~TLuaValueWalker()
+	{
+		lua_settop(L, Top);
+	}
+
+	const FString& GetError() const { return ErrorString; }
+
+	bool Walk(const int Index)
+	{
+		if (!lua_checkstack(L, 4) || !Sink.Reserve())
+		{
+			return Fail(TEXT("stack overflow"));
+		}
+
+		switch (lua_type(L, Index))
+		{
+		case LUA_TBOOLEAN:
+			Sink.Bool(lua_toboolean(L, Index) != 0);
+			return true;
+		case LUA_TNUMBER:
+			if (lua_isinteger(L, Index))
+			{
+				Sink.Integer(lua_tointeger(L, Index));
+			}
+			else
+			{
+				Sink.Number(lua_tonumber(L, Index));
+			}
+			return true;
+		case LUA_TSTRING:
+		{
+			size_t Length = 0;
+			const char* String = lua_tolstring(L, Index, &Length);
+			Sink.String(String, Length);
+			return true;
+		}
+		case LUA_TTABLE:
+			return WalkTable(Index);
+		case LUA_TUSERDATA:
+		{
+			FLuaUserData* UserData = (FLuaUserData*)lua_touserdata(L, Index);
+			if (UserData->Type == ELuaValueType::UObject && UserData->Context.IsValid())
+			{
+				Sink.Object(UserData->Context.Get());
+			}
+			else if (UserData->Type == ELuaValueType::UFunction && UserData->Context.IsValid() && UserData->Function.IsValid())
+			{
+				Sink.Function(UserData->Context.Get(), UserData->Function->GetFName());
+			}
+			else
+			{
+				Sink.Nil();
+			}
+			return true;
+		}
+		default:
+			Sink.Nil();
+			return true;
+		}
+	}
+
+private:
+	bool Fail(const TCHAR* Message)
+	{
+		ErrorString = Message;
+		return false;
+	}
+
+	bool WalkTable(const int Index)
+	{
+		lua_pushvalue(L, Index);
+		if (lua_rawget(L, SeenIndex) == LUA_TNUMBER)
+		{
+			const int32 Table = (int32)lua_tointeger(L, -1);
+			lua_pop(L, 1);
+			Sink.TableRef(Table);
+			return true;
+		}
+		lua_pop(L, 1);
+
+		if (Depth >= FLuaValueTransfer::MaxDepth)
+		{
+			return Fail(TEXT("tables nested too deeply"));
+		}
+
+		const int32 Table = ++NextTable;
+		lua_pushvalue(L, Index);
+		lua_pushinteger(L, Table);
+		lua_rawset(L, SeenIndex);
+
+		Sink.BeginTable(Table, (int32)lua_rawlen(L, Index));
+		Depth++;
+
+		lua_pushnil(L);
+		while (lua_next(L, Index))
+		{
+			const int ValueIndex = lua_gettop(L);
+			if (!Walk(ValueIndex - 1) || !Walk(ValueIndex))
+			{
+				return false;
+			}
+			Sink.SetField();
+			lua_pop(L, 1);
+		}
+
+		if (lua_getmetatable(L, Index))
+		{
+			const int MetaTableIndex = lua_gettop(L);
+			Sink.BeginMetaTable();
+			lua_pushliteral(L, "__name");
+			if (lua_rawget(L, MetaTableIndex) == LUA_TSTRING)
+			{
+				Sink.NamedMetaTable(lua_tostring(L, -1));
+			}
+			else if (!WalkTable(MetaTableIndex))
+			{
+				return false;
+			}
+			lua_pop(L, 2);
+			Sink.SetMetaTable();
+		}
+
+		Depth--;
+		Sink.EndTable();
+		return true;
+	}
+
+	lua_State* L;
+	SinkType& Sink;
+	int Top;
+	int SeenIndex;
+	int32 NextTable;
+	int32 Depth;
+	FString ErrorString;
+};
+
+/* rebuilds the walked value in another lua_State */
+class FLuaValueCopySink
+{
+public:
+	FLuaValueCopySink(lua_State* InL) : L(InL)
+	{
+		// table index -> copied table
+		lua_newtable(L);
+		CopiesIndex = lua_gettop(L);
+	}
+
+	bool Reserve() { return lua_checkstack(L, 4) != 0; }
+	void Nil() { lua_pushnil(L); }
+	void Bool(const bool bValue) { lua_pushboolean(L, bValue ? 1 : 0); }
+	void Integer(const lua_Integer Value) { lua_pushinteger(L, Value); }
+	void Number(const lua_Number Value) { lua_pushnumber(L, Value); }
+	void String(const char* Value, const size_t Length) { lua_pushlstring(L, Value, Length); }
+
+	void BeginTable(const int32 Table, const int32 ArraySize)
+	{
+		lua_createtable(L, ArraySize, 0);
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, CopiesIndex, Table);
+	}
+
+	void TableRef(const int32 Table) { lua_rawgeti(L, CopiesIndex, Table); }
+
+	void SetField()
+	{
+		// keys that can not be copied (functions, threads...) are skipped
+		if (lua_isnil(L, -2))
+		{
+			lua_pop(L, 2);
+			return;
+		}
+		lua_rawset(L, -3);
+	}
+
+	void BeginMetaTable() {}
+	void NamedMetaTable(const char* Name) { luaL_getmetatable(L, Name); }
+
+	void SetMetaTable()
+	{
+		if (lua_istable(L, -1))
+		{
+			lua_setmetatable(L, -2);
+		}
+		else
+		{
+			lua_pop(L, 1);
+		}
+	}
+
+	void EndTable() {}
+
+	void Object(UObject* InObject)
+	{
+		FLuaValue Value(InObject);
+		ULuaState::GetFromExtraSpace(L)->FromLuaValue(Value, nullptr, L);
+	}
+
+	void Function(UObject* InObject, const FName FunctionName)
+	{
+		FLuaValue Value = FLuaValue::FunctionOfObject(InObject, FunctionName);
+		ULuaState::GetFromExtraSpace(L)->FromLuaValue(Value, nullptr, L);
+	}
+
+	void Finish() { lua_remove(L, CopiesIndex); }
+
+private:
+	lua_State* L;
+	int CopiesIndex;
+};
+
+/* writes the walked value in a FLuaSerializedValue */
+class FLuaValueSerializeSink
+{
+public:
+	FLuaValueSerializeSink(FLuaSerializedValue& InSerialized) : Serialized(InSerialized)
+	{
+	}
+
+	bool Reserve() { return true; }
+	void Nil() { WriteTag(ELuaTransferTag::Nil); }
+	void Bool(const bool bValue) { WriteTag(bValue ? ELuaTransferTag::True : ELuaTransferTag::False); }
+
+	void Integer(const lua_Integer Value)
+	{
+		WriteTag(ELuaTransferTag::Integer);
+		Write<int64>(Value);
+	}
+
+	void Number(const lua_Number Value)
+	{
+		WriteTag(ELuaTransferTag::Number);
+		Write<double>(Value);
+	}
+
+	void String(const char* Value, const size_t Length)
+	{
+		WriteTag(ELuaTransferTag::String);
+		WriteString(Value, Length);
+	}
+
+	void BeginTable(const int32 Table, const int32 ArraySize)
+	{
+		// tables are numbered in order of appearance
+		WriteTag(ELuaTransferTag::Table);
+		Write<int32>(ArraySize);
+	}
+
+	void TableRef(const int32 Table)
+	{
+		WriteTag(ELuaTransferTag::TableRef);
+		Write<int32>(Table);
+	}
+
+	void SetField() {}
+	void BeginMetaTable() { WriteTag(ELuaTransferTag::MetaTable); }
+
+	void NamedMetaTable(const char* Name)
+	{
+		WriteTag(ELuaTransferTag::NamedMetaTable);
+		WriteString(Name, FCStringAnsi::Strlen(Name));
+	}
+
+	void SetMetaTable() {}
+	void EndTable() { WriteTag(ELuaTransferTag::End); }
+
+	void Object(UObject* InObject)
+	{
+		WriteTag(ELuaTransferTag::Object);
+		Write<int32>(AddObject(InObject));
+	}
+
+	void Function(UObject* InObject, const FName FunctionName)
+	{
+		WriteTag(ELuaTransferTag::Function);
+		Write<int32>(AddObject(InObject));
+		FTCHARToUTF8 Utf8FunctionName(*FunctionName.ToString());
+		WriteString(Utf8FunctionName.Get(), Utf8FunctionName.Length());
+	}
+
+private:
+	void WriteTag(const ELuaTransferTag Tag) { Serialized.Data.Add((uint8)Tag); }
+
+	template<typename T>
+	void Write(const T Value)
+	{
+		Serialized.Data.Append((const uint8*)&Value, sizeof(T));
+	}
+
+	void WriteString(const char* Value, const size_t Length)
+	{
+		Write<int32>((int32)Length);
+		Serialized.Data.Append((const uint8*)Value, (int32)Length);
+	}
+
+	int32 AddObject(UObject* InObject)
+	{
+		if (const int32* ObjectIndex = ObjectIndices.Find(InObject))
+		{
+			return *ObjectIndex;
+		}
+		const int32 ObjectIndex = Serialized.Objects.Add(InObject);
+		ObjectIndices.Add(InObject, ObjectIndex);
+		return ObjectIndex;
+	}
+
+	FLuaSerializedValue& Serialized;
+	TMap<UObject*, int32> ObjectIndices;
+};
+
+class FLuaValueDeserializer
+{
+public:
+	FLuaValueDeserializer(lua_State* InL, const FLuaSerializedValue& InSerialized) : L(InL), Serialized(InSerialized), Offset(0), NextTable(0), Depth(0)
+	{
+	}
+
+	bool Deserialize(FString& ErrorString)
+	{
+		const int Top = lua_gettop(L);
+		lua_newtable(L);
+		CopiesIndex = lua_gettop(L);
+
+		ELuaTransferTag Tag;
+		if (!ReadTag(Tag) || !ReadValue(Tag))
+		{
+			ErrorString = Error;
+			lua_settop(L, Top);
+			return false;
+		}
+
+		lua_remove(L, CopiesIndex);
+		return true;
+	}
+
+private:
+	bool Fail(const TCHAR* Message)
+	{
+		Error = Message;
+		return false;
+	}
+
+	bool Read(void* Value, const int32 Size)
+	{
+		if (Size < 0 || Offset + Size > Serialized.Data.Num())
+		{
+			return Fail(TEXT("truncated serialized value"));
+		}
+		FMemory::Memcpy(Value, Serialized.Data.GetData() + Offset, Size);
+		Offset += Size;
+		return true;
+	}
+
+	bool ReadTag(ELuaTransferTag& Tag)
+	{
+		return Read(&Tag, sizeof(Tag));
+	}
+
+	// pushes the string
+	bool ReadString()
+	{
+		int32 Length = 0;
+		if (!Read(&Length, sizeof(Length)) || Length < 0 || Offset + Length > Serialized.Data.Num())
+		{
+			return Fail(TEXT("truncated serialized value"));
+		}
+		lua_pushlstring(L, (const char*)Serialized.Data.GetData() + Offset, Length);
+		Offset += Length;
+		return true;
+	}
+
+	bool ReadObject(UObject*& Object)
+	{
+		int32 ObjectIndex = 0;
+		if (!Read(&ObjectIndex, sizeof(ObjectIndex)))
+		{
+			return false;
+		}
+		Object = Serialized.Objects.IsValidIndex(ObjectIndex) ? Serialized.Objects[ObjectIndex].Get() : nullptr;
+		return true;
+	}
+
+	bool ReadValue(const ELuaTransferTag Tag)
+	{
+		if (!lua_checkstack(L, 4))
+		{
+			return Fail(TEXT("stack overflow"));
+		}
+
+		switch (Tag)
+		{
+		case ELuaTransferTag::Nil:
+			lua_pushnil(L);
+			return true;
+		case ELuaTransferTag::False:
+		case ELuaTransferTag::True:
+			lua_pushboolean(L, Tag == ELuaTransferTag::True ? 1 : 0);
+			return true;
+		case ELuaTransferTag::Integer:
+		{
+			int64 Value = 0;
+			if (!Read(&Value, sizeof(Value)))
+			{
+				return false;
+			}
+			lua_pushinteger(L, Value);
+			return true;
+		}
+		case ELuaTransferTag::Number:
+		{
+			double Value = 0;
+			if (!Read(&Value, sizeof(Value)))
+			{
+				return false;
+			}
+			lua_pushnumber(L, Value);
+			return true;
+		}
+		case ELuaTransferTag::String:
+			return ReadString();
+		case ELuaTransferTag::Table:
+			return ReadTable();
+		case ELuaTransferTag::TableRef:
+		{
+			int32 Table = 0;
+			if (!Read(&Table, sizeof(Table)))
+			{
+				return false;
+			}
+			if (Table < 1 || Table > NextTable)
+			{
+				return Fail(TEXT("invalid table reference"));
+			}
+			lua_rawgeti(L, CopiesIndex, Table);
+			return true;
+		}
+		case ELuaTransferTag::NamedMetaTable:
+			if (!ReadString())
+			{
+				return false;
+			}
+			// same as luaL_getmetatable()
+			lua_rawget(L, LUA_REGISTRYINDEX);
+			return true;
+		case ELuaTransferTag::Object:
+		{
+			UObject* Object = nullptr;
+			if (!ReadObject(Object))
+			{
+				return false;
+			}
+			FLuaValue Value(Object);
+			ULuaState::GetFromExtraSpace(L)->FromLuaValue(Value, nullptr, L);
+			return true;
+		}
+		case ELuaTransferTag::Function:
+		{
+			UObject* Object = nullptr;
+			if (!ReadObject(Object) || !ReadString())
+			{
+				return false;
+			}
+			FLuaValue Value = FLuaValue::FunctionOfObject(Object, FName(UTF8_TO_TCHAR(lua_tostring(L, -1))));
+			lua_pop(L, 1);
+			if (Object)
+			{
+				ULuaState::GetFromExtraSpace(L)->FromLuaValue(Value, nullptr, L);
+			}
+			else
+			{
+				lua_pushnil(L);
+			}
+			return true;
+		}
+		default:
+			return Fail(TEXT("invalid serialized value"));
+		}
+	}
+
+	bool ReadTable()
+	{
+		int32 ArraySize = 0;
+		if (!Read(&ArraySize, sizeof(ArraySize)))
+		{
+			return false;
+		}
+
+		if (Depth >= FLuaValueTransfer::MaxDepth)
+		{
+			return Fail(TEXT("tables nested too deeply"));
+		}
+
+		lua_createtable(L, FMath::Max(ArraySize, 0), 0);
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, CopiesIndex, ++NextTable);
+		Depth++;
+
+		for (;;)
+		{
+			ELuaTransferTag Tag;
+			if (!ReadTag(Tag))
+			{
+				return false;
+			}
+
+			if (Tag == ELuaTransferTag::End)
+			{
+				break;
+			}
+
+			if (Tag == ELuaTransferTag::MetaTable)
+			{
+				if (!ReadTag(Tag) || !ReadValue(Tag))
+				{
+					return false;
+				}
+				if (lua_istable(L, -1))
+				{
+					lua_setmetatable(L, -2);
+				}
+				else
+				{
+					lua_pop(L, 1);
+				}
+				continue;
+			}
+
+			// key and value
+			if (!ReadValue(Tag) || !ReadTag(Tag) || !ReadValue(Tag))
+			{
+				return false;
+			}
+			if (lua_isnil(L, -2))
+			{
+				lua_pop(L, 2);
+				continue;
+			}
+			lua_rawset(L, -3);
+		}
+
+		Depth--;
+		return true;
+	}
+
+	lua_State* L;
+	const FLuaSerializedValue& Serialized;
+	int32 Offset;
+	int CopiesIndex;
+	int32 NextTable;
+	int32 Depth;
+	FString Error;
+};
+
+bool FLuaValueTransfer::Copy(lua_State* From, const int Index, lua_State* To, FString& ErrorString)
+{
+	// values do not need to be copied in the same lua_State
+	if (From == To)
+	{
+		lua_pushvalue(To, Index);
+		return true;
+	}
+
+	const int AbsIndex = lua_absindex(From, Index);
+	const int Top = lua_gettop(To);
+
+	FLuaValueCopySink Sink(To);
+	{
+		TLuaValueWalker<FLuaValueCopySink> Walker(From, Sink);
+		if (!Walker.Walk(AbsIndex))
+		{
+			ErrorString = Walker.GetError();
+			lua_settop(To, Top);
+			return false;
+		}
+	}
+	Sink.Finish();
+	return true;
+}
+
+bool FLuaValueTransfer::Serialize(lua_State* L, const int Index, FLuaSerializedValue& Serialized, FString& ErrorString)
+{
+	Serialized.Data.Reset();
+	Serialized.Objects.Reset();
+
+	const int AbsIndex = lua_absindex(L, Index);
+
+	FLuaValueSerializeSink Sink(Serialized);
+	TLuaValueWalker<FLuaValueSerializeSink> Walker(L, Sink);
+	if (!Walker.Walk(AbsIndex))
+	{
+		ErrorString = Walker.GetError();
+		Serialized.Data.Reset();
+		Serialized.Objects.Reset();
+		return false;
+	}
+	return true;
+}
+
+bool FLuaValueTransfer::Deserialize(lua_State* L, const FLuaSerializedValue& Serialized, FString& ErrorString)
+{
+	FLuaValueDeserializer Deserializer(L, Serialized);
+	return Deserializer.Deserialize(ErrorString);
+}
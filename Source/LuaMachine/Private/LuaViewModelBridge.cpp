@@ -2,6 +2,76 @@
 
 #include "LuaViewModelBridge.h"
 #include "LuaBlueprintFunctionLibrary.h"
+#include "Misc/CoreDelegates.h"
+
+/**
+ * @brief Compares two Lua values the way rawequal() does (tables, functions and threads by reference).
+ */
+static bool LuaViewModelValuesEqual(FLuaValue& A, FLuaValue& B)
+{
+	if (A.Type != B.Type)
+	{
+		return false;
+	}
+
+	switch (A.Type)
+	{
+	case ELuaValueType::Nil:
+		return true;
+	case ELuaValueType::Bool:
+		return A.Bool == B.Bool;
+	case ELuaValueType::Integer:
+		return A.Integer == B.Integer;
+	case ELuaValueType::Number:
+		return A.Number == B.Number;
+	case ELuaValueType::String:
+		return A.String.Equals(B.String, ESearchCase::CaseSensitive);
+	case ELuaValueType::UObject:
+		return A.Object == B.Object;
+	case ELuaValueType::UFunction:
+		return A.Object == B.Object && A.FunctionName == B.FunctionName;
+	case ELuaValueType::Table:
+	case ELuaValueType::Function:
+	case ELuaValueType::Thread:
+	{
+		ULuaState* State = A.LuaState.Get();
+		if (!State || State != B.LuaState.Get())
+		{
+			return false;
+		}
+		State->FromLuaValue(A);
+		State->FromLuaValue(B);
+		const bool bEqual = lua_rawequal(State->GetInternalLuaState(), -1, -2) != 0;
+		State->Pop(2);
+		return bEqual;
+	}
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief __index of the table passed to the compute functions: reads the property through LuaGetProperty, recording it as a dependency.
+ */
+static int LuaViewModelComputeProxy__index(lua_State* L)
+{
+	FLuaUserData* UserData = (FLuaUserData*)lua_touserdata(L, lua_upvalueindex(1));
+	ULuaViewModelBridge* Bridge = UserData ? Cast<ULuaViewModelBridge>(UserData->Context.Get()) : nullptr;
+	if (!Bridge || lua_type(L, 2) != LUA_TSTRING)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	FLuaValue Value = Bridge->LuaGetProperty(FName(UTF8_TO_TCHAR(lua_tostring(L, 2))));
+	ULuaState::GetFromExtraSpace(L)->FromLuaValue(Value, nullptr, L);
+	return 1;
+}
+
+static int LuaViewModelComputeProxy__newindex(lua_State* L)
+{
+	return luaL_error(L, "computed properties can not modify the ViewModel");
+}
 
 /**
  * @brief Constructs a ULuaViewModelBridge and enables error logging by default.
@@ -11,13 +81,18 @@
 ULuaViewModelBridge::ULuaViewModelBridge()
 {
 	bLogError = true;
+	bBatchFieldNotifications = false;
+	UpdateDepth = 0;
+	CachedHooksReloadCount = 0;
+	bUseProxyTable = false;
 }
 
 /**
  * @brief Initializes the Lua table that represents this view model and populates it with configured fields.
  *
  * Validates that a LuaState is set and that a ULuaState instance can be obtained; if validation fails the method logs an error (when logging is enabled) and returns without modifying state.
- * On success, creates the ViewModel Lua table, stores a reference to this view model on the table, and copies all key/value pairs from the bridge's Table property into the Lua table.
+ * On success, creates the ViewModel Lua table, stores a reference to this view model on the table, installs the Update/Flush/Computed functions, and copies all key/value pairs from the bridge's Table property into the Lua table.
+ * With bUseProxyTable the filled table becomes the hidden backing table of an empty proxy.
  */
 void ULuaViewModelBridge::InitializeLuaViewModel()
 {
@@ -46,23 +121,50 @@ void ULuaViewModelBridge::InitializeLuaViewModel()
 	// Add the ViewModel reference to the table
 	ULuaBlueprintFunctionLibrary::LuaTableSetField(ViewModelLuaTable, TEXT("ViewModel"), ULuaBlueprintFunctionLibrary::LuaCreateObject(this));
 
+	// Transactional updates: vm:Update({...}) or vm:Update(function(vm) ... end), vm:Flush()
+	ULuaBlueprintFunctionLibrary::LuaTableSetField(ViewModelLuaTable, TEXT("Update"), FLuaValue::FunctionOfObject(this, GET_FUNCTION_NAME_CHECKED(ULuaViewModelBridge, LuaTableUpdate)));
+	ULuaBlueprintFunctionLibrary::LuaTableSetField(ViewModelLuaTable, TEXT("Flush"), FLuaValue::FunctionOfObject(this, GET_FUNCTION_NAME_CHECKED(ULuaViewModelBridge, LuaTableFlush)));
+
+	ULuaBlueprintFunctionLibrary::LuaTableSetField(ViewModelLuaTable, TEXT("Computed"), FLuaValue::FunctionOfObject(this, GET_FUNCTION_NAME_CHECKED(ULuaViewModelBridge, LuaTableComputed)));
+
 	// Add all custom fields from the Table property
 	for (const TPair<FString, FLuaValue>& Pair : Table)
 	{
 		ULuaBlueprintFunctionLibrary::LuaTableSetField(ViewModelLuaTable, Pair.Key, Pair.Value);
 	}
+
+	ViewModelBackingTable = FLuaValue();
+	if (bUseProxyTable)
+	{
+		CreateProxyTable(State);
+	}
+
+	ResolveLuaHooks();
+
+	ComputedProperties.Empty();
+	ComputedDependents.Empty();
+	ComputeProxy = FLuaValue();
+	for (const TPair<FName, FName>& Pair : ComputedPropertyFunctions)
+	{
+		LuaDefineComputedProperty(Pair.Key.ToString(), ULuaBlueprintFunctionLibrary::LuaGetGlobal(this, LuaState, Pair.Value.ToString()));
+	}
 }
 
 /**
  * @brief Retrieve a property's value from the ViewModel's Lua table, allowing an optional Lua getter to override the lookup.
  *
- * If an OnGetPropertyLuaFunction is defined and returns a non-nil value for the given property, that value is used.
+ * If an OnGetPropertyLuaFunction is defined (resolved once, see ResolveLuaHooks) and returns a non-nil value for the given property, that value is used.
  * Otherwise the value is read directly from the ViewModel Lua table. If the ViewModel table is not initialized, this returns nil.
  *
  * @param PropertyName Name of the property to retrieve.
  * @return FLuaValue The Lua value of the requested property, or nil if the ViewModel table is uninitialized or the property is absent.
  */
 FLuaValue ULuaViewModelBridge::LuaGetProperty(const FString& PropertyName)
+{
+	return LuaGetProperty(FName(*PropertyName));
+}
+
+FLuaValue ULuaViewModelBridge::LuaGetProperty(const FName& PropertyName)
 {
 	if (ViewModelLuaTable.Type != ELuaValueType::Table)
 	{
@@ -73,15 +175,33 @@ FLuaValue ULuaViewModelBridge::LuaGetProperty(const FString& PropertyName)
 		return ULuaBlueprintFunctionLibrary::LuaCreateNil();
 	}
 
+	// Reads from a compute function are its dependencies
+	if (ComputeStack.Num() > 0)
+	{
+		const FName ComputingProperty = ComputeStack.Last();
+		FLuaViewModelComputedProperty* Computing = ComputedProperties.Find(ComputingProperty);
+		if (Computing && !Computing->Dependencies.Contains(PropertyName))
+		{
+			Computing->Dependencies.Add(PropertyName);
+			ComputedDependents.FindOrAdd(PropertyName).AddUnique(ComputingProperty);
+		}
+	}
+
+	// Computed properties are evaluated only when a dependency changed
+	if (FLuaViewModelComputedProperty* Computed = ComputedProperties.Find(PropertyName))
+	{
+		if (!Computed->bDirty)
+		{
+			return Computed->CachedValue;
+		}
+		return ComputeProperty(PropertyName);
+	}
+
 	// Try to call the OnGetPropertyLuaFunction if it exists
-	if (!OnGetPropertyLuaFunction.IsNone())
+	if (!OnGetPropertyLuaFunction.IsNone() && GetLuaHooksState())
 	{
-		TArray<FLuaValue> Args;
-		Args.Add(ViewModelLuaTable);
-		Args.Add(ULuaBlueprintFunctionLibrary::LuaCreateString(PropertyName));
-		
 		FLuaValue Result;
-		if (CallLuaFunctionIfExists(OnGetPropertyLuaFunction.ToString(), Args, Result))
+		if (CallLuaHook(CachedGetPropertyFunction, PropertyName, nullptr, Result))
 		{
 			// If the result is not nil, use it; otherwise fall through to default behavior
 			if (!ULuaBlueprintFunctionLibrary::LuaValueIsNil(Result))
@@ -92,7 +212,17 @@ FLuaValue ULuaViewModelBridge::LuaGetProperty(const FString& PropertyName)
 	}
 
 	// Default: get from table
-	return ULuaBlueprintFunctionLibrary::LuaTableGetField(ViewModelLuaTable, PropertyName);
+	ULuaState* State = ViewModelLuaTable.LuaState.Get();
+	if (!State)
+	{
+		return ULuaBlueprintFunctionLibrary::LuaCreateNil();
+	}
+
+	State->FromLuaValue(ViewModelLuaTable);
+	State->GetField(-1, GetUtf8PropertyName(PropertyName).GetData());
+	FLuaValue ReturnValue = State->ToLuaValue(-1);
+	State->Pop(2);
+	return ReturnValue;
 }
 
 /**
@@ -119,19 +249,26 @@ void ULuaViewModelBridge::LuaSetProperty(const FName& PropertyName, FLuaValue Va
 		return;
 	}
 
+	if (UpdateDepth > 0)
+	{
+		FLuaValue CurrentValue = ULuaBlueprintFunctionLibrary::LuaTableGetField(ViewModelLuaTable, PropertyName.ToString());
+		if (LuaViewModelValuesEqual(CurrentValue, Value))
+		{
+			return;
+		}
+	}
+
 	bool bPropertyWasSet = false;
 	bool bHandledByLua = false;
 
-	if (!OnSetPropertyLuaFunction.IsNone())
-	{
-		FString PropertyNameString = PropertyName.ToString();
-		TArray<FLuaValue> Args;
-		Args.Add(ViewModelLuaTable);
-		Args.Add(ULuaBlueprintFunctionLibrary::LuaCreateString(PropertyNameString));
-		Args.Add(Value);
+	// the proxy table must not notify the assignments done here (notified below only if the property was set)
+	const FName PreviousProxyFieldBeingSet = ProxyFieldBeingSet;
+	ProxyFieldBeingSet = PropertyName;
 
+	if (!OnSetPropertyLuaFunction.IsNone() && GetLuaHooksState())
+	{
 		FLuaValue Result;
-		if (CallLuaFunctionIfExists(OnSetPropertyLuaFunction.ToString(), Args, Result))
+		if (CallLuaHook(CachedSetPropertyFunction, PropertyName, &Value, Result))
 		{
 			bHandledByLua = true;
 			if (ULuaBlueprintFunctionLibrary::LuaValueIsBoolean(Result))
@@ -158,10 +295,12 @@ void ULuaViewModelBridge::LuaSetProperty(const FName& PropertyName, FLuaValue Va
 		bPropertyWasSet = true;
 	}
 
+	ProxyFieldBeingSet = PreviousProxyFieldBeingSet;
+
 	// Broadcast property change only if property was actually set
 	if (bPropertyWasSet)
 	{
-		LuaBroadcastFieldValueChanged(PropertyName);
+		MarkFieldDirty(PropertyName);
 	}
 }
 
@@ -245,7 +384,8 @@ void ULuaViewModelBridge::LuaSetField(const FString& Name, FLuaValue Value)
 	ULuaBlueprintFunctionLibrary::LuaTableSetField(ViewModelLuaTable, Name, Value);
 
 	// IMPORTANT: LuaSetField directly modifies the internal Lua table without broadcasting
-	// MVVM change notifications. This is intentional for direct table manipulation.
+	// MVVM change notifications (unless bUseProxyTable is set, in which case the proxy notifies it).
+	// This is intentional for direct table manipulation.
 	// If property changes need to update bound UI elements or other MVVM consumers,
 	// use LuaSetProperty (which broadcasts notifications) or explicitly call
 	// LuaBroadcastFieldValueChanged afterwards.
@@ -278,6 +418,586 @@ void ULuaViewModelBridge::LuaBroadcastFieldValueChanged(const FName& FieldName)
 	UE_MVVM_BROADCAST_FIELD_VALUE_CHANGED(FieldName);
 }
 
+/**
+ * @brief Broadcasts the change of a field, or records it when a transaction is open or notifications are batched.
+ *
+ * Recorded fields are broadcast once by the outermost LuaEndUpdate (or at the end of the frame when bBatchFieldNotifications is set).
+ * The computed properties depending on the field are invalidated (and marked dirty) first.
+ *
+ * @param FieldName Name of the field whose value changed.
+ */
+void ULuaViewModelBridge::MarkFieldDirty(const FName& FieldName)
+{
+	InvalidateComputedProperties(FieldName);
+
+	if (UpdateDepth == 0 && !bBatchFieldNotifications)
+	{
+		LuaBroadcastFieldValueChanged(FieldName);
+		return;
+	}
+
+	DirtyFields.Add(FieldName);
+
+	if (UpdateDepth == 0 && !FlushHandle.IsValid())
+	{
+		FlushHandle = FCoreDelegates::OnEndFrame.AddUObject(this, &ULuaViewModelBridge::FlushFieldNotifications);
+	}
+}
+
+/**
+ * @brief Opens a (nestable) transaction.
+ */
+void ULuaViewModelBridge::LuaBeginUpdate()
+{
+	UpdateDepth++;
+}
+
+/**
+ * @brief Closes a transaction, the outermost one broadcasts the changed fields (or schedules them for the end of the frame when batching).
+ */
+void ULuaViewModelBridge::LuaEndUpdate()
+{
+	if (UpdateDepth <= 0)
+	{
+		if (bLogError)
+		{
+			UE_LOG(LogLuaMachine, Warning, TEXT("LuaViewModelBridge: LuaEndUpdate called without LuaBeginUpdate"));
+		}
+		return;
+	}
+
+	if (--UpdateDepth > 0 || DirtyFields.Num() == 0)
+	{
+		return;
+	}
+
+	if (!bBatchFieldNotifications)
+	{
+		FlushFieldNotifications();
+	}
+	else if (!FlushHandle.IsValid())
+	{
+		FlushHandle = FCoreDelegates::OnEndFrame.AddUObject(this, &ULuaViewModelBridge::FlushFieldNotifications);
+	}
+}
+
+/**
+ * @brief Sets every string-keyed field of a Lua table as a ViewModel property in a single transaction.
+ *
+ * @param Fields Lua table of property names and values.
+ */
+void ULuaViewModelBridge::LuaUpdateProperties(FLuaValue Fields)
+{
+	if (Fields.Type != ELuaValueType::Table)
+	{
+		return;
+	}
+
+	LuaBeginUpdate();
+	for (const FLuaValue& Key : ULuaBlueprintFunctionLibrary::LuaTableGetKeys(Fields))
+	{
+		if (Key.Type == ELuaValueType::String)
+		{
+			const FString PropertyName = Key.ToString();
+			LuaSetProperty(FName(*PropertyName), ULuaBlueprintFunctionLibrary::LuaTableGetField(Fields, PropertyName));
+		}
+	}
+	LuaEndUpdate();
+}
+
+/**
+ * @brief Broadcasts every pending field notification once.
+ *
+ * Safe to call at any time, the fields changed by the listeners are recorded for the next flush.
+ */
+void ULuaViewModelBridge::FlushFieldNotifications()
+{
+	if (FlushHandle.IsValid())
+	{
+		FCoreDelegates::OnEndFrame.Remove(FlushHandle);
+		FlushHandle.Reset();
+	}
+
+	TSet<FName> FieldsToBroadcast = MoveTemp(DirtyFields);
+	DirtyFields.Reset();
+	for (const FName& FieldName : FieldsToBroadcast)
+	{
+		LuaBroadcastFieldValueChanged(FieldName);
+	}
+}
+
+/**
+ * @brief Resolves OnGetPropertyLuaFunction and OnSetPropertyLuaFunction to registry references.
+ *
+ * Called by InitializeLuaViewModel, and again by GetLuaHooksState whenever the cache is stale.
+ */
+void ULuaViewModelBridge::ResolveLuaHooks()
+{
+	CachedGetPropertyFunction = FLuaValue();
+	CachedSetPropertyFunction = FLuaValue();
+	CachedGetPropertyFunctionName = OnGetPropertyLuaFunction;
+	CachedSetPropertyFunctionName = OnSetPropertyLuaFunction;
+
+	ULuaState* State = LuaViewModelGetState();
+	CachedHooksLuaState = State;
+	if (!State)
+	{
+		return;
+	}
+	CachedHooksReloadCount = State->ModulesReloadCount;
+
+	if (!OnGetPropertyLuaFunction.IsNone())
+	{
+		CachedGetPropertyFunction = ULuaBlueprintFunctionLibrary::LuaGetGlobal(this, LuaState, OnGetPropertyLuaFunction.ToString());
+		if (!ULuaBlueprintFunctionLibrary::LuaValueIsFunction(CachedGetPropertyFunction) && bLogError)
+		{
+			UE_LOG(LogLuaMachine, Warning, TEXT("LuaViewModelBridge: Lua function '%s' not found or not callable"), *OnGetPropertyLuaFunction.ToString());
+		}
+	}
+
+	if (!OnSetPropertyLuaFunction.IsNone())
+	{
+		CachedSetPropertyFunction = ULuaBlueprintFunctionLibrary::LuaGetGlobal(this, LuaState, OnSetPropertyLuaFunction.ToString());
+		if (!ULuaBlueprintFunctionLibrary::LuaValueIsFunction(CachedSetPropertyFunction) && bLogError)
+		{
+			UE_LOG(LogLuaMachine, Warning, TEXT("LuaViewModelBridge: Lua function '%s' not found or not callable"), *OnSetPropertyLuaFunction.ToString());
+		}
+	}
+}
+
+/**
+ * @brief Returns the LuaState owning the cached hooks, resolving them again if the LuaState, the hook names or the reloaded modules changed.
+ *
+ * @return ULuaState* The LuaState of the hooks, or nullptr if it is not available.
+ */
+ULuaState* ULuaViewModelBridge::GetLuaHooksState()
+{
+	ULuaState* State = CachedHooksLuaState.Get();
+	if (!State || State->GetClass() != LuaState || State->ModulesReloadCount != CachedHooksReloadCount ||
+		CachedGetPropertyFunctionName != OnGetPropertyLuaFunction || CachedSetPropertyFunctionName != OnSetPropertyLuaFunction)
+	{
+		ResolveLuaHooks();
+		State = CachedHooksLuaState.Get();
+	}
+	return State;
+}
+
+/**
+ * @brief Calls a cached hook pushing (ViewModelTable, PropertyName[, Value]) directly on the Lua stack.
+ *
+ * @param Hook The cached hook function.
+ * @param PropertyName Name of the property, pushed as a string.
+ * @param Value Optional value pushed as the third argument.
+ * @param OutResult Receives the returned value (nil on error).
+ * @return `true` if the hook is a function and has been called, `false` otherwise.
+ */
+bool ULuaViewModelBridge::CallLuaHook(FLuaValue& Hook, const FName& PropertyName, FLuaValue* Value, FLuaValue& OutResult)
+{
+	ULuaState* State = CachedHooksLuaState.Get();
+	if (!State || Hook.Type != ELuaValueType::Function)
+	{
+		return false;
+	}
+
+	const TArray<ANSICHAR>& Utf8PropertyName = GetUtf8PropertyName(PropertyName);
+
+	State->FromLuaValue(Hook);
+	State->FromLuaValue(ViewModelLuaTable);
+	lua_pushlstring(State->GetInternalLuaState(), Utf8PropertyName.GetData(), Utf8PropertyName.Num() - 1);
+	int NArgs = 2;
+	if (Value)
+	{
+		State->FromLuaValue(*Value);
+		NArgs++;
+	}
+
+	if (!State->PCall(NArgs, OutResult))
+	{
+		OutResult = FLuaValue();
+	}
+	// the result or the error message
+	State->Pop();
+	return true;
+}
+
+/**
+ * @brief Returns the zero terminated UTF-8 version of a property name, converted only the first time.
+ */
+const TArray<ANSICHAR>& ULuaViewModelBridge::GetUtf8PropertyName(const FName& PropertyName)
+{
+	if (const TArray<ANSICHAR>* Utf8PropertyName = Utf8PropertyNames.Find(PropertyName))
+	{
+		return *Utf8PropertyName;
+	}
+
+	FTCHARToUTF8 Utf8Converter(*PropertyName.ToString());
+	TArray<ANSICHAR>& Utf8PropertyName = Utf8PropertyNames.Add(PropertyName);
+	Utf8PropertyName.Append(Utf8Converter.Get(), Utf8Converter.Length());
+	Utf8PropertyName.Add(0);
+	return Utf8PropertyName;
+}
+
+/**
+ * @brief Defines (or replaces) a computed property.
+ *
+ * The function is called with a read-only view of the ViewModel whose reads are recorded as dependencies; the result is cached
+ * and returned by LuaGetProperty without entering Lua until one of the dependencies changes (which also broadcasts the computed property).
+ *
+ * @param PropertyName Name of the computed property.
+ * @param ComputeFunction Lua function returning the value.
+ */
+void ULuaViewModelBridge::LuaDefineComputedProperty(const FString& PropertyName, FLuaValue ComputeFunction)
+{
+	if (!ULuaBlueprintFunctionLibrary::LuaValueIsFunction(ComputeFunction))
+	{
+		if (bLogError)
+		{
+			UE_LOG(LogLuaMachine, Error, TEXT("LuaViewModelBridge: computed property '%s' requires a Lua function"), *PropertyName);
+		}
+		return;
+	}
+
+	const FName PropertyFName = FName(*PropertyName);
+	if (FLuaViewModelComputedProperty* Previous = ComputedProperties.Find(PropertyFName))
+	{
+		for (const FName& Dependency : Previous->Dependencies)
+		{
+			if (TArray<FName>* Dependents = ComputedDependents.Find(Dependency))
+			{
+				Dependents->Remove(PropertyFName);
+			}
+		}
+	}
+
+	FLuaViewModelComputedProperty& Computed = ComputedProperties.Add(PropertyFName);
+	Computed.Function = ComputeFunction;
+
+	MarkFieldDirty(PropertyFName);
+}
+
+/**
+ * @brief Evaluates a computed property, recording the properties it reads as its new dependencies.
+ *
+ * @param PropertyName Name of the computed property.
+ * @return FLuaValue The computed value (nil on error or circular dependency).
+ */
+FLuaValue ULuaViewModelBridge::ComputeProperty(const FName& PropertyName)
+{
+	if (ComputeStack.Contains(PropertyName))
+	{
+		if (bLogError)
+		{
+			UE_LOG(LogLuaMachine, Error, TEXT("LuaViewModelBridge: circular dependency in computed property '%s'"), *PropertyName.ToString());
+		}
+		return FLuaValue();
+	}
+
+	ULuaState* State = ViewModelLuaTable.LuaState.Get();
+	FLuaViewModelComputedProperty* Computed = ComputedProperties.Find(PropertyName);
+	if (!Computed || !State || !EnsureComputeProxy(State))
+	{
+		return FLuaValue();
+	}
+
+	for (const FName& Dependency : Computed->Dependencies)
+	{
+		if (TArray<FName>* Dependents = ComputedDependents.Find(Dependency))
+		{
+			Dependents->Remove(PropertyName);
+		}
+	}
+	Computed->Dependencies.Reset();
+
+	FLuaValue ComputeFunction = Computed->Function;
+	ComputeStack.Push(PropertyName);
+	State->FromLuaValue(ComputeFunction);
+	State->FromLuaValue(ComputeProxy);
+	FLuaValue Result;
+	if (!State->PCall(1, Result))
+	{
+		Result = FLuaValue();
+	}
+	// the result or the error message
+	State->Pop();
+	ComputeStack.Pop();
+
+	// nested evaluations may have reallocated the map
+	Computed = ComputedProperties.Find(PropertyName);
+	if (Computed)
+	{
+		Computed->CachedValue = Result;
+		Computed->bDirty = false;
+	}
+	return Result;
+}
+
+/**
+ * @brief Invalidates (and marks dirty, transitively) the computed properties that read a field.
+ *
+ * @param FieldName Name of the changed field.
+ */
+void ULuaViewModelBridge::InvalidateComputedProperties(const FName& FieldName)
+{
+	TArray<FName>* DependentsPtr = ComputedDependents.Find(FieldName);
+	if (!DependentsPtr || DependentsPtr->Num() == 0)
+	{
+		return;
+	}
+
+	// listeners may evaluate the computed properties again, updating the dependencies
+	const TArray<FName> Dependents = *DependentsPtr;
+	for (const FName& Dependent : Dependents)
+	{
+		FLuaViewModelComputedProperty* Computed = ComputedProperties.Find(Dependent);
+		if (Computed && !Computed->bDirty)
+		{
+			Computed->bDirty = true;
+			Computed->CachedValue = FLuaValue();
+			MarkFieldDirty(Dependent);
+		}
+	}
+}
+
+/**
+ * @brief Creates the read-only table passed to the compute functions.
+ *
+ * @param State The LuaState of the ViewModel table.
+ * @return `true` if the proxy is available.
+ */
+bool ULuaViewModelBridge::EnsureComputeProxy(ULuaState* State)
+{
+	if (ComputeProxy.Type == ELuaValueType::Table && ComputeProxy.LuaState.Get() == State)
+	{
+		return true;
+	}
+
+	lua_State* L = State->GetInternalLuaState();
+	if (!L)
+	{
+		return false;
+	}
+
+	lua_newtable(L);
+	lua_newtable(L);
+	FLuaValue Self(this);
+	State->FromLuaValue(Self);
+	lua_pushcclosure(L, LuaViewModelComputeProxy__index, 1);
+	lua_setfield(L, -2, "__index");
+	lua_pushcfunction(L, LuaViewModelComputeProxy__newindex);
+	lua_setfield(L, -2, "__newindex");
+	lua_setmetatable(L, -2);
+
+	ComputeProxy = State->ToLuaValue(-1);
+	State->Pop();
+	return true;
+}
+
+/**
+ * @brief Moves the ViewModel fields behind an empty proxy table.
+ *
+ * Reads are served natively by __index (the backing table), __newindex stores the value in the backing table and,
+ * if it changed, marks the field dirty; __pairs and __len expose the backing table.
+ *
+ * @param State The LuaState of the ViewModel table.
+ */
+void ULuaViewModelBridge::CreateProxyTable(ULuaState* State)
+{
+	lua_State* L = State->GetInternalLuaState();
+	ViewModelBackingTable = ViewModelLuaTable;
+
+	lua_newtable(L);
+	lua_newtable(L);
+	State->FromLuaValue(ViewModelBackingTable);
+	lua_setfield(L, -2, "__index");
+	State->FromLuaValue(ViewModelBackingTable);
+	FLuaValue Self(this);
+	State->FromLuaValue(Self);
+	lua_pushcclosure(L, ULuaViewModelBridge::MetaTableFunctionProxy__newindex, 2);
+	lua_setfield(L, -2, "__newindex");
+	State->FromLuaValue(ViewModelBackingTable);
+	lua_pushcclosure(L, ULuaViewModelBridge::MetaTableFunctionProxy__pairs, 1);
+	lua_setfield(L, -2, "__pairs");
+	State->FromLuaValue(ViewModelBackingTable);
+	lua_pushcclosure(L, ULuaViewModelBridge::MetaTableFunctionProxy__len, 1);
+	lua_setfield(L, -2, "__len");
+	lua_setmetatable(L, -2);
+
+	ViewModelLuaTable = State->ToLuaValue(-1);
+	State->Pop();
+}
+
+/**
+ * @brief __newindex of the proxy table: stores the value in the backing table and marks the field dirty if it changed.
+ */
+int ULuaViewModelBridge::MetaTableFunctionProxy__newindex(lua_State* L)
+{
+	// upvalues: backing table, ViewModel
+	lua_pushvalue(L, 2);
+	lua_rawget(L, lua_upvalueindex(1));
+	const bool bUnchanged = lua_rawequal(L, -1, 3) != 0;
+	lua_pop(L, 1);
+	if (bUnchanged)
+	{
+		return 0;
+	}
+
+	lua_pushvalue(L, 2);
+	lua_pushvalue(L, 3);
+	lua_rawset(L, lua_upvalueindex(1));
+
+	if (lua_type(L, 2) != LUA_TSTRING)
+	{
+		return 0;
+	}
+
+	FLuaUserData* UserData = (FLuaUserData*)lua_touserdata(L, lua_upvalueindex(2));
+	ULuaViewModelBridge* Bridge = UserData ? Cast<ULuaViewModelBridge>(UserData->Context.Get()) : nullptr;
+	if (Bridge)
+	{
+		const FName FieldName = FName(UTF8_TO_TCHAR(lua_tostring(L, 2)));
+		if (FieldName != Bridge->ProxyFieldBeingSet)
+		{
+			Bridge->MarkFieldDirty(FieldName);
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief __pairs of the proxy table: iterates the backing table.
+ */
+static int LuaViewModelProxyNext(lua_State* L)
+{
+	lua_settop(L, 2);
+	if (lua_next(L, 1))
+	{
+		return 2;
+	}
+	lua_pushnil(L);
+	return 1;
+}
+
+int ULuaViewModelBridge::MetaTableFunctionProxy__pairs(lua_State* L)
+{
+	lua_pushcfunction(L, LuaViewModelProxyNext);
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_pushnil(L);
+	return 3;
+}
+
+/**
+ * @brief __len of the proxy table: length of the backing table.
+ */
+int ULuaViewModelBridge::MetaTableFunctionProxy__len(lua_State* L)
+{
+	lua_pushinteger(L, (lua_Integer)lua_rawlen(L, lua_upvalueindex(1)));
+	return 1;
+}
+
+/**
+ * @brief Lua entry point of vm:Computed(Name, Function).
+ */
+void ULuaViewModelBridge::LuaTableComputed(FLuaValue Self, FLuaValue PropertyName, FLuaValue ComputeFunction)
+{
+	LuaDefineComputedProperty(PropertyName.ToString(), ComputeFunction);
+}
+
+/**
+ * @brief Lua entry point of vm:Update().
+ *
+ * With a table, its fields are set as properties; with a function, the function is called with the ViewModel table and
+ * the fields it assigned directly are diffed against a snapshot. In both cases only the changed fields are broadcast, once.
+ *
+ * @param Self The ViewModel table (implicit with the colon syntax).
+ * @param FieldsOrFunction Table of new values or function updating the ViewModel table.
+ */
+void ULuaViewModelBridge::LuaTableUpdate(FLuaValue Self, FLuaValue FieldsOrFunction)
+{
+	if (FieldsOrFunction.Type == ELuaValueType::Table)
+	{
+		LuaUpdateProperties(FieldsOrFunction);
+		return;
+	}
+
+	if (FieldsOrFunction.Type != ELuaValueType::Function || ViewModelLuaTable.Type != ELuaValueType::Table)
+	{
+		return;
+	}
+
+	TArray<FLuaValue> Args;
+	Args.Add(ViewModelLuaTable);
+
+	// the proxy table already notifies every real change
+	if (ViewModelBackingTable.Type == ELuaValueType::Table)
+	{
+		LuaBeginUpdate();
+		ULuaBlueprintFunctionLibrary::LuaValueCall(FieldsOrFunction, Args);
+		LuaEndUpdate();
+		return;
+	}
+
+	TMap<FString, FLuaValue> Snapshot;
+	for (const FLuaValue& Key : ULuaBlueprintFunctionLibrary::LuaTableGetKeys(ViewModelLuaTable))
+	{
+		if (Key.Type == ELuaValueType::String)
+		{
+			const FString FieldName = Key.ToString();
+			Snapshot.Add(FieldName, ULuaBlueprintFunctionLibrary::LuaTableGetField(ViewModelLuaTable, FieldName));
+		}
+	}
+
+	LuaBeginUpdate();
+
+	ULuaBlueprintFunctionLibrary::LuaValueCall(FieldsOrFunction, Args);
+
+	for (const FLuaValue& Key : ULuaBlueprintFunctionLibrary::LuaTableGetKeys(ViewModelLuaTable))
+	{
+		if (Key.Type != ELuaValueType::String)
+		{
+			continue;
+		}
+		const FString FieldName = Key.ToString();
+		FLuaValue NewValue = ULuaBlueprintFunctionLibrary::LuaTableGetField(ViewModelLuaTable, FieldName);
+		FLuaValue* OldValue = Snapshot.Find(FieldName);
+		if (!OldValue || !LuaViewModelValuesEqual(*OldValue, NewValue))
+		{
+			MarkFieldDirty(FName(*FieldName));
+		}
+		Snapshot.Remove(FieldName);
+	}
+
+	// removed fields
+	for (const TPair<FString, FLuaValue>& Pair : Snapshot)
+	{
+		MarkFieldDirty(FName(*Pair.Key));
+	}
+
+	LuaEndUpdate();
+}
+
+/**
+ * @brief Lua entry point of vm:Flush().
+ */
+void ULuaViewModelBridge::LuaTableFlush(FLuaValue Self)
+{
+	FlushFieldNotifications();
+}
+
+/**
+ * @brief Stops waiting for the end of the frame, pending notifications are dropped with the ViewModel.
+ */
+void ULuaViewModelBridge::BeginDestroy()
+{
+	if (FlushHandle.IsValid())
+	{
+		FCoreDelegates::OnEndFrame.Remove(FlushHandle);
+		FlushHandle.Reset();
+	}
+	DirtyFields.Empty();
+
+	Super::BeginDestroy();
+}
+
 /**
  * Attempts to call a global Lua function by name and store its result.
  *
@@ -0,0 +1,121 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaMachineBenchmark.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "LuaState.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+FLuaMachineBenchmarkReport& FLuaMachineBenchmarkReport::Get()
+{
+	static FLuaMachineBenchmarkReport Report;
+	return Report;
+}
+
+FLuaMachineBenchmarkReport::FLuaMachineBenchmarkReport()
+	: Tolerance(0.2)
+{
+	if (!FParse::Value(FCommandLine::Get(), TEXT("LuaMachineBenchmarkOutput="), OutputDirectory))
+	{
+		OutputDirectory = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Automation"), TEXT("LuaMachine"));
+	}
+
+	FParse::Value(FCommandLine::Get(), TEXT("LuaMachineBenchmarkTolerance="), Tolerance);
+
+	FString BaselineFilename;
+	if (!FParse::Value(FCommandLine::Get(), TEXT("LuaMachineBenchmarkBaseline="), BaselineFilename))
+	{
+		return;
+	}
+
+	FString Json;
+	TSharedPtr<FJsonObject> JsonObject;
+	if (!FFileHelper::LoadFileToString(Json, *BaselineFilename) || !FJsonSerializer::Deserialize(TJsonReaderFactory<TCHAR>::Create(Json), JsonObject) || !JsonObject.IsValid())
+	{
+		UE_LOG(LogLuaMachine, Error, TEXT("unable to load benchmark baseline %s"), *BaselineFilename);
+		return;
+	}
+
+	const TArray<TSharedPtr<FJsonValue>>* Benchmarks = nullptr;
+	if (JsonObject->TryGetArrayField(TEXT("benchmarks"), Benchmarks))
+	{
+		for (const TSharedPtr<FJsonValue>& Benchmark : *Benchmarks)
+		{
+			const TSharedPtr<FJsonObject>& BenchmarkObject = Benchmark->AsObject();
+			if (BenchmarkObject.IsValid())
+			{
+				Baseline.Add(BenchmarkObject->GetStringField(TEXT("name")), BenchmarkObject->GetNumberField(TEXT("ns_per_op")));
+			}
+		}
+	}
+}
+
+bool FLuaMachineBenchmarkReport::AddResult(FAutomationTestBase& Test, const FString& Name, const int64 Operations, const double Seconds)
+{
+	FLuaMachineBenchmarkResult Result;
+	Result.Name = Name;
+	Result.Operations = Operations;
+	Result.NanosecondsPerOperation = Operations > 0 ? (Seconds * 1000000000.0) / Operations : 0;
+	Result.BaselineNanosecondsPerOperation = 0;
+	Result.bRegression = false;
+
+	if (const double* BaselineNanoseconds = Baseline.Find(Name))
+	{
+		Result.BaselineNanosecondsPerOperation = *BaselineNanoseconds;
+		Result.bRegression = *BaselineNanoseconds > 0 && Result.NanosecondsPerOperation > *BaselineNanoseconds * (1 + Tolerance);
+	}
+
+	// a test can be run multiple times in the same session, keep only the last result
+	Results.RemoveAll([&Name](const FLuaMachineBenchmarkResult& Other) { return Other.Name == Name; });
+	Results.Add(Result);
+	Save();
+
+	if (Result.bRegression)
+	{
+		Test.AddError(FString::Printf(TEXT("%s: %.1f ns/op, baseline %.1f ns/op (tolerance %.0f%%)"), *Name, Result.NanosecondsPerOperation, Result.BaselineNanosecondsPerOperation, Tolerance * 100));
+		return false;
+	}
+
+	Test.AddInfo(FString::Printf(TEXT("%s: %.1f ns/op"), *Name, Result.NanosecondsPerOperation));
+	return true;
+}
+
+void FLuaMachineBenchmarkReport::Save() const
+{
+	TArray<TSharedPtr<FJsonValue>> Benchmarks;
+	FString Csv = TEXT("name,operations,ns_per_op,baseline_ns_per_op,regression\n");
+
+	for (const FLuaMachineBenchmarkResult& Result : Results)
+	{
+		TSharedPtr<FJsonObject> Benchmark = MakeShared<FJsonObject>();
+		Benchmark->SetStringField(TEXT("name"), Result.Name);
+		Benchmark->SetNumberField(TEXT("operations"), (double)Result.Operations);
+		Benchmark->SetNumberField(TEXT("ns_per_op"), Result.NanosecondsPerOperation);
+		Benchmark->SetNumberField(TEXT("baseline_ns_per_op"), Result.BaselineNanosecondsPerOperation);
+		Benchmark->SetBoolField(TEXT("regression"), Result.bRegression);
+		Benchmarks.Add(MakeShared<FJsonValueObject>(Benchmark));
+
+		Csv += FString::Printf(TEXT("%s,%lld,%.3f,%.3f,%d\n"), *Result.Name, Result.Operations, Result.NanosecondsPerOperation, Result.BaselineNanosecondsPerOperation, Result.bRegression ? 1 : 0);
+	}
+
+	TSharedRef<FJsonObject> JsonObject = MakeShared<FJsonObject>();
+	JsonObject->SetStringField(TEXT("platform"), FPlatformProperties::IniPlatformName());
+	JsonObject->SetStringField(TEXT("date"), FDateTime::UtcNow().ToIso8601());
+	JsonObject->SetNumberField(TEXT("tolerance"), Tolerance);
+	JsonObject->SetArrayField(TEXT("benchmarks"), Benchmarks);
+
+	FString Json;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(JsonObject, Writer);
+
+	FFileHelper::SaveStringToFile(Json, *FPaths::Combine(OutputDirectory, TEXT("Benchmarks.json")));
+	FFileHelper::SaveStringToFile(Csv, *FPaths::Combine(OutputDirectory, TEXT("Benchmarks.csv")));
+}
+
+#endif
@@ -0,0 +1,72 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+struct FLuaMachineBenchmarkResult
+{
+	FString Name;
+	int64 Operations;
+	double NanosecondsPerOperation;
+	// 0 when no baseline is available
+	double BaselineNanosecondsPerOperation;
+	bool bRegression;
+};
+
+/*
+ * Collects the results of the LuaMachine.Benchmarks tests and writes them (after every benchmark)
+ * as Benchmarks.json and Benchmarks.csv in Saved/Automation/LuaMachine (or -LuaMachineBenchmarkOutput=<dir>).
+ *
+ * Regressions are reported as test errors when a baseline is passed with -LuaMachineBenchmarkBaseline=<file>
+ * (a Benchmarks.json from a previous run) and a result is slower than the baseline by more than
+ * -LuaMachineBenchmarkTolerance=<fraction> (0.2 by default).
+ */
+class FLuaMachineBenchmarkReport
+{
+public:
+	static FLuaMachineBenchmarkReport& Get();
+
+	/* Body is called Iterations times (after a warm up) for every run, the fastest run is recorded. OperationsPerIteration is for bodies running a batch (like a Lua loop) */
+	template<typename Callback>
+	bool Run(FAutomationTestBase& Test, const FString& Name, const int32 Iterations, Callback Body, const int32 OperationsPerIteration = 1)
+	{
+		const int32 WarmUpIterations = FMath::Clamp(Iterations / 10, 1, 1000);
+		for (int32 Iteration = 0; Iteration < WarmUpIterations; Iteration++)
+		{
+			Body();
+		}
+
+		double BestSeconds = MAX_dbl;
+		for (int32 RunIndex = 0; RunIndex < NumRuns; RunIndex++)
+		{
+			const double StartSeconds = FPlatformTime::Seconds();
+			for (int32 Iteration = 0; Iteration < Iterations; Iteration++)
+			{
+				Body();
+			}
+			BestSeconds = FMath::Min(BestSeconds, FPlatformTime::Seconds() - StartSeconds);
+		}
+
+		return AddResult(Test, Name, (int64)Iterations * OperationsPerIteration, BestSeconds);
+	}
+
+	bool AddResult(FAutomationTestBase& Test, const FString& Name, const int64 Operations, const double Seconds);
+
+	void Save() const;
+
+private:
+	FLuaMachineBenchmarkReport();
+
+	static const int32 NumRuns = 5;
+
+	FString OutputDirectory;
+	double Tolerance;
+	TMap<FString, double> Baseline;
+	TArray<FLuaMachineBenchmarkResult> Results;
+};
+
+#endif
@@ -0,0 +1,80 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "LuaState.h"
+#include "LuaMachineBenchmarkTypes.generated.h"
+
+/*
+ * Types used by the LuaMachine.Benchmarks automation tests.
+ * They live in the module (UHT does not support automation guards) but are hidden from the editor.
+ */
+
+USTRUCT()
+struct FLuaMachineBenchmarkStruct
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FVector Location = FVector::ZeroVector;
+
+	UPROPERTY()
+	FString Name;
+
+	UPROPERTY()
+	int32 Counter = 0;
+
+	UPROPERTY()
+	TArray<float> Weights;
+};
+
+UCLASS(NotBlueprintable, NotBlueprintType, HideDropdown, Transient)
+class ULuaMachineBenchmarkState : public ULuaState
+{
+	GENERATED_BODY()
+
+public:
+	ULuaMachineBenchmarkState()
+	{
+		bLuaOpenLibs = true;
+		bLogError = true;
+		bAddProjectContentDirToPackagePath = false;
+	}
+};
+
+/* same as ULuaMachineBenchmarkState but UFunctions are exposed through __rawcall */
+UCLASS(NotBlueprintable, NotBlueprintType, HideDropdown, Transient)
+class ULuaMachineBenchmarkRawCallState : public ULuaMachineBenchmarkState
+{
+	GENERATED_BODY()
+
+public:
+	ULuaMachineBenchmarkRawCallState()
+	{
+		bRawLuaFunctionCall = true;
+	}
+};
+
+UCLASS(NotBlueprintable, NotBlueprintType, HideDropdown, Transient)
+class ULuaMachineBenchmarkObject : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION()
+	int32 Add(const int32 A, const int32 B) { return A + B; }
+
+	UFUNCTION()
+	FVector Scale(const FVector& Vector, const float Factor) { return Vector * Factor; }
+
+	UFUNCTION()
+	void Nop() {}
+
+	UPROPERTY()
+	TArray<int32> Values;
+
+	UPROPERTY()
+	FLuaMachineBenchmarkStruct Data;
+};
@@ -0,0 +1,280 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "LuaMachineBenchmark.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "LuaMachineBenchmarkTypes.h"
+#include "LuaMachine.h"
+#include "LuaBlueprintFunctionLibrary.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+/*
+ * Headless benchmarks of the bridge hot paths, run them with:
+ * UnrealEditor-Cmd <Project> -nullrhi -unattended -ExecCmds="Automation RunTests LuaMachine.Benchmarks; Quit"
+ */
+
+template<typename T>
+static ULuaState* GetLuaMachineBenchmarkState()
+{
+	return FLuaMachineModule::Get().GetLuaState(T::StaticClass(), nullptr);
+}
+
+static ULuaMachineBenchmarkObject* NewLuaMachineBenchmarkObject()
+{
+	ULuaMachineBenchmarkObject* Object = NewObject<ULuaMachineBenchmarkObject>(GetTransientPackage());
+	Object->AddToRoot();
+	for (int32 Index = 0; Index < 256; Index++)
+	{
+		Object->Values.Add(Index);
+	}
+	Object->Data.Location = FVector(1, 2, 3);
+	Object->Data.Name = TEXT("LuaMachine");
+	Object->Data.Counter = 17;
+	for (int32 Index = 0; Index < 16; Index++)
+	{
+		Object->Data.Weights.Add(Index * 0.5f);
+	}
+	return Object;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaMachineBenchmarkMarshallingTest, "LuaMachine.Benchmarks.Marshalling", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FLuaMachineBenchmarkMarshallingTest::RunTest(const FString& Parameters)
+{
+	ULuaState* L = GetLuaMachineBenchmarkState<ULuaMachineBenchmarkState>();
+	ULuaMachineBenchmarkObject* Object = NewLuaMachineBenchmarkObject();
+	FLuaMachineBenchmarkReport& Report = FLuaMachineBenchmarkReport::Get();
+
+	TArray<TPair<FString, FLuaValue>> Values;
+	Values.Add(TPair<FString, FLuaValue>(TEXT("Nil"), FLuaValue()));
+	Values.Add(TPair<FString, FLuaValue>(TEXT("Bool"), FLuaValue(true)));
+	Values.Add(TPair<FString, FLuaValue>(TEXT("Integer"), FLuaValue(17)));
+	Values.Add(TPair<FString, FLuaValue>(TEXT("Number"), FLuaValue(3.5)));
+	Values.Add(TPair<FString, FLuaValue>(TEXT("String"), FLuaValue(TEXT("Hello LuaMachine"))));
+	Values.Add(TPair<FString, FLuaValue>(TEXT("Table"), L->CreateLuaTable()));
+	Values.Add(TPair<FString, FLuaValue>(TEXT("UObject"), FLuaValue(Object)));
+
+	for (TPair<FString, FLuaValue>& Pair : Values)
+	{
+		FLuaValue& Value = Pair.Value;
+		Report.Run(*this, TEXT("FromLuaValue.") + Pair.Key, 100000, [L, &Value]()
+			{
+				L->FromLuaValue(Value);
+				L->Pop();
+			});
+
+		L->FromLuaValue(Value);
+		Report.Run(*this, TEXT("ToLuaValue.") + Pair.Key, 100000, [L]()
+			{
+				FLuaValue Result = L->ToLuaValue(-1);
+			});
+		L->Pop();
+	}
+
+	Object->RemoveFromRoot();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaMachineBenchmarkGlobalCallTest, "LuaMachine.Benchmarks.GlobalCall", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FLuaMachineBenchmarkGlobalCallTest::RunTest(const FString& Parameters)
+{
+	ULuaState* L = GetLuaMachineBenchmarkState<ULuaMachineBenchmarkState>();
+	FLuaMachineBenchmarkReport& Report = FLuaMachineBenchmarkReport::Get();
+
+	L->RunString(TEXT("function bench_add(a, b) return a + b end\nbench = { math = { add = bench_add } }\nfunction bench_loop(n) local f = bench_add for i = 1, n do f(i, 1) end end"), TEXT("LuaMachineBenchmarks/GlobalCall"));
+
+	TArray<FLuaValue> Args = { FLuaValue(1), FLuaValue(2) };
+	Report.Run(*this, TEXT("LuaGlobalCall"), 100000, [&Args]()
+		{
+			ULuaBlueprintFunctionLibrary::LuaGlobalCall(GetTransientPackage(), ULuaMachineBenchmarkState::StaticClass(), TEXT("bench_add"), Args);
+		});
+
+	Report.Run(*this, TEXT("LuaGlobalCall.Nested"), 100000, [&Args]()
+		{
+			ULuaBlueprintFunctionLibrary::LuaGlobalCall(GetTransientPackage(), ULuaMachineBenchmarkState::StaticClass(), TEXT("bench.math.add"), Args);
+		});
+
+	// Lua to Lua calls, the reference for the bridge overhead
+	TArray<FLuaValue> LoopArgs = { FLuaValue(1000) };
+	Report.Run(*this, TEXT("LuaCall.Native"), 1000, [&LoopArgs]()
+		{
+			ULuaBlueprintFunctionLibrary::LuaGlobalCall(GetTransientPackage(), ULuaMachineBenchmarkState::StaticClass(), TEXT("bench_loop"), LoopArgs);
+		}, 1000);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaMachineBenchmarkUFunctionCallTest, "LuaMachine.Benchmarks.UFunctionCall", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FLuaMachineBenchmarkUFunctionCallTest::RunTest(const FString& Parameters)
+{
+	ULuaMachineBenchmarkObject* Object = NewLuaMachineBenchmarkObject();
+	FLuaMachineBenchmarkReport& Report = FLuaMachineBenchmarkReport::Get();
+
+	auto RunCalls = [this, Object, &Report](TSubclassOf<ULuaState> StateClass, ULuaState* L, const FString& Suffix)
+	{
+		FLuaValue NopFunction = FLuaValue::Function(GET_FUNCTION_NAME_CHECKED(ULuaMachineBenchmarkObject, Nop));
+		FLuaValue AddFunction = FLuaValue::Function(GET_FUNCTION_NAME_CHECKED(ULuaMachineBenchmarkObject, Add));
+		FLuaValue ScaleFunction = FLuaValue::Function(GET_FUNCTION_NAME_CHECKED(ULuaMachineBenchmarkObject, Scale));
+		L->SetFieldFromTree(TEXT("bench_object_nop"), NopFunction, true, Object);
+		L->SetFieldFromTree(TEXT("bench_object_add"), AddFunction, true, Object);
+		L->SetFieldFromTree(TEXT("bench_object_scale"), ScaleFunction, true, Object);
+
+		L->RunString(TEXT(
+			"function bench_call_nop(n) local f = bench_object_nop for i = 1, n do f() end end\n"
+			"function bench_call_add(n) local f = bench_object_add for i = 1, n do f(i, 1) end end\n"
+			"function bench_call_scale(n) local f = bench_object_scale local v = {X=1, Y=2, Z=3} for i = 1, n do f(v, 2) end end\n"),
+			TEXT("LuaMachineBenchmarks/UFunctionCall"));
+
+		TArray<FLuaValue> LoopArgs = { FLuaValue(1000) };
+		for (const FString& Name : { FString(TEXT("nop")), FString(TEXT("add")), FString(TEXT("scale")) })
+		{
+			Report.Run(*this, FString::Printf(TEXT("UFunction.%s.%s"), *Name, *Suffix), 100, [StateClass, &Name, &LoopArgs]()
+				{
+					ULuaBlueprintFunctionLibrary::LuaGlobalCall(GetTransientPackage(), StateClass, TEXT("bench_call_") + Name, LoopArgs);
+				}, 1000);
+		}
+	};
+
+	RunCalls(ULuaMachineBenchmarkState::StaticClass(), GetLuaMachineBenchmarkState<ULuaMachineBenchmarkState>(), TEXT("__call"));
+	RunCalls(ULuaMachineBenchmarkRawCallState::StaticClass(), GetLuaMachineBenchmarkState<ULuaMachineBenchmarkRawCallState>(), TEXT("__rawcall"));
+
+	Object->RemoveFromRoot();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaMachineBenchmarkStructTest, "LuaMachine.Benchmarks.Structs", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FLuaMachineBenchmarkStructTest::RunTest(const FString& Parameters)
+{
+	ULuaState* L = GetLuaMachineBenchmarkState<ULuaMachineBenchmarkState>();
+	ULuaMachineBenchmarkObject* Object = NewLuaMachineBenchmarkObject();
+	FLuaMachineBenchmarkReport& Report = FLuaMachineBenchmarkReport::Get();
+
+	Report.Run(*this, TEXT("Struct.ToLuaTable"), 20000, [L, Object]()
+		{
+			FLuaValue Table = L->StructToLuaValue(Object->Data);
+		});
+
+	FLuaValue Table = L->StructToLuaValue(Object->Data);
+	Report.Run(*this, TEXT("Struct.FromLuaTable"), 20000, [L, &Table]()
+		{
+			FLuaMachineBenchmarkStruct Data;
+			L->LuaTableToStruct(Table, FLuaMachineBenchmarkStruct::StaticStruct(), (uint8*)&Data);
+		});
+
+	Report.Run(*this, TEXT("Array.FromProperty.256"), 2000, [L, Object]()
+		{
+			FLuaValue Array = L->GetLuaValueFromProperty(Object, TEXT("Values"));
+		});
+
+	FLuaValue Array = L->GetLuaValueFromProperty(Object, TEXT("Values"));
+	Report.Run(*this, TEXT("Array.ToProperty.256"), 2000, [L, Object, &Array]()
+		{
+			L->SetPropertyFromLuaValue(Object, TEXT("Values"), Array);
+		});
+
+	Object->RemoveFromRoot();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaMachineBenchmarkJsonTest, "LuaMachine.Benchmarks.Json", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FLuaMachineBenchmarkJsonTest::RunTest(const FString& Parameters)
+{
+	GetLuaMachineBenchmarkState<ULuaMachineBenchmarkState>();
+	FLuaMachineBenchmarkReport& Report = FLuaMachineBenchmarkReport::Get();
+
+	FString Json = TEXT("{\"name\": \"bench\", \"nested\": {\"a\": true, \"b\": null, \"c\": \"text\"}, \"values\": [");
+	for (int32 Index = 0; Index < 64; Index++)
+	{
+		Json += FString::Printf(TEXT("%s%d"), Index > 0 ? TEXT(", ") : TEXT(""), Index);
+	}
+	Json += TEXT("], \"items\": [");
+	for (int32 Index = 0; Index < 16; Index++)
+	{
+		Json += FString::Printf(TEXT("%s{\"id\": %d, \"position\": [%d.5, 2, 3], \"label\": \"item%d\"}"), Index > 0 ? TEXT(", ") : TEXT(""), Index, Index, Index);
+	}
+	Json += TEXT("]}");
+
+	Report.Run(*this, TEXT("Json.ToLuaValue"), 2000, [&Json]()
+		{
+			FLuaValue Value;
+			ULuaBlueprintFunctionLibrary::LuaValueFromJson(GetTransientPackage(), ULuaMachineBenchmarkState::StaticClass(), Json, Value);
+		});
+
+	FLuaValue Value;
+	TestTrue(TEXT("valid json"), ULuaBlueprintFunctionLibrary::LuaValueFromJson(GetTransientPackage(), ULuaMachineBenchmarkState::StaticClass(), Json, Value));
+	Report.Run(*this, TEXT("Json.FromLuaValue"), 2000, [&Value]()
+		{
+			ULuaBlueprintFunctionLibrary::LuaValueToJson(Value);
+		});
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaMachineBenchmarkRequireTest, "LuaMachine.Benchmarks.Require", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FLuaMachineBenchmarkRequireTest::RunTest(const FString& Parameters)
+{
+	ULuaState* L = GetLuaMachineBenchmarkState<ULuaMachineBenchmarkState>();
+	FLuaMachineBenchmarkReport& Report = FLuaMachineBenchmarkReport::Get();
+
+	const FString ModulesDirectory = FPaths::ConvertRelativePathToFull(FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Automation"), TEXT("LuaMachine"), TEXT("Modules")));
+	FString Module = TEXT("local M = {}\n");
+	for (int32 Index = 0; Index < 64; Index++)
+	{
+		Module += FString::Printf(TEXT("function M.f%d(a, b) if a > b then return a - b end return a + b + %d end\n"), Index, Index);
+	}
+	Module += TEXT("return M\n");
+	if (!TestTrue(TEXT("module written"), FFileHelper::SaveStringToFile(Module, *FPaths::Combine(ModulesDirectory, TEXT("bench_module.lua")))))
+	{
+		return false;
+	}
+
+	L->RunString(FString::Printf(TEXT(
+		"package.path = '%s/?.lua;' .. package.path\n"
+		"function bench_require_cold(n) for i = 1, n do package.loaded.bench_module = nil require('bench_module') end end\n"
+		"function bench_require_warm(n) for i = 1, n do require('bench_module') end end\n"),
+		*ModulesDirectory.Replace(TEXT("\\"), TEXT("/"))), TEXT("LuaMachineBenchmarks/Require"));
+
+	TArray<FLuaValue> LoopArgs = { FLuaValue(100) };
+	Report.Run(*this, TEXT("Require.Cold"), 20, [&LoopArgs]()
+		{
+			ULuaBlueprintFunctionLibrary::LuaGlobalCall(GetTransientPackage(), ULuaMachineBenchmarkState::StaticClass(), TEXT("bench_require_cold"), LoopArgs);
+		}, 100);
+
+	Report.Run(*this, TEXT("Require.Warm"), 200, [&LoopArgs]()
+		{
+			ULuaBlueprintFunctionLibrary::LuaGlobalCall(GetTransientPackage(), ULuaMachineBenchmarkState::StaticClass(), TEXT("bench_require_warm"), LoopArgs);
+		}, 100);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaMachineBenchmarkStartupTest, "LuaMachine.Benchmarks.Startup", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FLuaMachineBenchmarkStartupTest::RunTest(const FString& Parameters)
+{
+	FLuaMachineBenchmarkReport& Report = FLuaMachineBenchmarkReport::Get();
+
+	Report.Run(*this, TEXT("State.Startup"), 100, []()
+		{
+			ULuaState* NewLuaState = NewObject<ULuaMachineBenchmarkState>(GetTransientPackage());
+			NewLuaState->GetLuaState(nullptr);
+			// the lua VM is closed when the object is collected
+#if ENGINE_MAJOR_VERSION > 4
+			NewLuaState->MarkAsGarbage();
+#else
+			NewLuaState->MarkPendingKill();
+#endif
+		});
+
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	return true;
+}
+
+#endif
@@ -0,0 +1,75 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "LuaPreprocessor.h"
+
+static FLuaPreprocessorOptions GetLuaPreprocessorTestOptions()
+{
+	FLuaPreprocessorOptions Options;
+	Options.Constants.Add(TEXT("DEBUG"), TEXT("false"));
+	return Options;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaPreprocessorConstantsTest, "LuaMachine.Preprocessor.Constants", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FLuaPreprocessorConstantsTest::RunTest(const FString& Parameters)
+{
+	const FLuaPreprocessorOptions Options = GetLuaPreprocessorTestOptions();
+
+	const TArray<TPair<FString, FString>> Cases = {
+		{ TEXT("if DEBUG then print(1) end"), TEXT("if false then print(1) end") },
+		{ TEXT("if DEBUG == true then end"), TEXT("if false == true then end") },
+		{ TEXT("print(DEBUG, \"DEBUG\") -- DEBUG"), TEXT("print(false, \"DEBUG\") -- DEBUG") },
+		{ TEXT("t = {DEBUG = 1, v = DEBUG}"), TEXT("t = {DEBUG = 1, v = false}") },
+		{ TEXT("t = {[DEBUG] = 1; DEBUG = 2}"), TEXT("t = {[false] = 1; DEBUG = 2}") },
+		{ TEXT("x = t.DEBUG + t:DEBUG()"), TEXT("x = t.DEBUG + t:DEBUG()") },
+		{ TEXT("goto DEBUG ::DEBUG::"), TEXT("goto DEBUG ::DEBUG::") },
+	};
+
+	for (const TPair<FString, FString>& Case : Cases)
+	{
+		FString OutCode;
+		FString ErrorString;
+		if (TestTrue(FString::Printf(TEXT("Process(%s)"), *Case.Key), FLuaPreprocessor::Process(Case.Key, Options, OutCode, ErrorString)))
+		{
+			TestEqual(Case.Key, OutCode, Case.Value);
+		}
+	}
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaPreprocessorConstantBindingsTest, "LuaMachine.Preprocessor.ConstantBindings", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FLuaPreprocessorConstantBindingsTest::RunTest(const FString& Parameters)
+{
+	const FLuaPreprocessorOptions Options = GetLuaPreprocessorTestOptions();
+
+	// replacing only the later uses would silently change their meaning
+	const TArray<FString> Cases = {
+		TEXT("local DEBUG = false; print(DEBUG)"),
+		TEXT("function f(DEBUG) return DEBUG end"),
+		TEXT("local f = function(a, DEBUG) return DEBUG end"),
+		TEXT("local a, DEBUG = 1, 2"),
+		TEXT("for DEBUG = 1, 10 do end"),
+		TEXT("for k, DEBUG in pairs(t) do end"),
+		TEXT("function DEBUG() end"),
+		TEXT("DEBUG = true"),
+		TEXT("DEBUG, a = 1, 2"),
+	};
+
+	for (const FString& Case : Cases)
+	{
+		FString OutCode;
+		FString ErrorString;
+		TestFalse(FString::Printf(TEXT("Process(%s)"), *Case), FLuaPreprocessor::Process(Case, Options, OutCode, ErrorString));
+		TestTrue(FString::Printf(TEXT("error of %s"), *Case), ErrorString.Contains(TEXT("DEBUG")));
+	}
+
+	return true;
+}
+
+#endif
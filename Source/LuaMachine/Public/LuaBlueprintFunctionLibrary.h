@@ -103,12 +103,28 @@ public:
 	UFUNCTION(BlueprintCallable, meta = (WorldContext = "WorldContextObject"), Category="Lua")
 	static FLuaValue LuaCreateObjectInState(UObject* WorldContextObject, TSubclassOf<ULuaState> State, UObject* InObject);
 
+	/* Initialize the LuaStates in worker threads (useful during loading screens), the engine side of the initialization is finished on the game thread */
+	UFUNCTION(BlueprintCallable, meta = (WorldContext = "WorldContextObject"), Category="Lua")
+	static void LuaPreloadStates(UObject* WorldContextObject, TArray<TSubclassOf<ULuaState>> States);
+
+	/* 0-1, 1 when no LuaState is being preloaded */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="Lua")
+	static float LuaGetPreloadProgress();
+
 	UFUNCTION(BlueprintCallable, meta=(WorldContext="WorldContextObject"), Category="Lua")
 	static FLuaValue LuaGetGlobal(UObject* WorldContextObject, TSubclassOf<ULuaState> State, const FString& Name);
 
 	UFUNCTION(BlueprintCallable, meta = (WorldContext = "WorldContextObject"), Category="Lua")
 	static void LuaSetGlobal(UObject* WorldContextObject, TSubclassOf<ULuaState> State, const FString& Name, FLuaValue Value);
 
+	/* Import a whole UDataTable in columnar form as a global (numeric scans like items:select("Weight", "<", 10) run natively) */
+	UFUNCTION(BlueprintCallable, meta = (WorldContext = "WorldContextObject"), Category="Lua")
+	static bool LuaSetGlobalDataTable(UObject* WorldContextObject, TSubclassOf<ULuaState> State, const FString& Name, UDataTable* DataTable);
+
+	/* Copy a value (even a table owned by another LuaState) in the specified LuaState */
+	UFUNCTION(BlueprintCallable, meta = (WorldContext = "WorldContextObject"), Category="Lua")
+	static FLuaValue LuaValueCopyToState(UObject* WorldContextObject, TSubclassOf<ULuaState> State, FLuaValue Value);
+
 	UFUNCTION(BlueprintCallable, meta = (WorldContext = "WorldContextObject"), Category="Lua")
 	static void LuaSetUserDataMetaTable(UObject* WorldContextObject, TSubclassOf<ULuaState> State, FLuaValue MetaTable);
 
@@ -0,0 +1,52 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LuaPreprocessor.h"
+
+class ULuaCode;
+
+/*
+ * Bytecode compiler used when cooking ULuaCode assets.
+ * Results are cached by source hash, in memory and in Saved/LuaMachine/ByteCodeCache (so unchanged assets
+ * are not recompiled by the next cooks). Every compilation runs in its own scratch lua_State, so it is thread safe.
+ * Sources are specialized by FLuaPreprocessor when cook defines, constants or stripped functions are configured.
+ *
+ * Compile errors stop the cook when -LuaMachineFailOnCompileError is on the command line or
+ * bFailCookOnCompileError=True is in the [LuaMachine] section of DefaultEngine.ini.
+ */
+class LUAMACHINE_API FLuaCodeCompiler
+{
+public:
+	static FLuaCodeCompiler& Get();
+
+	bool Compile(const FString& Code, const FString& CodePath, TArray<uint8>& ByteCode, FString& ErrorString);
+
+	/* compile all of the (cookable) assets in parallel, returns the number of errors */
+	int32 CompileAll(const TArray<ULuaCode*>& LuaCodes);
+
+	static bool ShouldFailOnError();
+
+	FORCEINLINE const FLuaPreprocessorOptions& GetPreprocessorOptions() const { return PreprocessorOptions; }
+
+private:
+	FLuaCodeCompiler();
+
+	struct FEntry
+	{
+		TArray<uint8> ByteCode;
+		FString Error;
+	};
+
+	FString GetCacheKey(const FString& Code, const FString& CodePath) const;
+
+	FLuaPreprocessorOptions PreprocessorOptions;
+	FString PreprocessorOptionsKey;
+
+	FCriticalSection CacheLock;
+	TMap<FString, FEntry> Cache;
+
+	FThreadSafeCounter NumCompiled;
+	FThreadSafeCounter NumCacheHits;
+};
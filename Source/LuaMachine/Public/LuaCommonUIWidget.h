@@ -8,6 +8,9 @@
 #include "LuaValue.h"
 #include "LuaCommonUIWidget.generated.h"
 
+class UListView;
+class ULuaListDataSource;
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FLuaCommonUIWidgetActivated);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FLuaCommonUIWidgetDeactivated);
 
@@ -81,6 +84,11 @@ public:
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Lua")
 	FLuaValue GetWidgetLuaTable() const { return WidgetLuaTable; }
 
+	// Fill ListView with the Lua array stored in the ArrayName field of the widget's Lua table (only the visible rows are read from Lua)
+	// The Lua api of the data source (Dirty/Refresh/Flush) is stored in the SourceName field when not empty
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	ULuaListDataSource* LuaBindListView(UListView* ListView, const FString& ArrayName, const FString& SourceName);
+
 protected:
 	virtual void NativeConstruct() override;
 	virtual void NativeDestruct() override;
@@ -95,4 +103,8 @@ protected:
 
 	// The Lua table value representing this widget
 	FLuaValue WidgetLuaTable;
+
+	// Data sources created by LuaBindListView
+	UPROPERTY()
+	TArray<ULuaListDataSource*> ListDataSources;
 };
\ No newline at end of file
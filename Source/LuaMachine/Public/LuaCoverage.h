@@ -0,0 +1,73 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ThirdParty/lua/lua.hpp"
+#include "LuaHookListener.h"
+
+/*
+ * Native line coverage collector.
+ * Executed lines are stored in a bitset per chunk, and the line hook is enabled (per lua thread)
+ * only while a function of a measured chunk is running: unmeasured code only pays for call/return events.
+ * Executable lines are known only for functions called at least once (the api does not expose the nested prototypes).
+ */
+class LUAMACHINE_API FLuaCoverage : public ILuaHookListener
+{
+public:
+	FLuaCoverage();
+
+	/* wildcards matched against the chunk name (without the leading '@'), an empty list measures every chunk */
+	void Start(const TArray<FString>& InFilters);
+	void Stop();
+	void Reset();
+
+	FORCEINLINE bool IsRunning() const { return bRunning; }
+
+	/* ILuaHookListener, lines are requested on demand when entering a measured chunk */
+	virtual int32 GetLuaHookMask() const override { return bRunning ? (LUA_MASKCALL | LUA_MASKRET) : 0; }
+	virtual int32 GetLuaHookOnDemandMask() const override { return LUA_MASKLINE; }
+	virtual void OnLuaHook(ULuaState* LuaState, FLuaHookEvent& Event) override;
+
+	/* lcov tracefile (one record per measured chunk, SF is the chunk name) */
+	FString ExportLcov(const FString& TestName = TEXT("")) const;
+	bool SaveLcov(const FString& Filename, const FString& TestName = TEXT("")) const;
+
+	/* hit/executable lines for every measured chunk */
+	FString GetSummary() const;
+
+private:
+	struct FFunction
+	{
+		FString Name;
+		int32 Hits;
+	};
+
+	struct FChunk
+	{
+		FString Name;
+		TArray<ANSICHAR> Key;
+		bool bMeasured;
+		TBitArray<> ExecutedLines;
+		TBitArray<> ExecutableLines;
+		// keyed by line defined
+		TMap<int32, FFunction> Functions;
+	};
+
+	int32 FindChunk(const char* Source);
+	void OnFunctionCall(FLuaHookEvent& Event, FChunk& Chunk);
+
+	static void SetLine(TBitArray<>& Lines, const int32 Line);
+
+	bool bRunning;
+	TArray<FString> Filters;
+
+	TArray<FChunk> Chunks;
+	TMap<FString, int32> ChunkIds;
+	// lua strings are interned, so the source pointer is a fast (but verified) key
+	TMap<const char*, int32> ChunkPointers;
+
+	// line events are always in the chunk of the previous one, except after call/return events
+	const char* LastSource;
+	int32 LastChunkId;
+};
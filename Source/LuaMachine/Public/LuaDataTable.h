@@ -0,0 +1,117 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/WeakObjectPtr.h"
+#include "Runtime/Launch/Resources/Version.h"
+#include "ThirdParty/lua/lua.hpp"
+
+class UDataTable;
+
+class FLuaDataTable;
+typedef TSharedPtr<const FLuaDataTable, ESPMode::ThreadSafe> FLuaDataTablePtr;
+
+/*
+ * Columnar copy of a UDataTable: every field of the row struct becomes a column,
+ * numeric and boolean fields are stored in typed buffers, strings (FString, FName, FText) are interned.
+ * Fields of other types (structs, arrays, objects...) are converted from the UDataTable on access.
+ *
+ * Lua sees it as a read-only userdata:
+ *   #items, items.Weight[i], items:row("Sword"), items:name(i), items:get("Sword", "Weight"), items:totable("Sword")
+ *   items:select("Weight", "<", 10, "Rarity", "==", "Rare") and items:count(...) (the scans run natively)
+ *   items:sum("Weight"), items:min("Weight"), items:max("Weight")
+ * Rows are 1-based indices (in the UDataTable order), every method accepts a row index or a row name.
+ */
+class LUAMACHINE_API FLuaDataTable : public TSharedFromThis<FLuaDataTable, ESPMode::ThreadSafe>
+{
+public:
+	enum class EColumnType : uint8
+	{
+		Bool,
+		Integer,
+		Number,
+		String,
+		Value,
+	};
+
+	struct FColumn
+	{
+		FString Name;
+		// zero terminated, for the lookups from Lua
+		TArray<ANSICHAR> Utf8Name;
+		EColumnType Type;
+		TArray<bool> Bools;
+		TArray<int64> Integers;
+		TArray<double> Numbers;
+		// indices in the interned strings
+		TArray<int32> Strings;
+#if ENGINE_MAJOR_VERSION > 4 || ENGINE_MINOR_VERSION >= 25
+		FProperty* Property;
+#else
+		UProperty* Property;
+#endif
+	};
+
+	/* must be called on the game thread */
+	static FLuaDataTablePtr Import(UDataTable* DataTable);
+
+	/* push the table userdata */
+	static void PushProxy(lua_State* L, FLuaDataTablePtr Data);
+
+	FORCEINLINE int32 GetNumRows() const { return RowNames.Num(); }
+	FORCEINLINE int32 GetNumColumns() const { return Columns.Num(); }
+	int32 FindRow(const FName& RowName) const;
+	int32 FindColumn(const char* Name) const;
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	struct FProxy;
+	struct FCondition;
+
+	int32 InternString(const FString& Value);
+	int32 FindString(const char* Value, const int32 Length) const;
+
+	void PushCell(lua_State* L, const int32 Column, const int32 Row) const;
+	void PushColumnProxy(lua_State* L, const int32 Column) const;
+
+	static FProxy* CheckProxy(lua_State* L, const int Index);
+	// INDEX_NONE when the row does not exist
+	static int32 ToRow(lua_State* L, const FLuaDataTable& Data, const int Index);
+	static int32 CheckColumn(lua_State* L, const FLuaDataTable& Data, const int Index);
+	static int32 CheckNumericColumn(lua_State* L, const FLuaDataTable& Data, const int Index);
+	// the conditions live in a userdata pushed on the stack (nothing to free when a Lua error is raised)
+	static TArrayView<FCondition> CheckConditions(lua_State* L, const FLuaDataTable& Data, const int FirstIndex);
+	bool MatchesConditions(const TArrayView<FCondition> Conditions, const int32 Row) const;
+
+	static int MetaTableFunction__index(lua_State* L);
+	static int MetaTableFunction__newindex(lua_State* L);
+	static int MetaTableFunction__len(lua_State* L);
+	static int MetaTableFunction__tostring(lua_State* L);
+	static int MetaTableFunction__gc(lua_State* L);
+	static int MetaTableFunctionColumn__index(lua_State* L);
+	static int MetaTableFunctionColumn__len(lua_State* L);
+	static int MetaTableFunctionColumn__tostring(lua_State* L);
+
+	static int TableFunction_row(lua_State* L);
+	static int TableFunction_name(lua_State* L);
+	static int TableFunction_column(lua_State* L);
+	static int TableFunction_get(lua_State* L);
+	static int TableFunction_totable(lua_State* L);
+	static int TableFunction_select(lua_State* L);
+	static int TableFunction_count(lua_State* L);
+	static int TableFunction_sum(lua_State* L);
+	static int TableFunction_min(lua_State* L);
+	static int TableFunction_max(lua_State* L);
+
+	FString Name;
+	TWeakObjectPtr<UDataTable> DataTable;
+	TArray<FName> RowNames;
+	TMap<FName, int32> RowIndices;
+	TArray<FColumn> Columns;
+
+	// interned UTF-8 strings, zero terminated
+	TArray<ANSICHAR> StringData;
+	TArray<int32> StringOffsets;
+	TMultiMap<uint32, int32> StringsByHash;
+};
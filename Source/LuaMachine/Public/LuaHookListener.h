@@ -0,0 +1,71 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ThirdParty/lua/lua.hpp"
+
+class ULuaState;
+
+/*
+ * Raw view on the lua_Debug passed to the hook.
+ * Fields are filled lazily: only the lua_getinfo() options not already requested by a previous listener are evaluated.
+ * It is trivially destructible on purpose, as listeners are allowed to raise Lua errors (luaL_error) from the hook.
+ */
+struct LUAMACHINE_API FLuaHookEvent
+{
+	FLuaHookEvent(lua_State* InL, lua_Debug* InDebug)
+		: L(InL)
+		, Debug(InDebug)
+		, FilledFields(0)
+	{
+	}
+
+	FORCEINLINE int32 GetEvent() const { return Debug->event; }
+
+	/* same options of lua_getinfo(): 'S' source, 'l' current line, 'n' name, 'u' upvalues/params, 't' tail call */
+	const lua_Debug& Require(const char* What);
+
+	FORCEINLINE const char* GetSource() { return Require("S").source; }
+	FORCEINLINE const char* GetShortSource() { return Require("S").short_src; }
+	FORCEINLINE const char* GetWhat() { return Require("S").what; }
+	FORCEINLINE int32 GetLineDefined() { return Require("S").linedefined; }
+	FORCEINLINE int32 GetCurrentLine() { return Debug->event == LUA_HOOKLINE ? Debug->currentline : Require("l").currentline; }
+	FORCEINLINE const char* GetName() { return Require("n").name; }
+
+	lua_State* L;
+	lua_Debug* Debug;
+
+private:
+	uint8 FilledFields;
+};
+
+/*
+ * Native hook listener, register it with ULuaState::AddHookListener().
+ * The state installs a single lua hook with the union of the masks of its listeners,
+ * call ULuaState::RefreshDebugHook() whenever the mask or the instruction count of a listener changes.
+ */
+class LUAMACHINE_API ILuaHookListener
+{
+public:
+	virtual ~ILuaHookListener() {}
+
+	/* combination of LUA_MASKCALL (tail calls included), LUA_MASKRET, LUA_MASKLINE and LUA_MASKCOUNT */
+	virtual int32 GetLuaHookMask() const = 0;
+
+	/* instructions between two count events, meaningful only with LUA_MASKCOUNT */
+	virtual int32 GetLuaHookInstructionCount() const { return 0; }
+
+	/* events delivered to the listener but not installed, the listener enables them per lua thread with ULuaState::SetThreadOnDemandHook() */
+	virtual int32 GetLuaHookOnDemandMask() const { return 0; }
+
+	virtual void OnLuaHook(ULuaState* LuaState, FLuaHookEvent& Event) = 0;
+};
+
+struct FLuaActiveHookListener
+{
+	ILuaHookListener* Listener;
+	int32 Mask;
+	int32 InstructionCount;
+	int32 PendingInstructions;
+};
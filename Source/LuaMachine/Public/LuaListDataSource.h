@@ -0,0 +1,158 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "LuaValue.h"
+#include "LuaListDataSource.generated.h"
+
+class UListView;
+class ULuaListDataSource;
+class ULuaListItem;
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FLuaListItemChanged, ULuaListItem*, Item);
+
+/**
+ * Lightweight list item representing a row of a Lua array.
+ * The row value is read from Lua only when asked (by the entry widgets of the visible rows) and cached until the row is marked dirty.
+ */
+UCLASS(BlueprintType)
+class LUAMACHINE_API ULuaListItem : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	ULuaListItem();
+
+	// 1-based index in the Lua array
+	UPROPERTY(BlueprintReadOnly, Category = "Lua")
+	int32 Index;
+
+	// Broadcast when Lua marks this row dirty, entry widgets bind to it in OnListItemObjectSet
+	UPROPERTY(BlueprintAssignable, Category = "Lua")
+	FLuaListItemChanged OnLuaItemChanged;
+
+	// The value of the row in the Lua array
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Lua")
+	FLuaValue GetLuaValue();
+
+	// A field of the row (when it is a table)
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Lua")
+	FLuaValue GetLuaField(const FString& Name);
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Lua")
+	ULuaListDataSource* GetDataSource() const { return DataSource.Get(); }
+
+	TWeakObjectPtr<ULuaListDataSource> DataSource;
+
+	// Drop the materialized value
+	void Invalidate();
+
+protected:
+	// Rows are often UObjects, so the cached value must be visible to the GC
+	UPROPERTY()
+	FLuaValue CachedValue;
+
+	bool bMaterialized;
+};
+
+/**
+ * Exposes a Lua array to a UListView.
+ * List items are pooled index handles (reused across refreshes, never recreated for the same row),
+ * the rows are converted only when an entry widget asks for them, so only the visible rows are ever read from Lua.
+ *
+ * Lua api (installed in the table returned by GetLuaTable()):
+ *   list:Dirty(i) or list:Dirty(first, last) mark rows as changed, notified once at the end of the frame
+ *   list:Refresh() rereads the length of the array (after insertions/removals) and regenerates the visible entries
+ *   list:Flush() notifies the dirty rows now
+ */
+UCLASS(BlueprintType)
+class LUAMACHINE_API ULuaListDataSource : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	ULuaListDataSource();
+
+	// Create a data source for Array and bind it to ListView
+	UFUNCTION(BlueprintCallable, Category = "Lua", meta = (DefaultToSelf = "Outer"))
+	static ULuaListDataSource* CreateLuaListDataSource(UObject* Outer, UListView* ListView, FLuaValue Array);
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void SetArray(FLuaValue InArray);
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void BindListView(UListView* InListView);
+
+	// Reread the length of the array, resize the list and drop every materialized row
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void Refresh();
+
+	// Mark a row (1-based) as changed
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void MarkIndexDirty(const int32 Index);
+
+	// Mark the rows First..Last (inclusive, 1-based) as changed
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void MarkRangeDirty(const int32 First, const int32 Last);
+
+	// Notify the dirty rows now instead of at the end of the frame
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void FlushDirtyIndices();
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Lua")
+	int32 GetNumItems() const { return NumItems; }
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Lua")
+	ULuaListItem* GetItem(const int32 Index) const;
+
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Lua")
+	FLuaValue GetArray() const { return Array; }
+
+	// The Lua table with the Dirty/Refresh/Flush methods
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Lua")
+	FLuaValue GetLuaTable();
+
+	// Read a row from the Lua array
+	FLuaValue GetLuaValue(const int32 Index) const;
+
+	// Enable logging of errors
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lua")
+	bool bLogError;
+
+	virtual void BeginDestroy() override;
+
+protected:
+	FLuaValue Array;
+
+	FLuaValue LuaTable;
+
+	TWeakObjectPtr<UListView> ListView;
+
+	// Pool of the items, Items[i] is row i + 1; rows past NumItems stay allocated for when the array grows again
+	UPROPERTY()
+	TArray<ULuaListItem*> Items;
+
+	int32 NumItems;
+
+	TSet<int32> DirtyIndices;
+
+	bool bAllDirty;
+
+	FDelegateHandle FlushHandle;
+
+	void ScheduleFlush();
+
+	int32 GetArrayLength() const;
+
+	// Lua api
+	UFUNCTION()
+	void LuaTableDirty(FLuaValue Self, FLuaValue First, FLuaValue Last);
+
+	UFUNCTION()
+	void LuaTableRefresh(FLuaValue Self);
+
+	UFUNCTION()
+	void LuaTableFlush(FLuaValue Self);
+};
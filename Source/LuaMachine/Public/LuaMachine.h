@@ -10,6 +10,8 @@
 
 DECLARE_MULTICAST_DELEGATE(FOnRegisteredLuaStatesChanged);
 DECLARE_MULTICAST_DELEGATE_OneParam(FOnNewLuaState, ULuaState*);
+// LuaState (nullptr when its initialization failed), number of preloaded states, number of requested states
+DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnLuaStatePreloaded, ULuaState*, int32, int32);
 
 class LUAMACHINE_API FLuaMachineModule : public IModuleInterface, public FGCObject, public FSelfRegisteringExec
 {
@@ -28,14 +30,35 @@ public:
 
 	TArray<ULuaState*> GetRegisteredLuaStates();
 
+	/* lookup a registered state by its class name (the _C suffix of Blueprint classes is optional) */
+	ULuaState* FindLuaStateByName(const FString& Name);
+
+	/*
+	 * Initialize the states in the thread pool (VM creation, libraries, PreloadModules and main chunks compilation),
+	 * the engine side of the initialization is finished on the game thread at the end of the frame (or by GetLuaState).
+	 * Useful during loading screens.
+	 */
+	void PreloadLuaStates(const TArray<TSubclassOf<ULuaState>>& LuaStateClasses, UWorld* InWorld);
+
+	/* finish the preloaded states whose worker is done, or all of them (waiting) when bWait is true */
+	void FinishPreloadedLuaStates(const bool bWait = false);
+
+	/* 0-1, 1 when nothing is being preloaded */
+	float GetPreloadProgress() const;
+	FORCEINLINE bool IsPreloading() const { return PreloadingLuaStates.Num() > 0; }
+
 	FOnNewLuaState OnNewLuaState;
 	FOnRegisteredLuaStatesChanged OnRegisteredLuaStatesChanged;
+	FOnLuaStatePreloaded OnLuaStatePreloaded;
 
 	void LuaLevelAddedToWorld(ULevel* Level, UWorld* World);
 	void LuaLevelRemovedFromWorld(ULevel* Level, UWorld* World);
 
 	void AddReferencedObjects(FReferenceCollector& Collector) override;
 
+	/* called at the end of every frame, feeds STATGROUP_LuaMachine and the LuaMachine csv category */
+	void PublishLuaStats();
+
 	void RegisterLuaConsoleCommand(const FString& CommandName, const FLuaValue& LuaConsoleCommand);
 	void UnregisterLuaConsoleCommand(const FString& CommandName);
 
@@ -57,4 +80,22 @@ private:
 	TMap<TSubclassOf<ULuaState>, ULuaState*> LuaStates;
 #endif
 	TSet<FString> LuaConsoleCommands;
+	FDelegateHandle EndFrameHandle;
+
+	// created but not registered until their initialization is finished
+#if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION >= 4
+	TMap<TSubclassOf<ULuaState>, TObjectPtr<ULuaState>> PreloadingLuaStates;
+#else
+	TMap<TSubclassOf<ULuaState>, ULuaState*> PreloadingLuaStates;
+#endif
+	TWeakObjectPtr<UWorld> PreloadWorld;
+	int32 NumPreloadRequested = 0;
+	int32 NumPreloaded = 0;
+	FDelegateHandle PreloadEndFrameHandle;
+	FDelegateHandle PostEngineInitHandle;
+
+	ULuaState* FinishPreloadedLuaState(TSubclassOf<ULuaState> LuaStateClass);
+
+	/* the PreloadLuaStates of ULuaMachineSettings (Project Settings/Plugins/LuaMachine) */
+	void PreloadConfiguredLuaStates();
 };
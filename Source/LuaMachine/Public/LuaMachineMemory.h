@@ -0,0 +1,66 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/LowLevelMemTracker.h"
+#include "ThirdParty/lua/lua.hpp"
+
+/*
+ * lua_Alloc implementation used by every ULuaState.
+ * All of the VM allocations go through FMemory under the "LuaMachine/<LuaState class>" LLM tag.
+ * Optionally (it is expensive) live allocations can be attributed to the Lua source:line that made them,
+ * with snapshots for finding leaks in long running sessions.
+ */
+class LUAMACHINE_API FLuaStateAllocator
+{
+public:
+	FLuaStateAllocator(const FString& StateName);
+
+	static void* Alloc(void* UserData, void* Ptr, size_t OldSize, size_t NewSize);
+
+	FORCEINLINE void SetLuaState(lua_State* InL) { L = InL; }
+
+	void StartTracking();
+	void StopTracking();
+	FORCEINLINE bool IsTracking() const { return bTracking; }
+
+	void TakeSnapshot();
+
+	/* live bytes grouped by allocation site, biggest first */
+	FString GetReport(const int32 Num) const;
+	/* growth of every allocation site since the last snapshot, biggest first */
+	FString GetSnapshotDiff(const int32 Num) const;
+
+private:
+	void* Realloc(void* Ptr, size_t NewSize);
+	int32 GetCurrentSite();
+
+	struct FAllocation
+	{
+		int32 SiteId;
+		int64 Size;
+	};
+
+	struct FSite
+	{
+		FString Name;
+		int64 LiveBytes;
+		int32 LiveAllocations;
+		int64 SnapshotBytes;
+		int32 SnapshotAllocations;
+	};
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	FName LLMTagName;
+#endif
+
+	lua_State* L;
+	bool bTracking;
+	bool bHasSnapshot;
+
+	TMap<void*, FAllocation> Allocations;
+	TArray<FSite> Sites;
+	// keyed by source crc and line
+	TMap<uint64, int32> SiteIds;
+};
@@ -0,0 +1,42 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "LuaState.h"
+#include "LuaMachineRunCommandlet.generated.h"
+
+/* LuaState used by the LuaMachineRun commandlet when no -State= is specified (standard Lua libraries only) */
+UCLASS(NotBlueprintable, NotBlueprintType, HideDropdown, Transient)
+class LUAMACHINE_API ULuaMachineRunCommandletState : public ULuaState
+{
+	GENERATED_BODY()
+
+public:
+	ULuaMachineRunCommandletState()
+	{
+		bLuaOpenLibs = true;
+		bLogError = true;
+	}
+};
+
+/*
+ * Headless script runner for load testing and CI perf runs:
+ *
+ * UnrealEditor-Cmd <Project> -run=LuaMachineRun -Script=<file> [-State=<class path>] [-Function=<global>] [-Args="<args>"]
+ *     [-Iterations=<n>] [-WarmUp=<n>] [-Threads=<n>] [-FullGC] [-Report=<file.json>] -nullrhi -unattended
+ *
+ * Every thread gets its own LuaState instance. The exit code is the value returned by the last iteration
+ * (an integer, or 1 for false) or 1 on errors.
+ */
+UCLASS()
+class LUAMACHINE_API ULuaMachineRunCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	ULuaMachineRunCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,25 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DeveloperSettings.h"
+#include "LuaMachineSettings.generated.h"
+
+class ULuaState;
+
+/**
+ * Project Settings/Plugins/LuaMachine, saved in the [/Script/LuaMachine.LuaMachineSettings] section of DefaultEngine.ini
+ */
+UCLASS(config = Engine, defaultconfig, meta = (DisplayName = "LuaMachine"))
+class LUAMACHINE_API ULuaMachineSettings : public UDeveloperSettings
+{
+	GENERATED_BODY()
+
+public:
+	ULuaMachineSettings();
+
+	// LuaStates initialized in the thread pool after the engine initialization (not in the editor)
+	UPROPERTY(config, EditAnywhere, Category = "Preload")
+	TArray<TSoftClassPtr<ULuaState>> PreloadLuaStates;
+};
@@ -0,0 +1,89 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+class ULuaState;
+
+DECLARE_STATS_GROUP(TEXT("LuaMachine"), STATGROUP_LuaMachine, STATCAT_Advanced);
+
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Time in Lua (ms)"), STAT_LuaMachine_LuaTime, STATGROUP_LuaMachine, LUAMACHINE_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Bridge Marshalling (ms)"), STAT_LuaMachine_BridgeTime, STATGROUP_LuaMachine, LUAMACHINE_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("GC (ms)"), STAT_LuaMachine_GCTime, STATGROUP_LuaMachine, LUAMACHINE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Calls"), STAT_LuaMachine_Calls, STATGROUP_LuaMachine, LUAMACHINE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bridge Calls"), STAT_LuaMachine_BridgeCalls, STATGROUP_LuaMachine, LUAMACHINE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Registry Size"), STAT_LuaMachine_RegistrySize, STATGROUP_LuaMachine, LUAMACHINE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Tracked UserData"), STAT_LuaMachine_TrackedUserData, STATGROUP_LuaMachine, LUAMACHINE_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Used Memory"), STAT_LuaMachine_UsedMemory, STATGROUP_LuaMachine, LUAMACHINE_API);
+
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(LUAMACHINE_API, LuaMachine);
+
+/*
+ * Per-state counters, accumulated while running and published (then reset) at the end of every frame.
+ * Lua time is inclusive of the bridge calls done by the scripts.
+ */
+struct LUAMACHINE_API FLuaStateFrameStats
+{
+	uint64 LuaCycles = 0;
+	uint64 BridgeCycles = 0;
+	uint64 GCCycles = 0;
+	uint32 Calls = 0;
+	uint32 BridgeCalls = 0;
+
+	void Reset()
+	{
+		LuaCycles = 0;
+		BridgeCycles = 0;
+		GCCycles = 0;
+		Calls = 0;
+		BridgeCalls = 0;
+	}
+
+	/* publish the counters of every registered state to the stats system and the csv profiler */
+	static void PublishFrameStats(const TArray<ULuaState*>& LuaStates);
+
+private:
+	// returns the used memory in bytes
+	int64 Publish(ULuaState* LuaState);
+
+	// per-state names are built only once
+	FString StateName;
+#if STATS
+	TArray<FName> StatNames;
+#endif
+#if CSV_PROFILER
+	TArray<FName> CsvNames;
+#endif
+};
+
+/* accumulates cycles spent marshalling arguments and return values of a Lua->UE call, ProcessEvent time excluded */
+struct FLuaBridgeStatsScope
+{
+	FLuaBridgeStatsScope(FLuaStateFrameStats& InStats)
+		: Stats(InStats)
+		, StartCycles(FPlatformTime::Cycles64())
+	{
+		Stats.BridgeCalls++;
+	}
+
+	void PauseForProcessEvent()
+	{
+		Stats.BridgeCycles += FPlatformTime::Cycles64() - StartCycles;
+	}
+
+	void ResumeAfterProcessEvent()
+	{
+		StartCycles = FPlatformTime::Cycles64();
+	}
+
+	~FLuaBridgeStatsScope()
+	{
+		Stats.BridgeCycles += FPlatformTime::Cycles64() - StartCycles;
+	}
+
+	FLuaStateFrameStats& Stats;
+	uint64 StartCycles;
+};
@@ -0,0 +1,67 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ThirdParty/lua/lua.hpp"
+
+class ULuaState;
+class ULuaCode;
+struct FFileChangeData;
+
+/* where a required module has been loaded from */
+struct FLuaModuleSource
+{
+	// same path used for the chunk name, empty for LuaCode assets
+	FString Filename;
+	TWeakObjectPtr<ULuaCode> LuaCode;
+	// modification time of the file when it has been (re)loaded
+	FDateTime Timestamp;
+};
+
+/*
+ * Module-granular hot reload: only the changed module is executed again, then
+ * - the new functions are patched in the table already in package.loaded (the other fields keep their runtime values, new fields are added)
+ * - the upvalues of the new functions are joined with the ones (with the same name) of the old functions, so the module locals are preserved
+ * - every reference to the old functions reachable from the registry (globals, tables, upvalues, metatables, FLuaValues) is replaced
+ *
+ * Modules can define a __reload function, called with the module after the patching.
+ */
+class LUAMACHINE_API FLuaModuleReloader
+{
+public:
+	FLuaModuleReloader(ULuaState* InLuaState);
+	~FLuaModuleReloader();
+
+	void RecordModuleSource(const FString& ModuleName, const FString& Filename, ULuaCode* LuaCode);
+
+	bool ReloadModule(const FString& ModuleName);
+
+	/* reload the file modules modified after they have been loaded, returns the number of reloaded modules */
+	int32 ReloadModifiedModules();
+
+	int32 ReloadLuaCodeModules(ULuaCode* LuaCode);
+
+	/* editor only: reload the modified modules whenever a .lua file changes in the Content directory */
+	void StartWatching();
+	void StopWatching();
+
+private:
+	// modules loaded by the standard Lua searcher (package.path) are resolved with package.searchpath()
+	void ResolveModuleSources();
+
+	void PatchTable(const int OldIndex, const int NewIndex, const int FunctionsIndex, const int VisitedIndex);
+	void JoinUpvalues(const int OldIndex, const int NewIndex);
+	void ReplaceFunctions(const int FunctionsIndex);
+
+	ULuaState* LuaState;
+	TMap<FString, FLuaModuleSource> ModuleSources;
+	FDateTime StartTime;
+
+#if WITH_EDITOR
+	void OnDirectoryChanged(const TArray<FFileChangeData>& FileChanges);
+
+	FString WatchedDirectory;
+	FDelegateHandle DirectoryWatcherHandle;
+#endif
+};
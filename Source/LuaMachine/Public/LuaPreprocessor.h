@@ -0,0 +1,49 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct LUAMACHINE_API FLuaPreprocessorOptions
+{
+	/* names evaluated as true by --#if/--#elseif */
+	TSet<FString> Defines;
+	/* globals replaced by a Lua literal (like DEBUG=false) */
+	TMap<FString, FString> Constants;
+	/* functions (like assert) whose calls are removed when used as statements */
+	TSet<FString> StrippedFunctions;
+
+	bool IsEmpty() const
+	{
+		return Defines.Num() == 0 && Constants.Num() == 0 && StrippedFunctions.Num() == 0;
+	}
+
+	/* stable representation, part of the bytecode cache key */
+	FString ToString() const;
+
+	/*
+	 * CookDefines, CookConstants and CookStrippedFunctions from the [LuaMachine] section of DefaultEngine.ini,
+	 * merged with -LuaMachineDefines=A,B -LuaMachineConstants=DEBUG=false -LuaMachineStripFunctions=assert
+	 */
+	static FLuaPreprocessorOptions FromCookSettings();
+};
+
+/*
+ * Build-time specialization of Lua sources (used when cooking LuaCode assets):
+ *
+ * --#if SHIPPING and not (DEMO or TEST)
+ * --#elseif DEVELOPMENT
+ * --#else
+ * --#endif
+ *
+ * Discarded lines are blanked (line numbers in errors and debug info do not change). Constants are replaced
+ * outside of strings and comments (the Lua compiler turns "if false then" into a single jump), table keys ({DEBUG = 1})
+ * and labels are left untouched. Declaring or assigning a constant (local DEBUG, function f(DEBUG), DEBUG = true)
+ * is an error, as the following uses would not refer to the declared value.
+ * The directives are plain comments, so the same scripts keep working when not preprocessed.
+ */
+class LUAMACHINE_API FLuaPreprocessor
+{
+public:
+	static bool Process(const FString& Code, const FLuaPreprocessorOptions& Options, FString& OutCode, FString& ErrorString);
+};
@@ -0,0 +1,94 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ThirdParty/lua/lua.hpp"
+#include "LuaHookListener.h"
+#include <atomic>
+
+struct FLuaProfilerEntry
+{
+	FString Location;
+	int32 SelfSamples;
+	int32 TotalSamples;
+
+	FLuaProfilerEntry()
+		: SelfSamples(0)
+		, TotalSamples(0)
+	{
+	}
+};
+
+/*
+ * Native sampling profiler driven by the Lua count hook.
+ * Each sample is a list of interned source:line ids written into a fixed size ring buffer:
+ * once the frames table is warm the hook never allocates, never locks and never builds an FString.
+ * Exports are meant to be called from the thread owning the Lua VM (or after Stop()).
+ */
+class LUAMACHINE_API FLuaSamplingProfiler : public ILuaHookListener
+{
+public:
+	FLuaSamplingProfiler(const int32 InMaxSamples = 65536, const int32 InMaxDepth = 32);
+
+	void Start(const int32 InInstructionInterval, const float InTimeInterval = 0);
+	void Stop();
+	void Reset();
+
+	FORCEINLINE bool IsRunning() const { return bRunning; }
+	FORCEINLINE int32 GetInstructionInterval() const { return InstructionInterval; }
+
+	/* ILuaHookListener, a count event every InstructionInterval instructions while running */
+	virtual int32 GetLuaHookMask() const override { return bRunning ? LUA_MASKCOUNT : 0; }
+	virtual int32 GetLuaHookInstructionCount() const override { return InstructionInterval; }
+	virtual void OnLuaHook(ULuaState* LuaState, FLuaHookEvent& Event) override;
+
+	int32 GetNumSamples() const;
+	int64 GetNumDroppedSamples() const;
+
+	/* one line per unique stack (root first, ';' separated) followed by the number of samples, ready for flamegraph.pl/speedscope */
+	FString ExportCollapsedStacks() const;
+
+	/* entries sorted by self samples */
+	TArray<FLuaProfilerEntry> GetTopEntries(const int32 Num) const;
+	FString GetTopEntriesReport(const int32 Num) const;
+
+private:
+	void Sample(lua_State* L);
+
+	int32 InternSource(const char* Source);
+	uint32 InternFrame(const int32 SourceId, const int32 Line);
+	FString GetFrameName(const uint32 FrameId) const;
+
+	template<typename Callback>
+	void ForEachSample(Callback InCallback) const;
+
+	struct FFrame
+	{
+		int32 SourceId;
+		int32 Line;
+	};
+
+	const int32 MaxSamples;
+	const int32 MaxDepth;
+
+	// MaxSamples * MaxDepth frame ids, leaf first
+	TArray<uint32> FrameBuffer;
+	TArray<uint8> DepthBuffer;
+	// total number of samples ever published, the slot is WriteIndex % MaxSamples
+	std::atomic<uint64> WriteIndex;
+
+	TArray<FFrame> Frames;
+	TMap<uint64, uint32> FrameIds;
+
+	TArray<FString> SourceNames;
+	TArray<TArray<ANSICHAR>> SourceKeys;
+	// Lua strings are interned, so the source pointer is a fast (but verified) cache key
+	TMap<const char*, int32> SourcePointers;
+	TMap<FString, int32> SourceIds;
+
+	bool bRunning;
+	int32 InstructionInterval;
+	uint64 TimeIntervalCycles;
+	uint64 NextSampleCycles;
+};
@@ -0,0 +1,43 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ThirdParty/lua/lua.hpp"
+
+/*
+ * Debug helper recording the creation site (C++ callstack and, when available, the running Blueprint function)
+ * of every registry reference created by ULuaState::NewRef (FLuaValue copies, ToLuaValue/FromLuaValue...).
+ * Live references are grouped by site and Lua type, with growth deltas between snapshots.
+ */
+class LUAMACHINE_API FLuaRegistryTracker
+{
+public:
+	FLuaRegistryTracker();
+
+	/* the referenced value is still at the top of the stack */
+	void OnRef(lua_State* L, const int Ref);
+	void OnUnref(const int Ref);
+
+	void TakeSnapshot();
+
+	FString GetCensus(const int32 Num, const int32 NumStackFrames = 6) const;
+
+	FORCEINLINE int32 GetNumLiveReferences() const { return LiveReferences.Num(); }
+
+private:
+	struct FSite
+	{
+		int32 LuaType;
+		TArray<uint64> BackTrace;
+		FString BlueprintFunction;
+		int32 LiveReferences;
+		int32 SnapshotReferences;
+		int32 TotalReferences;
+	};
+
+	TMap<int, int32> LiveReferences;
+	TMap<uint32, int32> SiteIds;
+	TArray<FSite> Sites;
+	bool bHasSnapshot;
+};
@@ -0,0 +1,113 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ThirdParty/lua/lua.hpp"
+
+class ULuaTableAsset;
+class FJsonValue;
+
+class FLuaSharedData;
+typedef TSharedPtr<const FLuaSharedData, ESPMode::ThreadSafe> FLuaSharedDataPtr;
+
+/*
+ * Immutable tree of nil/boolean/number/string/table values (built from a json file or a LuaTableAsset),
+ * stored in a few flat arrays and shared by all of the LuaStates (and threads).
+ *
+ * Lua sees it as read-only userdata proxies: t.key, t[index], #t, pairs(t) (the array part first) and ==.
+ * Every access to a nested table creates a small proxy, so cache them in locals in hot paths.
+ */
+class LUAMACHINE_API FLuaSharedData : public TSharedFromThis<FLuaSharedData, ESPMode::ThreadSafe>
+{
+public:
+	enum class EValueType : uint8
+	{
+		Nil,
+		Bool,
+		Integer,
+		Number,
+		String,
+		Table,
+	};
+
+	struct FValue
+	{
+		EValueType Type;
+		union
+		{
+			bool Bool;
+			int64 Integer;
+			double Number;
+			// string or table index
+			int32 Index;
+		};
+	};
+
+	static FLuaSharedDataPtr FromJson(const FString& Json, FString& ErrorString);
+	static FLuaSharedDataPtr FromLuaTableAsset(const ULuaTableAsset* TableAsset);
+
+	/* cached: every LuaState gets the same data (thread safe), in the editor modified json files are reloaded */
+	static FLuaSharedDataPtr LoadJsonFile(const FString& Filename, const bool bNonContentDirectory = false);
+	static FLuaSharedDataPtr LoadLuaTableAsset(const ULuaTableAsset* TableAsset);
+	/* the data stays alive until the last proxy is collected */
+	static void ReleaseCache();
+	/* called when the asset is edited */
+	static void ReleaseCachedLuaTableAsset(const ULuaTableAsset* TableAsset);
+
+	/* push a proxy of the root table */
+	static void PushProxy(lua_State* L, FLuaSharedDataPtr Data);
+
+	FORCEINLINE int32 GetNumTables() const { return Tables.Num(); }
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	struct FStringSlice
+	{
+		int32 Offset;
+		int32 Length;
+	};
+
+	struct FEntry
+	{
+		uint32 Hash;
+		int32 Key;
+		FValue Value;
+	};
+
+	struct FTable
+	{
+		int32 FirstArrayValue;
+		int32 NumArrayValues;
+		// sorted by hash and key
+		int32 FirstEntry;
+		int32 NumEntries;
+	};
+
+	struct FProxy;
+	friend class FLuaSharedDataBuilder;
+
+	int32 Compare(const FEntry& Entry, const uint32 Hash, const char* Key, const int32 KeyLength) const;
+	const FValue* FindField(const int32 Table, const char* Key, const int32 KeyLength) const;
+	const FValue* FindIndex(const int32 Table, const lua_Integer Index) const;
+
+	void PushValue(lua_State* L, const FValue& Value) const;
+	void PushString(lua_State* L, const int32 String) const;
+	void PushTableProxy(lua_State* L, const int32 Table) const;
+
+	static int MetaTableFunction__index(lua_State* L);
+	static int MetaTableFunction__newindex(lua_State* L);
+	static int MetaTableFunction__len(lua_State* L);
+	static int MetaTableFunction__pairs(lua_State* L);
+	static int MetaTableFunction__eq(lua_State* L);
+	static int MetaTableFunction__tostring(lua_State* L);
+	static int MetaTableFunction__gc(lua_State* L);
+	static int PairsIterator(lua_State* L);
+
+	TArray<ANSICHAR> StringData;
+	TArray<FStringSlice> Strings;
+	TArray<FEntry> Entries;
+	TArray<FValue> ArrayValues;
+	TArray<FTable> Tables;
+	FValue Root;
+};
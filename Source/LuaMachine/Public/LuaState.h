@@ -8,9 +8,17 @@
 #include "LuaValue.h"
 #include "LuaCode.h"
 #include "Runtime/Core/Public/Containers/Queue.h"
+#include "Async/Future.h"
 #include "Runtime/Launch/Resources/Version.h"
 #include "LuaDelegate.h"
 #include "LuaCommandExecutor.h"
+#include "LuaProfiler.h"
+#include "LuaMachineStats.h"
+#include "LuaMachineMemory.h"
+#include "LuaRegistryTracker.h"
+#include "LuaHookListener.h"
+#include "LuaCoverage.h"
+#include "LuaModuleReloader.h"
 #include "LuaState.generated.h"
 
 LUAMACHINE_API DECLARE_LOG_CATEGORY_EXTERN(LogLuaMachine, Log, All);
@@ -19,7 +27,12 @@ LUAMACHINE_API DECLARE_LOG_CATEGORY_EXTERN(LogLuaMachine, Log, All);
  *
  */
 
+class ULuaTableAsset;
+class UDataTable;
+struct FLuaSerializedValue;
 class ULuaBlueprintPackage;
+class FLuaStateTracer;
+class FLuaDebugServer;
 
 struct FLuaUserData
 {
@@ -172,9 +185,29 @@ public:
 	UPROPERTY(EditAnywhere, Category = "Lua", meta = (DisplayName = "Lua Blueprint Packages Table"))
 	TMap<FString, TSubclassOf<ULuaBlueprintPackage>> LuaBlueprintPackagesTable;
 
+	/* Globals exposing a read-only view of a LuaTableAsset, shared (not copied) by all of the LuaStates */
+	UPROPERTY(EditAnywhere, Category = "Lua")
+	TMap<FString, ULuaTableAsset*> SharedTableAssets;
+
+	/* Globals exposing a read-only view of a json file (relative to the Content directory), parsed once for all of the LuaStates */
+	UPROPERTY(EditAnywhere, Category = "Lua")
+	TMap<FString, FString> SharedJsonFiles;
+
+	/* Globals exposing a UDataTable in columnar form (numeric columns in typed buffers, interned strings, natively scanned) */
+	UPROPERTY(EditAnywhere, Category = "Lua")
+	TMap<FString, UDataTable*> DataTables;
+
+	/* Create a Blueprint package (and convert its Table) only when the scripts access it for the first time */
+	UPROPERTY(EditAnywhere, Category = "Lua")
+	bool bLazyLuaBlueprintPackages;
+
 	UPROPERTY(EditAnywhere, Category = "Lua")
 	TMap<FString, ULuaCode*> RequireTable;
 
+	/* Modules required before the Table values and the Blueprint packages are added. When the state is preloaded they run in a worker thread, so they must be pure Lua (no UObject access) */
+	UPROPERTY(EditAnywhere, Category = "Lua")
+	TArray<FString> PreloadModules;
+
 	UPROPERTY(EditAnywhere, Category = "Lua")
 	bool bLuaOpenLibs;
 
@@ -209,7 +242,7 @@ public:
 	void ReceiveLuaReturnHook(const FLuaDebug& LuaDebug);
 
 	// Not BlueprintNativeEvent, as throwing a luaL_error from an RTTI call results in leaving the VM in an unexpected
-	// state and will result in exceptions
+	// state and will result in exceptions (use the Watchdog properties for stopping runaway scripts)
 	UFUNCTION(Category = "Lua", meta = (DisplayName = "Lua Count Hook"))
 	virtual void ReceiveLuaCountHook(const FLuaDebug& LuaDebug);
 
@@ -222,6 +255,9 @@ public:
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Lua")
 	TMap<FString, FLuaValue> LuaGetLocals(const int32 Level);
 
+	/* same as LuaGetLocals but for a specific lua thread (like the one passed to a hook) */
+	TMap<FString, FLuaValue> GetLocals(lua_State* Thread, const int32 Level);
+
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Lua")
 	TSubclassOf<ULuaState> GetSelfLuaState() const { return GetClass(); }
 
@@ -279,6 +315,78 @@ public:
 	UPROPERTY(EditAnywhere, Category = "Lua", Meta = (EditCondition = "bEnableCountHook"))
 	int32 HookInstructionCount = 25000;
 
+	/* Stop runaway scripts: when one of the budgets is exceeded a Lua error is raised (scripts can catch it with pcall, but it will be raised again at the next check) */
+	UPROPERTY(EditAnywhere, Category = "Lua")
+	bool bEnableWatchdog;
+
+	/* Max number of Lua instructions for each call from the engine (0 for unlimited) */
+	UPROPERTY(EditAnywhere, Category = "Lua", Meta = (EditCondition = "bEnableWatchdog", ClampMin = "0"))
+	int32 WatchdogInstructionBudget = 0;
+
+	/* Max number of seconds for each call from the engine (0 for unlimited) */
+	UPROPERTY(EditAnywhere, Category = "Lua", Meta = (EditCondition = "bEnableWatchdog", ClampMin = "0"))
+	float WatchdogTimeBudget = 0;
+
+	/* Max number of seconds spent in this Lua state for each frame (0 for unlimited) */
+	UPROPERTY(EditAnywhere, Category = "Lua", Meta = (EditCondition = "bEnableWatchdog", ClampMin = "0"))
+	float WatchdogFrameTimeBudget = 0;
+
+	/* Number of Lua instructions between two watchdog checks */
+	UPROPERTY(EditAnywhere, Category = "Lua", Meta = (EditCondition = "bEnableWatchdog", ClampMin = "1"))
+	int32 WatchdogCheckInstructionCount = 1000;
+
+	/* Start the native sampling profiler as soon as the Lua state is initialized */
+	UPROPERTY(EditAnywhere, Category = "Lua")
+	bool bEnableSamplingProfiler;
+
+	/* Number of Lua instructions between two profiler samples */
+	UPROPERTY(EditAnywhere, Category = "Lua", Meta = (EditCondition = "bEnableSamplingProfiler", ClampMin = "1"))
+	int32 SamplingProfilerInstructionCount = 1000;
+
+	/* If greater than zero, take at most one sample every this amount of seconds */
+	UPROPERTY(EditAnywhere, Category = "Lua", Meta = (EditCondition = "bEnableSamplingProfiler", ClampMin = "0"))
+	float SamplingProfilerInterval = 0;
+
+	/* Start collecting line coverage as soon as the Lua state is initialized */
+	UPROPERTY(EditAnywhere, Category = "Lua")
+	bool bEnableCoverage;
+
+	/* Wildcards matched against the chunk names (empty for measuring every chunk) */
+	UPROPERTY(EditAnywhere, Category = "Lua", Meta = (EditCondition = "bEnableCoverage"))
+	TArray<FString> CoverageFilters;
+
+	/* Record the creation site of every registry reference (debug only, it is really slow). See the luarefs console command */
+	UPROPERTY(EditAnywhere, Category = "Lua")
+	bool bTrackRegistryReferences;
+
+	/* Start a Debug Adapter Protocol server (localhost only, not available in Shipping builds) as soon as the Lua state is initialized */
+	UPROPERTY(EditAnywhere, Category = "Lua")
+	bool bEnableDebugServer;
+
+	UPROPERTY(EditAnywhere, Category = "Lua", Meta = (EditCondition = "bEnableDebugServer", ClampMin = "1", ClampMax = "65535"))
+	int32 DebugServerPort = 8172;
+
+	/* Reload the modified modules (in place, preserving their state) whenever a .lua file changes in the Content directory (editor only) */
+	UPROPERTY(EditAnywhere, Category = "Lua")
+	bool bHotReload;
+
+	/* Execute again a required module and patch its functions in the already loaded one (fields and locals keep their values) */
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	bool ReloadModule(const FString& ModuleName);
+
+	/* Reload every file module modified after being required, returns the number of reloaded modules */
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	int32 ReloadModifiedModules();
+
+	/* Reload the modules required from the specified LuaCode asset */
+	int32 ReloadLuaCodeModules(ULuaCode* InLuaCode);
+
+	UFUNCTION(BlueprintNativeEvent, Category = "Lua", meta = (DisplayName = "Lua Module Reloaded"))
+	void ReceiveLuaModuleReloaded(const FString& ModuleName);
+
+	/* incremented by every module reload, for invalidating cached function lookups */
+	int32 ModulesReloadCount;
+
 	UPROPERTY()
 	TMap<FString, ULuaBlueprintPackage*> LuaBlueprintPackages;
 
@@ -363,6 +471,12 @@ public:
 
 	ULuaState* GetLuaState(UWorld* InWorld);
 
+	/* run InitializeLuaVM() in the thread pool, the next GetLuaState() waits for it and finishes the initialization */
+	bool StartAsyncInitialization();
+
+	FORCEINLINE bool IsAsyncInitializationPending() const { return AsyncInitialization.IsValid(); }
+	FORCEINLINE bool IsAsyncInitializationReady() const { return AsyncInitialization.IsValid() && AsyncInitialization.IsReady(); }
+
 	bool RunCode(const TArray<uint8>& Code, const FString& CodePath, int NRet = 0);
 	bool RunCode(const FString& Code, const FString& CodePath, int NRet = 0);
 
@@ -378,6 +492,11 @@ public:
 	static int MetaTableFunctionUserData__index(lua_State* L);
 	static int MetaTableFunctionUserData__newindex(lua_State* L);
 
+	static int MetaTableFunctionLazyPackage__index(lua_State* L);
+	static int MetaTableFunctionLazyPackage__newindex(lua_State* L);
+	static int MetaTableFunctionLazyPackage__pairs(lua_State* L);
+	static int MetaTableFunctionLazyPackage__len(lua_State* L);
+
 	static int TableFunction_print(lua_State* L);
 	static int TableFunction_package_preload(lua_State* L);
 	static int TableFunction_package_loader(lua_State* L);
@@ -394,6 +513,7 @@ public:
 	static int ToByteCode_Writer(lua_State* L, const void* Ptr, size_t Size, void* UserData);
 
 	static void Debug_Hook(lua_State* L, lua_Debug* ar);
+	static void Watchdog_Check(lua_State* L, ULuaState* LuaState);
 
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Lua")
 	static TArray<uint8> ToByteCode(const FString& Code, const FString& CodePath, FString& ErrorString);
@@ -464,6 +584,18 @@ public:
 
 	void LuaTableToStruct(FLuaValue& LuaValue, UScriptStruct* InScriptStruct, uint8* StructData);
 
+	/* Import a whole UDataTable in columnar form as the global Name (see FLuaDataTable) */
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	bool SetGlobalDataTable(const FString& Name, UDataTable* DataTable);
+
+	/* Copy a value owned by another LuaState in this one (tables are deep copied, see FLuaValueTransfer) */
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	FLuaValue CopyLuaValue(FLuaValue Value);
+
+	/* the serialized form can be moved to another thread and deserialized in any LuaState */
+	bool SerializeLuaValue(FLuaValue& Value, FLuaSerializedValue& Serialized);
+	FLuaValue DeserializeLuaValue(const FLuaSerializedValue& Serialized);
+
 	template<class T>
 	FLuaValue StructToLuaValue(T& InStruct)
 	{
@@ -497,6 +629,92 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Lua")
 	void Error(const FString& ErrorString);
 
+	/* (re)install the debug hook based on the enabled hooks and the native tools currently attached */
+	void RefreshDebugHook();
+
+	/* the listener is not owned, remove it before destroying it */
+	void AddHookListener(ILuaHookListener* Listener);
+	void RemoveHookListener(ILuaHookListener* Listener);
+
+	/* install (or remove) the on demand hook events for the specified lua thread.
+	 * When called from a hook listener it applies to the thread of the current event, and the requests of all the listeners are merged */
+	void SetThreadOnDemandHook(lua_State* Thread, const int32 OnDemandMask);
+
+	/* give the current hook to a coroutine created before the last RefreshDebugHook() (called before resuming it) */
+	void SyncThreadHook(lua_State* Thread);
+
+	// coroutines already existing get the hook when resumed (coroutine.resume, coroutine.wrap functions and Resume())
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void StartSamplingProfiler(const int32 InstructionCount = 1000, const float Interval = 0, const bool bReset = true);
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void StopSamplingProfiler();
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	FString GetSamplingProfilerReport(const int32 NumEntries = 20);
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	bool SaveSamplingProfilerCollapsedStacks(const FString& Filename);
+
+	FORCEINLINE TSharedPtr<FLuaSamplingProfiler> GetSamplingProfiler() const { return SamplingProfiler; }
+
+	// coroutines already existing get the hook when resumed (coroutine.resume, coroutine.wrap functions and Resume())
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void StartCoverage(const TArray<FString>& Filters, const bool bReset = true);
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void StopCoverage();
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	FString GetCoverageSummary();
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	bool SaveCoverageLcov(const FString& Filename, const FString& TestName = TEXT(""));
+
+	FORCEINLINE TSharedPtr<FLuaCoverage> GetCoverage() const { return Coverage; }
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	bool StartDebugServer(const int32 Port = 8172);
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void StopDebugServer();
+
+	FORCEINLINE FLuaStateFrameStats& GetFrameStats() { return FrameStats; }
+
+	/* attribute live Lua allocations to the source:line that made them (expensive, for debugging leaks only) */
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void StartAllocationTracking();
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void StopAllocationTracking();
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void TakeAllocationSnapshot();
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	FString GetAllocationReport(const int32 NumEntries = 20);
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	FString GetAllocationSnapshotDiff(const int32 NumEntries = 20);
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void StartRegistryTracking();
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void StopRegistryTracking();
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void TakeRegistrySnapshot();
+
+	/* live registry references grouped by creation site and type */
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	FString GetRegistryCensus(const int32 NumEntries = 20);
+
+	static int LuaPanic(lua_State* L);
+
+	/* valid only when the module is built with Insights support (CPUPROFILERTRACE_ENABLED) */
+	FORCEINLINE FLuaStateTracer* GetTracer() const { return Tracer.Get(); }
+
 protected:
 	lua_State* L;
 	bool bDisabled;
@@ -513,6 +731,77 @@ protected:
 	TMap<TWeakObjectPtr<UObject>, FLuaDelegateGroup> LuaDelegatesMap;
 
 	FLuaCommandExecutor LuaConsole;
+
+	TSharedPtr<FLuaSamplingProfiler> SamplingProfiler;
+
+	TSharedPtr<FLuaCoverage> Coverage;
+
+	TSharedPtr<FLuaDebugServer> DebugServer;
+
+	TSharedPtr<FLuaModuleReloader> ModuleReloader;
+
+	// VM creation, libraries, package setup, PreloadModules and compilation of the main chunks: no UObject is loaded or modified when running in a worker
+	bool InitializeLuaVM();
+	// Table, Blueprint packages, hooks and main chunks execution (game thread)
+	ULuaState* FinishInitialization();
+
+	void PrecompileChunk(const TArray<uint8>& Code, const FString& CodePath);
+	void PrecompileCodeAsset(ULuaCode* CodeAsset);
+	// source (or bytecode) of a LuaCode asset, ready for luaL_loadbuffer()
+	static void GetCodeAssetChunk(ULuaCode* CodeAsset, TArray<uint8>& Chunk);
+	bool RequirePreloadModule(const FString& ModuleName);
+	void ReleasePrecompiledChunks();
+
+	void SetupLuaBlueprintPackage(const FString& PackageName, TSubclassOf<ULuaBlueprintPackage> PackageClass, lua_State* State);
+	// returns false if the package has been already created
+	bool SetupLazyLuaBlueprintPackage(const FString& PackageName, lua_State* State);
+
+	// stub tables of the packages not created yet
+	TMap<FString, FLuaValue> LazyLuaBlueprintPackages;
+
+	TFuture<bool> AsyncInitialization;
+	// chunk name -> registry reference of the compiled function, consumed by RunCode()
+	TMap<FString, int32> PrecompiledChunks;
+	// chunks of LuaCodeAsset and UserDataMetaTableFromCodeAsset, copied on the game thread for the worker
+	TMap<FString, TArray<uint8>> AsyncCodeAssetChunks;
+	// PreloadModules requiring LuaCode assets, loaded by FinishInitialization() after an async initialization
+	TArray<FString> DeferredPreloadModules;
+	void RecordModuleSource(const FString& ModuleName, const FString& Filename, ULuaCode* InLuaCode);
+
+	// not owned, every listener must be removed before being destroyed
+	TArray<ILuaHookListener*> HookListeners;
+	// listeners with a non zero mask, rebuilt by RefreshDebugHook()
+	TArray<FLuaActiveHookListener> ActiveHookListeners;
+	TSharedPtr<ILuaHookListener> BlueprintHookListener;
+	// installed mask and instructions between two count hook calls
+	int32 CurrentHookMask;
+	int32 CurrentHookCount;
+	int32 CurrentOnDemandHookMask;
+	bool bDispatchingHook;
+	bool bHookRefreshPending;
+	bool bThreadOnDemandRequested;
+	int32 PendingThreadOnDemandMask;
+
+	TSharedPtr<FLuaStateTracer> Tracer;
+	bool bTraceHookInstalled;
+
+	FLuaStateFrameStats FrameStats;
+
+	// must outlive the lua_State
+	TSharedPtr<FLuaStateAllocator> Allocator;
+
+	TSharedPtr<FLuaRegistryTracker> RegistryTracker;
+	// nesting level of UE->Lua transitions
+	int32 ExecutionDepth;
+	uint64 ExecutionStartCycles;
+
+	int64 WatchdogCallInstructions;
+	uint64 WatchdogFrameNumber;
+	uint64 WatchdogFrameCycles;
+
+	friend struct FLuaExecutionScope;
+	friend class FLuaDebugServer;
+	friend class FLuaModuleReloader;
 };
 
 #define LUACFUNCTION(FuncClass, FuncName, NumRetValues, NumArgs) static int FuncName ## _C(lua_State* L)\
@@ -6,6 +6,10 @@
 #include "Engine/DataAsset.h"
 #include "LuaState.h"
 #include "LuaValue.h"
+#include "Runtime/Launch/Resources/Version.h"
+#if ENGINE_MAJOR_VERSION > 4
+#include "UObject/ObjectSaveContext.h"
+#endif
 #include "LuaTableAsset.generated.h"
 
 /**
@@ -17,9 +21,59 @@ class LUAMACHINE_API ULuaTableAsset : public UDataAsset
 	GENERATED_BODY()
 	
 public:
+	ULuaTableAsset();
 
 	UPROPERTY(EditAnywhere, Category = "Lua")
 	TMap<FString, FLuaValue> Table;
 
+	/* Cache the LuaTableImplements results (for each Lua table) until the end of the frame. Enable it only if the checked tables do not change their fields during a frame */
+	UPROPERTY(EditAnywhere, Category = "Lua")
+	bool bCacheImplements;
+
 	FLuaValue ToLuaTable(ULuaState* LuaState);
+
+	/* O(1) lookup (perfect hash) in the baked form */
+	const FLuaValue* FindField(const FString& Key);
+
+	/* true if the Lua table has all of the fields of the asset (with the same type) */
+	bool IsImplementedBy(FLuaValue& LuaTable);
+
+	/* must be called after changing Table from C++: the baked form is rebuilt on the next access */
+	void MarkTableDirty();
+
+	virtual void PostLoad() override;
+
+#if ENGINE_MAJOR_VERSION > 4
+	virtual void PreSave(FObjectPreSaveContext ObjectSaveContext) override;
+#else
+	virtual void PreSave(const ITargetPlatform* TargetPlatform) override;
+#endif
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+protected:
+	/* build the baked form of Table (done when saving, so cooked assets are loaded already baked) */
+	void Bake();
+	void BakeIfRequired();
+
+	bool MatchesTable(lua_State* L, int Index) const;
+
+	// interned UTF8 keys (zero terminated), in slot order
+	UPROPERTY()
+	TArray<uint8> BakedKeys;
+
+	UPROPERTY()
+	TArray<int32> BakedKeyOffsets;
+
+	UPROPERTY()
+	TArray<FLuaValue> BakedValues;
+
+	// hash and displace: one seed for each bucket, negative values are slots (-1 based) of single key buckets
+	UPROPERTY()
+	TArray<int32> BakedSeeds;
+
+	// Table changed after the last Bake()
+	bool bBakeDirty;
 };
@@ -0,0 +1,38 @@
+// Copyright 2018-2023 - Roberto De Ioris
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/WeakObjectPtr.h"
+#include "ThirdParty/lua/lua.hpp"
+
+/* self-contained copy of a Lua value, can be moved to another thread */
+struct LUAMACHINE_API FLuaSerializedValue
+{
+	TArray<uint8> Data;
+	// referenced UObjects, resolved when deserializing (on the game thread)
+	TArray<TWeakObjectPtr<UObject>> Objects;
+
+	FORCEINLINE bool IsEmpty() const { return Data.Num() == 0; }
+};
+
+/*
+ * Native copy of Lua values between lua_States (ULuaState::FromLuaValue() pushes nil for values owned by another LuaState).
+ * Tables are walked with lua_next, shared and cyclic references are preserved and strings are copied with a single memcpy.
+ * Metatables registered with luaL_newmetatable() (having a __name) are looked up by name in the destination, the other ones are copied.
+ * UObjects and UFunctions are copied as references; Lua functions, threads and the other userdata become nil.
+ */
+class LUAMACHINE_API FLuaValueTransfer
+{
+public:
+	/* copy the value at Index of From on the top of To (both states must be owned by the calling thread) */
+	static bool Copy(lua_State* From, const int Index, lua_State* To, FString& ErrorString);
+
+	static bool Serialize(lua_State* L, const int Index, FLuaSerializedValue& Serialized, FString& ErrorString);
+
+	/* push the value on the top of L */
+	static bool Deserialize(lua_State* L, const FLuaSerializedValue& Serialized, FString& ErrorString);
+
+	/* nested tables deeper than this are refused (the walk is recursive) */
+	static const int32 MaxDepth = 200;
+};
@@ -8,6 +8,29 @@
 #include "LuaValue.h"
 #include "LuaViewModelBridge.generated.h"
 
+/**
+ * Cached state of a computed property
+ */
+USTRUCT()
+struct FLuaViewModelComputedProperty
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FLuaValue Function;
+
+	// Can hold a UObject, so it must be visible to the GC
+	UPROPERTY()
+	FLuaValue CachedValue;
+
+	UPROPERTY()
+	bool bDirty = true;
+
+	// Properties read by the last evaluation
+	UPROPERTY()
+	TArray<FName> Dependencies;
+};
+
 /**
  * Bridge class that connects UMG ViewModels with Lua scripting
  * Allows Lua scripts to bind to and modify ViewModel properties
@@ -102,6 +125,18 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lua")
 	bool bLogError;
 
+	// Accumulate the changed fields and broadcast each of them once at the end of the frame (or on FlushFieldNotifications)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lua")
+	bool bBatchFieldNotifications;
+
+	// Keep the data in a hidden backing table behind an empty proxy: every assignment (vm.x = 1 in Lua, LuaSetField...) is detected natively and notified
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lua")
+	bool bUseProxyTable;
+
+	// Computed properties: property name -> global Lua function computing it from the ViewModel table
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lua")
+	TMap<FName, FName> ComputedPropertyFunctions;
+
 	// Initialize the Lua table for this ViewModel
 	UFUNCTION(BlueprintCallable, Category = "Lua")
 	void InitializeLuaViewModel();
@@ -110,6 +145,9 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Lua")
 	FLuaValue LuaGetProperty(const FString& PropertyName);
 
+	// Get a property value from Lua using a pre-computed FName for performance
+	FLuaValue LuaGetProperty(const FName& PropertyName);
+
 	// Set a property value in Lua
 	UFUNCTION(BlueprintCallable, Category = "Lua")
 	void LuaSetProperty(const FString& PropertyName, FLuaValue Value);
@@ -141,10 +179,101 @@ public:
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category = "Lua")
 	FLuaValue GetViewModelLuaTable() const { return ViewModelLuaTable; }
 
+	// Start a transaction: properties set to their current value are not notified, the changed ones are broadcast once by the outermost LuaEndUpdate
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void LuaBeginUpdate();
+
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void LuaEndUpdate();
+
+	// Set every field of a Lua table as a property in a single transaction
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void LuaUpdateProperties(FLuaValue Fields);
+
+	// Broadcast the pending field notifications now
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void FlushFieldNotifications();
+
+	// Define a property computed by a Lua function (called with the ViewModel table), cached until one of the properties it read changes
+	UFUNCTION(BlueprintCallable, Category = "Lua")
+	void LuaDefineComputedProperty(const FString& PropertyName, FLuaValue ComputeFunction);
+
+	virtual void BeginDestroy() override;
+
 protected:
 	// The Lua table value representing this ViewModel
 	FLuaValue ViewModelLuaTable;
 
+	// Fields changed in the current transaction or frame, broadcast at most once
+	TSet<FName> DirtyFields;
+
+	int32 UpdateDepth;
+
+	FDelegateHandle FlushHandle;
+
+	// Broadcast the change, or record it while batching
+	void MarkFieldDirty(const FName& FieldName);
+
+	// Lua api installed in the ViewModel table: vm:Update(Fields) or vm:Update(function(vm) ... end), vm:Flush()
+	UFUNCTION()
+	void LuaTableUpdate(FLuaValue Self, FLuaValue FieldsOrFunction);
+
+	UFUNCTION()
+	void LuaTableFlush(FLuaValue Self);
+
+	// vm:Computed(Name, Function)
+	UFUNCTION()
+	void LuaTableComputed(FLuaValue Self, FLuaValue PropertyName, FLuaValue ComputeFunction);
+
+	UPROPERTY()
+	TMap<FName, FLuaViewModelComputedProperty> ComputedProperties;
+
+	// Property -> computed properties that read it
+	TMap<FName, TArray<FName>> ComputedDependents;
+
+	// Computed properties being evaluated, the properties read are recorded as dependencies of the last one
+	TArray<FName> ComputeStack;
+
+	// Table passed to the compute functions, its reads go through LuaGetProperty
+	FLuaValue ComputeProxy;
+
+	// Real storage of the fields when bUseProxyTable is set (ViewModelLuaTable is the proxy)
+	FLuaValue ViewModelBackingTable;
+
+	// Field assigned by LuaSetProperty, notified by LuaSetProperty itself instead of the proxy
+	FName ProxyFieldBeingSet;
+
+	void CreateProxyTable(ULuaState* State);
+
+	static int MetaTableFunctionProxy__newindex(lua_State* L);
+	static int MetaTableFunctionProxy__pairs(lua_State* L);
+	static int MetaTableFunctionProxy__len(lua_State* L);
+
+	FLuaValue ComputeProperty(const FName& PropertyName);
+	void InvalidateComputedProperties(const FName& FieldName);
+	bool EnsureComputeProxy(ULuaState* State);
+
 	// Helper to call a Lua function if it exists
 	bool CallLuaFunctionIfExists(const FString& FunctionName, const TArray<FLuaValue>& Args, FLuaValue& OutResult);
+
+	// Getter/setter hooks resolved once (registry references), resolved again when the LuaState, the hook names or the Lua modules change
+	FLuaValue CachedGetPropertyFunction;
+	FLuaValue CachedSetPropertyFunction;
+	FName CachedGetPropertyFunctionName;
+	FName CachedSetPropertyFunctionName;
+	TWeakObjectPtr<ULuaState> CachedHooksLuaState;
+	int32 CachedHooksReloadCount;
+
+	// UTF-8 property names (zero terminated) for the direct stack accesses
+	TMap<FName, TArray<ANSICHAR>> Utf8PropertyNames;
+
+	void ResolveLuaHooks();
+
+	// Returns the LuaState of the cached hooks, resolving them again if they are stale
+	ULuaState* GetLuaHooksState();
+
+	// Call a hook with (ViewModelTable, PropertyName[, Value]) pushed directly on the stack, false if the hook is not a function
+	bool CallLuaHook(FLuaValue& Hook, const FName& PropertyName, FLuaValue* Value, FLuaValue& OutResult);
+
+	const TArray<ANSICHAR>& GetUtf8PropertyName(const FName& PropertyName);
 };
\ No newline at end of file
@@ -43,6 +43,7 @@ public class LuaMachineEditor : ModuleRules
                 "Projects",
                 "InputCore",
                 "EditorStyle",
+                "AssetRegistry",
                 "LuaMachine"
             }
             );
@@ -18,6 +18,13 @@
 #include "Widgets/Layout/SScrollBox.h"
 #include "LuaUserDataObject.h"
 #include "LuaCodeFactory.h"
+#include "LuaCode.h"
+#include "LuaCodeCompiler.h"
+#if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
+#include "AssetRegistry/AssetRegistryModule.h"
+#else
+#include "AssetRegistryModule.h"
+#endif
 
 #define LOCTEXT_NAMESPACE "FLuaMachineEditorModule"
 
@@ -86,6 +93,36 @@ void FLuaMachineEditorModule::OnPostEngineInit()
 
 	//Add LuaCode to Filters.
 	RegisterAssetTypeAction(AssetTools, MakeShareable(new FLuaCodeAssetTypeActions(LuaMachineAssetCategoryBit)));
+
+	if (IsRunningCookCommandlet() && !FParse::Param(FCommandLine::Get(), TEXT("LuaMachineSkipPrecompile")))
+	{
+		PrecompileLuaCodeAssets();
+	}
+}
+
+void FLuaMachineEditorModule::PrecompileLuaCodeAssets()
+{
+	// compile everything in parallel before the cook starts, ULuaCode::Serialize() will hit the cache
+	IAssetRegistry& AssetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry").Get();
+	AssetRegistry.SearchAllAssets(true);
+
+	TArray<FAssetData> Assets;
+#if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION >= 1
+	AssetRegistry.GetAssetsByClass(ULuaCode::StaticClass()->GetClassPathName(), Assets, true);
+#else
+	AssetRegistry.GetAssetsByClass(ULuaCode::StaticClass()->GetFName(), Assets, true);
+#endif
+
+	TArray<ULuaCode*> LuaCodes;
+	for (const FAssetData& Asset : Assets)
+	{
+		if (ULuaCode* LuaCode = Cast<ULuaCode>(Asset.GetAsset()))
+		{
+			LuaCodes.Add(LuaCode);
+		}
+	}
+
+	FLuaCodeCompiler::Get().CompileAll(LuaCodes);
 }
 
 TSharedPtr<FSlateStyleSet> FLuaMachineEditorModule::GetStyleSet()
@@ -35,6 +35,7 @@ public:
 private:
 	TSharedPtr<FSlateStyleSet> StyleSet;
 	static TSharedRef<SDockTab> CreateLuaMachineDebugger(const FSpawnTabArgs& Args); 
+	void PrecompileLuaCodeAssets();
 	EAssetTypeCategories::Type LuaMachineAssetCategoryBit;
 	/** All created asset type actions.  Cached here so that we can unregister them during shutdown. */
 	TArray< TSharedPtr<IAssetTypeActions> > CreatedAssetTypeActions;